@@ -0,0 +1,79 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#ifndef HOST_STM32F7XX_HAL_H
+#define HOST_STM32F7XX_HAL_H
+
+/*
+ * Stand-in for the Cube HAL header in host builds (host/CMakeLists.txt). Only
+ * what the modules compiled there use : the SPI handle the library passes
+ * around, the GPIO pin numbers of stm32f4xx_nucleo_bluenrg.h, the time base
+ * (implemented by clock.c), a SysTick which never counts (btsnoop timestamps
+ * get whole milliseconds) and the interrupt masking intrinsics. The host has
+ * no interrupts, so masking is a no-op and the barrier a compiler / CPU fence.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef struct {
+        void *Instance;
+} SPI_HandleTypeDef;
+
+typedef enum { HAL_OK = 0x00, HAL_ERROR = 0x01, HAL_BUSY = 0x02, HAL_TIMEOUT = 0x03 } HAL_StatusTypeDef;
+
+#define GPIO_PIN_0 ((uint16_t)0x0001)
+#define GPIO_PIN_1 ((uint16_t)0x0002)
+#define GPIO_PIN_2 ((uint16_t)0x0004)
+#define GPIO_PIN_3 ((uint16_t)0x0008)
+#define GPIO_PIN_4 ((uint16_t)0x0010)
+#define GPIO_PIN_5 ((uint16_t)0x0020)
+#define GPIO_PIN_6 ((uint16_t)0x0040)
+#define GPIO_PIN_7 ((uint16_t)0x0080)
+#define GPIO_PIN_8 ((uint16_t)0x0100)
+#define GPIO_PIN_9 ((uint16_t)0x0200)
+#define GPIO_PIN_10 ((uint16_t)0x0400)
+#define GPIO_PIN_11 ((uint16_t)0x0800)
+#define GPIO_PIN_12 ((uint16_t)0x1000)
+#define GPIO_PIN_13 ((uint16_t)0x2000)
+#define GPIO_PIN_14 ((uint16_t)0x4000)
+#define GPIO_PIN_15 ((uint16_t)0x8000)
+
+uint32_t HAL_GetTick (void);
+void HAL_Delay (uint32_t Delay);
+void HAL_IncTick (void);
+
+typedef struct {
+        volatile uint32_t CTRL;
+        volatile uint32_t LOAD;
+        volatile uint32_t VAL;
+        volatile uint32_t CALIB;
+} SysTick_Type;
+
+static SysTick_Type hostSysTick __attribute__ ((unused));
+#define SysTick (&hostSysTick)
+
+static inline uint32_t __get_PRIMASK (void) { return 0; }
+static inline void __set_PRIMASK (uint32_t priMask) { (void)priMask; }
+static inline uint32_t __get_BASEPRI (void) { return 0; }
+static inline void __set_BASEPRI (uint32_t basePri) { (void)basePri; }
+static inline void __set_BASEPRI_MAX (uint32_t basePri) { (void)basePri; }
+static inline void __disable_irq (void) {}
+static inline void __enable_irq (void) {}
+static inline void __DMB (void) { __sync_synchronize (); }
+static inline void __DSB (void) { __sync_synchronize (); }
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HOST_STM32F7XX_HAL_H
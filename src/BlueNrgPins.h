@@ -0,0 +1,30 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#ifndef BLUENRG_PINS_H
+#define BLUENRG_PINS_H
+
+#include "Gpio.h"
+
+/*
+ * Compile-time view of the BlueNRG control pins from stm32f4xx_nucleo_bluenrg.h.
+ * SCLK, MISO and MOSI are driven by the SPI peripheral and are not listed here.
+ */
+#ifdef HOST_BUILD
+using BnrgCs = GpioPin<MockGpioPort<0>, 10>;
+using BnrgIrq = GpioPin<MockGpioPort<1>, 0>;
+using BnrgReset = GpioPin<MockGpioPort<2>, 3>;
+#else
+#include "stm32f4xx_nucleo_bluenrg.h"
+
+using BnrgCs = GpioPin<GpioPort<BNRG_SPI_CS_PORT_BASE>, __builtin_ctz (BNRG_SPI_CS_PIN)>;
+using BnrgIrq = GpioPin<GpioPort<BNRG_SPI_IRQ_PORT_BASE>, __builtin_ctz (BNRG_SPI_IRQ_PIN)>;
+using BnrgReset = GpioPin<GpioPort<BNRG_SPI_RESET_PORT_BASE>, __builtin_ctz (BNRG_SPI_RESET_PIN)>;
+#endif
+
+#endif // BLUENRG_PINS_H
@@ -0,0 +1,161 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#ifndef GATT_SCHEMA_H
+#define GATT_SCHEMA_H
+
+#include <cstdint>
+
+extern "C" {
+#include "gatt_handle_table.h"
+#include "aci_async.h"
+#include "hal_types.h"
+#include "bluenrg_gatt_server.h"
+#include "bluenrg_gatt_aci.h"
+#include "bluenrg_aci_const.h"
+}
+
+/**
+ * Compile-time description of GATT services. UUIDs and presentation format
+ * descriptors are constexpr, so they stay in flash and go to the controller
+ * from there. Characteristics are listed once; the attribute record count
+ * given to aci_gatt_add_serv is derived from them, and registerService adds
+ * the service, its characteristics and descriptors in order, storing every
+ * handle in the State member the schema names (the handle map) and the
+ * characteristics' event handlers in a Gatt_Handle_Table_t.
+ *
+ * constexpr Characteristic<S> chars[] = { ... };
+ * constexpr Service<S> service = gattService (uuid, &S::servHandle, chars);
+ * static_assert (service.records <= GATT_SCHEMA_MAX_RECORDS, "...");
+ */
+
+#define GATT_SCHEMA_MAX_RECORDS 255 /* max_attr_records is 8 bits */
+#define GATT_SCHEMA_ENCRYPTION_KEY_SIZE 16
+
+/// 128 bit UUID, little endian as the ACI wants it.
+struct Uuid128 {
+        uint8_t bytes[16];
+};
+
+/// Takes the bytes in reading order (most significant first), as in the specifications.
+constexpr Uuid128 uuid128 (uint8_t b15, uint8_t b14, uint8_t b13, uint8_t b12, uint8_t b11, uint8_t b10, uint8_t b9, uint8_t b8, uint8_t b7, uint8_t b6,
+                           uint8_t b5, uint8_t b4, uint8_t b3, uint8_t b2, uint8_t b1, uint8_t b0)
+{
+        return Uuid128{ { b0, b1, b2, b3, b4, b5, b6, b7, b8, b9, b10, b11, b12, b13, b14, b15 } };
+}
+
+constexpr bool equalFrom (const Uuid128 &a, const Uuid128 &b, unsigned int i) { return i == 16 || (a.bytes[i] == b.bytes[i] && equalFrom (a, b, i + 1)); }
+
+constexpr bool operator== (const Uuid128 &a, const Uuid128 &b) { return equalFrom (a, b, 0); }
+
+/// Value of a characteristic presentation format descriptor (0x2904).
+struct PresentationFormat {
+        uint8_t bytes[7];
+};
+
+constexpr PresentationFormat presentationFormat (uint8_t format, int8_t exponent, uint16_t unit, uint8_t nameSpace = 0, uint16_t description = 0)
+{
+        return PresentationFormat{ { format, uint8_t (exponent), uint8_t (unit), uint8_t (unit >> 8), nameSpace, uint8_t (description), uint8_t (description >> 8) } };
+}
+
+template <typename State> struct Characteristic {
+        Uuid128 uuid;
+        uint8_t valueLength; /// Maximum if variable.
+        uint8_t properties;  /// CHAR_PROP_*
+        uint8_t securityPermissions;
+        uint8_t eventMask; /// GATT_NOTIFY_* / GATT_DONT_NOTIFY_EVENTS
+        uint8_t variable;
+        uint16_t State::*handle;
+        const PresentationFormat *format; /// nullptr : no presentation format descriptor.
+        const Gatt_Char_Handlers_t *handlers; /// nullptr : no read / write / CCCD events expected.
+};
+
+/// Records the controller allocates for c : declaration, value and the descriptors it adds.
+template <typename State> constexpr unsigned int records (const Characteristic<State> &c)
+{
+        return 2 + ((c.properties & (CHAR_PROP_NOTIFY | CHAR_PROP_INDICATE)) ? 1 : 0) + ((c.properties & CHAR_PROP_BROADCAST) ? 1 : 0)
+                + ((c.properties & CHAR_PROP_EXT) ? 1 : 0) + ((c.format) ? 1 : 0);
+}
+
+/// Records of a service : its declaration and n characteristics.
+template <typename State> constexpr unsigned int records (const Characteristic<State> *c, unsigned int n)
+{
+        return (n == 0) ? (1) : (records (c[0]) + records (c + 1, n - 1));
+}
+
+/// Whether c[i] has a UUID of its own among the n characteristics (and the ones after it too).
+template <typename State> constexpr bool uniqueFrom (const Characteristic<State> *c, unsigned int n, unsigned int i, unsigned int j)
+{
+        return (i >= n) ? (true) : (j >= n) ? (uniqueFrom (c, n, i + 1, i + 2)) : (!(c[i].uuid == c[j].uuid) && uniqueFrom (c, n, i, j + 1));
+}
+
+template <typename State> struct Service {
+        Uuid128 uuid;
+        uint16_t State::*handle;
+        const Characteristic<State> *characteristics;
+        unsigned int count;
+        unsigned int records; /// max_attr_records.
+        bool unique;          /// No two characteristics share a UUID.
+};
+
+template <typename State, unsigned int N>
+constexpr Service<State> gattService (const Uuid128 &uuid, uint16_t State::*handle, const Characteristic<State> (&characteristics)[N])
+{
+        return Service<State>{ uuid, handle, characteristics, N, records (characteristics, N), uniqueFrom (characteristics, N, 0, 1) };
+}
+
+/**
+ * Adds service to the controller, handles go to state and the handlers of
+ * the characteristics to table. Stops at the first command which fails and
+ * returns its status.
+ */
+template <typename State> tBleStatus registerService (const Service<State> &service, State *state, Gatt_Handle_Table_t *table)
+{
+        tBleStatus ret = ACI_BLOCKING (aci_gatt_add_serv (UUID_TYPE_128, service.uuid.bytes, PRIMARY_SERVICE, service.records, &(state->*service.handle)));
+
+        if (ret != BLE_STATUS_SUCCESS) {
+                return ret;
+        }
+
+        uint16_t servHandle = state->*service.handle;
+
+        for (unsigned int i = 0; i < service.count; ++i) {
+                const Characteristic<State> &c = service.characteristics[i];
+                uint16_t *charHandle = &(state->*c.handle);
+
+                ret = ACI_BLOCKING (aci_gatt_add_char (servHandle, UUID_TYPE_128, c.uuid.bytes, c.valueLength, c.properties, c.securityPermissions,
+                                                       c.eventMask, GATT_SCHEMA_ENCRYPTION_KEY_SIZE, c.variable, charHandle));
+
+                if (ret != BLE_STATUS_SUCCESS) {
+                        return ret;
+                }
+
+                if (c.handlers && Gatt_Handle_Table_Add (table, *charHandle, c.properties & (CHAR_PROP_NOTIFY | CHAR_PROP_INDICATE), c.handlers)) {
+                        return BLE_STATUS_INSUFFICIENT_RESOURCES;
+                }
+
+                if (!c.format) {
+                        continue;
+                }
+
+                static const uint16_t formatUuid = CHAR_FORMAT_DESC_UUID;
+                uint16_t descHandle;
+
+                ret = ACI_BLOCKING (aci_gatt_add_char_desc (servHandle, *charHandle, UUID_TYPE_16, reinterpret_cast<const uint8_t *> (&formatUuid),
+                                                            sizeof (PresentationFormat), sizeof (PresentationFormat), c.format->bytes, ATTR_PERMISSION_NONE,
+                                                            ATTR_ACCESS_READ_ONLY, GATT_DONT_NOTIFY_EVENTS, GATT_SCHEMA_ENCRYPTION_KEY_SIZE, FALSE, &descHandle));
+
+                if (ret != BLE_STATUS_SUCCESS) {
+                        return ret;
+                }
+        }
+
+        return BLE_STATUS_SUCCESS;
+}
+
+#endif // GATT_SCHEMA_H
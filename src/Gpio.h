@@ -0,0 +1,93 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#ifndef GPIO_H
+#define GPIO_H
+
+#include <cstdint>
+
+#ifndef HOST_BUILD
+#include <stm32f7xx_hal.h>
+#endif
+
+/**
+ * MODER field values (2 bits per pin).
+ */
+enum class GpioMode : uint32_t { IN = 0x00, OUT = 0x01, AF = 0x02, ANALOG = 0x03 };
+
+#ifndef HOST_BUILD
+/**
+ * GPIO port known at compile time. Every operation boils down to a single access
+ * to the port register (MODER is read-modify-write).
+ */
+template <uint32_t base> struct GpioPort {
+        static GPIO_TypeDef *regs () { return reinterpret_cast<GPIO_TypeDef *> (base); }
+        static void set (uint32_t mask) { regs ()->BSRR = mask; }
+        static void reset (uint32_t mask) { regs ()->BSRR = mask << 16; }
+        static bool read (uint32_t mask) { return regs ()->IDR & mask; }
+
+        static void setMode (unsigned pinNo, GpioMode mode)
+        {
+                regs ()->MODER = (regs ()->MODER & ~(0x03U << (pinNo * 2))) | (uint32_t (mode) << (pinNo * 2));
+        }
+};
+#endif
+
+/**
+ * Host replacement for GpioPort. Keeps the output/input/mode state in plain
+ * variables so the SPI driver can run off-target. Tests drive the input with
+ * idr and inspect odr, moder and the number of register writes.
+ */
+template <int id> struct MockGpioPort {
+        static void set (uint32_t mask)
+        {
+                odr |= mask;
+                ++writes;
+        }
+
+        static void reset (uint32_t mask)
+        {
+                odr &= ~mask;
+                ++writes;
+        }
+
+        static bool read (uint32_t mask) { return idr & mask; }
+
+        static void setMode (unsigned pinNo, GpioMode mode)
+        {
+                moder = (moder & ~(0x03U << (pinNo * 2))) | (uint32_t (mode) << (pinNo * 2));
+                ++writes;
+        }
+
+        static uint32_t odr;
+        static uint32_t idr;
+        static uint32_t moder;
+        static uint32_t writes;
+};
+
+template <int id> uint32_t MockGpioPort<id>::odr;
+template <int id> uint32_t MockGpioPort<id>::idr;
+template <int id> uint32_t MockGpioPort<id>::moder;
+template <int id> uint32_t MockGpioPort<id>::writes;
+
+/**
+ * Single pin of a compile-time port. Port is GpioPort<GPIOx_BASE> on target or
+ * MockGpioPort<n> on the host.
+ */
+template <typename Port, unsigned pinNo> struct GpioPin {
+        static_assert (pinNo < 16, "GPIO ports have 16 pins");
+        static constexpr uint32_t mask = 1U << pinNo;
+
+        static void set () { Port::set (mask); }
+        static void reset () { Port::reset (mask); }
+        static void write (bool b) { (b) ? (set ()) : (reset ()); }
+        static bool read () { return Port::read (mask); }
+        static void setMode (GpioMode mode) { Port::setMode (pinNo, mode); }
+};
+
+#endif // GPIO_H
@@ -0,0 +1,198 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#ifdef ACI_ACCOUNTING
+#include "aci_account.h"
+#include <stm32f7xx_hal.h>
+#include <stdio.h>
+#include <string.h>
+
+Aci_Account_Op_Stats_t aciAccountStats[ACI_OP_COUNT];
+
+static const char *const opNames[ACI_OP_COUNT] = {
+        [ACI_OP_ACC_UPDATE] = "Acc_Update",
+        [ACI_OP_READ_REQUEST] = "Read_Request_CB",
+        [ACI_OP_READ_ACC] = "Read_Request_CB acc",
+        [ACI_OP_READ_TEMPERATURE] = "Read_Request_CB temperature",
+        [ACI_OP_READ_PRESSURE] = "Read_Request_CB pressure",
+        [ACI_OP_READ_HUMIDITY] = "Read_Request_CB humidity",
+        [ACI_OP_ADD_ACC_SERVICE] = "Add_Acc_Service",
+        [ACI_OP_ADD_ENVIRONMENTAL_SERVICE] = "Add_Environmental_Sensor_Service",
+        [ACI_OP_SET_CONNECTABLE] = "setConnectable",
+        [ACI_OP_CONNECTION_SETUP] = "connection setup",
+        [ACI_OP_REFRESH] = "characteristic refresh",
+};
+
+/*
+ * Open operations and what each one has cost so far. Changed by the main loop
+ * (Begin, End, Write) and by the bottom half (Read, PendSV), serialized with
+ * PRIMASK.
+ */
+static Aci_Account_Op_t opStack[ACI_ACCOUNT_MAX_DEPTH];
+static Aci_Account_Cost_t costStack[ACI_ACCOUNT_MAX_DEPTH];
+static volatile uint8_t depth;
+static volatile uint8_t awaitingResponse;
+
+/*****************************************************************************/
+
+void Aci_Account_Begin (Aci_Account_Op_t op)
+{
+        uint32_t primask = __get_PRIMASK ();
+        __disable_irq ();
+
+        if (depth < ACI_ACCOUNT_MAX_DEPTH) {
+                opStack[depth] = op;
+                memset (&costStack[depth], 0, sizeof (Aci_Account_Cost_t));
+        }
+
+        /* Deeper operations are only charged to the outer ones. */
+        ++depth;
+        __set_PRIMASK (primask);
+}
+
+/*****************************************************************************/
+
+/* Aci_Account_Cost_t is all uint32_t counters, walked as an array below. */
+#define COST_FIELDS (sizeof (Aci_Account_Cost_t) / sizeof (uint32_t))
+
+void Aci_Account_End (void)
+{
+        Aci_Account_Cost_t cost;
+
+        uint32_t primask = __get_PRIMASK ();
+        __disable_irq ();
+        uint8_t d = (depth > 0) ? (--depth) : (ACI_ACCOUNT_MAX_DEPTH);
+
+        if (d < ACI_ACCOUNT_MAX_DEPTH) {
+                cost = costStack[d];
+        }
+
+        __set_PRIMASK (primask);
+
+        if (d >= ACI_ACCOUNT_MAX_DEPTH) {
+                return;
+        }
+
+        /* aciAccountStats belongs to the main loop, the totals are made outside the critical section. */
+        Aci_Account_Op_Stats_t *s = &aciAccountStats[opStack[d]];
+        const uint32_t *c = (const uint32_t *)&cost;
+        uint32_t *total = (uint32_t *)&s->total;
+        uint32_t *max = (uint32_t *)&s->max;
+
+        ++s->calls;
+
+        for (unsigned int i = 0; i < COST_FIELDS; ++i) {
+                total[i] += c[i];
+
+                if (c[i] > max[i]) {
+                        max[i] = c[i];
+                }
+        }
+}
+
+/*****************************************************************************/
+
+void Aci_Account_Write (int32_t len)
+{
+        uint32_t primask = __get_PRIMASK ();
+        __disable_irq ();
+        uint8_t n = (depth < ACI_ACCOUNT_MAX_DEPTH) ? (depth) : (ACI_ACCOUNT_MAX_DEPTH);
+
+        for (uint8_t i = 0; i < n; ++i) {
+                ++costStack[i].commands;
+                ++costStack[i].transactions;
+                costStack[i].txBytes += len;
+        }
+
+        awaitingResponse = 1;
+        __set_PRIMASK (primask);
+}
+
+/*****************************************************************************/
+
+void Aci_Account_Read (int32_t len)
+{
+        uint32_t primask = __get_PRIMASK ();
+        __disable_irq ();
+        uint8_t n = (depth < ACI_ACCOUNT_MAX_DEPTH) ? (depth) : (ACI_ACCOUNT_MAX_DEPTH);
+        uint8_t roundTrip = len > 0 && awaitingResponse;
+
+        if (len > 0) {
+                awaitingResponse = 0;
+        }
+
+        for (uint8_t i = 0; i < n; ++i) {
+                ++costStack[i].transactions;
+
+                if (len > 0) {
+                        ++costStack[i].events;
+                        costStack[i].rxBytes += len;
+                        costStack[i].roundTrips += roundTrip;
+                }
+        }
+
+        __set_PRIMASK (primask);
+}
+
+/*****************************************************************************/
+
+void Aci_Account_Reset (void) { memset (aciAccountStats, 0, sizeof (aciAccountStats)); }
+
+/*****************************************************************************/
+
+void Aci_Account_Report (void)
+{
+        printf ("%-32s %6s %8s %8s %8s %8s %8s %8s\n", "operation", "calls", "commands", "tx", "events", "rx", "xfers", "trips");
+
+        for (int i = 0; i < ACI_OP_COUNT; ++i) {
+                const Aci_Account_Op_Stats_t *s = &aciAccountStats[i];
+
+                if (!s->calls) {
+                        continue;
+                }
+
+                printf ("%-32s %6lu %8lu %8lu %8lu %8lu %8lu %8lu\n", opNames[i], (unsigned long)s->calls, (unsigned long)s->total.commands,
+                        (unsigned long)s->total.txBytes, (unsigned long)s->total.events, (unsigned long)s->total.rxBytes,
+                        (unsigned long)s->total.transactions, (unsigned long)s->total.roundTrips);
+        }
+}
+
+/*****************************************************************************/
+
+int Aci_Account_Check (const Aci_Account_Cost_t budget[ACI_OP_COUNT])
+{
+        int over = 0;
+
+        for (int i = 0; i < ACI_OP_COUNT; ++i) {
+                const Aci_Account_Op_Stats_t *s = &aciAccountStats[i];
+                const uint32_t *max = (const uint32_t *)&s->max;
+                const uint32_t *limit = (const uint32_t *)&budget[i];
+                unsigned int f = 0;
+
+                if (!s->calls) {
+                        continue;
+                }
+
+                while (f < COST_FIELDS && max[f] <= limit[f]) {
+                        ++f;
+                }
+
+                if (f == COST_FIELDS) {
+                        continue;
+                }
+
+                printf ("%s over budget : %lu commands, %lu tx, %lu events, %lu rx, %lu xfers, %lu trips\n", opNames[i], (unsigned long)s->max.commands,
+                        (unsigned long)s->max.txBytes, (unsigned long)s->max.events, (unsigned long)s->max.rxBytes, (unsigned long)s->max.transactions,
+                        (unsigned long)s->max.roundTrips);
+                ++over;
+        }
+
+        return over;
+}
+
+#endif /* ACI_ACCOUNTING */
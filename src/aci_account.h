@@ -0,0 +1,95 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#ifndef ACI_ACCOUNT_H
+#define ACI_ACCOUNT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/*
+ * What the high level operations cost on the link to the controller. Code
+ * brackets an operation with Aci_Account_Begin / Aci_Account_End, and
+ * hci_transport.c reports every packet written and read meanwhile. Operations
+ * nest : the transfers are charged to every open one, so Read_Request_CB
+ * includes the Acc_Update it makes.
+ *
+ * Events are charged to whatever is open when they are read, so an unrelated
+ * event arriving during an operation counts too. Compare runs of the same
+ * scenario.
+ *
+ * Without ACI_ACCOUNTING all of this compiles to nothing.
+ */
+
+typedef enum {
+        ACI_OP_ACC_UPDATE,
+        ACI_OP_READ_REQUEST, /// Read_Request_CB for a characteristic not listed below.
+        ACI_OP_READ_ACC,
+        ACI_OP_READ_TEMPERATURE,
+        ACI_OP_READ_PRESSURE,
+        ACI_OP_READ_HUMIDITY,
+        ACI_OP_ADD_ACC_SERVICE,
+        ACI_OP_ADD_ENVIRONMENTAL_SERVICE,
+        ACI_OP_SET_CONNECTABLE,
+        ACI_OP_CONNECTION_SETUP, /// Handling of the LE connection complete event.
+        ACI_OP_REFRESH,          /// One round of the LOCAL_READS background refresh.
+        ACI_OP_COUNT
+} Aci_Account_Op_t;
+
+typedef struct {
+        uint32_t commands;     /// Packets written.
+        uint32_t txBytes;
+        uint32_t events;       /// Packets read.
+        uint32_t rxBytes;
+        uint32_t transactions; /// Transport (SPI) transfers, including the reads which found nothing.
+        uint32_t roundTrips;   /// Writes followed by a read, i.e. waits for the controller.
+} Aci_Account_Cost_t;
+
+typedef struct {
+        uint32_t calls;
+        Aci_Account_Cost_t total;
+        Aci_Account_Cost_t max; /// Most expensive single call, field by field.
+} Aci_Account_Op_Stats_t;
+
+#ifdef ACI_ACCOUNTING
+
+#define ACI_ACCOUNT_MAX_DEPTH 4
+
+extern Aci_Account_Op_Stats_t aciAccountStats[ACI_OP_COUNT];
+
+void Aci_Account_Begin (Aci_Account_Op_t op);
+/// Ends the innermost operation.
+void Aci_Account_End (void);
+
+/// Transport hooks.
+void Aci_Account_Write (int32_t len);
+void Aci_Account_Read (int32_t len);
+
+void Aci_Account_Reset (void);
+/// One line per operation called at least once, in Aci_Account_Op_t order.
+void Aci_Account_Report (void);
+/// Compares the per call maxima with budget, prints and returns the number of operations over it.
+int Aci_Account_Check (const Aci_Account_Cost_t budget[ACI_OP_COUNT]);
+
+#else
+
+static inline void Aci_Account_Begin (Aci_Account_Op_t op) { (void)op; }
+static inline void Aci_Account_End (void) {}
+static inline void Aci_Account_Write (int32_t len) { (void)len; }
+static inline void Aci_Account_Read (int32_t len) { (void)len; }
+
+#endif /* ACI_ACCOUNTING */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ACI_ACCOUNT_H
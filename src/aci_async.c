@@ -0,0 +1,303 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#include "aci_async.h"
+#include "timer_wheel.h"
+#include "hci.h"
+#include "stm32_bluenrg_ble.h"
+#include <string.h>
+
+enum { SLOT_QUEUED, SLOT_IN_FLIGHT, SLOT_DONE };
+
+#define PACKET_HEADER_SIZE (HCI_TYPE_LEN + HCI_COMMAND_HDR_SIZE)
+
+typedef struct {
+        uint16_t opcode;
+        uint8_t plen;
+        uint8_t state;
+        Aci_Async_Callback_t callback;
+        void *context;
+        Timer_Wheel_Timer_t timeout; /* Running while in flight. */
+        /* Complete H4 command packet, sent as is : type, opcode, plen, parameters. */
+        uint8_t packet[PACKET_HEADER_SIZE + ACI_ASYNC_MAX_PARAMS];
+} Slot;
+
+Aci_Async_Stats_t aciAsyncStats = { .credits = 1 };
+
+/*
+ * Slots form a FIFO : [head, head + sent) went to the controller (in flight or
+ * done, out of order completions are possible), [head + sent, head + count)
+ * wait for credits.
+ */
+static Slot slots[ACI_ASYNC_SLOTS];
+static uint8_t head;
+static uint8_t count;
+static uint8_t sent;
+static uint8_t inFlight;
+static const uint8_t *callbackParams; /* Of the command whose callback runs. */
+
+typedef struct {
+        Aci_Async_Deferred_t callback;
+        void *context;
+} Deferred;
+
+/* FIFO of the callbacks waiting for inFlight to drop to 0. Nothing is sent while it is not empty. */
+static Deferred deferred[ACI_ASYNC_DEFERRED];
+static uint8_t deferredHead;
+static uint8_t deferredCount;
+
+/*****************************************************************************/
+
+static inline Slot *slot_at (uint8_t i) { return &slots[(head + i) % ACI_ASYNC_SLOTS]; }
+
+/*****************************************************************************/
+
+static void pump (void)
+{
+        /* Deferred callbacks wait for the ones in flight only, not for the queued ones too. */
+        while (aciAsyncStats.credits > 0 && sent < count && !deferredCount) {
+                Slot *s = slot_at (sent++);
+                s->state = SLOT_IN_FLIGHT;
+                ++inFlight;
+                --aciAsyncStats.credits;
+                ++aciAsyncStats.sent;
+                Timer_Wheel_Start (&s->timeout, ACI_ASYNC_TIMEOUT, 0);
+                /* Header and parameters as the two segments the SPI write expects, both in place. */
+                Hal_Write_Serial (s->packet, s->packet + PACKET_HEADER_SIZE, PACKET_HEADER_SIZE, s->plen);
+        }
+
+        if (inFlight > aciAsyncStats.inFlightMax) {
+                aciAsyncStats.inFlightMax = inFlight;
+        }
+}
+
+/*****************************************************************************/
+
+/// Runs the deferred callbacks while nothing is in flight, then sends what they held back.
+static void run_deferred (void)
+{
+        static uint8_t running;
+
+        /* A callback deferring another one while idle : the loop below runs it. */
+        if (running) {
+                return;
+        }
+
+        running = 1;
+
+        while (deferredCount && !inFlight) {
+                Deferred d = deferred[deferredHead];
+                deferredHead = (deferredHead + 1) % ACI_ASYNC_DEFERRED;
+                --deferredCount;
+                d.callback (d.context);
+        }
+
+        running = 0;
+        pump ();
+}
+
+/*****************************************************************************/
+
+/// The command of s is over, one way or the other : frees its slot and calls its callback.
+static void finish (Slot *s, uint8_t status, const uint8_t *ret, uint8_t retLen)
+{
+        Aci_Async_Callback_t callback = s->callback;
+        void *context = s->context;
+        Timer_Wheel_Stop (&s->timeout);
+        s->state = SLOT_DONE;
+        --inFlight;
+
+        while (count && slot_at (0)->state == SLOT_DONE) {
+                head = (head + 1) % ACI_ASYNC_SLOTS;
+                --count;
+                --sent;
+        }
+
+        /* The slot is free already, the callback may queue the next command. */
+        if (callback) {
+                const uint8_t *outer = callbackParams;
+                callbackParams = s->packet + PACKET_HEADER_SIZE;
+                callback (context, status, ret, retLen);
+                callbackParams = outer;
+        }
+}
+
+/*****************************************************************************/
+
+static void complete (uint16_t opcode, uint8_t ncmd, uint8_t status, const uint8_t *ret, uint8_t retLen)
+{
+        aciAsyncStats.credits = ncmd;
+
+        for (uint8_t i = 0; i < sent; ++i) {
+                Slot *s = slot_at (i);
+
+                if (s->state == SLOT_IN_FLIGHT && s->opcode == opcode) {
+                        ++aciAsyncStats.completed;
+                        finish (s, status, ret, retLen);
+                        break;
+                }
+        }
+
+        run_deferred ();
+}
+
+/*****************************************************************************/
+
+/// Timer_Wheel callback : the Command Complete / Status of the slot never came (or the command never went out).
+static void timed_out (void *arg)
+{
+        Slot *s = arg;
+
+        /* Whatever the controller makes of the command, it takes commands again by now. */
+        if (!aciAsyncStats.credits) {
+                aciAsyncStats.credits = 1;
+        }
+
+        ++aciAsyncStats.timedOut;
+        finish (s, BLE_STATUS_TIMEOUT, NULL, 0);
+        run_deferred ();
+}
+
+/*****************************************************************************/
+
+uint8_t *Aci_Cmd_Begin (uint16_t ogf, uint16_t ocf, uint8_t plen, Aci_Async_Callback_t callback, void *context)
+{
+        if (count >= ACI_ASYNC_SLOTS || plen > ACI_ASYNC_MAX_PARAMS) {
+                ++aciAsyncStats.rejected;
+                return NULL;
+        }
+
+        /* Reserved, but only counted (and sent) on commit. */
+        Slot *s = slot_at (count);
+        s->opcode = cmd_opcode_pack (ogf, ocf);
+        s->plen = plen;
+        s->state = SLOT_QUEUED;
+        s->callback = callback;
+        s->context = context;
+        Timer_Wheel_Init_Timer (&s->timeout, timed_out, s);
+
+        s->packet[0] = HCI_COMMAND_PKT;
+        s->packet[1] = s->opcode & 0xff;
+        s->packet[2] = s->opcode >> 8;
+        s->packet[3] = plen;
+        return s->packet + PACKET_HEADER_SIZE;
+}
+
+/*****************************************************************************/
+
+void Aci_Cmd_Commit (void)
+{
+        ++count;
+
+        if (count - sent > aciAsyncStats.queuedMax) {
+                aciAsyncStats.queuedMax = count - sent;
+        }
+
+        pump ();
+}
+
+/*****************************************************************************/
+
+int Aci_Async_Send (uint16_t ogf, uint16_t ocf, const void *params, uint8_t plen, Aci_Async_Callback_t callback, void *context)
+{
+        uint8_t *p = Aci_Cmd_Begin (ogf, ocf, plen, callback, context);
+
+        if (!p) {
+                return -1;
+        }
+
+        memcpy (p, params, plen);
+        Aci_Cmd_Commit ();
+        return 0;
+}
+
+/*****************************************************************************/
+
+const uint8_t *Aci_Async_Callback_Params (void) { return callbackParams; }
+
+/*****************************************************************************/
+
+uint8_t Aci_Async_Pending (void) { return count; }
+
+/*****************************************************************************/
+
+uint8_t Aci_Async_Idle (void) { return !inFlight; }
+
+/*****************************************************************************/
+
+int Aci_Async_Defer (Aci_Async_Deferred_t callback, void *context)
+{
+        if (deferredCount >= ACI_ASYNC_DEFERRED) {
+                ++aciAsyncStats.deferRejected;
+                return -1;
+        }
+
+        deferred[(deferredHead + deferredCount) % ACI_ASYNC_DEFERRED] = (Deferred){ callback, context };
+        ++deferredCount;
+
+        if (inFlight) {
+                ++aciAsyncStats.deferred;
+        }
+
+        run_deferred ();
+        return 0;
+}
+
+/*****************************************************************************/
+
+int Aci_Async_Blocking_Done (int ret)
+{
+        /* The controller answered a command whose Command Complete we did not see : it has a credit again. */
+        if (!aciAsyncStats.credits) {
+                aciAsyncStats.credits = 1;
+        }
+
+        ++aciAsyncStats.blocking;
+        return ret;
+}
+
+/*****************************************************************************/
+
+int Aci_Async_Blocking_Refused (void)
+{
+        ++aciAsyncStats.blockingRefused;
+        return BLE_STATUS_BUSY;
+}
+
+/*****************************************************************************/
+
+void Aci_Async_On_Cmd_Complete (void *data)
+{
+        evt_cmd_complete *cc = data;
+        /* data is the event payload : plen bytes, the return parameters follow the header. */
+        uint8_t plen = ((hci_event_pckt *)((uint8_t *)data - HCI_EVENT_HDR_SIZE))->plen;
+
+        if (plen < sizeof (evt_cmd_complete)) {
+                ++aciAsyncStats.malformed;
+                return;
+        }
+
+        uint8_t retLen = plen - sizeof (evt_cmd_complete);
+        const uint8_t *ret = (const uint8_t *)data + sizeof (evt_cmd_complete);
+
+        complete (btohs (cc->opcode), cc->ncmd, (retLen) ? (ret[0]) : (0), ret, retLen);
+}
+
+/*****************************************************************************/
+
+void Aci_Async_On_Cmd_Status (void *data)
+{
+        evt_cmd_status *cs = data;
+
+        if (((hci_event_pckt *)((uint8_t *)data - HCI_EVENT_HDR_SIZE))->plen < sizeof (evt_cmd_status)) {
+                ++aciAsyncStats.malformed;
+                return;
+        }
+
+        complete (btohs (cs->opcode), cs->ncmd, cs->status, NULL, 0);
+}
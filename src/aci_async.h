@@ -0,0 +1,145 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#ifndef ACI_ASYNC_H
+#define ACI_ASYNC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "ble_status.h"
+#include <stdint.h>
+
+/*
+ * Non blocking HCI / ACI commands. Aci_Async_Send queues a command and returns;
+ * commands go out as long as the controller has command credits (Num_HCI_Command
+ * _Packets of the last Command Complete / Command Status), so several may be in
+ * flight. The callback runs from HCI_Process (via the event table) when the
+ * matching Command Complete or Command Status arrives.
+ *
+ * The library's blocking calls (aci_*, hci_send_req) take the first event off
+ * the queue and fail if it is not theirs, and the async command whose Command
+ * Complete they swallowed would never complete. So they must not be made while
+ * async commands are in flight : every blocking call goes through ACI_BLOCKING,
+ * which refuses it then. Code which may run at such a time (event handlers,
+ * the main loop once connected) puts its blocking calls in a callback given to
+ * Aci_Async_Defer, which runs it once the commands in flight have completed.
+ * Nothing here runs HCI_Process, so it is safe from event handlers.
+ *
+ * A command whose Command Complete / Status does not come within
+ * ACI_ASYNC_TIMEOUT ms (lost, or the write failed) fails with
+ * BLE_STATUS_TIMEOUT and gives its credit back, so the rest does not stall.
+ * The timeouts run on the timer wheel (timer_wheel.h).
+ *
+ * Everything here runs in the main loop context.
+ */
+
+#ifndef ACI_ASYNC_SLOTS
+#define ACI_ASYNC_SLOTS 8
+#endif
+
+/* Callbacks waiting for the commands in flight (Aci_Async_Defer). */
+#ifndef ACI_ASYNC_DEFERRED
+#define ACI_ASYNC_DEFERRED 4
+#endif
+
+/* ms a command may be in flight. */
+#ifndef ACI_ASYNC_TIMEOUT
+#define ACI_ASYNC_TIMEOUT 1000
+#endif
+
+/* Room for a characteristic update carrying a full notification of a large ATT_MTU. */
+#ifndef ACI_ASYNC_MAX_PARAMS
+#define ACI_ASYNC_MAX_PARAMS 128
+#endif
+
+/**
+ * Called on completion. status is the first return parameter (Command Complete)
+ * or the status field (Command Status), ret / retLen the whole return parameters
+ * (NULL / 0 for Command Status, or when status is BLE_STATUS_TIMEOUT).
+ */
+typedef void (*Aci_Async_Callback_t) (void *context, uint8_t status, const uint8_t *ret, uint8_t retLen);
+
+typedef void (*Aci_Async_Deferred_t) (void *context);
+
+typedef struct {
+        uint32_t sent;
+        uint32_t completed;
+        uint32_t rejected;        /// Aci_Async_Send calls refused, all slots busy.
+        uint32_t blocking;        /// Blocking calls made through ACI_BLOCKING.
+        uint32_t blockingRefused; /// ACI_BLOCKING calls refused, commands were in flight.
+        uint32_t deferred;        /// Aci_Async_Defer callbacks which had to wait.
+        uint32_t deferRejected;   /// Aci_Async_Defer calls refused, ACI_ASYNC_DEFERRED wait already.
+        uint32_t timedOut;        /// Commands failed after ACI_ASYNC_TIMEOUT.
+        uint32_t malformed;       /// Command Complete / Status events too short, ignored.
+        uint8_t inFlightMax;
+        uint8_t queuedMax;
+        uint8_t credits; /// Current controller command credits.
+} Aci_Async_Stats_t;
+
+extern Aci_Async_Stats_t aciAsyncStats;
+
+/**
+ * Queues ogf/ocf with plen bytes of params (copied, see Aci_Cmd_Begin to avoid
+ * that). callback may be NULL.
+ * Returns 0, or -1 if all ACI_ASYNC_SLOTS are busy or params are too long.
+ */
+int Aci_Async_Send (uint16_t ogf, uint16_t ocf, const void *params, uint8_t plen, Aci_Async_Callback_t callback, void *context);
+
+/**
+ * In place construction : reserves a slot for ogf/ocf and returns where its plen
+ * parameter bytes go, or NULL if no slot is free (or plen is too long). The
+ * caller writes the parameters there and calls Aci_Cmd_Commit, the buffer then
+ * goes to the transport as it is. One command may be under construction at a
+ * time and it must be committed before anything else is sent.
+ */
+uint8_t *Aci_Cmd_Begin (uint16_t ogf, uint16_t ocf, uint8_t plen, Aci_Async_Callback_t callback, void *context);
+void Aci_Cmd_Commit (void);
+
+/**
+ * From an Aci_Async_Callback_t : the parameters its command was sent with.
+ * They stay in the freed slot until the callback queues another command.
+ */
+const uint8_t *Aci_Async_Callback_Params (void);
+
+/// Number of commands queued or in flight.
+uint8_t Aci_Async_Pending (void);
+
+/// No command is in flight : a blocking call may be made.
+uint8_t Aci_Async_Idle (void);
+
+/**
+ * Runs callback (context) once no command is in flight : right away if none is,
+ * otherwise from the event completing the last one. Queued commands are held
+ * back until then, so the callback may make blocking calls. Callbacks run in
+ * the order they were deferred. Returns 0, or -1 if ACI_ASYNC_DEFERRED
+ * callbacks wait already.
+ */
+int Aci_Async_Defer (Aci_Async_Deferred_t callback, void *context);
+
+/**
+ * Makes the blocking call `call` (e.g. aci_gatt_allow_read (handle)) if no
+ * command is in flight and evaluates to its result, otherwise evaluates to
+ * BLE_STATUS_BUSY without making it.
+ */
+#define ACI_BLOCKING(call) ((Aci_Async_Idle ()) ? (Aci_Async_Blocking_Done (call)) : (Aci_Async_Blocking_Refused ()))
+
+/// ACI_BLOCKING internals.
+int Aci_Async_Blocking_Done (int ret);
+int Aci_Async_Blocking_Refused (void);
+
+/// Event table handlers for EVT_CMD_COMPLETE and EVT_CMD_STATUS (see hci_dispatch.h).
+void Aci_Async_On_Cmd_Complete (void *data);
+void Aci_Async_On_Cmd_Status (void *data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ACI_ASYNC_H
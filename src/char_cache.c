@@ -0,0 +1,56 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#include "char_cache.h"
+
+Char_Cache_Stats_t charCacheStats;
+
+/*****************************************************************************/
+
+void Char_Cache_Init (Char_Cache_t *cache, uint32_t deadband)
+{
+        cache->deadband = deadband;
+        cache->skipped = 0;
+        cache->valid = 0;
+}
+
+/*****************************************************************************/
+
+static uint32_t distance (int32_t a, int32_t b) { return (a > b) ? ((uint32_t)a - (uint32_t)b) : ((uint32_t)b - (uint32_t)a); }
+
+/*****************************************************************************/
+
+uint8_t Char_Cache_Update (Char_Cache_t *cache, const int32_t *fields, uint8_t n)
+{
+        /* More fields than the cache holds : always sent, never cached. */
+        if (n > CHAR_CACHE_MAX_FIELDS) {
+                cache->valid = 0;
+                ++charCacheStats.updates;
+                return 1;
+        }
+
+        uint8_t changed = !cache->valid;
+
+        for (uint8_t i = 0; i < n && !changed; ++i) {
+                changed = distance (fields[i], cache->fields[i]) > cache->deadband;
+        }
+
+        if (!changed) {
+                ++cache->skipped;
+                ++charCacheStats.skipped;
+                return 0;
+        }
+
+        for (uint8_t i = 0; i < n; ++i) {
+                cache->fields[i] = fields[i];
+        }
+
+        cache->valid = 1;
+        ++charCacheStats.updates;
+        return 1;
+}
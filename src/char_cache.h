@@ -0,0 +1,60 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#ifndef CHAR_CACHE_H
+#define CHAR_CACHE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/*
+ * Copy of a characteristic value as last written to the controller, so that
+ * updates which would not change it cost no SPI traffic.
+ *
+ * A value is up to CHAR_CACHE_MAX_FIELDS signed fields (e.g. the 3 axes of
+ * the accelerometer). Char_Cache_Update tells whether a new value has to be
+ * sent : when nothing is cached yet, or when a field moved by more than the
+ * deadband away from the cached one. The deadband is compared with the last
+ * value sent, so slow drifts get through once they add up. When the write
+ * fails afterwards, Char_Cache_Invalidate makes the next update go through.
+ */
+
+#define CHAR_CACHE_MAX_FIELDS 3
+
+typedef struct {
+        int32_t fields[CHAR_CACHE_MAX_FIELDS];
+        uint32_t deadband; /// Largest change per field which is not worth an update, 0 : any change is.
+        uint32_t skipped;
+        uint8_t valid;
+} Char_Cache_t;
+
+typedef struct {
+        uint32_t updates; /// Values which had to be sent.
+        uint32_t skipped; /// Values which did not.
+} Char_Cache_Stats_t;
+
+extern Char_Cache_Stats_t charCacheStats;
+
+void Char_Cache_Init (Char_Cache_t *cache, uint32_t deadband);
+
+/// Returns 1 (and caches fields) if the n fields have to be sent, 0 if the update is redundant. Over CHAR_CACHE_MAX_FIELDS fields, always 1.
+uint8_t Char_Cache_Update (Char_Cache_t *cache, const int32_t *fields, uint8_t n);
+
+static inline uint8_t Char_Cache_Update_1 (Char_Cache_t *cache, int32_t value) { return Char_Cache_Update (cache, &value, 1); }
+
+/// The controller's value is unknown : the next update is sent whatever it is.
+static inline void Char_Cache_Invalidate (Char_Cache_t *cache) { cache->valid = 0; }
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CHAR_CACHE_H
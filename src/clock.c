@@ -37,10 +37,48 @@
 
 /* Includes ------------------------------------------------------------------*/
 #include "clock.h"
+
+#ifdef HOST_BUILD
+#include "virtual_clock.h"
+#include <stdio.h>
+#include <time.h>
+#else
 #include <stm32f7xx_hal.h>
+#endif
 
 const uint32_t CLOCK_SECOND = 1000;
 
+#ifdef HOST_BUILD
+#define VCLOCK_MAX_EVENTS 64
+/* Consecutive Clock_Time calls without time moving, taken as a busy wait. */
+#define VCLOCK_IDLE_POLLS 16
+
+typedef struct {
+  tClockTime at;
+  VClock_Callback_t callback;
+  void *arg;
+} VClock_Event_t;
+
+VClock_Stats_t vclockStats;
+static tClockTime now;
+static uint32_t idlePolls;
+static VClock_Event_t events[VCLOCK_MAX_EVENTS]; /* sorted by at */
+static uint32_t eventsCount;
+static struct timespec wallStart;
+static int realTime;
+static int64_t realOffset; /* Clock_Time - wall_ms in real time mode */
+
+static void vclock_idle (void);
+
+/* Wall clock ms since Clock_Init. */
+static int64_t wall_ms (void)
+{
+  struct timespec wallNow;
+  clock_gettime (CLOCK_MONOTONIC, &wallNow);
+  return (wallNow.tv_sec - wallStart.tv_sec) * 1000LL + (wallNow.tv_nsec - wallStart.tv_nsec) / 1000000;
+}
+#endif
+
 /**
  * @brief  Clock_Init
  * @param  None
@@ -48,8 +86,16 @@ const uint32_t CLOCK_SECOND = 1000;
  */
 void Clock_Init(void)
 {
+#ifdef HOST_BUILD
+  now = 0;
+  idlePolls = 0;
+  eventsCount = 0;
+  realTime = 0;
+  clock_gettime (CLOCK_MONOTONIC, &wallStart);
+#else
   // FIXME: as long as Cube HAL is initialized this is OK
   // Cube HAL default is one clock each 1 ms
+#endif
 }
 
 /**
@@ -59,7 +105,16 @@ void Clock_Init(void)
  */
 tClockTime Clock_Time(void)
 {
+#ifdef HOST_BUILD
+  if (realTime) {
+    return (tClockTime)(wall_ms () + realOffset);
+  }
+
+  vclock_idle ();
+  return now;
+#else
   return HAL_GetTick();
+#endif
 }
 
 /**
@@ -69,8 +124,146 @@ tClockTime Clock_Time(void)
  */
 void Clock_Wait(uint32_t i)
 {
+#ifdef HOST_BUILD
+  if (realTime) {
+    struct timespec ts = { i / 1000, (i % 1000) * 1000000L };
+    nanosleep (&ts, NULL);
+    return;
+  }
+
+  VClock_Advance (i);
+#else
   HAL_Delay(i);
+#endif
+}
+
+#ifdef HOST_BUILD
+/**
+ * @brief  Fast-forwards a polling loop : after VCLOCK_IDLE_POLLS reads of an
+ *         unchanged time, jumps to the next scheduled event (or by 1 ms if
+ *         there is none), so timeouts expire without wall-clock waiting.
+ * @param  None
+ * @retval None
+ */
+static void vclock_idle (void)
+{
+  if (++idlePolls < VCLOCK_IDLE_POLLS) {
+    return;
+  }
+
+  ++vclockStats.idleSkips;
+  VClock_Advance ((eventsCount && events[0].at != now) ? (events[0].at - now) : 1);
+}
+
+/**
+ * @brief  VClock_Now
+ * @param  None
+ * @retval Simulated time, without the busy wait detection of Clock_Time.
+ */
+tClockTime VClock_Now (void)
+{
+  return now;
+}
+
+/**
+ * @brief  VClock_Advance
+ * @param  ms : simulated milliseconds to move forward.
+ * @retval None
+ */
+void VClock_Advance (tClockTime ms)
+{
+  tClockTime target = now + ms;
+
+  while (eventsCount && (int32_t)(events[0].at - target) <= 0) {
+    VClock_Event_t e = events[0];
+
+    --eventsCount;
+    for (uint32_t i = 0; i < eventsCount; ++i) {
+      events[i] = events[i + 1];
+    }
+
+    now = e.at;
+    ++vclockStats.events;
+    /* May schedule further events, which are honoured if due before target. It may
+       also wait (advance) itself, possibly past target. */
+    e.callback (e.arg);
+  }
+
+  /* Never backwards, after a callback which advanced further than this call. */
+  if ((int32_t)(target - now) > 0) {
+    now = target;
+  }
+
+  idlePolls = 0;
+}
+
+/**
+ * @brief  VClock_Schedule
+ * @param  delay : ms from now.
+ * @param  callback, arg : called when simulated time reaches now + delay.
+ * @retval 0 on success, -1 if the queue is full.
+ */
+int VClock_Schedule (tClockTime delay, VClock_Callback_t callback, void *arg)
+{
+  if (eventsCount >= VCLOCK_MAX_EVENTS) {
+    ++vclockStats.overflows;
+    return -1;
+  }
+
+  tClockTime at = now + delay;
+  uint32_t i = eventsCount;
+
+  /* Insertion keeps FIFO order between events due at the same time. */
+  while (i > 0 && (int32_t)(events[i - 1].at - at) > 0) {
+    events[i] = events[i - 1];
+    --i;
+  }
+
+  events[i].at = at;
+  events[i].callback = callback;
+  events[i].arg = arg;
+  ++eventsCount;
+  return 0;
+}
+
+/**
+ * @brief  VClock_Real_Time : time follows the wall clock from now on, going
+ *         on from the current simulated time.
+ * @param  None
+ * @retval None
+ */
+void VClock_Real_Time (void)
+{
+  realOffset = (int64_t)now - wall_ms ();
+  realTime = 1;
 }
 
+/**
+ * @brief  VClock_Report
+ * @param  label : printed in front of the line.
+ * @param  operations : number of completed operations (events, writes...).
+ * @param  bytes : payload carried by those operations.
+ * @retval None
+ */
+void VClock_Report (const char *label, uint32_t operations, uint32_t bytes)
+{
+  struct timespec wallNow;
+  clock_gettime (CLOCK_MONOTONIC, &wallNow);
+  double wallMs = (wallNow.tv_sec - wallStart.tv_sec) * 1e3 + (wallNow.tv_nsec - wallStart.tv_nsec) / 1e6;
+  double simS = now / (double)CLOCK_SECOND;
+
+  printf ("%s: simulated %.3f s (wall %.1f ms), %u ops, %.1f ops/s, %.1f B/s, %.3f ms/op, events %u, idle skips %u\n",
+          label, simS, wallMs, operations, (simS > 0) ? (operations / simS) : 0.0, (simS > 0) ? (bytes / simS) : 0.0,
+          (operations) ? ((double)now / operations) : 0.0, vclockStats.events, vclockStats.idleSkips);
+}
+
+/**
+ * @brief  Cube HAL time base replacement for host builds.
+ */
+uint32_t HAL_GetTick (void) { return Clock_Time (); }
+void HAL_Delay (uint32_t Delay) { Clock_Wait (Delay); }
+void HAL_IncTick (void) { VClock_Advance (1); }
+#endif
+
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
 
@@ -0,0 +1,66 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#ifndef CYCLE_COUNTER_H
+#define CYCLE_COUNTER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#ifdef HOST_BUILD
+#include <time.h>
+#else
+#include <stm32f7xx_hal.h>
+#endif
+
+/*
+ * Time base of the timing statistics (SPI sessions, bottom half, reads, replay) :
+ * the DWT cycle counter, which runs once Cycle_Counter_Init has been called at
+ * startup (main). Host builds count nanoseconds of CLOCK_MONOTONIC instead.
+ * Differences of Cycle_Counter_Now values are valid across one wrap (~20 s at
+ * 216 MHz).
+ */
+
+static inline void Cycle_Counter_Init (void)
+{
+#ifndef HOST_BUILD
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+        DWT->LAR = 0xC5ACCE55;
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+}
+
+static inline uint32_t Cycle_Counter_Now (void)
+{
+#ifdef HOST_BUILD
+        struct timespec ts;
+        clock_gettime (CLOCK_MONOTONIC, &ts);
+        return (uint32_t)(ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+#else
+        return DWT->CYCCNT;
+#endif
+}
+
+/// Counts per microsecond.
+static inline uint32_t Cycle_Counter_Per_Us (void)
+{
+#ifdef HOST_BUILD
+        return 1000;
+#else
+        return SystemCoreClock / 1000000;
+#endif
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CYCLE_COUNTER_H
@@ -0,0 +1,85 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#include "gatt_handle_table.h"
+
+/*****************************************************************************/
+
+static int map (Gatt_Handle_Table_t *table, uint16_t attrHandle, uint16_t charHandle, const Gatt_Char_Handlers_t *handlers)
+{
+        uint16_t i = attrHandle - table->base;
+
+        if (i >= GATT_HANDLE_TABLE_SIZE) {
+                return -1;
+        }
+
+        table->entries[i].handlers = handlers;
+        table->entries[i].charHandle = charHandle;
+        return 0;
+}
+
+/*****************************************************************************/
+
+int Gatt_Handle_Table_Add (Gatt_Handle_Table_t *table, uint16_t charHandle, uint8_t cccd, const Gatt_Char_Handlers_t *handlers)
+{
+        if (!table->used) {
+                table->base = charHandle + 1;
+                table->used = 1;
+        }
+
+        if (map (table, charHandle + 1, charHandle, handlers)) {
+                return -1;
+        }
+
+        if (cccd && map (table, charHandle + 2, charHandle, handlers)) {
+                return -1;
+        }
+
+        return 0;
+}
+
+/*****************************************************************************/
+
+int Gatt_Handle_Table_Read (const Gatt_Handle_Table_t *table, uint16_t connHandle, uint16_t attrHandle)
+{
+        const Gatt_Handle_Entry_t *e = Gatt_Handle_Table_Find (table, attrHandle);
+
+        if (!e || attrHandle != e->charHandle + 1 || !e->handlers->read) {
+                return -1;
+        }
+
+        e->handlers->read (connHandle, e->charHandle);
+        return 0;
+}
+
+/*****************************************************************************/
+
+int Gatt_Handle_Table_Modified (const Gatt_Handle_Table_t *table, uint16_t connHandle, uint16_t attrHandle, const uint8_t *data, uint8_t len)
+{
+        const Gatt_Handle_Entry_t *e = Gatt_Handle_Table_Find (table, attrHandle);
+
+        if (!e) {
+                return -1;
+        }
+
+        if (attrHandle == e->charHandle + 1) {
+                if (!e->handlers->write) {
+                        return -1;
+                }
+
+                e->handlers->write (connHandle, e->charHandle, data, len);
+                return 0;
+        }
+
+        if (!e->handlers->cccd || len < 1) {
+                return -1;
+        }
+
+        e->handlers->cccd (connHandle, e->charHandle, data[0] | ((len > 1) ? (data[1] << 8) : (0)));
+        return 0;
+}
@@ -0,0 +1,97 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#ifndef GATT_HANDLE_TABLE_H
+#define GATT_HANDLE_TABLE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Attribute handle to characteristic handlers, for the GATT server events
+ * (read permit request, attribute modified). Indexed by the attribute handle,
+ * so finding the handlers takes the same time whatever the number of
+ * characteristics.
+ *
+ * The controller gives every characteristic consecutive handles : the
+ * declaration (the handle aci_gatt_add_char returns), the value at +1 and,
+ * for notifiable / indicatable ones, the CCCD at +2. Gatt_Handle_Table_Add
+ * maps the value and the CCCD, as the characteristics are registered (see
+ * registerService in GattSchema.h). The table covers
+ * GATT_HANDLE_TABLE_SIZE handles from the first one added. A table must be
+ * zero initialized.
+ */
+
+#ifndef GATT_HANDLE_TABLE_SIZE
+#define GATT_HANDLE_TABLE_SIZE 48
+#endif
+
+/* CCCD bits. */
+#define GATT_CCCD_NOTIFY 0x0001
+#define GATT_CCCD_INDICATE 0x0002
+
+/// Gatt_Char_Handlers_t.tag left unset (0, what designated initializers leave out).
+#define GATT_CHAR_TAG_NONE 0
+
+/* connHandle is the connection of the client the event comes from. */
+typedef struct {
+        /// Read permit request on the value (GATT_NOTIFY_READ_REQ_AND_WAIT_FOR_APPL_RESP).
+        void (*read) (uint16_t connHandle, uint16_t charHandle);
+        /// Value written by the client.
+        void (*write) (uint16_t connHandle, uint16_t charHandle, const uint8_t *data, uint8_t len);
+        /// CCCD written by the client, config is GATT_CCCD_* bits. Every client has its own.
+        void (*cccd) (uint16_t connHandle, uint16_t charHandle, uint16_t config);
+        /// Free for the application (e.g. the aci_account.h category of the reads). Non-zero, or GATT_CHAR_TAG_NONE.
+        uint8_t tag;
+} Gatt_Char_Handlers_t;
+
+typedef struct {
+        const Gatt_Char_Handlers_t *handlers;
+        uint16_t charHandle; /// Declaration handle.
+} Gatt_Handle_Entry_t;
+
+typedef struct {
+        uint16_t base;
+        uint8_t used;
+        Gatt_Handle_Entry_t entries[GATT_HANDLE_TABLE_SIZE];
+} Gatt_Handle_Table_t;
+
+/**
+ * Maps the value (and CCCD if cccd is set) of the characteristic declared at
+ * charHandle to handlers. Returns 0, or -1 if the handles are out of the
+ * table's range.
+ */
+int Gatt_Handle_Table_Add (Gatt_Handle_Table_t *table, uint16_t charHandle, uint8_t cccd, const Gatt_Char_Handlers_t *handlers);
+
+/// Entry of attrHandle, NULL if none.
+static inline const Gatt_Handle_Entry_t *Gatt_Handle_Table_Find (const Gatt_Handle_Table_t *table, uint16_t attrHandle)
+{
+        uint16_t i = attrHandle - table->base;
+
+        if (!table->used || i >= GATT_HANDLE_TABLE_SIZE || !table->entries[i].handlers) {
+                return NULL;
+        }
+
+        return &table->entries[i];
+}
+
+/// Runs the read handler of attrHandle. Returns 0, or -1 if there is none.
+int Gatt_Handle_Table_Read (const Gatt_Handle_Table_t *table, uint16_t connHandle, uint16_t attrHandle);
+
+/// Runs the write or CCCD handler of attrHandle, after what was written. Returns 0, or -1 if there is none.
+int Gatt_Handle_Table_Modified (const Gatt_Handle_Table_t *table, uint16_t connHandle, uint16_t attrHandle, const uint8_t *data, uint8_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // GATT_HANDLE_TABLE_H
@@ -0,0 +1,55 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+/*
+ * The library's polled timers (gp_timer.h), built in place of its
+ * utils/gp_timer.c : deadlines on the timer wheel's clock, expiring by the
+ * wheel's rule (Timer_Wheel_Due), so a gp_timer and a wheel timer started
+ * together for the same time expire on the same tick, across the wrap too.
+ *
+ * A gp_timer is not linked into the wheel. Its users (hci_send_req, the SPI
+ * write) keep it on the stack and poll it in a busy wait which they leave
+ * without telling : a linked timer would stay in the wheel after its frame
+ * is gone. And a busy wait inside a blocking command cannot run the main
+ * loop callbacks of Timer_Wheel_Process, which may send commands themselves.
+ */
+
+#include "gp_timer.h"
+#include "timer_wheel.h"
+
+/*****************************************************************************/
+
+void Timer_Set (struct timer *t, tClockTime interval)
+{
+        t->interval = interval;
+        t->start = Clock_Time ();
+}
+
+/*****************************************************************************/
+
+/// Next period, from the end of the current one (no drift).
+void Timer_Reset (struct timer *t) { t->start += t->interval; }
+
+/*****************************************************************************/
+
+/// Same period again, from now.
+void Timer_Restart (struct timer *t) { t->start = Clock_Time (); }
+
+/*****************************************************************************/
+
+int Timer_Expired (struct timer *t) { return Timer_Wheel_Due (t->start + t->interval, Clock_Time ()); }
+
+/*****************************************************************************/
+
+/// Time left, 0 once expired (the library's version wrapped round).
+tClockTime Timer_Remaining (struct timer *t)
+{
+        tClockTime now = Clock_Time ();
+        tClockTime expires = t->start + t->interval;
+        return (Timer_Wheel_Due (expires, now)) ? (0) : (expires - now);
+}
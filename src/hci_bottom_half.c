@@ -0,0 +1,154 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#include "hci_bottom_half.h"
+#include "hci.h"
+#include "cycle_counter.h"
+#include <stm32f7xx_hal.h>
+
+HCI_Bottom_Half_Stats_t hciBottomHalfStats;
+
+/* EXTI timestamps, written by the top half (head) and read by the bottom half (tail). */
+static uint32_t queue[HCI_BOTTOM_HALF_QUEUE_SIZE];
+static volatile uint8_t head;
+static volatile uint8_t tail;
+
+static volatile uint8_t masked;
+static volatile uint8_t pendingRun;
+
+/*****************************************************************************/
+
+static inline uint32_t now (void)
+{
+#ifdef BNRG_SPI_STATS
+        return Cycle_Counter_Now ();
+#else
+        return 0;
+#endif
+}
+
+/*****************************************************************************/
+
+/**
+ * Pends the bottom half. Host builds have no PendSV, the run happens right away,
+ * unless the bottom half is running already (a simulated controller may raise
+ * its "IRQ" while HCI_Isr reads) : as PendSV, it then runs again on return.
+ */
+static inline void pend (void)
+{
+#ifdef HOST_BUILD
+        static uint8_t pended;
+        static uint8_t running;
+
+        pended = 1;
+
+        if (running) {
+                return;
+        }
+
+        running = 1;
+
+        while (pended) {
+                pended = 0;
+                HCI_Bottom_Half_Run ();
+        }
+
+        running = 0;
+#else
+        SCB->ICSR = SCB_ICSR_PENDSVSET_Msk;
+#endif
+}
+
+/*****************************************************************************/
+
+void HCI_Bottom_Half_Schedule (void)
+{
+        uint32_t start = now ();
+        uint8_t h = head;
+        uint8_t depth = (uint8_t)(h - tail);
+
+        ++hciBottomHalfStats.notifications;
+
+        if (depth < HCI_BOTTOM_HALF_QUEUE_SIZE) {
+                queue[h & (HCI_BOTTOM_HALF_QUEUE_SIZE - 1)] = start;
+                __DMB ();
+                head = h + 1;
+
+                if (++depth > hciBottomHalfStats.queueDepthMax) {
+                        hciBottomHalfStats.queueDepthMax = depth;
+                }
+        }
+        else {
+                /* The bottom half is pending anyway and reads everything there is. */
+                ++hciBottomHalfStats.overflows;
+        }
+
+#ifdef BNRG_SPI_STATS
+        uint32_t cycles = now () - start;
+
+        if (cycles > hciBottomHalfStats.isrCyclesMax) {
+                hciBottomHalfStats.isrCyclesMax = cycles;
+        }
+#endif
+
+        pend ();
+}
+
+/*****************************************************************************/
+
+void HCI_Bottom_Half_Run (void)
+{
+        if (masked) {
+                pendingRun = 1;
+                ++hciBottomHalfStats.deferred;
+                return;
+        }
+
+#ifdef BNRG_SPI_STATS
+        uint32_t start = now ();
+#endif
+
+        while (tail != head) {
+#ifdef BNRG_SPI_STATS
+                uint32_t latency = start - queue[tail & (HCI_BOTTOM_HALF_QUEUE_SIZE - 1)];
+
+                if (latency > hciBottomHalfStats.latencyCyclesMax) {
+                        hciBottomHalfStats.latencyCyclesMax = latency;
+                }
+#endif
+                ++tail;
+        }
+
+        ++hciBottomHalfStats.runs;
+        HCI_Isr ();
+
+#ifdef BNRG_SPI_STATS
+        uint32_t cycles = now () - start;
+
+        if (cycles > hciBottomHalfStats.bottomHalfCyclesMax) {
+                hciBottomHalfStats.bottomHalfCyclesMax = cycles;
+        }
+#endif
+}
+
+/*****************************************************************************/
+
+void HCI_Bottom_Half_Mask (void) { masked = 1; }
+
+/*****************************************************************************/
+
+void HCI_Bottom_Half_Unmask (void)
+{
+        masked = 0;
+
+        /* PendSV can only have set pendingRun before masked was cleared. */
+        if (pendingRun) {
+                pendingRun = 0;
+                pend ();
+        }
+}
@@ -0,0 +1,62 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#ifndef HCI_BOTTOM_HALF_H
+#define HCI_BOTTOM_HALF_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/*
+ * Split of the BlueNRG interrupt. The EXTI handler (top half) only clears the
+ * EXTI line, records the notification in a single producer / single consumer
+ * queue and pends PendSV.
+ * PendSV runs at IRQ_PRIORITY_HCI_BOTTOM_HALF, the lowest priority, and does
+ * the SPI read (HCI_Isr) there, so USB and SysTick are never delayed by it.
+ * HCI_Process keeps dispatching the received events from the main loop.
+ *
+ * PendSV still preempts the main loop, which is needed since hci_send_req busy
+ * waits there for its response. What used to be masked by disabling the EXTI
+ * (the library's Disable_SPI_IRQ, Hal_Write_Serial) now also has to hold off
+ * the bottom half : see HCI_Bottom_Half_Mask.
+ */
+
+#define HCI_BOTTOM_HALF_QUEUE_SIZE 16 /* power of 2 */
+
+typedef struct {
+        uint32_t notifications; /// EXTI interrupts.
+        uint32_t runs;          /// HCI_Isr calls made by the bottom half.
+        uint32_t deferred;      /// Runs postponed because the bottom half was masked.
+        uint32_t overflows;     /// Notifications not queued (the bottom half still runs).
+        uint8_t queueDepthMax;
+#ifdef BNRG_SPI_STATS
+        uint32_t isrCyclesMax;        /// Longest top half.
+        uint32_t bottomHalfCyclesMax; /// Longest HCI_Isr call, i.e. what used to run at EXTI priority.
+        uint32_t latencyCyclesMax;    /// Longest time from the EXTI to the start of the bottom half.
+#endif
+} HCI_Bottom_Half_Stats_t;
+
+extern HCI_Bottom_Half_Stats_t hciBottomHalfStats;
+
+/// Top half, called from the BlueNRG EXTI handler.
+void HCI_Bottom_Half_Schedule (void);
+/// Bottom half, called from PendSV_Handler.
+void HCI_Bottom_Half_Run (void);
+
+/// Holds off / releases the bottom half. Not nested; a run missed while masked happens on unmask.
+void HCI_Bottom_Half_Mask (void);
+void HCI_Bottom_Half_Unmask (void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HCI_BOTTOM_HALF_H
@@ -0,0 +1,261 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#ifdef HCI_BTSNOOP
+#include "hci_btsnoop.h"
+#include "hci_packet_pool.h"
+#include <stm32f7xx_hal.h>
+#include <string.h>
+
+#define BTSNOOP_VERSION 1
+#define BTSNOOP_DATALINK_H4 1002
+#define BTSNOOP_RECORD_HEADER_SIZE 24
+#define BTSNOOP_FLAG_RECEIVED 0x01
+#define BTSNOOP_FLAG_COMMAND_EVENT 0x02
+/* Microseconds from 0 AD to 1970-01-01, btsnoop timestamps are counted from 0 AD. */
+#define BTSNOOP_EPOCH_OFFSET 0x00DCDDB30F2F8000ULL
+
+#define H4_COMMAND_PKT 0x01
+#define H4_EVENT_PKT 0x04
+
+HCI_Btsnoop_Stats_t hciBtsnoopStats;
+
+/// A received packet whose record header is in the ring at "at", its bytes in a pool block.
+typedef struct {
+        HCI_Packet_t *packet;
+        uint32_t at;
+} Held_Packet_t;
+
+/*
+ * Written by the recorders (main loop and the bottom half, serialized with
+ * PRIMASK), read by the main loop only.
+ */
+static uint8_t ring[HCI_BTSNOOP_RING_SIZE];
+static volatile uint32_t head;
+static volatile uint32_t tail;
+static uint8_t enabled;
+
+/* Held packets in record order : added by the recorders, removed by the main loop. */
+static Held_Packet_t held[HCI_BTSNOOP_HELD];
+static uint8_t heldFirst;
+static volatile uint8_t heldCount;
+static uint16_t heldOffset; /* Bytes of held[heldFirst] already handed over. */
+
+/*****************************************************************************/
+
+static void put (const void *data, uint32_t len)
+{
+        const uint8_t *p = data;
+
+        while (len > 0) {
+                uint32_t pos = head & (HCI_BTSNOOP_RING_SIZE - 1);
+                uint32_t chunk = HCI_BTSNOOP_RING_SIZE - pos;
+
+                if (chunk > len) {
+                        chunk = len;
+                }
+
+                memcpy (ring + pos, p, chunk);
+                head += chunk;
+                p += chunk;
+                len -= chunk;
+        }
+}
+
+/*****************************************************************************/
+
+static void put_be32 (uint8_t *p, uint32_t v)
+{
+        p[0] = v >> 24;
+        p[1] = v >> 16;
+        p[2] = v >> 8;
+        p[3] = v;
+}
+
+/*****************************************************************************/
+
+/// Microseconds since boot, SysTick gives the part below HAL_GetTick's millisecond.
+static uint64_t now_us (void)
+{
+        uint32_t tick, val;
+
+        do {
+                tick = HAL_GetTick ();
+                val = SysTick->VAL;
+        } while (tick != HAL_GetTick ());
+
+        uint32_t load = SysTick->LOAD + 1;
+        return (uint64_t)tick * 1000 + (uint64_t)(load - 1 - val) * 1000 / load;
+}
+
+/*****************************************************************************/
+
+void HCI_Btsnoop_Start (void)
+{
+        static const uint8_t fileHeader[16] = { 'b', 't', 's', 'n', 'o', 'o', 'p', 0, 0, 0, 0, BTSNOOP_VERSION, 0, 0, BTSNOOP_DATALINK_H4 >> 8,
+                                                BTSNOOP_DATALINK_H4 & 0xFF };
+
+        uint32_t primask = __get_PRIMASK ();
+        __disable_irq ();
+
+        for (; heldCount > 0; --heldCount) {
+                HCI_Packet_Release (held[heldFirst].packet);
+                heldFirst = (heldFirst + 1) % HCI_BTSNOOP_HELD;
+        }
+
+        heldOffset = 0;
+        memset (&hciBtsnoopStats, 0, sizeof (hciBtsnoopStats));
+        head = tail = 0;
+        put (fileHeader, sizeof (fileHeader));
+        enabled = 1;
+        __set_PRIMASK (primask);
+}
+
+/*****************************************************************************/
+
+void HCI_Btsnoop_Stop (void) { enabled = 0; }
+
+/*****************************************************************************/
+
+uint8_t HCI_Btsnoop_Active (void) { return enabled; }
+
+/*****************************************************************************/
+
+void HCI_Btsnoop_Record (const void *data1, const void *data2, int32_t n_bytes1, int32_t n_bytes2, uint8_t received)
+{
+        if (!enabled || n_bytes1 <= 0) {
+                return;
+        }
+
+        if (n_bytes2 < 0) {
+                n_bytes2 = 0;
+        }
+
+        uint32_t len = n_bytes1 + n_bytes2;
+        uint8_t type = *(const uint8_t *)data1;
+        uint8_t header[BTSNOOP_RECORD_HEADER_SIZE];
+        uint64_t timestamp = now_us () + BTSNOOP_EPOCH_OFFSET;
+        uint32_t flags = (received) ? (BTSNOOP_FLAG_RECEIVED) : (0);
+
+        if (type == H4_COMMAND_PKT || type == H4_EVENT_PKT) {
+                flags |= BTSNOOP_FLAG_COMMAND_EVENT;
+        }
+
+        put_be32 (header, len);
+        put_be32 (header + 4, len);
+        put_be32 (header + 8, flags);
+        put_be32 (header + 16, timestamp >> 32);
+        put_be32 (header + 20, timestamp);
+
+        /* Copied with the interrupts on, only the header goes through the ring. */
+        HCI_Packet_t *packet = (received && n_bytes2 == 0) ? (HCI_Packet_Copy (data1, len)) : (NULL);
+
+        uint32_t primask = __get_PRIMASK ();
+        __disable_irq ();
+
+        uint8_t hold = (packet && heldCount < HCI_BTSNOOP_HELD);
+        uint32_t size = BTSNOOP_RECORD_HEADER_SIZE + ((hold) ? (0) : (len));
+        uint32_t used = head - tail;
+
+        if (used + size > HCI_BTSNOOP_RING_SIZE) {
+                ++hciBtsnoopStats.dropped;
+                __set_PRIMASK (primask);
+
+                if (packet) {
+                        HCI_Packet_Release (packet);
+                }
+
+                return;
+        }
+
+        put_be32 (header + 12, hciBtsnoopStats.dropped);
+        put (header, BTSNOOP_RECORD_HEADER_SIZE);
+
+        if (hold) {
+                Held_Packet_t *h = &held[(heldFirst + heldCount) % HCI_BTSNOOP_HELD];
+                h->packet = packet;
+                h->at = head;
+                ++heldCount;
+                ++hciBtsnoopStats.held;
+        }
+        else {
+                put (data1, n_bytes1);
+                put (data2, n_bytes2);
+        }
+
+        ++hciBtsnoopStats.records;
+        used += size;
+
+        if (used > hciBtsnoopStats.peakUsed) {
+                hciBtsnoopStats.peakUsed = used;
+        }
+
+        __set_PRIMASK (primask);
+
+        /* No room to hold it, recorded inline all the same. */
+        if (packet && !hold) {
+                HCI_Packet_Release (packet);
+        }
+}
+
+/*****************************************************************************/
+
+uint32_t HCI_Btsnoop_Peek (const uint8_t **data)
+{
+        uint32_t t = tail;
+        uint32_t used = head - t;
+
+        /* The ring up to the next held packet, then that packet. */
+        if (heldCount) {
+                const Held_Packet_t *h = &held[heldFirst];
+
+                if (h->at == t) {
+                        *data = h->packet->data + heldOffset;
+                        return h->packet->len - heldOffset;
+                }
+
+                used = h->at - t;
+        }
+
+        uint32_t pos = t & (HCI_BTSNOOP_RING_SIZE - 1);
+        uint32_t contiguous = HCI_BTSNOOP_RING_SIZE - pos;
+
+        *data = ring + pos;
+        return (used < contiguous) ? (used) : (contiguous);
+}
+
+/*****************************************************************************/
+
+void HCI_Btsnoop_Consume (uint32_t n)
+{
+        hciBtsnoopStats.bytes += n;
+
+        if (!heldCount || held[heldFirst].at != tail) {
+                tail += n;
+                return;
+        }
+
+        HCI_Packet_t *packet = held[heldFirst].packet;
+        heldOffset += n;
+
+        if (heldOffset < packet->len) {
+                return;
+        }
+
+        HCI_Packet_Release (packet);
+        heldOffset = 0;
+
+        /* Together : the recorders append at heldFirst + heldCount. */
+        uint32_t primask = __get_PRIMASK ();
+        __disable_irq ();
+        heldFirst = (heldFirst + 1) % HCI_BTSNOOP_HELD;
+        --heldCount;
+        __set_PRIMASK (primask);
+}
+
+#endif /* HCI_BTSNOOP */
@@ -0,0 +1,83 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#ifndef HCI_BTSNOOP_H
+#define HCI_BTSNOOP_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#ifdef HCI_BTSNOOP
+
+/*
+ * Live btsnoop (RFC 1761 style, datalink 1002 : H4) stream of the HCI traffic.
+ *
+ * hci_transport.c records every packet written to and read from the controller
+ * into a byte ring, as complete btsnoop records. Recording never blocks : a
+ * record which does not fit is dropped and counted, the count is carried by
+ * the next record's "cumulative drops" field so the gap shows in Wireshark.
+ * The main loop moves the ring to the USB channel (HCI_Btsnoop_Peek / Consume).
+ *
+ * A received packet is copied into a pool block (hci_packet_pool.h) before the
+ * interrupts are masked, and only its record header goes into the ring : the
+ * ring points at the block, Peek hands its bytes over in turn, the block is
+ * released once consumed. A handler holding the same event during dispatch
+ * (HCI_Packet_Hold) before it is consumed shares that block instead of copying
+ * the packet again.
+ * With the pool exhausted, or HCI_BTSNOOP_HELD packets already held, the
+ * packet is copied into the ring as the written ones are.
+ *
+ * HCI_Btsnoop_Start queues the btsnoop file header first, tools/btsnoop.py
+ * looks for it in the USB stream and writes everything from there to a file.
+ * Until HCI_Btsnoop_Stop nothing else may go to the USB channel : _write
+ * (syscalls.c) drops the printf output meanwhile.
+ */
+
+#ifndef HCI_BTSNOOP_RING_SIZE
+#define HCI_BTSNOOP_RING_SIZE 4096 /* power of 2 */
+#endif
+
+#ifndef HCI_BTSNOOP_HELD
+#define HCI_BTSNOOP_HELD 8 /* received packets held in the pool at most */
+#endif
+
+typedef struct {
+        uint32_t records;
+        uint32_t held; /// Received packets recorded from a pool block, not copied into the ring.
+        uint32_t dropped;
+        uint32_t bytes;    /// Handed over to the USB channel.
+        uint32_t peakUsed; /// Ring high watermark.
+        uint32_t silenced; /// printf bytes dropped to keep the stream clean.
+} HCI_Btsnoop_Stats_t;
+
+extern HCI_Btsnoop_Stats_t hciBtsnoopStats;
+
+/// Empties the ring and queues the file header.
+void HCI_Btsnoop_Start (void);
+void HCI_Btsnoop_Stop (void);
+/// Between HCI_Btsnoop_Start and HCI_Btsnoop_Stop : the USB channel is taken.
+uint8_t HCI_Btsnoop_Active (void);
+
+/// One H4 packet, possibly in two parts (as Hal_Write_Serial gets it). received : controller to host.
+void HCI_Btsnoop_Record (const void *data1, const void *data2, int32_t n_bytes1, int32_t n_bytes2, uint8_t received);
+
+/// Points data at the oldest queued bytes, returns how many are contiguous there.
+uint32_t HCI_Btsnoop_Peek (const uint8_t **data);
+/// Frees n bytes returned by HCI_Btsnoop_Peek.
+void HCI_Btsnoop_Consume (uint32_t n);
+
+#endif /* HCI_BTSNOOP */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HCI_BTSNOOP_H
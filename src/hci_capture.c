@@ -0,0 +1,268 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#ifdef HCI_CAPTURE
+#include "hci_capture.h"
+#include "hci_bottom_half.h"
+#include "hci_dispatch.h"
+#include "cycle_counter.h"
+#include <stm32f7xx_hal.h>
+#include <stdio.h>
+#include <string.h>
+
+uint8_t hciCaptureBuffer[HCI_CAPTURE_SIZE];
+HCI_Capture_Stats_t hciCaptureStats;
+HCI_Replay_Stats_t hciReplayStats;
+
+static uint8_t capturing;
+static uint32_t lastTick;
+
+static const HCI_Transport_t *previousTransport;
+static const uint8_t *replayPos;
+static const uint8_t *replayEnd;
+static uint8_t replayPaced;
+static uint32_t replayStartTick;
+static uint32_t replayDue; /* ms after replayStartTick at which the next record is due */
+static uint32_t eventStart;
+static enum { REPLAY_IDLE, REPLAY_RUNNING, REPLAY_DRAINING } replayState;
+
+/*****************************************************************************/
+
+void HCI_Capture_Start (void)
+{
+        memset (&hciCaptureStats, 0, sizeof (hciCaptureStats));
+        lastTick = HAL_GetTick ();
+        capturing = 1;
+}
+
+/*****************************************************************************/
+
+void HCI_Capture_Stop (void) { capturing = 0; }
+
+/*****************************************************************************/
+
+void HCI_Capture_Record (const uint8_t *packet, int32_t len)
+{
+        if (!capturing || len <= 0) {
+                return;
+        }
+
+        if (hciCaptureStats.bytes + HCI_CAPTURE_RECORD_HEADER_SIZE + len > HCI_CAPTURE_SIZE) {
+                ++hciCaptureStats.dropped;
+                return;
+        }
+
+        uint32_t tick = HAL_GetTick ();
+        uint32_t dt = tick - lastTick;
+        uint8_t *p = hciCaptureBuffer + hciCaptureStats.bytes;
+
+        if (dt > 0xFFFF) {
+                dt = 0xFFFF;
+        }
+
+        lastTick = tick;
+        p[0] = dt & 0xFF;
+        p[1] = dt >> 8;
+        p[2] = len;
+        memcpy (p + HCI_CAPTURE_RECORD_HEADER_SIZE, packet, len);
+        hciCaptureStats.bytes += HCI_CAPTURE_RECORD_HEADER_SIZE + len;
+        ++hciCaptureStats.records;
+}
+
+/*****************************************************************************/
+
+static uint16_t record_dt (const uint8_t *record) { return record[0] | (record[1] << 8); }
+
+/*****************************************************************************/
+
+/// Whether a whole record starts at p : a truncated or corrupt capture ends where its last complete record does.
+static uint8_t record_complete (const uint8_t *p)
+{
+        return replayEnd - p >= HCI_CAPTURE_RECORD_HEADER_SIZE && replayEnd - p - HCI_CAPTURE_RECORD_HEADER_SIZE >= p[2];
+}
+
+/*****************************************************************************/
+
+static uint8_t replay_data_present (void)
+{
+        if (!record_complete (replayPos)) {
+                return 0;
+        }
+
+        return !replayPaced || HAL_GetTick () - replayStartTick >= replayDue;
+}
+
+/*****************************************************************************/
+
+static int32_t replay_read (uint8_t *buffer, uint8_t buff_size)
+{
+        if (!replay_data_present ()) {
+                return 0;
+        }
+
+        uint8_t len = replayPos[2];
+        const uint8_t *packet = replayPos + HCI_CAPTURE_RECORD_HEADER_SIZE;
+
+        replayPos = packet + len;
+
+        if (record_complete (replayPos)) {
+                replayDue += record_dt (replayPos);
+        }
+
+        /* avoid to read more data that size of the buffer */
+        if (len > buff_size) {
+                len = buff_size;
+        }
+
+        memcpy (buffer, packet, len);
+        ++hciReplayStats.records;
+        return len;
+}
+
+/*****************************************************************************/
+
+static void replay_write (const void *data1, const void *data2, int32_t n_bytes1, int32_t n_bytes2)
+{
+        (void)data1;
+        (void)data2;
+        (void)n_bytes1;
+        (void)n_bytes2;
+        ++hciReplayStats.commands;
+}
+
+/*****************************************************************************/
+
+static void replay_nop (void) {}
+
+/*****************************************************************************/
+
+/* The IRQ the library masks is the bottom half which calls HCI_Isr. */
+const HCI_Transport_t hciTransportReplay = { "replay", replay_nop, replay_nop, replay_write, replay_read, replay_data_present, HCI_Bottom_Half_Unmask,
+                                             HCI_Bottom_Half_Mask };
+
+/*****************************************************************************/
+
+void HCI_Replay_Start (const uint8_t *capture, uint32_t len, uint8_t paced)
+{
+        if (replayState != REPLAY_IDLE) {
+                return;
+        }
+
+        if (!capture) {
+                capture = hciCaptureBuffer;
+                len = hciCaptureStats.bytes;
+        }
+
+        HCI_Capture_Stop ();
+        memset (&hciReplayStats, 0, sizeof (hciReplayStats));
+
+        replayPos = capture;
+        replayEnd = capture + len;
+        replayPaced = paced;
+        replayStartTick = HAL_GetTick ();
+        replayDue = (record_complete (capture)) ? (record_dt (capture)) : (0);
+
+        previousTransport = HCI_Transport_Get ();
+        HCI_Transport_Set (&hciTransportReplay);
+        replayState = REPLAY_RUNNING;
+}
+
+/*****************************************************************************/
+
+void HCI_Replay_Process (void)
+{
+        if (replayState == REPLAY_DRAINING) {
+                /* HCI_Process has dispatched the last events since. */
+                replayState = REPLAY_IDLE;
+                HCI_Replay_Report ();
+                return;
+        }
+
+        if (replayState != REPLAY_RUNNING) {
+                return;
+        }
+
+        if (replay_data_present ()) {
+                HCI_Bottom_Half_Schedule ();
+                return;
+        }
+
+        if (record_complete (replayPos)) {
+                /* Paced, next record not due yet. */
+                return;
+        }
+
+        HCI_Transport_Set (previousTransport);
+        replayState = REPLAY_DRAINING;
+}
+
+/*****************************************************************************/
+
+void HCI_Replay_Event_Begin (void) { eventStart = Cycle_Counter_Now (); }
+
+/*****************************************************************************/
+
+void HCI_Replay_Event_End (void *pckt)
+{
+        if (replayState == REPLAY_IDLE) {
+                return;
+        }
+
+        uint32_t cycles = Cycle_Counter_Now () - eventStart;
+        void *data;
+        int slot = HCI_Dispatch_Slot (pckt, &data);
+
+        ++hciReplayStats.events;
+        hciReplayStats.cycles += cycles;
+
+        if (cycles > hciReplayStats.maxCycles) {
+                hciReplayStats.maxCycles = cycles;
+        }
+
+        for (int i = 0; i < HCI_REPLAY_KINDS; ++i) {
+                HCI_Replay_Kind_t *kind = &hciReplayStats.kinds[i];
+
+                if (kind->count && kind->slot != slot) {
+                        continue;
+                }
+
+                kind->slot = slot;
+                ++kind->count;
+                kind->cycles += cycles;
+
+                if (cycles > kind->maxCycles) {
+                        kind->maxCycles = cycles;
+                }
+
+                return;
+        }
+
+        ++hciReplayStats.otherKinds;
+}
+
+/*****************************************************************************/
+
+void HCI_Replay_Report (void)
+{
+        HCI_Replay_Stats_t *s = &hciReplayStats;
+
+        printf ("replay : %lu records, %lu events, %lu commands, %lu cycles avg, %lu max\n", (unsigned long)s->records, (unsigned long)s->events,
+                (unsigned long)s->commands, (unsigned long)((s->events) ? (s->cycles / s->events) : (0)), (unsigned long)s->maxCycles);
+
+        for (int i = 0; i < HCI_REPLAY_KINDS && s->kinds[i].count; ++i) {
+                HCI_Replay_Kind_t *kind = &s->kinds[i];
+                printf ("  slot %3d : %lu events, %lu cycles avg, %lu max\n", kind->slot, (unsigned long)kind->count,
+                        (unsigned long)(kind->cycles / kind->count), (unsigned long)kind->maxCycles);
+        }
+
+        if (s->otherKinds) {
+                printf ("  other    : %lu events\n", (unsigned long)s->otherKinds);
+        }
+}
+
+#endif /* HCI_CAPTURE */
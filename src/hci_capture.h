@@ -0,0 +1,109 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#ifndef HCI_CAPTURE_H
+#define HCI_CAPTURE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#ifdef HCI_CAPTURE
+#include "hci_transport.h"
+
+/*
+ * Capture of the HCI event stream and its replay, for profiling the event
+ * handling on real traffic.
+ *
+ * Capture : every packet returned by the transport's read (BlueNRG_SPI_Read_All)
+ * is appended to hciCaptureBuffer as a record :
+ *
+ * uint16_t dt      milliseconds since the previous record (capture start for the
+ *                  first one), little endian, saturated at 0xFFFF.
+ * uint8_t  len     H4 packet length.
+ * uint8_t  data[]  the packet, as passed to HCI_Event_CB.
+ *
+ * Capturing stops when the buffer is full. The buffer is read out with the
+ * debugger (hciCaptureStats.bytes long) and can be written back the same way.
+ *
+ * Replay : hciTransportReplay takes the place of the controller and feeds the
+ * records back through HCI_Isr / HCI_Process / HCI_Event_CB, either at the
+ * recorded pace or as fast as the main loop takes them. Commands sent meanwhile
+ * are discarded, blocking ones are answered by the recorded responses, so
+ * captures should start after the initialization (as main does). The cycles
+ * spent in each HCI_Event_CB call, i.e. in the handlers, Read_Request_CB and the
+ * GATT updates they make, are accumulated per event and per dispatch slot.
+ * A record cut short (truncated or corrupt capture) ends the replay. On the
+ * board the USER button starts one (main.cc), tools/hci_replay_bench.c replays
+ * on the host.
+ */
+
+#ifndef HCI_CAPTURE_SIZE
+#define HCI_CAPTURE_SIZE 8192
+#endif
+
+#define HCI_CAPTURE_RECORD_HEADER_SIZE 3
+#define HCI_REPLAY_KINDS 8
+
+typedef struct {
+        uint32_t records;
+        uint32_t bytes;   /// Used part of hciCaptureBuffer.
+        uint32_t dropped; /// Packets not captured because the buffer was full.
+} HCI_Capture_Stats_t;
+
+typedef struct {
+        int slot; /// HCI_Dispatch_Slot of the events, -1 for packets which have none.
+        uint32_t count;
+        uint32_t cycles;
+        uint32_t maxCycles;
+} HCI_Replay_Kind_t;
+
+typedef struct {
+        uint32_t records;  /// Records the host read. A blocking call of the firmware takes its own answer without HCI_Event_CB.
+        uint32_t events;   /// HCI_Event_CB calls.
+        uint32_t cycles;   /// Spent in HCI_Event_CB.
+        uint32_t maxCycles;
+        uint32_t commands; /// Packets written (and discarded) during the replay.
+        uint32_t otherKinds; /// Events not accounted per slot because kinds[] was full.
+        HCI_Replay_Kind_t kinds[HCI_REPLAY_KINDS];
+} HCI_Replay_Stats_t;
+
+extern uint8_t hciCaptureBuffer[HCI_CAPTURE_SIZE];
+extern HCI_Capture_Stats_t hciCaptureStats;
+extern HCI_Replay_Stats_t hciReplayStats;
+extern const HCI_Transport_t hciTransportReplay;
+
+/// Restarts the capture from an empty buffer.
+void HCI_Capture_Start (void);
+void HCI_Capture_Stop (void);
+/// Read path hook (BlueNRG_SPI_Read_All).
+void HCI_Capture_Record (const uint8_t *packet, int32_t len);
+
+/**
+ * Replays len bytes of records from capture (hciCaptureBuffer if NULL), paced
+ * as recorded or not. Stops the capture and switches to hciTransportReplay; the
+ * previous transport is restored once every record has been read. Ignored while
+ * a replay is running.
+ */
+void HCI_Replay_Start (const uint8_t *capture, uint32_t len, uint8_t paced);
+/// Main loop, before HCI_Process : feeds the bottom half and prints the report once the replay is over.
+void HCI_Replay_Process (void);
+/// Bracket HCI_Event_CB.
+void HCI_Replay_Event_Begin (void);
+void HCI_Replay_Event_End (void *pckt);
+void HCI_Replay_Report (void);
+
+#endif /* HCI_CAPTURE */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HCI_CAPTURE_H
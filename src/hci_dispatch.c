@@ -0,0 +1,71 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#include "hci_dispatch.h"
+#include "hci.h"
+#include "bluenrg_aci_const.h"
+#include <stddef.h>
+
+HCI_Dispatch_Stats_t hciDispatchStats;
+
+/*****************************************************************************/
+
+int HCI_Dispatch_Slot (void *pckt, void **data)
+{
+        hci_uart_pckt *hci_pckt = pckt;
+        hci_event_pckt *event_pckt = (hci_event_pckt *)hci_pckt->data;
+        int slot = event_pckt->evt;
+
+        *data = event_pckt->data;
+
+        if (hci_pckt->type != HCI_EVENT_PKT) {
+                return -1;
+        }
+
+        if (slot == EVT_LE_META_EVENT) {
+                evt_le_meta_event *evt = *data;
+
+                if (evt->subevent >= HCI_DISPATCH_VENDOR_BASE - HCI_DISPATCH_LE_META_BASE) {
+                        return -1;
+                }
+
+                *data = evt->data;
+                return HCI_LE_META_SLOT (evt->subevent);
+        }
+
+        if (slot == EVT_VENDOR) {
+                evt_blue_aci *blue_evt = *data;
+
+                if (!HCI_VENDOR_SLOT_VALID (blue_evt->ecode)) {
+                        return -1;
+                }
+
+                *data = blue_evt->data;
+                return HCI_VENDOR_EVENT_SLOT (blue_evt->ecode);
+        }
+
+        return slot;
+}
+
+/*****************************************************************************/
+
+int HCI_Dispatch (const HCI_Dispatch_Table_t table, void *pckt)
+{
+        void *data;
+        int slot = HCI_Dispatch_Slot (pckt, &data);
+        HCI_Event_Handler_t handler = (slot >= 0) ? (table[slot]) : (NULL);
+
+        if (!handler) {
+                ++hciDispatchStats.unhandled;
+                return 0;
+        }
+
+        ++hciDispatchStats.handled;
+        handler (data);
+        return 1;
+}
@@ -0,0 +1,78 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#ifndef HCI_DISPATCH_H
+#define HCI_DISPATCH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/*
+ * Flat HCI event dispatch. Every (event, LE subevent, vendor ecode) triple maps
+ * to one slot of a single table, so dispatching is one index computation and one
+ * load, whatever the event :
+ *
+ * [0, 256)        plain HCI events, by event code.
+ * [256, 288)      LE meta subevents (EVT_LE_META_EVENT), by subevent code.
+ * [288, 416)      BlueNRG vendor events (EVT_VENDOR), by HCI_VENDOR_SLOT (ecode).
+ *
+ * Tables are built with designated initializers, e.g.
+ * [HCI_EVENT_SLOT (EVT_DISCONN_COMPLETE)] = onDisconnect, and may be changed at
+ * run time through HCI_Event_Mask_Set_Handler so the controller's event masks
+ * follow (hci_event_mask.h). Handlers get the payload of the innermost level :
+ * the bytes after the event header, after the subevent code, or after the
+ * vendor ecode respectively.
+ */
+
+#define HCI_DISPATCH_LE_META_BASE 256
+#define HCI_DISPATCH_VENDOR_BASE (HCI_DISPATCH_LE_META_BASE + 32)
+#define HCI_DISPATCH_SLOTS (HCI_DISPATCH_VENDOR_BASE + 128)
+
+/*
+ * BlueNRG vendor event codes are grouped : 0x0001 (initialized), 0x04xx (GAP),
+ * 0x08xx (L2CAP) and 0x0Cxx (GATT), none of the groups uses more than 32 codes.
+ * Bits 10-11 select the group, bits 0-4 the code within it.
+ */
+#define HCI_VENDOR_SLOT_VALID(ecode) (((ecode) & ~0x0C1F) == 0)
+#define HCI_VENDOR_SLOT(ecode) ((((ecode) >> 10) & 0x03) << 5 | ((ecode) & 0x1F))
+
+#define HCI_EVENT_SLOT(evt) (evt)
+#define HCI_LE_META_SLOT(subevent) (HCI_DISPATCH_LE_META_BASE + (subevent))
+#define HCI_VENDOR_EVENT_SLOT(ecode) (HCI_DISPATCH_VENDOR_BASE + HCI_VENDOR_SLOT (ecode))
+
+typedef void (*HCI_Event_Handler_t) (void *data);
+typedef HCI_Event_Handler_t HCI_Dispatch_Table_t[HCI_DISPATCH_SLOTS];
+
+typedef struct {
+        uint32_t handled;
+        uint32_t unhandled; /// Events which reached the host for nothing, see hci_event_mask.h.
+} HCI_Dispatch_Stats_t;
+
+extern HCI_Dispatch_Stats_t hciDispatchStats;
+
+/**
+ * Returns the table slot of pckt (an H4 packet as passed to HCI_Event_CB) and
+ * points data at the payload its handler gets, or returns -1 if pckt does not
+ * fit in a table (not an event, unknown subevent or vendor code).
+ */
+int HCI_Dispatch_Slot (void *pckt, void **data);
+
+/**
+ * Calls the handler registered for pckt (an H4 packet as passed to HCI_Event_CB).
+ * Returns 1 if there was one, 0 if the packet was not an event or nobody handles it.
+ */
+int HCI_Dispatch (const HCI_Dispatch_Table_t table, void *pckt);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HCI_DISPATCH_H
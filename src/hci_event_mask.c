@@ -0,0 +1,149 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#include "hci_event_mask.h"
+#include "hci.h"
+#include "ble_status.h"
+#include "bluenrg_aci_const.h"
+#include "bluenrg_gap_aci.h"
+#include "bluenrg_gatt_aci.h"
+#include "aci_async.h"
+
+#define GATT_VENDOR_FIRST 0x0C01
+#define GAP_VENDOR_FIRST 0x0400
+
+HCI_Event_Masks_t hciEventMasks;
+static uint8_t vendorMasks;
+static uint8_t programmed; /* hciEventMasks is what the controller has */
+
+/*****************************************************************************/
+
+void HCI_Event_Mask_Compute (const HCI_Dispatch_Table_t table, HCI_Event_Masks_t *masks)
+{
+        masks->hci = HCI_EVENT_MASK_ALWAYS;
+        masks->le = 0;
+        masks->gatt = 0;
+        masks->gap = 0;
+
+        /* Event codes 0x01 - 0x40 map to bits 0 - 63. */
+        for (unsigned int evt = 1; evt <= 64; ++evt) {
+                if (table[HCI_EVENT_SLOT (evt)]) {
+                        masks->hci |= 1ULL << (evt - 1);
+                }
+        }
+
+        for (unsigned int sub = 1; sub < HCI_DISPATCH_VENDOR_BASE - HCI_DISPATCH_LE_META_BASE; ++sub) {
+                if (table[HCI_LE_META_SLOT (sub)]) {
+                        masks->le |= 1ULL << (sub - 1);
+                }
+        }
+
+        if (masks->le) {
+                masks->hci |= 1ULL << (EVT_LE_META_EVENT - 1);
+        }
+
+        /* Reserved bit, the controller sends Number Of Completed Packets anyway. */
+        masks->hci &= ~(1ULL << (EVT_NUM_COMP_PKTS - 1));
+
+        for (unsigned int n = 0; n < 32 && HCI_VENDOR_SLOT_VALID (GATT_VENDOR_FIRST + n); ++n) {
+                if (table[HCI_VENDOR_EVENT_SLOT (GATT_VENDOR_FIRST + n)]) {
+                        masks->gatt |= 1UL << n;
+                }
+        }
+
+        for (unsigned int n = 0; n < 16; ++n) {
+                if (table[HCI_VENDOR_EVENT_SLOT (GAP_VENDOR_FIRST + n)]) {
+                        masks->gap |= 1U << n;
+                }
+        }
+}
+
+/*****************************************************************************/
+
+void HCI_Event_Mask_Init (uint8_t withVendorMasks)
+{
+        vendorMasks = withVendorMasks;
+        programmed = 0;
+}
+
+/*****************************************************************************/
+
+static int set_mask (uint16_t ogf, uint16_t ocf, uint64_t mask)
+{
+        uint8_t cp[8];
+        uint8_t status;
+        struct hci_request rq = { 0 };
+
+        for (int i = 0; i < 8; ++i) {
+                cp[i] = mask >> (8 * i);
+        }
+
+        rq.ogf = ogf;
+        rq.ocf = ocf;
+        rq.cparam = cp;
+        rq.clen = sizeof (cp);
+        rq.rparam = &status;
+        rq.rlen = 1;
+
+        int ret = ACI_BLOCKING (hci_send_req (&rq, FALSE));
+
+        if (ret == BLE_STATUS_BUSY) {
+                return ret;
+        }
+
+        if (ret < 0) {
+                return BLE_STATUS_TIMEOUT;
+        }
+
+        return status;
+}
+
+/*****************************************************************************/
+
+int HCI_Event_Mask_Apply (const HCI_Dispatch_Table_t table)
+{
+        HCI_Event_Masks_t masks;
+        int ret = BLE_STATUS_SUCCESS;
+
+        /* All or nothing : do not leave some of the masks programmed. */
+        if (!Aci_Async_Idle ()) {
+                return BLE_STATUS_BUSY;
+        }
+
+        HCI_Event_Mask_Compute (table, &masks);
+
+        if ((!programmed || masks.hci != hciEventMasks.hci) && (ret = set_mask (OGF_HOST_CTL, OCF_SET_EVENT_MASK, masks.hci))) {
+                return ret;
+        }
+
+        if ((!programmed || masks.le != hciEventMasks.le) && (ret = set_mask (OGF_LE_CTL, OCF_LE_SET_EVENT_MASK, masks.le))) {
+                return ret;
+        }
+
+        if (vendorMasks) {
+                if ((!programmed || masks.gatt != hciEventMasks.gatt) && (ret = ACI_BLOCKING (aci_gatt_set_event_mask (masks.gatt)))) {
+                        return ret;
+                }
+
+                if ((!programmed || masks.gap != hciEventMasks.gap) && (ret = ACI_BLOCKING (aci_gap_set_event_mask (masks.gap)))) {
+                        return ret;
+                }
+        }
+
+        hciEventMasks = masks;
+        programmed = 1;
+        return BLE_STATUS_SUCCESS;
+}
+
+/*****************************************************************************/
+
+int HCI_Event_Mask_Set_Handler (HCI_Dispatch_Table_t table, unsigned int slot, HCI_Event_Handler_t handler)
+{
+        table[slot] = handler;
+        return (programmed) ? (HCI_Event_Mask_Apply (table)) : (BLE_STATUS_SUCCESS);
+}
@@ -0,0 +1,66 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#ifndef HCI_EVENT_MASK_H
+#define HCI_EVENT_MASK_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "hci_dispatch.h"
+
+/*
+ * Controller event masks derived from a dispatch table : an event is enabled
+ * only if the table has a handler for it, so the controller does not raise the
+ * IRQ and clock out events nobody would look at.
+ *
+ * HCI Set_Event_Mask and LE Set_Event_Mask cover the plain and LE meta events.
+ * BlueNRG-MS (IDB05A1) also has GAP and GATT vendor event masks, older firmware
+ * (IDB04A1) does not, its vendor events always come through.
+ * Command Complete / Command Status are not maskable, nor is Number Of
+ * Completed Packets (its Set_Event_Mask bit is reserved and left clear).
+ */
+
+typedef struct {
+        uint64_t hci;
+        uint64_t le;
+        uint32_t gatt; /// Bit n : vendor event 0x0C01 + n.
+        uint16_t gap;  /// Bit n : vendor event 0x0400 + n.
+} HCI_Event_Masks_t;
+
+/// Always enabled, whatever the table : hardware error.
+#define HCI_EVENT_MASK_ALWAYS (1ULL << (0x10 - 1))
+
+void HCI_Event_Mask_Compute (const HCI_Dispatch_Table_t table, HCI_Event_Masks_t *masks);
+
+/**
+ * withVendorMasks : the controller supports the GAP / GATT event masks (IDB05A1).
+ * Call after reset, before HCI_Event_Mask_Apply.
+ */
+void HCI_Event_Mask_Init (uint8_t withVendorMasks);
+
+/**
+ * Programs the masks for table, sending only the ones which changed since the
+ * last call. Uses blocking commands : returns BLE_STATUS_BUSY without sending
+ * anything while async commands are in flight (call it from an Aci_Async_Defer
+ * callback then). Returns 0 or the first error status.
+ */
+int HCI_Event_Mask_Apply (const HCI_Dispatch_Table_t table);
+
+/// Installs (or removes, with NULL) a handler and reprograms the masks accordingly.
+int HCI_Event_Mask_Set_Handler (HCI_Dispatch_Table_t table, unsigned int slot, HCI_Event_Handler_t handler);
+
+/// Masks last programmed.
+extern HCI_Event_Masks_t hciEventMasks;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HCI_EVENT_MASK_H
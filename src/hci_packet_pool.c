@@ -0,0 +1,181 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#include "hci_packet_pool.h"
+#include "hci.h"
+#include <string.h>
+
+#if HCI_PACKET_POOL_BLOCKS > 32
+#error "HCI_PACKET_POOL_BLOCKS must fit the 32 bit free mask"
+#endif
+
+#define ALL_FREE ((uint32_t)((1ULL << HCI_PACKET_POOL_BLOCKS) - 1))
+
+HCI_Packet_Pool_Stats_t hciPacketPoolStats;
+static HCI_Packet_t blocks[HCI_PACKET_POOL_BLOCKS];
+static uint32_t freeMask = ALL_FREE;
+
+/* Event being dispatched, and its pool copy once somebody holds it. */
+static const hci_uart_pckt *current;
+static HCI_Packet_t *currentBlock;
+
+/*****************************************************************************/
+
+static HCI_Packet_t *block_alloc (void)
+{
+        uint32_t mask = __atomic_load_n (&freeMask, __ATOMIC_RELAXED);
+
+        do {
+                if (!mask) {
+                        return NULL;
+                }
+        } while (!__atomic_compare_exchange_n (&freeMask, &mask, mask & (mask - 1), 1, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+
+        uint8_t inUse = HCI_PACKET_POOL_BLOCKS - __builtin_popcount (mask & (mask - 1));
+        hciPacketPoolStats.inUse = inUse;
+
+        if (inUse > hciPacketPoolStats.peakInUse) {
+                hciPacketPoolStats.peakInUse = inUse;
+        }
+
+        return &blocks[__builtin_ctz (mask)];
+}
+
+/*****************************************************************************/
+
+static void block_free (HCI_Packet_t *packet)
+{
+        uint32_t bit = 1UL << (packet - blocks);
+        packet->source = NULL;
+        uint32_t mask = __atomic_or_fetch (&freeMask, bit, __ATOMIC_RELEASE);
+        hciPacketPoolStats.inUse = HCI_PACKET_POOL_BLOCKS - __builtin_popcount (mask);
+}
+
+/*****************************************************************************/
+
+/// A block with one reference holding the len bytes of pckt.
+static HCI_Packet_t *copy (const void *pckt, uint16_t len)
+{
+        HCI_Packet_t *packet = block_alloc ();
+
+        if (!packet) {
+                ++hciPacketPoolStats.exhausted;
+                return NULL;
+        }
+
+        memcpy (packet->data, pckt, len);
+        packet->len = len;
+        packet->refs = 1;
+        packet->source = pckt;
+
+        ++hciPacketPoolStats.holds;
+        ++hciPacketPoolStats.copies;
+        ++hciPacketPoolStats.lengths[(len - 1) * HCI_PACKET_SIZE_BUCKETS / HCI_PACKET_MAX_SIZE];
+
+        if (len > hciPacketPoolStats.maxLength) {
+                hciPacketPoolStats.maxLength = len;
+        }
+
+        return packet;
+}
+
+/*****************************************************************************/
+
+void HCI_Packet_Begin (const void *pckt)
+{
+        current = pckt;
+        currentBlock = NULL;
+
+        /* Copied on the read path already. */
+        for (int i = 0; i < HCI_PACKET_POOL_BLOCKS; ++i) {
+                if (blocks[i].source == pckt) {
+                        currentBlock = &blocks[i];
+                }
+        }
+}
+
+/*****************************************************************************/
+
+void HCI_Packet_End (void)
+{
+        /* The library recycles pckt now : the next event read into it must not find this copy. */
+        if (currentBlock) {
+                const void *source = current;
+                __atomic_compare_exchange_n (&currentBlock->source, &source, NULL, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+        }
+
+        current = NULL;
+        currentBlock = NULL;
+}
+
+/*****************************************************************************/
+
+HCI_Packet_t *HCI_Packet_Hold (void)
+{
+        /* Already copied, unless every holder has released it meanwhile. */
+        if (currentBlock) {
+                uint8_t refs = __atomic_load_n (&currentBlock->refs, __ATOMIC_RELAXED);
+
+                while (refs && !__atomic_compare_exchange_n (&currentBlock->refs, &refs, refs + 1, 1, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+                }
+
+                /* Freed and taken again for another packet in between : not this one. */
+                if (refs && currentBlock->source != current) {
+                        HCI_Packet_Release (currentBlock);
+                        refs = 0;
+                }
+
+                if (refs) {
+                        ++hciPacketPoolStats.holds;
+                        return currentBlock;
+                }
+        }
+
+        if (!current) {
+                return NULL;
+        }
+
+        const hci_event_pckt *event = (const hci_event_pckt *)current->data;
+        currentBlock = copy (current, HCI_TYPE_LEN + HCI_EVENT_HDR_SIZE + event->plen);
+        return currentBlock;
+}
+
+/*****************************************************************************/
+
+HCI_Packet_t *HCI_Packet_Copy (const void *pckt, uint16_t len)
+{
+        /* The library reads into pckt again : what was copied from it before is another packet. */
+        for (int i = 0; i < HCI_PACKET_POOL_BLOCKS; ++i) {
+                if (blocks[i].source == pckt) {
+                        blocks[i].source = NULL;
+                }
+        }
+
+        if (len == 0 || len > HCI_PACKET_MAX_SIZE) {
+                return NULL;
+        }
+
+        return copy (pckt, len);
+}
+
+/*****************************************************************************/
+
+HCI_Packet_t *HCI_Packet_Ref (HCI_Packet_t *packet)
+{
+        __atomic_add_fetch (&packet->refs, 1, __ATOMIC_RELAXED);
+        return packet;
+}
+
+/*****************************************************************************/
+
+void HCI_Packet_Release (HCI_Packet_t *packet)
+{
+        if (__atomic_sub_fetch (&packet->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+                block_free (packet);
+        }
+}
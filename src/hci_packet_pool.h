@@ -0,0 +1,82 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#ifndef HCI_PACKET_POOL_H
+#define HCI_PACKET_POOL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/*
+ * Reference counted pool for received HCI packets.
+ *
+ * The HCI library recycles its read packet as soon as HCI_Event_CB returns.
+ * A handler which wants to keep the event (log it, send it over USB, process it
+ * later) calls HCI_Packet_Hold during dispatch : the first call copies the
+ * packet into a pool block, further calls only take another reference on that
+ * same block. Events nobody holds are never copied. Every holder calls
+ * HCI_Packet_Release when done, the block returns to the pool with the last one.
+ *
+ * The read path may take the packet first : HCI_Packet_Copy copies what the
+ * transport has just read into the library's read packet (btsnoop does, see
+ * hci_btsnoop.h). Dispatching that same read packet later, HCI_Packet_Hold
+ * takes a reference on this copy instead of making another one, for as long as
+ * it is held.
+ *
+ * Hold is for the dispatching (main loop) context, Copy for the read path (the
+ * HCI bottom half), Ref and Release may be called from interrupts as well.
+ */
+
+#ifndef HCI_PACKET_POOL_BLOCKS
+#define HCI_PACKET_POOL_BLOCKS 8 /* at most 32 */
+#endif
+
+/// H4 type, event code, parameter length and up to 255 parameter bytes.
+#define HCI_PACKET_MAX_SIZE (3 + 255)
+#define HCI_PACKET_SIZE_BUCKETS 8
+
+typedef struct {
+        uint8_t data[HCI_PACKET_MAX_SIZE]; /// H4 packet, as passed to HCI_Event_CB.
+        uint16_t len;
+        volatile uint8_t refs;
+        const void *volatile source; /// Library read packet it was copied from, until the library reads into that one again.
+} HCI_Packet_t;
+
+typedef struct {
+        uint32_t holds;     /// Successful HCI_Packet_Hold and HCI_Packet_Copy calls.
+        uint32_t copies;    /// Packets copied into the pool (HCI_Packet_Copy, first hold of an event nobody copied).
+        uint32_t exhausted; /// Holds and copies which failed because every block was in use.
+        uint8_t inUse;
+        uint8_t peakInUse;
+        uint16_t maxLength;
+        /// Lengths of the copied packets, in HCI_PACKET_MAX_SIZE / HCI_PACKET_SIZE_BUCKETS wide buckets.
+        uint32_t lengths[HCI_PACKET_SIZE_BUCKETS];
+} HCI_Packet_Pool_Stats_t;
+
+extern HCI_Packet_Pool_Stats_t hciPacketPoolStats;
+
+/// Marks pckt (library owned) as the event being dispatched. Called by HCI_Event_CB.
+void HCI_Packet_Begin (const void *pckt);
+/// Ends the dispatch started with HCI_Packet_Begin.
+void HCI_Packet_End (void);
+
+/// Takes a reference on the event being dispatched. Returns NULL if the pool is exhausted.
+HCI_Packet_t *HCI_Packet_Hold (void);
+/// Read path : copies the len bytes just read into pckt (library owned), returns it with one reference, or NULL if the pool is exhausted.
+HCI_Packet_t *HCI_Packet_Copy (const void *pckt, uint16_t len);
+HCI_Packet_t *HCI_Packet_Ref (HCI_Packet_t *packet);
+void HCI_Packet_Release (HCI_Packet_t *packet);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HCI_PACKET_POOL_H
@@ -0,0 +1,104 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#include "hci_transport.h"
+#include "stm32_bluenrg_ble.h"
+#include "hci_capture.h"
+#include "hci_btsnoop.h"
+#include "aci_account.h"
+
+#if defined(HOST_BUILD)
+#define DEFAULT_TRANSPORT hciTransportSocket
+#elif defined(HCI_TRANSPORT_UART)
+#define DEFAULT_TRANSPORT hciTransportUart
+#else
+#define DEFAULT_TRANSPORT hciTransportSpi
+#endif
+
+static const HCI_Transport_t *transport = &DEFAULT_TRANSPORT;
+
+/*****************************************************************************/
+
+void HCI_Transport_Set (const HCI_Transport_t *t) { transport = t; }
+
+/*****************************************************************************/
+
+const HCI_Transport_t *HCI_Transport_Get (void) { return transport; }
+
+/*****************************************************************************/
+
+void HCI_Transport_Init (void) { transport->init (); }
+
+/*****************************************************************************/
+
+void HCI_Transport_Reset (void) { transport->reset (); }
+
+/*****************************************************************************/
+/* Entry points used by the HCI library.                                     */
+/*****************************************************************************/
+
+void Hal_Write_Serial (const void *data1, const void *data2, int32_t n_bytes1, int32_t n_bytes2)
+{
+#ifdef HCI_BTSNOOP
+        HCI_Btsnoop_Record (data1, data2, n_bytes1, n_bytes2, 0);
+#endif
+        Aci_Account_Write (n_bytes1 + n_bytes2);
+        transport->write (data1, data2, n_bytes1, n_bytes2);
+}
+
+/*****************************************************************************/
+
+/*
+ * The name is what hci.c calls. hspi is always the library's SpiHandle and is
+ * meaningless for other transports.
+ */
+int32_t BlueNRG_SPI_Read_All (SPI_HandleTypeDef *hspi, uint8_t *buffer, uint8_t buff_size)
+{
+        (void)hspi;
+        int32_t len = transport->read (buffer, buff_size);
+#ifdef HCI_CAPTURE
+        HCI_Capture_Record (buffer, len);
+#endif
+#ifdef HCI_BTSNOOP
+        HCI_Btsnoop_Record (buffer, NULL, len, 0, 1);
+#endif
+        Aci_Account_Read (len);
+        return len;
+}
+
+/*****************************************************************************/
+
+uint8_t BlueNRG_DataPresent (void) { return transport->dataPresent (); }
+
+/*****************************************************************************/
+
+void Enable_SPI_IRQ (void) { transport->enableIrq (); }
+
+/*****************************************************************************/
+
+void Disable_SPI_IRQ (void) { transport->disableIrq (); }
+
+#ifdef HOST_BUILD
+/*****************************************************************************/
+/* What stm32_bluenrg_ble.cc provides the library with on target.           */
+/*****************************************************************************/
+
+SPI_HandleTypeDef SpiHandle;
+
+/*****************************************************************************/
+
+void Clear_SPI_EXTI_Flag (void) {}
+
+/*****************************************************************************/
+
+void BlueNRG_RST (void) { HCI_Transport_Reset (); }
+
+/*****************************************************************************/
+
+void BlueNRG_HW_Bootloader (void) {}
+#endif
@@ -0,0 +1,63 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#ifndef HCI_TRANSPORT_H
+#define HCI_TRANSPORT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/**
+ * Link between the HCI library and the controller. The library only sees
+ * Hal_Write_Serial, BlueNRG_SPI_Read_All, BlueNRG_DataPresent and
+ * Enable_SPI_IRQ / Disable_SPI_IRQ; hci_transport.c forwards those to the
+ * active transport. Packets are H4 framed in both directions (first byte is
+ * the packet type), which is what the library produces and expects.
+ */
+typedef struct {
+        const char *name;
+        void (*init) (void);
+        void (*reset) (void);
+        void (*write) (const void *data1, const void *data2, int32_t n_bytes1, int32_t n_bytes2);
+        /// Reads one packet, returns its length or 0.
+        int32_t (*read) (uint8_t *buffer, uint8_t buff_size);
+        uint8_t (*dataPresent) (void);
+        /// Masks / unmasks the "data ready" notification (IRQ), as the library expects.
+        void (*enableIrq) (void);
+        void (*disableIrq) (void);
+} HCI_Transport_t;
+
+/// Current BlueNRG SPI driver (stm32_bluenrg_ble.cc).
+extern const HCI_Transport_t hciTransportSpi;
+
+#ifdef HCI_TRANSPORT_UART
+/// H4 over UART, for modules running the UART network-processor firmware.
+extern const HCI_Transport_t hciTransportUart;
+void HCI_Transport_Uart_Isr (void);
+#endif
+
+#ifdef HOST_BUILD
+/// H4 over a Unix domain socket, for host builds talking to a controller stand-in.
+extern const HCI_Transport_t hciTransportSocket;
+/// Simulated BlueNRG-MS on the virtual clock, see sim_controller.h.
+extern const HCI_Transport_t hciTransportSim;
+#endif
+
+void HCI_Transport_Set (const HCI_Transport_t *transport);
+const HCI_Transport_t *HCI_Transport_Get (void);
+void HCI_Transport_Init (void);
+void HCI_Transport_Reset (void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HCI_TRANSPORT_H
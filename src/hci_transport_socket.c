@@ -0,0 +1,181 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#ifdef HOST_BUILD
+#include "hci_transport.h"
+#include "hci.h"
+#include "virtual_clock.h"
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/*
+ * H4 over a Unix domain (stream) socket, for host builds. The controller
+ * stand-in listens on $BNRG_SOCKET (default below). A reader thread plays the
+ * role of the EXTI interrupt : it calls HCI_Isr whenever an event is waiting.
+ * Masking the "IRQ" is emulated with a mutex held by the masking thread, calls
+ * made from within HCI_Isr itself are no-ops, as they are on target. The peer
+ * answers in real time, so the clock is switched to it (VClock_Real_Time).
+ */
+
+#define DEFAULT_SOCKET_PATH "/tmp/bluenrg.sock"
+#define H4_EVENT_HEADER_SIZE 3 /* packet type, event code, parameter length */
+
+static int sock = -1;
+static pthread_t isrThread;
+static pthread_mutex_t irqMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*****************************************************************************/
+
+static int in_isr (void) { return pthread_equal (pthread_self (), isrThread); }
+
+/*****************************************************************************/
+
+static int read_exact (uint8_t *buffer, size_t len)
+{
+        while (len > 0) {
+                ssize_t r = recv (sock, buffer, len, 0);
+
+                if (r <= 0) {
+                        return -1;
+                }
+
+                buffer += r;
+                len -= r;
+        }
+
+        return 0;
+}
+
+/*****************************************************************************/
+
+static uint8_t socket_data_present (void)
+{
+        struct pollfd pfd = { sock, POLLIN, 0 };
+        return poll (&pfd, 1, 0) > 0 && (pfd.revents & POLLIN);
+}
+
+/*****************************************************************************/
+
+static void *isr_thread (void *arg)
+{
+        (void)arg;
+
+        while (1) {
+                struct pollfd pfd = { sock, POLLIN, 0 };
+
+                if (poll (&pfd, 1, -1) < 0 || (pfd.revents & (POLLHUP | POLLERR))) {
+                        return NULL;
+                }
+
+                pthread_mutex_lock (&irqMutex);
+                HCI_Isr ();
+                pthread_mutex_unlock (&irqMutex);
+
+                /* HCI_Isr leaves data unread when the library runs out of packets. */
+                if (socket_data_present ()) {
+                        usleep (100);
+                }
+        }
+}
+
+/*****************************************************************************/
+
+static void socket_init (void)
+{
+        struct sockaddr_un addr;
+        const char *path = getenv ("BNRG_SOCKET");
+
+        memset (&addr, 0, sizeof (addr));
+        addr.sun_family = AF_UNIX;
+        strncpy (addr.sun_path, (path) ? (path) : (DEFAULT_SOCKET_PATH), sizeof (addr.sun_path) - 1);
+
+        sock = socket (AF_UNIX, SOCK_STREAM, 0);
+
+        if (sock < 0 || connect (sock, (struct sockaddr *)&addr, sizeof (addr)) < 0) {
+                perror ("HCI socket transport");
+                exit (1);
+        }
+
+        VClock_Real_Time ();
+        pthread_create (&isrThread, NULL, isr_thread, NULL);
+}
+
+/*****************************************************************************/
+
+static void socket_reset (void)
+{
+        /* The stand-in starts from reset state on every connection. */
+}
+
+/*****************************************************************************/
+
+static void socket_write (const void *data1, const void *data2, int32_t n_bytes1, int32_t n_bytes2)
+{
+        struct iovec iov[2] = { { (void *)data1, (size_t)n_bytes1 }, { (void *)data2, (size_t)n_bytes2 } };
+
+        if (writev (sock, iov, 2) < 0) {
+                perror ("HCI socket transport");
+        }
+}
+
+/*****************************************************************************/
+
+static int32_t socket_read (uint8_t *buffer, uint8_t buff_size)
+{
+        uint8_t packet[H4_EVENT_HEADER_SIZE + 255];
+
+        if (!socket_data_present () || read_exact (packet, H4_EVENT_HEADER_SIZE) < 0) {
+                return 0;
+        }
+
+        uint16_t len = H4_EVENT_HEADER_SIZE + packet[2];
+
+        if (read_exact (packet + H4_EVENT_HEADER_SIZE, packet[2]) < 0) {
+                return 0;
+        }
+
+        /* avoid to read more data that size of the buffer */
+        if (len > buff_size) {
+                len = buff_size;
+        }
+
+        memcpy (buffer, packet, len);
+        return len;
+}
+
+/*****************************************************************************/
+
+static void socket_enable_irq (void)
+{
+        if (!in_isr ()) {
+                pthread_mutex_unlock (&irqMutex);
+        }
+}
+
+/*****************************************************************************/
+
+static void socket_disable_irq (void)
+{
+        if (!in_isr ()) {
+                pthread_mutex_lock (&irqMutex);
+        }
+}
+
+/*****************************************************************************/
+
+const HCI_Transport_t hciTransportSocket = { "socket", socket_init, socket_reset, socket_write, socket_read, socket_data_present, socket_enable_irq,
+                                             socket_disable_irq };
+
+#endif /* HOST_BUILD */
@@ -0,0 +1,241 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#ifdef HCI_TRANSPORT_UART
+#include "hci_transport.h"
+#include "stm32_bluenrg_ble.h"
+#include "irq_priorities.h"
+#include "hci_bottom_half.h"
+
+/*
+ * H4 over UART. Bytes are received in the UART IRQ into a ring buffer and split
+ * into packets there. Once a whole event is in, the IRQ schedules the HCI
+ * bottom half (hci_bottom_half.h), which calls HCI_Isr just like it does for
+ * SPI, and HCI_Isr pulls the packets with uart_read.
+ *
+ * The IRQ is the only writer of rxHead, packetStart and packetsIn, the main
+ * loop / bottom half the only writer of rxTail and packetsOut, so neither side
+ * needs to mask the other. Masking the "data ready" notification (the
+ * library's Disable_SPI_IRQ) holds off the bottom half only : reception goes
+ * on meanwhile.
+ */
+
+#define RX_BUFFER_SIZE 1024 /* power of 2 */
+#define RX_MASK (RX_BUFFER_SIZE - 1)
+#define H4_EVENT_PKT 0x04
+#define H4_EVENT_HEADER_SIZE 3 /* packet type, event code, parameter length */
+#define TX_TIMEOUT 100
+
+static UART_HandleTypeDef uartHandle;
+static uint8_t rxBuffer[RX_BUFFER_SIZE];
+static volatile uint16_t rxHead;     /* IRQ : end of the bytes received. */
+static volatile uint16_t rxTail;     /* Consumer : start of the oldest packet not read. */
+static uint16_t packetStart;         /* IRQ : first byte of the packet being received. */
+static volatile uint8_t packetsIn;   /* IRQ : whole packets received, wraps. */
+static volatile uint8_t packetsOut;  /* Consumer : packets read, wraps. */
+static uint8_t headerPos;
+static uint16_t payloadRemaining;
+static uint8_t dropping;             /* The rest of the current packet is skipped. */
+
+/// Number of packets dropped because the ring buffer was full or the UART overran.
+uint32_t hciUartOverruns;
+
+/*****************************************************************************/
+
+static uint8_t packets_ready (void) { return (uint8_t)(packetsIn - packetsOut); }
+
+/*****************************************************************************/
+
+static void uart_init (void)
+{
+        uartHandle.Instance = BNRG_UART_INSTANCE;
+        uartHandle.Init.BaudRate = BNRG_UART_BAUDRATE;
+        uartHandle.Init.WordLength = UART_WORDLENGTH_8B;
+        uartHandle.Init.StopBits = UART_STOPBITS_1;
+        uartHandle.Init.Parity = UART_PARITY_NONE;
+        uartHandle.Init.Mode = UART_MODE_TX_RX;
+        uartHandle.Init.HwFlowCtl = UART_HWCONTROL_NONE;
+        uartHandle.Init.OverSampling = UART_OVERSAMPLING_16;
+        HAL_UART_Init (&uartHandle);
+
+        BNRG_UART_INSTANCE->CR1 |= USART_CR1_RXNEIE;
+        HAL_NVIC_SetPriority (BNRG_UART_IRQn, IRQ_PRIORITY_BNRG_EXTI, 0);
+        HAL_NVIC_EnableIRQ (BNRG_UART_IRQn);
+}
+
+/*****************************************************************************/
+
+static void uart_write (const void *data1, const void *data2, int32_t n_bytes1, int32_t n_bytes2)
+{
+        if (n_bytes1 > 0) {
+                HAL_UART_Transmit (&uartHandle, (uint8_t *)data1, n_bytes1, TX_TIMEOUT);
+        }
+
+        if (n_bytes2 > 0) {
+                HAL_UART_Transmit (&uartHandle, (uint8_t *)data2, n_bytes2, TX_TIMEOUT);
+        }
+}
+
+/*****************************************************************************/
+
+static int32_t uart_read (uint8_t *buffer, uint8_t buff_size)
+{
+        if (!packets_ready ()) {
+                return 0;
+        }
+
+        /* The packet's bytes were written before packetsIn was. */
+        __DMB ();
+
+        uint16_t tail = rxTail;
+        uint16_t len = H4_EVENT_HEADER_SIZE + rxBuffer[(tail + 2) & RX_MASK];
+        int32_t copied = 0;
+
+        for (uint16_t i = 0; i < len; ++i) {
+                /* avoid to read more data that size of the buffer */
+                if (i < buff_size) {
+                        buffer[copied++] = rxBuffer[(tail + i) & RX_MASK];
+                }
+        }
+
+        /* The IRQ may reuse the space once rxTail has moved. */
+        __DMB ();
+        rxTail = (tail + len) & RX_MASK;
+        ++packetsOut;
+        return copied;
+}
+
+/*****************************************************************************/
+
+static uint8_t uart_data_present (void) { return packets_ready () > 0; }
+
+/*****************************************************************************/
+
+static void uart_enable_irq (void) { HCI_Bottom_Half_Unmask (); }
+
+/*****************************************************************************/
+
+static void uart_disable_irq (void) { HCI_Bottom_Half_Mask (); }
+
+/*****************************************************************************/
+
+/// Drops the packet being received : its bytes so far, and the rest once they come.
+static void drop_packet (void)
+{
+        ++hciUartOverruns;
+        rxHead = packetStart;
+        dropping = (headerPos > 0);
+}
+
+/*****************************************************************************/
+
+static void rx_byte (uint8_t b)
+{
+        if (headerPos == 0 && b != H4_EVENT_PKT) {
+                /* Out of sync, wait for the next event packet. */
+                return;
+        }
+
+        if (!dropping) {
+                uint16_t next = (rxHead + 1) & RX_MASK;
+
+                if (next == rxTail) {
+                        /* Full : the packets already complete stay, this one is lost. */
+                        drop_packet ();
+                        dropping = 1;
+                }
+                else {
+                        rxBuffer[rxHead] = b;
+                        rxHead = next;
+                }
+        }
+
+        if (headerPos < H4_EVENT_HEADER_SIZE) {
+                if (++headerPos < H4_EVENT_HEADER_SIZE) {
+                        return;
+                }
+
+                payloadRemaining = b;
+        }
+        else {
+                --payloadRemaining;
+        }
+
+        if (payloadRemaining > 0) {
+                return;
+        }
+
+        headerPos = 0;
+
+        if (dropping) {
+                dropping = 0;
+                rxHead = packetStart;
+                return;
+        }
+
+        packetStart = rxHead;
+        /* The consumer reads the bytes once it sees packetsIn move. */
+        __DMB ();
+        ++packetsIn;
+        HCI_Bottom_Half_Schedule ();
+}
+
+/*****************************************************************************/
+
+void HCI_Transport_Uart_Isr (void)
+{
+        uint32_t isr = BNRG_UART_INSTANCE->ISR;
+
+        if (isr & USART_ISR_ORE) {
+                /* A byte is lost, the packet it belonged to is useless. */
+                BNRG_UART_INSTANCE->ICR = USART_ICR_ORECF;
+
+                if (headerPos > 0 && !dropping) {
+                        drop_packet ();
+                }
+        }
+
+        if (isr & USART_ISR_RXNE) {
+                rx_byte (BNRG_UART_INSTANCE->RDR);
+        }
+}
+
+/*****************************************************************************/
+
+void HAL_UART_MspInit (UART_HandleTypeDef *huart)
+{
+        GPIO_InitTypeDef GPIO_InitStruct;
+
+        if (huart->Instance != BNRG_UART_INSTANCE) {
+                return;
+        }
+
+        BNRG_UART_PORT_CLK_ENABLE ();
+        BNRG_SPI_RESET_CLK_ENABLE ();
+        BNRG_UART_CLK_ENABLE ();
+
+        GPIO_InitStruct.Pin = BNRG_UART_TX_PIN | BNRG_UART_RX_PIN;
+        GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
+        GPIO_InitStruct.Pull = GPIO_PULLUP;
+        GPIO_InitStruct.Speed = GPIO_SPEED_HIGH;
+        GPIO_InitStruct.Alternate = BNRG_UART_ALTERNATE;
+        HAL_GPIO_Init (BNRG_UART_PORT, &GPIO_InitStruct);
+
+        GPIO_InitStruct.Pin = BNRG_SPI_RESET_PIN;
+        GPIO_InitStruct.Mode = BNRG_SPI_RESET_MODE;
+        GPIO_InitStruct.Pull = BNRG_SPI_RESET_PULL;
+        GPIO_InitStruct.Speed = BNRG_SPI_RESET_SPEED;
+        GPIO_InitStruct.Alternate = BNRG_SPI_RESET_ALTERNATE;
+        HAL_GPIO_Init (BNRG_SPI_RESET_PORT, &GPIO_InitStruct);
+}
+
+/*****************************************************************************/
+
+const HCI_Transport_t hciTransportUart = { "uart", uart_init, BlueNRG_RST, uart_write, uart_read, uart_data_present, uart_enable_irq, uart_disable_irq };
+
+#endif /* HCI_TRANSPORT_UART */
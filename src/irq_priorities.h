@@ -0,0 +1,32 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#ifndef IRQ_PRIORITIES_H
+#define IRQ_PRIORITIES_H
+
+/*
+ * Interrupt priority plan. HAL_Init selects NVIC_PRIORITYGROUP_4, so all 4 bits
+ * are preemption priority (0 = most urgent). Pure defines only - this file is
+ * included from stm32f7xx_hal_conf.h.
+ *
+ * The BlueNRG SPI session (header + payload) is guarded by raising BASEPRI to
+ * IRQ_PRIORITY_BNRG_EXTI, which holds off the BlueNRG EXTI (the only thing that
+ * may start another SPI transaction) and everything less urgent. USB and SysTick
+ * sit above it and keep running during the transfer. The transfer itself runs
+ * in the HCI bottom half (PendSV, see hci_bottom_half.h), below everything.
+ */
+#define IRQ_PRIORITY_USB 1
+#define IRQ_PRIORITY_SYSTICK 2
+#define IRQ_PRIORITY_BNRG_EXTI 5
+/// PendSV, running the BlueNRG SPI reads. Lowest, so it never delays anything but the main loop.
+#define IRQ_PRIORITY_HCI_BOTTOM_HALF 15
+
+/// Value for BASEPRI that masks IRQs with priority numerically >= prio.
+#define IRQ_PRIORITY_TO_BASEPRI(prio) ((prio) << (8 - __NVIC_PRIO_BITS))
+
+#endif // IRQ_PRIORITIES_H
@@ -8,13 +8,14 @@
 
 #include <stm32f7xx_hal.h>
 #include "errorHandler.h"
-extern "C" {
-#include "osal.h"
-}
-#include "sensor_service.h"
+#include "sensor_app.h"
 #include "debug.h"
 #include "stm32_bluenrg_ble.h"
-#include "bluenrg_utils.h"
+#include "irq_priorities.h"
+#include "hci_capture.h"
+#include "hci_btsnoop.h"
+#include "cycle_counter.h"
+#include "Gpio.h"
 
 #include "ioBuffer/IoBuffer.h"
 #include "usb/Usb.h"
@@ -22,15 +23,13 @@ extern "C" {
 
 #include <cstdio>
 
-#define BDADDR_SIZE 6
-
-extern volatile uint8_t set_connectable;
-extern volatile int connected;
-extern AxesRaw_t axes_data;
-uint8_t bnrg_expansion_board = IDB04A1; /* at startup, suppose the X-NUCLEO-IDB04A1 is used */
-
-void User_Process (AxesRaw_t *p_axes);
 static void systemClockConfig ();
+#ifdef HCI_BTSNOOP
+static void btsnoopFlush (IoBuffer &buffer);
+#endif
+#ifdef HCI_CAPTURE
+static void replayTrigger ();
+#endif
 
 /*****************************************************************************/
 
@@ -41,15 +40,9 @@ static void MPU_Config (void);
 
 int main (void)
 {
-        const char *name = "ZlaSuka";
-        uint8_t SERVER_BDADDR[] = { 0x12, 0x34, 0x00, 0xE1, 0x80, 0x03 };
-        uint8_t bdaddr[BDADDR_SIZE];
-        uint16_t service_handle, dev_name_char_handle, appearance_char_handle;
-
         uint8_t hwVersion;
         uint16_t fwVersion;
 
-        int ret;
         /* Configure the MPU attributes as Write Through */
         MPU_Config ();
 
@@ -66,167 +59,101 @@ int main (void)
         /* Configure the system clock */
         systemClockConfig ();
 
+        /* Timing statistics (SPI, bottom half, reads, replay) read the cycle counter. */
+        Cycle_Counter_Init ();
+
         IoBuffer usbBuffer (1024);
         Usb usb (&usbBuffer);
         Debug debug (&usbBuffer);
         usb.init ();
+        /* USB must preempt the BlueNRG SPI session, see irq_priorities.h */
+        HAL_NVIC_SetPriority (OTG_FS_IRQn, IRQ_PRIORITY_USB, 0);
+        HAL_NVIC_SetPriority (PendSV_IRQn, IRQ_PRIORITY_HCI_BOTTOM_HALF, 0);
         debug.log (1, MICRO_STRING, "µC Initialized");
         HAL_Delay (100);
 
-        /* Initialize the BlueNRG SPI driver */
-        BNRG_SPI_Init ();
-
-        /* Initialize the BlueNRG HCI */
-        HCI_Init ();
-
-        /* Reset BlueNRG hardware */
-        BlueNRG_RST ();
-
-        /* get the BlueNRG HW and FW versions */
-        getBlueNRGVersion (&hwVersion, &fwVersion);
-
-        /*
-         * Reset BlueNRG again otherwise we won't
-         * be able to change its MAC address.
-         * aci_hal_write_config_data() must be the first
-         * command after reset otherwise it will fail.
-         */
-        BlueNRG_RST ();
+        /* BlueNRG stack, services and event masks */
+        Sensor_App_Init (&hwVersion, &fwVersion);
 
         debug.log (2, MICRO_UINT_8, &hwVersion);
         debug.log (3, MICRO_UINT_16, &fwVersion);
+        debug.log (1, MICRO_STRING, "BlueNRG ready");
 
-        if (hwVersion > 0x30) { /* X-NUCLEO-IDB05A1 expansion board is used */
-                bnrg_expansion_board = IDB05A1;
-                /*
-                 * Change the MAC address to avoid issues with Android cache:
-                 * if different boards have the same MAC address, Android
-                 * applications unless you restart Bluetooth on tablet/phone
-                 */
-                SERVER_BDADDR[5] = 0x02;
-        }
-
-        /* The Nucleo board must be configured as SERVER */
-        Osal_MemCpy (bdaddr, SERVER_BDADDR, sizeof (SERVER_BDADDR));
-
-        ret = aci_hal_write_config_data (CONFIG_DATA_PUBADDR_OFFSET, CONFIG_DATA_PUBADDR_LEN, bdaddr);
-
-        if (ret) {
-                printf ("Setting BD_ADDR failed.\n");
-        }
-
-        ret = aci_gatt_init ();
-
-        if (ret) {
-                printf ("GATT_Init failed.\n");
-        }
-
-        if (bnrg_expansion_board == IDB05A1) {
-                ret = aci_gap_init_IDB05A1 (GAP_PERIPHERAL_ROLE_IDB05A1, 0, 0x07, &service_handle, &dev_name_char_handle, &appearance_char_handle);
-        }
-        else {
-                ret = aci_gap_init_IDB04A1 (GAP_PERIPHERAL_ROLE_IDB04A1, &service_handle, &dev_name_char_handle, &appearance_char_handle);
-        }
-
-        if (ret != BLE_STATUS_SUCCESS) {
-                printf ("GAP_Init failed.\n");
-        }
-
-        ret = aci_gatt_update_char_value (service_handle, dev_name_char_handle, 0, strlen (name), (uint8_t *)name);
-
-        if (ret) {
-                printf ("aci_gatt_update_char_value failed.\n");
-                while (1)
-                        ;
-        }
-
-        ret = aci_gap_set_auth_requirement (MITM_PROTECTION_REQUIRED, OOB_AUTH_DATA_ABSENT, NULL, 7, 16, USE_FIXED_PIN_FOR_PAIRING, 123456, BONDING);
-        if (ret == BLE_STATUS_SUCCESS) {
-                printf ("BLE Stack Initialized.\n");
-        }
-
-        printf ("SERVER: BLE Stack Initialized\n");
-
-        ret = Add_Acc_Service ();
-
-        if (ret == BLE_STATUS_SUCCESS)
-                printf ("Acc service added successfully.\n");
-        else
-                printf ("Error while adding Acc service.\n");
-
-        ret = Add_Environmental_Sensor_Service ();
-
-        if (ret == BLE_STATUS_SUCCESS)
-                printf ("Environmental Sensor service added successfully.\n");
-        else
-                printf ("Error while adding Environmental Sensor service.\n");
-
-#if NEW_SERVICES
-        /* Instantiate Timer Service with two characteristics:
-         * - seconds characteristic (Readable only)
-         * - minutes characteristics (Readable and Notifiable )
-         */
-        ret = Add_Time_Service ();
-
-        if (ret == BLE_STATUS_SUCCESS)
-                printf ("Time service added successfully.\n");
-        else
-                printf ("Error while adding Time service.\n");
-
-        /* Instantiate LED Button Service with one characteristic:
-         * - LED characteristic (Readable and Writable)
-         */
-        ret = Add_LED_Service ();
-
-        if (ret == BLE_STATUS_SUCCESS)
-                printf ("LED service added successfully.\n");
-        else
-                printf ("Error while adding LED service.\n");
+#ifdef HCI_CAPTURE
+        /* Replaying needs the responses to the initialization commands out of the capture. */
+        HCI_Capture_Start ();
+
+        /* USER button, replayTrigger. */
+        PUSH_BUTTON_CLK_ENABLE ();
+        GPIO_InitTypeDef button = {};
+        button.Pin = PUSH_BUTTON_PIN;
+        button.Mode = PUSH_BUTTON_MODE;
+        button.Pull = PUSH_BUTTON_PULL;
+        button.Speed = PUSH_BUTTON_SPEED;
+        HAL_GPIO_Init (PUSH_BUTTON_PORT, &button);
 #endif
 
-        /* Set output power level */
-        ret = aci_hal_set_tx_power_level (1, 4);
-
-        debug.log (1, MICRO_STRING, "BlueNRG ready");
+#ifdef HCI_BTSNOOP
+        /* From here on the USB channel carries the btsnoop stream only (tools/btsnoop.py), printf output is dropped. */
+        HCI_Btsnoop_Start ();
+#endif
 
         while (1) {
-                HCI_Process ();
-                User_Process (&axes_data);
-#if NEW_SERVICES
-                Update_Time_Characteristics ();
+#ifdef HCI_CAPTURE
+                replayTrigger ();
+#endif
+                Sensor_App_Process ();
+#ifdef HCI_BTSNOOP
+                btsnoopFlush (usbBuffer);
 #endif
         }
 }
 
+#ifdef HCI_BTSNOOP
 /**
- * @brief  Process user input (i.e. pressing the USER button on Nucleo board)
- *         and send the updated acceleration data to the remote client.
- *
- * @param  AxesRaw_t* p_axes
- * @retval None
+ * @brief  Moves what fits of the btsnoop stream to the USB buffer, piece by piece
+ *         (ring bytes and held packets). Never waits, the ring drops (and counts)
+ *         records when USB does not keep up.
  */
-void User_Process (AxesRaw_t *p_axes)
+static void btsnoopFlush (IoBuffer &buffer)
 {
-        if (set_connectable) {
-                setConnectable ();
-                set_connectable = FALSE;
-        }
+        const uint8_t *data;
+        uint32_t n;
 
-        static int i = 0;
+        while ((n = HCI_Btsnoop_Peek (&data)) > 0) {
+                uint32_t i = 0;
+
+                while (i < n && buffer.push (data[i])) {
+                        ++i;
+                }
 
-        if (++i > 1000000) {
-                i = 0;
+                HCI_Btsnoop_Consume (i);
 
-                if (connected) {
-                        /* Update acceleration data */
-                        p_axes->AXIS_X += 100;
-                        p_axes->AXIS_Y += 100;
-                        p_axes->AXIS_Z += 100;
-                        // printf("ACC: X=%6d Y=%6d Z=%6d\r\n", p_axes->AXIS_X, p_axes->AXIS_Y, p_axes->AXIS_Z);
-                        Acc_Update (p_axes);
+                if (i < n) {
+                        break;
                 }
         }
 }
+#endif
+
+#ifdef HCI_CAPTURE
+/**
+ * @brief  USER button (PUSH_BUTTON_PIN, high when pressed) : replays what has
+ *         been captured so far, as fast as the main loop takes it. The report
+ *         is printed once the replay is over.
+ */
+static void replayTrigger ()
+{
+        static bool wasPressed;
+        bool pressed = GpioPort<PUSH_BUTTON_PORT_BASE>::read (PUSH_BUTTON_PIN);
+
+        if (pressed && !wasPressed) {
+                HCI_Replay_Start (NULL, 0, 0);
+        }
+
+        wasPressed = pressed;
+}
+#endif
 
 /*****************************************************************************/
 
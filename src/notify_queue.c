@@ -0,0 +1,269 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#include "notify_queue.h"
+#include "ble_status.h"
+#include "hci_const.h"
+#include "bluenrg_aci_const.h"
+#include <string.h>
+
+#define MASK (NOTIFY_QUEUE_SIZE - 1)
+
+/*****************************************************************************/
+
+static void store_le_16 (uint8_t *p, uint16_t v)
+{
+        p[0] = v;
+        p[1] = v >> 8;
+}
+
+/*****************************************************************************/
+
+/// Runs the barriers head has reached.
+static void run_barriers (Notify_Queue_t *q)
+{
+        while (q->barrierCount && (int8_t)(q->head - q->barriers[0].mark) >= 0) {
+                Notify_Queue_Barrier_Entry_t b = q->barriers[0];
+
+                --q->barrierCount;
+                memmove (q->barriers, q->barriers + 1, q->barrierCount * sizeof (b));
+                b.callback (b.context);
+        }
+}
+
+/*****************************************************************************/
+
+static void on_update_done (void *context, uint8_t status, const uint8_t *ret, uint8_t retLen);
+
+/// Reserves the aci_async slot of an update, NULL if there is none free.
+static uint8_t *begin (Notify_Queue_t *q, uint8_t len)
+{
+        /* aci_gatt_update_char_value parameters : service, characteristic, offset, length, value. */
+        return Aci_Cmd_Begin (OGF_VENDOR_CMD, OCF_GATT_UPD_CHAR_VAL, 6 + len, on_update_done, q);
+}
+
+/*****************************************************************************/
+
+/// Writes the parameters of e with value into the slot begin returned, and sends them.
+static void commit (Notify_Queue_t *q, uint8_t *params, const Notify_Queue_Entry_t *e, const void *value)
+{
+        store_le_16 (params, e->servHandle);
+        store_le_16 (params + 2, e->charHandle);
+        params[4] = 0;
+        params[5] = e->len;
+        memcpy (params + 6, value, e->len);
+        q->inFlight = 1;
+        Aci_Cmd_Commit ();
+}
+
+/*****************************************************************************/
+
+static void retry_later (Notify_Queue_t *q)
+{
+        if (!Timer_Wheel_Running (&q->timer)) {
+                Timer_Wheel_Start (&q->timer, NOTIFY_QUEUE_RETRY, 0);
+        }
+}
+
+/*****************************************************************************/
+
+/// Sends the oldest update, unless it is in flight already or the controller is full.
+static void pump (Notify_Queue_t *q)
+{
+        if (q->inFlight || q->paused || !Notify_Queue_Count (q)) {
+                return;
+        }
+
+        const Notify_Queue_Entry_t *e = &q->entries[q->head & MASK];
+        uint8_t *params = begin (q, e->len);
+
+        if (!params) {
+                retry_later (q);
+                return;
+        }
+
+        commit (q, params, e, e->value);
+}
+
+/*****************************************************************************/
+
+static void on_update_done (void *context, uint8_t status, const uint8_t *ret, uint8_t retLen)
+{
+        Notify_Queue_t *q = context;
+        Notify_Queue_Entry_t *e = &q->entries[q->head & MASK];
+
+        q->inFlight = 0;
+
+        /* Kept at the head, it goes first once the controller has room. Sent by Notify_Queue_Push itself, its value is in the slot only. */
+        if (status == BLE_STATUS_INSUFFICIENT_RESOURCES) {
+                if (!e->queued) {
+                        memcpy (e->value, Aci_Async_Callback_Params () + 6, e->len);
+                        e->queued = 1;
+                }
+
+                ++q->stats.refused;
+                Notify_Queue_Pause (q);
+                return;
+        }
+
+        if (status == BLE_STATUS_SUCCESS) {
+                ++q->stats.accepted;
+                ++q->burst;
+        }
+        else {
+                ++q->stats.failed;
+        }
+
+        /* The slot is free before the callback runs, it may queue the next update. */
+        Aci_Async_Callback_t done = e->done;
+        void *doneContext = e->context;
+        ++q->head;
+
+        if (done) {
+                done (doneContext, status, ret, retLen);
+        }
+
+        run_barriers (q);
+        pump (q);
+}
+
+/*****************************************************************************/
+
+static void on_timer (void *arg)
+{
+        Notify_Queue_t *q = arg;
+
+        if (q->paused) {
+                q->paused = 0;
+                ++q->stats.timeouts;
+        }
+
+        pump (q);
+}
+
+/*****************************************************************************/
+
+void Notify_Queue_Init (Notify_Queue_t *queue)
+{
+        queue->head = queue->tail = 0;
+        queue->inFlight = 0;
+        queue->paused = 0;
+        queue->burst = 0;
+        queue->barrierCount = 0;
+        memset (&queue->stats, 0, sizeof (queue->stats));
+        Timer_Wheel_Init_Timer (&queue->timer, on_timer, queue);
+}
+
+/*****************************************************************************/
+
+int Notify_Queue_Push (Notify_Queue_t *queue, uint16_t servHandle, uint16_t charHandle, const void *value, uint8_t len, Aci_Async_Callback_t done,
+                       void *context)
+{
+        if (Notify_Queue_Count (queue) == NOTIFY_QUEUE_SIZE || len > NOTIFY_QUEUE_MAX_VALUE) {
+                ++queue->stats.full;
+                return -1;
+        }
+
+        Notify_Queue_Entry_t *e = &queue->entries[queue->tail & MASK];
+        e->servHandle = servHandle;
+        e->charHandle = charHandle;
+        e->len = len;
+        e->done = done;
+        e->context = context;
+        ++queue->tail;
+        ++queue->stats.queued;
+
+        if (Notify_Queue_Count (queue) > queue->stats.depthMax) {
+                queue->stats.depthMax = Notify_Queue_Count (queue);
+        }
+
+        /* Nothing ahead of it : built in the command slot, the entry only keeps track of it. */
+        uint8_t first = (Notify_Queue_Count (queue) == 1 && !queue->paused);
+        uint8_t *params = (first) ? (begin (queue, len)) : (NULL);
+
+        if (params) {
+                e->queued = 0;
+                ++queue->stats.direct;
+                commit (queue, params, e, value);
+                return 0;
+        }
+
+        e->queued = 1;
+        memcpy (e->value, value, len);
+
+        if (first) {
+                retry_later (queue);
+        }
+
+        return 0;
+}
+
+/*****************************************************************************/
+
+void Notify_Queue_Pause (Notify_Queue_t *queue)
+{
+        if (queue->burst > queue->stats.burstMax) {
+                queue->stats.burstMax = queue->burst;
+        }
+
+        queue->burst = 0;
+        queue->paused = 1;
+        Timer_Wheel_Start (&queue->timer, NOTIFY_QUEUE_PAUSE_TIMEOUT, 0);
+}
+
+/*****************************************************************************/
+
+void Notify_Queue_Resume (Notify_Queue_t *queue)
+{
+        if (!queue->paused) {
+                return;
+        }
+
+        queue->paused = 0;
+        ++queue->stats.resumes;
+        Timer_Wheel_Stop (&queue->timer);
+        pump (queue);
+}
+
+/*****************************************************************************/
+
+int Notify_Queue_When_Sent (Notify_Queue_t *queue, Notify_Queue_Barrier_t callback, void *context)
+{
+        if (!Notify_Queue_Count (queue)) {
+                callback (context);
+                return 0;
+        }
+
+        if (queue->barrierCount >= NOTIFY_QUEUE_BARRIERS) {
+                return -1;
+        }
+
+        Notify_Queue_Barrier_Entry_t *b = &queue->barriers[queue->barrierCount++];
+        b->mark = queue->tail;
+        b->callback = callback;
+        b->context = context;
+        return 0;
+}
+
+/*****************************************************************************/
+
+void Notify_Queue_Reset (Notify_Queue_t *queue)
+{
+        queue->tail = queue->head + queue->inFlight;
+        queue->paused = 0;
+        Timer_Wheel_Stop (&queue->timer);
+
+        /* Their updates are gone, they wait for the one in flight at most. */
+        for (uint8_t i = 0; i < queue->barrierCount; ++i) {
+                if ((int8_t)(queue->barriers[i].mark - queue->tail) > 0) {
+                        queue->barriers[i].mark = queue->tail;
+                }
+        }
+
+        run_barriers (queue);
+}
@@ -0,0 +1,146 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#ifndef NOTIFY_QUEUE_H
+#define NOTIFY_QUEUE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "aci_async.h"
+#include "timer_wheel.h"
+#include <stdint.h>
+
+/*
+ * Characteristic updates, kept until the controller has taken them. One queue
+ * serves every connection : an update is one command whatever the number of
+ * clients, the controller notifies each subscribed one over its own link.
+ * So is the accounting : the controller reports neither per link TX buffer
+ * use nor per link completions of notifications (EVT_BLUE_GATT_TX_POOL_AVAILABLE
+ * is global), so nothing here is counted per connection.
+ *
+ * An update of a notifiable characteristic needs a controller TX buffer for
+ * the notification. When there is none left the update fails with
+ * BLE_STATUS_INSUFFICIENT_RESOURCES. The queue then keeps the refused update,
+ * stops sending and goes on where it stopped on EVT_BLUE_GATT_TX_POOL_AVAILABLE
+ * (Notify_Queue_Resume), or after NOTIFY_QUEUE_PAUSE_TIMEOUT ms should the
+ * event not come.
+ *
+ * Updates go out in order, one at a time (inFlight) : the next one as soon as
+ * the controller has accepted the previous one. So the controller never waits
+ * for the application while there is something to send, and it is never
+ * asked for more than it can buffer. There is no point in a deeper window :
+ * the controller grants one command credit (aci_async.h), and an update
+ * accepted right after a refused one would reach the client first.
+ *
+ * Main loop context only.
+ */
+
+#ifndef NOTIFY_QUEUE_SIZE
+#define NOTIFY_QUEUE_SIZE 8 /* updates, power of 2 */
+#endif
+
+/// What fits in one aci_async command with the update_char_value header (6 bytes).
+#define NOTIFY_QUEUE_MAX_VALUE (ACI_ASYNC_MAX_PARAMS - 6)
+/// When no async slot is free.
+#define NOTIFY_QUEUE_RETRY 1
+/// Resumes anyway if EVT_BLUE_GATT_TX_POOL_AVAILABLE does not come, ms.
+#define NOTIFY_QUEUE_PAUSE_TIMEOUT 50
+
+/* Notify_Queue_When_Sent callbacks waiting at once. */
+#ifndef NOTIFY_QUEUE_BARRIERS
+#define NOTIFY_QUEUE_BARRIERS 4
+#endif
+
+typedef void (*Notify_Queue_Barrier_t) (void *context);
+
+typedef struct {
+        uint16_t servHandle;
+        uint16_t charHandle;
+        uint8_t len;
+        Aci_Async_Callback_t done; /// Called once the controller took the update, or failed it for good. May be NULL.
+        void *context;
+        uint8_t queued; /// value holds the update. 0 : sent by Notify_Queue_Push itself, the value is in the aci_async slot only.
+        uint8_t value[NOTIFY_QUEUE_MAX_VALUE];
+} Notify_Queue_Entry_t;
+
+typedef struct {
+        uint32_t queued;
+        uint32_t direct;   /// Sent by Notify_Queue_Push itself, built in the command slot without a copy.
+        uint32_t accepted; /// Taken by the controller.
+        uint32_t refused;  /// BLE_STATUS_INSUFFICIENT_RESOURCES, sent again after the pause.
+        uint32_t failed;   /// Other errors, dropped.
+        uint32_t full;     /// Notify_Queue_Push calls refused, the queue was full.
+        uint32_t resumes;
+        uint32_t timeouts; /// Pauses ended by NOTIFY_QUEUE_PAUSE_TIMEOUT.
+        uint16_t burstMax; /// Most updates accepted between two refusals, i.e. what the controller buffers.
+        uint8_t depthMax;
+} Notify_Queue_Stats_t;
+
+typedef struct {
+        uint8_t mark; /// Runs once head reaches it.
+        Notify_Queue_Barrier_t callback;
+        void *context;
+} Notify_Queue_Barrier_Entry_t;
+
+typedef struct {
+        Notify_Queue_Entry_t entries[NOTIFY_QUEUE_SIZE];
+        Notify_Queue_Barrier_Entry_t barriers[NOTIFY_QUEUE_BARRIERS]; /// In mark order.
+        uint8_t barrierCount;
+        uint8_t head;
+        uint8_t tail;
+        uint8_t inFlight; /// The oldest update was sent, its Command Complete has not arrived yet.
+        uint8_t paused;   /// The controller is out of TX buffers.
+        uint16_t burst;   /// Updates accepted since the last refusal.
+        Timer_Wheel_Timer_t timer;
+        Notify_Queue_Stats_t stats;
+} Notify_Queue_t;
+
+void Notify_Queue_Init (Notify_Queue_t *queue);
+
+/**
+ * Queues an update of charHandle to the len bytes of value and sends it if
+ * nothing is ahead of it. value is copied once : into the command itself when
+ * it goes out now, into the queue otherwise (or when the controller refuses
+ * it). done (may be NULL) gets context and the final status. Returns 0, or -1
+ * if the queue is full or len too long.
+ */
+int Notify_Queue_Push (Notify_Queue_t *queue, uint16_t servHandle, uint16_t charHandle, const void *value, uint8_t len, Aci_Async_Callback_t done,
+                       void *context);
+
+/// The controller refused an update sent outside of the queue : waits for TX buffers like after a refusal of its own.
+void Notify_Queue_Pause (Notify_Queue_t *queue);
+
+/// EVT_BLUE_GATT_TX_POOL_AVAILABLE : the controller has TX buffers again.
+void Notify_Queue_Resume (Notify_Queue_t *queue);
+
+/**
+ * Runs callback (context) once every update queued so far is done with (taken
+ * or failed for good) : right away if the queue is empty. E.g. a read is
+ * allowed only once the value it asked for is in the controller. Returns 0,
+ * or -1 if NOTIFY_QUEUE_BARRIERS callbacks wait already.
+ */
+int Notify_Queue_When_Sent (Notify_Queue_t *queue, Notify_Queue_Barrier_t callback, void *context);
+
+/**
+ * Drops the updates not sent yet (e.g. on disconnection). The one in flight
+ * completes as usual. Notify_Queue_When_Sent callbacks run once it has.
+ */
+void Notify_Queue_Reset (Notify_Queue_t *queue);
+
+static inline uint8_t Notify_Queue_Count (const Notify_Queue_t *queue) { return (uint8_t)(queue->tail - queue->head); }
+
+/// Whether an update sent now, outside of the queue, would overtake queued ones or find the controller full.
+static inline uint8_t Notify_Queue_Busy (const Notify_Queue_t *queue) { return Notify_Queue_Count (queue) || queue->paused; }
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // NOTIFY_QUEUE_H
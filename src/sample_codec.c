@@ -0,0 +1,162 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#include "sample_codec.h"
+
+/*****************************************************************************/
+
+uint8_t Sample_Codec_Header (uint8_t *packet, uint16_t seq, uint16_t timestamp, uint8_t flags)
+{
+        packet[0] = seq;
+        packet[1] = seq >> 8;
+        packet[2] = timestamp;
+        packet[3] = timestamp >> 8;
+        packet[4] = flags;
+        return SAMPLE_CODEC_HEADER_SIZE;
+}
+
+/*****************************************************************************/
+
+uint8_t Sample_Codec_Encode_Raw (const int16_t xyz[3], uint8_t *out)
+{
+        for (int i = 0; i < 3; ++i) {
+                out[2 * i] = xyz[i];
+                out[2 * i + 1] = (uint16_t)xyz[i] >> 8;
+        }
+
+        return SAMPLE_CODEC_RAW_SAMPLE_SIZE;
+}
+
+/*****************************************************************************/
+
+uint8_t Sample_Codec_Encode (Sample_Codec_t *codec, const int16_t xyz[3], uint8_t *out)
+{
+        uint8_t *p = out;
+
+        for (int i = 0; i < 3; ++i) {
+                int16_t delta = (int16_t)(uint16_t)(xyz[i] - codec->last[i]);
+                uint16_t zz = (uint16_t)(((uint16_t)delta << 1) ^ (uint16_t)(delta >> 15));
+
+                codec->last[i] = xyz[i];
+
+                while (zz >= 0x80) {
+                        *p++ = (zz & 0x7f) | 0x80;
+                        zz >>= 7;
+                }
+
+                *p++ = zz;
+        }
+
+        return p - out;
+}
+
+/*****************************************************************************/
+
+int Sample_Codec_Decode (Sample_Codec_t *codec, const uint8_t *in, uint16_t len, int16_t xyz[3])
+{
+        uint16_t used = 0;
+
+        for (int i = 0; i < 3; ++i) {
+                uint32_t zz = 0;
+                uint8_t shift = 0;
+                uint8_t byte;
+
+                do {
+                        if (used == len || shift > 14) {
+                                return -1;
+                        }
+
+                        byte = in[used++];
+                        zz |= (uint32_t)(byte & 0x7f) << shift;
+                        shift += 7;
+                } while (byte & 0x80);
+
+                int16_t delta = (int16_t)((zz >> 1) ^ -(zz & 1));
+                codec->last[i] = (int16_t)(uint16_t)(codec->last[i] + delta);
+                xyz[i] = codec->last[i];
+        }
+
+        return used;
+}
+
+/*****************************************************************************/
+
+void Sample_Decoder_Init (Sample_Decoder_t *decoder)
+{
+        Sample_Codec_Reset (&decoder->codec);
+        decoder->seq = 0;
+        decoder->synced = 0;
+        decoder->lost = 0;
+        decoder->skipped = 0;
+}
+
+/*****************************************************************************/
+
+int Sample_Decoder_Packet (Sample_Decoder_t *decoder, const uint8_t *packet, uint16_t len, int16_t (*xyz)[3], uint16_t max, uint16_t *timestamp)
+{
+        if (len < SAMPLE_CODEC_HEADER_SIZE) {
+                return -1;
+        }
+
+        uint16_t seq = packet[0] | (packet[1] << 8);
+        uint8_t flags = packet[4];
+        uint8_t format = flags & SAMPLE_CODEC_FORMAT_MASK;
+
+        if (format != SAMPLE_CODEC_FORMAT_RAW && format != SAMPLE_CODEC_FORMAT_DELTA) {
+                return -1;
+        }
+
+        if (decoder->synced && seq != decoder->seq) {
+                decoder->lost += (uint16_t)(seq - decoder->seq);
+                decoder->synced = 0;
+        }
+
+        decoder->seq = seq + 1;
+
+        if ((flags & SAMPLE_CODEC_KEYFRAME) || format == SAMPLE_CODEC_FORMAT_RAW) {
+                Sample_Codec_Reset (&decoder->codec);
+                decoder->synced = 1;
+        }
+        else if (!decoder->synced) {
+                ++decoder->skipped;
+                return -1;
+        }
+
+        *timestamp = packet[2] | (packet[3] << 8);
+
+        uint16_t pos = SAMPLE_CODEC_HEADER_SIZE;
+        int n = 0;
+
+        if (format == SAMPLE_CODEC_FORMAT_RAW) {
+                if ((len - pos) % SAMPLE_CODEC_RAW_SAMPLE_SIZE) {
+                        return -1;
+                }
+
+                for (; pos < len && n < max; pos += SAMPLE_CODEC_RAW_SAMPLE_SIZE, ++n) {
+                        for (int i = 0; i < 3; ++i) {
+                                xyz[n][i] = (int16_t)(packet[pos + 2 * i] | (packet[pos + 2 * i + 1] << 8));
+                        }
+                }
+
+                return n;
+        }
+
+        while (pos < len && n < max) {
+                int used = Sample_Codec_Decode (&decoder->codec, packet + pos, len - pos, xyz[n]);
+
+                if (used < 0) {
+                        decoder->synced = 0;
+                        return -1;
+                }
+
+                pos += used;
+                ++n;
+        }
+
+        return n;
+}
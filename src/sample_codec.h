@@ -0,0 +1,102 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#ifndef SAMPLE_CODEC_H
+#define SAMPLE_CODEC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/*
+ * Packets of 3 axis samples for the sample stream (sample_stream.h). Layout,
+ * little endian, whatever the format :
+ *
+ * uint16_t seq        packet counter, gaps show lost packets.
+ * uint16_t timestamp  Clock_Time of the first sample, low 16 bits (ms).
+ * uint8_t  flags      SAMPLE_CODEC_KEYFRAME, and the format of the samples
+ *                     (SAMPLE_CODEC_FORMAT_MASK) :
+ *                     SAMPLE_CODEC_FORMAT_RAW    int16_t x, y, z each,
+ *                     SAMPLE_CODEC_FORMAT_DELTA  3 varints per sample (x, y, z).
+ *                     The other formats are reserved, decoders skip them.
+ * samples
+ *
+ * So a client tells the formats apart on the one characteristic, and a
+ * firmware may switch at run time. A raw packet stands alone, it is always a
+ * keyframe.
+ *
+ * Delta format : each axis is the difference from the same axis of the
+ * previous sample, modulo 2^16, zig-zag mapped (0, -1, 1, -2... to 0, 1, 2,
+ * 3...) and written as a little endian base 128 varint : 1 byte for changes
+ * within +-63, 2 within +-8191, 3 otherwise. Differences run on across
+ * packets. A keyframe packet starts from 0, i.e. its first sample is
+ * absolute, so a decoder which missed a packet resynchronizes on the next
+ * keyframe.
+ *
+ * No dependency on the HAL : the reference decoder below builds on the host.
+ */
+
+#define SAMPLE_CODEC_HEADER_SIZE 5
+#define SAMPLE_CODEC_KEYFRAME 0x01
+#define SAMPLE_CODEC_FORMAT_MASK 0x06
+#define SAMPLE_CODEC_FORMAT_RAW 0x00
+#define SAMPLE_CODEC_FORMAT_DELTA 0x02
+#define SAMPLE_CODEC_RAW_SAMPLE_SIZE 6
+#define SAMPLE_CODEC_MIN_SAMPLE_SIZE 3
+#define SAMPLE_CODEC_MAX_SAMPLE_SIZE 9
+
+/// Previous sample, on either side.
+typedef struct {
+        int16_t last[3];
+} Sample_Codec_t;
+
+/// Next sample is coded from 0 (keyframe).
+static inline void Sample_Codec_Reset (Sample_Codec_t *codec) { codec->last[0] = codec->last[1] = codec->last[2] = 0; }
+
+/// Writes the packet header, flags with the format, returns SAMPLE_CODEC_HEADER_SIZE.
+uint8_t Sample_Codec_Header (uint8_t *packet, uint16_t seq, uint16_t timestamp, uint8_t flags);
+
+/// Writes one sample in the raw format, returns SAMPLE_CODEC_RAW_SAMPLE_SIZE.
+uint8_t Sample_Codec_Encode_Raw (const int16_t xyz[3], uint8_t *out);
+
+/// Encodes one sample to out (room for SAMPLE_CODEC_MAX_SAMPLE_SIZE bytes), returns its size.
+uint8_t Sample_Codec_Encode (Sample_Codec_t *codec, const int16_t xyz[3], uint8_t *out);
+
+/// Decodes one sample out of len bytes. Returns the bytes used, or -1 if they end in the middle of it.
+int Sample_Codec_Decode (Sample_Codec_t *codec, const uint8_t *in, uint16_t len, int16_t xyz[3]);
+
+/*
+ * Reference decoder of whole packets.
+ */
+
+typedef struct {
+        Sample_Codec_t codec;
+        uint16_t seq; /// Expected next.
+        uint8_t synced;
+        uint32_t lost;    /// Packets missing from the sequence.
+        uint32_t skipped; /// Packets received while waiting for a keyframe.
+} Sample_Decoder_t;
+
+/// Decoder waiting for its first keyframe.
+void Sample_Decoder_Init (Sample_Decoder_t *decoder);
+
+/**
+ * Decodes one packet of either format into xyz (room for max samples) and its
+ * timestamp. Returns the number of samples, or -1 if the packet cannot be
+ * decoded : a packet was lost and this one is not a keyframe, it is
+ * malformed, or of a format this decoder does not know.
+ */
+int Sample_Decoder_Packet (Sample_Decoder_t *decoder, const uint8_t *packet, uint16_t len, int16_t (*xyz)[3], uint16_t max, uint16_t *timestamp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SAMPLE_CODEC_H
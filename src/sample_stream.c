@@ -0,0 +1,236 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#include "sample_stream.h"
+#include "clock.h"
+#include <string.h>
+
+#define MASK (SAMPLE_STREAM_BUFFER - 1)
+
+/*****************************************************************************/
+
+static uint16_t buffered (const Sample_Stream_t *s) { return (uint16_t)(s->head - s->tail); }
+
+/*****************************************************************************/
+
+static uint16_t per_packet (const Sample_Stream_t *s) { return (s->payload - SAMPLE_STREAM_HEADER_SIZE) / SAMPLE_STREAM_SAMPLE_SIZE; }
+
+/*****************************************************************************/
+
+/**
+ * Builds the next packet out of the oldest buffered samples, as many as fit.
+ * Sets n to their number, full when the packet takes no more samples and
+ * codec to the encoder state after it. Returns the packet length.
+ */
+static uint8_t build_packet (const Sample_Stream_t *s, uint8_t *packet, uint16_t *n, uint8_t *full, Sample_Codec_t *codec)
+{
+        uint16_t count = buffered (s);
+        uint16_t i = 0;
+        uint8_t *p;
+
+        if (s->encoding == SAMPLE_STREAM_RAW) {
+                uint16_t max = per_packet (s);
+
+                *full = count >= max;
+
+                if (count > max) {
+                        count = max;
+                }
+
+                p = packet + Sample_Codec_Header (packet, s->seq, s->timestamp[s->tail & MASK], SAMPLE_CODEC_FORMAT_RAW | SAMPLE_CODEC_KEYFRAME);
+
+                for (; i < count; ++i) {
+                        p += Sample_Codec_Encode_Raw (s->xyz[(s->tail + i) & MASK], p);
+                }
+
+                *n = count;
+                return p - packet;
+        }
+
+        uint8_t key = (s->keyCountdown == 0);
+        const uint8_t *end = packet + s->payload;
+        uint8_t sample[SAMPLE_CODEC_MAX_SAMPLE_SIZE];
+
+        *codec = s->codec;
+
+        if (key) {
+                Sample_Codec_Reset (codec);
+        }
+
+        p = packet + Sample_Codec_Header (packet, s->seq, s->timestamp[s->tail & MASK], SAMPLE_CODEC_FORMAT_DELTA | ((key) ? (SAMPLE_CODEC_KEYFRAME) : (0)));
+
+        for (; i < count; ++i) {
+                Sample_Codec_t next = *codec;
+                uint8_t size = Sample_Codec_Encode (&next, s->xyz[(s->tail + i) & MASK], sample);
+
+                if (p + size > end) {
+                        break;
+                }
+
+                memcpy (p, sample, size);
+                p += size;
+                *codec = next;
+        }
+
+        *full = i < count || end - p < SAMPLE_CODEC_MIN_SAMPLE_SIZE;
+        *n = i;
+        return p - packet;
+}
+
+/*****************************************************************************/
+
+/// Sends a packet of n samples made by build_packet. Returns 0 if it was queued.
+static int send_packet (Sample_Stream_t *s, const uint8_t *packet, uint8_t len, uint16_t n, const Sample_Codec_t *codec)
+{
+        if (s->send (s->context, packet, len)) {
+                ++s->stats.retries;
+                s->retrying = 1;
+                return -1;
+        }
+
+        s->retrying = 0;
+        s->tail += n;
+        ++s->seq;
+        ++s->stats.packets;
+        s->stats.samples += n;
+        s->stats.bytes += len;
+
+        if (s->encoding == SAMPLE_STREAM_DELTA) {
+                s->codec = *codec;
+                s->keyCountdown = (s->keyCountdown) ? (s->keyCountdown - 1) : (SAMPLE_STREAM_KEYFRAME_INTERVAL - 1);
+        }
+
+        return 0;
+}
+
+/*****************************************************************************/
+
+static uint16_t waited (const Sample_Stream_t *s) { return (uint16_t)Clock_Time () - s->timestamp[s->tail & MASK]; }
+
+/*****************************************************************************/
+
+/**
+ * Sends the full packets and, once the oldest sample has waited the latency
+ * bound (or if force is set), the partial one. Then waits for more samples
+ * until the oldest one's deadline.
+ */
+static void pump (Sample_Stream_t *s, uint8_t force)
+{
+        uint8_t packet[SAMPLE_STREAM_MAX_PAYLOAD];
+        Sample_Codec_t codec;
+        uint16_t n;
+        uint8_t full;
+
+        while (buffered (s)) {
+                uint8_t len = build_packet (s, packet, &n, &full, &codec);
+
+                if (!full && !force && waited (s) < s->latency) {
+                        break;
+                }
+
+                if (send_packet (s, packet, len, n, &codec)) {
+                        Timer_Wheel_Start (&s->timer, SAMPLE_STREAM_RETRY, 0);
+                        return;
+                }
+
+                if (!full) {
+                        ++s->stats.latencyFlushes;
+                }
+        }
+
+        if (!buffered (s)) {
+                Timer_Wheel_Stop (&s->timer);
+        }
+        else if (!Timer_Wheel_Running (&s->timer)) {
+                Timer_Wheel_Start (&s->timer, s->latency - waited (s), 0);
+        }
+}
+
+/*****************************************************************************/
+
+static void on_timer (void *arg) { pump (arg, 0); }
+
+/*****************************************************************************/
+
+void Sample_Stream_Init (Sample_Stream_t *stream, Sample_Stream_Send_t send, void *context, uint16_t latency)
+{
+        stream->head = stream->tail = 0;
+        stream->seq = 0;
+        stream->payload = SAMPLE_STREAM_DEFAULT_PAYLOAD;
+        stream->encoding = SAMPLE_STREAM_RAW;
+        stream->retrying = 0;
+        stream->keyCountdown = 0;
+        Sample_Codec_Reset (&stream->codec);
+        stream->latency = latency;
+        stream->send = send;
+        stream->context = context;
+        Timer_Wheel_Init_Timer (&stream->timer, on_timer, stream);
+}
+
+/*****************************************************************************/
+
+void Sample_Stream_Set_Payload (Sample_Stream_t *stream, uint16_t payload)
+{
+        if (payload > SAMPLE_STREAM_MAX_PAYLOAD) {
+                payload = SAMPLE_STREAM_MAX_PAYLOAD;
+        }
+
+        /* At least one sample, whatever the encoding. */
+        if (payload < SAMPLE_CODEC_HEADER_SIZE + SAMPLE_CODEC_MAX_SAMPLE_SIZE) {
+                payload = SAMPLE_CODEC_HEADER_SIZE + SAMPLE_CODEC_MAX_SAMPLE_SIZE;
+        }
+
+        stream->payload = payload;
+}
+
+/*****************************************************************************/
+
+void Sample_Stream_Set_Encoding (Sample_Stream_t *stream, Sample_Stream_Encoding_t encoding)
+{
+        stream->encoding = encoding;
+        stream->keyCountdown = 0;
+}
+
+/*****************************************************************************/
+
+void Sample_Stream_Push (Sample_Stream_t *stream, int16_t x, int16_t y, int16_t z)
+{
+        if (buffered (stream) == SAMPLE_STREAM_BUFFER) {
+                ++stream->tail;
+                ++stream->stats.dropped;
+        }
+
+        int16_t *xyz = stream->xyz[stream->head & MASK];
+        xyz[0] = x;
+        xyz[1] = y;
+        xyz[2] = z;
+        stream->timestamp[stream->head & MASK] = Clock_Time ();
+        ++stream->head;
+
+        /* A packet was already waiting : its send failed and is retried by the timer. */
+        if (stream->retrying) {
+                return;
+        }
+
+        pump (stream, 0);
+}
+
+/*****************************************************************************/
+
+void Sample_Stream_Flush (Sample_Stream_t *stream) { pump (stream, 1); }
+
+/*****************************************************************************/
+
+void Sample_Stream_Reset (Sample_Stream_t *stream)
+{
+        Timer_Wheel_Stop (&stream->timer);
+        stream->tail = stream->head;
+        stream->retrying = 0;
+        /* The next client starts from a keyframe. */
+        stream->keyCountdown = 0;
+}
@@ -0,0 +1,101 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#ifndef SAMPLE_STREAM_H
+#define SAMPLE_STREAM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "timer_wheel.h"
+#include "aci_async.h"
+#include "sample_codec.h"
+#include <stdint.h>
+
+/*
+ * Packs buffered 3 axis samples into as few notifications as possible.
+ *
+ * Samples are pushed as they are taken. A packet goes out as soon as a full
+ * one can be made, or when the oldest buffered sample has waited latency ms,
+ * whichever comes first. Packets start with the header of sample_codec.h,
+ * whose flags tell the format. SAMPLE_STREAM_RAW packets carry
+ * n = (length - 5) / 6 samples as int16_t x, y, z.
+ *
+ * SAMPLE_STREAM_DELTA packets carry the samples delta / varint encoded, with
+ * a keyframe every SAMPLE_STREAM_KEYFRAME_INTERVAL packets, see
+ * sample_codec.h for the layout and the reference decoder, which decodes
+ * both. A packet is full when the next sample does not fit, so how many
+ * samples it carries depends on how much they change.
+ *
+ * The packet size is bounded by the payload a notification can carry
+ * (Sample_Stream_Set_Payload, ATT_MTU - 3) and by SAMPLE_STREAM_MAX_PAYLOAD.
+ * When the send function fails (no room for the command) the samples stay
+ * buffered and sending is retried after SAMPLE_STREAM_RETRY ms. When the
+ * buffer is full the oldest samples are dropped.
+ *
+ * Main loop context only (the timer runs on the timer wheel).
+ */
+
+#define SAMPLE_STREAM_HEADER_SIZE SAMPLE_CODEC_HEADER_SIZE
+#define SAMPLE_STREAM_SAMPLE_SIZE SAMPLE_CODEC_RAW_SAMPLE_SIZE
+/// What fits in one aci_async command with the update_char_value header (6 bytes).
+#define SAMPLE_STREAM_MAX_PAYLOAD (ACI_ASYNC_MAX_PARAMS - 6)
+#define SAMPLE_STREAM_DEFAULT_PAYLOAD 20 /* ATT_MTU 23 */
+#define SAMPLE_STREAM_BUFFER 64          /* samples, power of 2 */
+#define SAMPLE_STREAM_RETRY 1
+#define SAMPLE_STREAM_KEYFRAME_INTERVAL 16 /* packets */
+
+typedef enum { SAMPLE_STREAM_RAW, SAMPLE_STREAM_DELTA } Sample_Stream_Encoding_t;
+
+/// Returns 0 if the packet was queued.
+typedef int (*Sample_Stream_Send_t) (void *context, const uint8_t *packet, uint8_t len);
+
+typedef struct {
+        uint32_t packets;
+        uint32_t samples; /// Sent.
+        uint32_t dropped; /// Overwritten before being sent.
+        uint32_t retries; /// Sends which failed and were retried.
+        uint32_t latencyFlushes; /// Packets sent partially filled because of the latency bound.
+        uint32_t bytes;   /// Sent, headers included.
+} Sample_Stream_Stats_t;
+
+typedef struct {
+        int16_t xyz[SAMPLE_STREAM_BUFFER][3];
+        uint16_t timestamp[SAMPLE_STREAM_BUFFER];
+        uint16_t head;
+        uint16_t tail;
+        uint16_t seq;
+        uint8_t payload;
+        uint8_t encoding;
+        uint8_t retrying;      /// The last send failed, the timer retries it.
+        uint8_t keyCountdown;  /// Packets before the next keyframe.
+        Sample_Codec_t codec;  /// State after the last packet sent.
+        uint16_t latency;
+        Sample_Stream_Send_t send;
+        void *context;
+        Timer_Wheel_Timer_t timer;
+        Sample_Stream_Stats_t stats;
+} Sample_Stream_t;
+
+void Sample_Stream_Init (Sample_Stream_t *stream, Sample_Stream_Send_t send, void *context, uint16_t latency);
+/// Sets the notification payload (ATT_MTU - 3), capped at SAMPLE_STREAM_MAX_PAYLOAD.
+void Sample_Stream_Set_Payload (Sample_Stream_t *stream, uint16_t payload);
+/// SAMPLE_STREAM_RAW (default) or SAMPLE_STREAM_DELTA. The next packet is a keyframe.
+void Sample_Stream_Set_Encoding (Sample_Stream_t *stream, Sample_Stream_Encoding_t encoding);
+void Sample_Stream_Push (Sample_Stream_t *stream, int16_t x, int16_t y, int16_t z);
+/// Sends what is buffered now, regardless of the latency bound.
+void Sample_Stream_Flush (Sample_Stream_t *stream);
+/// Drops the buffered samples and stops the timer (e.g. on disconnection). The sequence number goes on.
+void Sample_Stream_Reset (Sample_Stream_t *stream);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SAMPLE_STREAM_H
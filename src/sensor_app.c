@@ -0,0 +1,229 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#include "sensor_app.h"
+#include "osal.h"
+#include "hci_transport.h"
+#include "bluenrg_utils.h"
+#include "hci_capture.h"
+#include "aci_account.h"
+#include "aci_async.h"
+#include "timer_wheel.h"
+#include <stdio.h>
+
+#define BDADDR_SIZE 6
+
+uint8_t bnrg_expansion_board = IDB04A1; /* at startup, suppose the X-NUCLEO-IDB04A1 is used */
+
+static void sample_acc (void *arg);
+
+/*****************************************************************************/
+
+void Sensor_App_Init (uint8_t *hwVersion, uint16_t *fwVersion)
+{
+        const char *name = "ZlaSuka";
+        uint8_t SERVER_BDADDR[] = { 0x12, 0x34, 0x00, 0xE1, 0x80, 0x03 };
+        uint8_t bdaddr[BDADDR_SIZE];
+        uint16_t service_handle, dev_name_char_handle, appearance_char_handle;
+        int ret;
+
+        /* Initialize the link to BlueNRG (SPI driver unless another transport is selected) */
+        HCI_Transport_Init ();
+
+        /* Initialize the BlueNRG HCI */
+        HCI_Init ();
+
+        /* Reset BlueNRG hardware */
+        HCI_Transport_Reset ();
+
+        /* get the BlueNRG HW and FW versions */
+        ACI_BLOCKING (getBlueNRGVersion (hwVersion, fwVersion));
+
+        /*
+         * Reset BlueNRG again otherwise we won't
+         * be able to change its MAC address.
+         * aci_hal_write_config_data() must be the first
+         * command after reset otherwise it will fail.
+         */
+        HCI_Transport_Reset ();
+
+        if (*hwVersion > 0x30) { /* X-NUCLEO-IDB05A1 expansion board is used */
+                bnrg_expansion_board = IDB05A1;
+                /*
+                 * Change the MAC address to avoid issues with Android cache:
+                 * if different boards have the same MAC address, Android
+                 * applications unless you restart Bluetooth on tablet/phone
+                 */
+                SERVER_BDADDR[5] = 0x02;
+        }
+
+        Sensor_Service_Init_Events ();
+
+        /* The Nucleo board must be configured as SERVER */
+        Osal_MemCpy (bdaddr, SERVER_BDADDR, sizeof (SERVER_BDADDR));
+
+        ret = ACI_BLOCKING (aci_hal_write_config_data (CONFIG_DATA_PUBADDR_OFFSET, CONFIG_DATA_PUBADDR_LEN, bdaddr));
+
+        if (ret) {
+                printf ("Setting BD_ADDR failed.\n");
+        }
+
+        ret = ACI_BLOCKING (aci_gatt_init ());
+
+        if (ret) {
+                printf ("GATT_Init failed.\n");
+        }
+
+        if (bnrg_expansion_board == IDB05A1) {
+                ret = ACI_BLOCKING (
+                        aci_gap_init_IDB05A1 (GAP_PERIPHERAL_ROLE_IDB05A1, 0, 0x07, &service_handle, &dev_name_char_handle, &appearance_char_handle));
+        }
+        else {
+                ret = ACI_BLOCKING (aci_gap_init_IDB04A1 (GAP_PERIPHERAL_ROLE_IDB04A1, &service_handle, &dev_name_char_handle, &appearance_char_handle));
+        }
+
+        if (ret != BLE_STATUS_SUCCESS) {
+                printf ("GAP_Init failed.\n");
+        }
+
+        ret = ACI_BLOCKING (aci_gatt_update_char_value (service_handle, dev_name_char_handle, 0, strlen (name), (uint8_t *)name));
+
+        if (ret) {
+                printf ("aci_gatt_update_char_value failed.\n");
+                while (1)
+                        ;
+        }
+
+        ret = ACI_BLOCKING (
+                aci_gap_set_auth_requirement (MITM_PROTECTION_REQUIRED, OOB_AUTH_DATA_ABSENT, NULL, 7, 16, USE_FIXED_PIN_FOR_PAIRING, 123456, BONDING));
+        if (ret == BLE_STATUS_SUCCESS) {
+                printf ("BLE Stack Initialized.\n");
+        }
+
+        printf ("SERVER: BLE Stack Initialized\n");
+
+        Aci_Account_Begin (ACI_OP_ADD_ACC_SERVICE);
+        ret = Add_Acc_Service ();
+        Aci_Account_End ();
+
+        if (ret == BLE_STATUS_SUCCESS)
+                printf ("Acc service added successfully.\n");
+        else
+                printf ("Error while adding Acc service.\n");
+
+        Aci_Account_Begin (ACI_OP_ADD_ENVIRONMENTAL_SERVICE);
+        ret = Add_Environmental_Sensor_Service ();
+        Aci_Account_End ();
+
+        if (ret == BLE_STATUS_SUCCESS)
+                printf ("Environmental Sensor service added successfully.\n");
+        else
+                printf ("Error while adding Environmental Sensor service.\n");
+
+#if NEW_SERVICES
+        /* Instantiate Timer Service with two characteristics:
+         * - seconds characteristic (Readable only)
+         * - minutes characteristics (Readable and Notifiable )
+         */
+        ret = Add_Time_Service ();
+
+        if (ret == BLE_STATUS_SUCCESS)
+                printf ("Time service added successfully.\n");
+        else
+                printf ("Error while adding Time service.\n");
+
+        /* Instantiate LED Button Service with one characteristic:
+         * - LED characteristic (Readable and Writable)
+         */
+        ret = Add_LED_Service ();
+
+        if (ret == BLE_STATUS_SUCCESS)
+                printf ("LED service added successfully.\n");
+        else
+                printf ("Error while adding LED service.\n");
+#endif
+
+        /* Set output power level */
+        ret = ACI_BLOCKING (aci_hal_set_tx_power_level (1, 4));
+
+        /* Silence every event nobody handles */
+        ret = Sensor_Service_Program_Event_Mask ();
+
+        if (ret != BLE_STATUS_SUCCESS)
+                printf ("Error while programming the event masks.\n");
+
+#ifdef ACI_ACCOUNTING
+        /* What the initialization cost, Aci_Account_Report again later for the rest. */
+        Aci_Account_Report ();
+#endif
+
+        Timer_Wheel_Init_Timer (&sensorService->sampleTimer, sample_acc, sensorService);
+        Timer_Wheel_Start (&sensorService->sampleTimer, SENSOR_SAMPLE_PERIOD, SENSOR_SAMPLE_PERIOD);
+}
+
+/*****************************************************************************/
+
+void Sensor_App_Process (void)
+{
+#ifdef HCI_CAPTURE
+        HCI_Replay_Process ();
+#endif
+        HCI_Process ();
+        Timer_Wheel_Process ();
+        User_Process ((AxesRaw_t *)&sensorService->axes_data);
+#if NEW_SERVICES
+        Update_Time_Characteristics ();
+#endif
+}
+
+/**
+ * @brief  Process user input (i.e. pressing the USER button on Nucleo board)
+ *         and send the updated acceleration data to the remote client.
+ *
+ * @param  AxesRaw_t* p_axes
+ * @retval None
+ */
+void User_Process (AxesRaw_t *p_axes)
+{
+        (void)p_axes;
+
+        /* setConnectable sets it again when it could not be done now. */
+        if (sensorService->set_connectable) {
+                sensorService->set_connectable = FALSE;
+                setConnectable ();
+        }
+}
+
+/*****************************************************************************/
+
+/// Every SENSOR_SAMPLE_PERIOD ms : the accelerometer emulation.
+static void sample_acc (void *arg)
+{
+        Sensor_Service_t *s = arg;
+        AxesRaw_t *p_axes = (AxesRaw_t *)&s->axes_data;
+
+        if (!s->connected) {
+                return;
+        }
+
+        /* Update acceleration data */
+        p_axes->AXIS_X += 100;
+        p_axes->AXIS_Y += 100;
+        p_axes->AXIS_Z += 100;
+        // printf("ACC: X=%6d Y=%6d Z=%6d\r\n", p_axes->AXIS_X, p_axes->AXIS_Y, p_axes->AXIS_Z);
+        Acc_Stream_Push (p_axes);
+
+        /* Clients of the accelerometer characteristic still get its notifications, at a lower rate. */
+        if (s->accUpdateSkip) {
+                --s->accUpdateSkip;
+                return;
+        }
+
+        s->accUpdateSkip = SENSOR_ACC_UPDATE_PERIOD / SENSOR_SAMPLE_PERIOD - 1;
+        Acc_Update_Async (p_axes);
+}
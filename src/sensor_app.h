@@ -0,0 +1,48 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#ifndef SENSOR_APP_H
+#define SENSOR_APP_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "sensor_service.h"
+
+/*
+ * The sensor demo minus the board : the BlueNRG stack and services setup and
+ * one round of the main loop. main.cc wraps it with the clocks, caches and USB;
+ * host builds run it as is over a simulated controller (sim_controller.h).
+ */
+
+/* Accelerometer emulation period, ms. */
+#ifndef SENSOR_SAMPLE_PERIOD
+#define SENSOR_SAMPLE_PERIOD 10
+#endif
+
+/* Period of the accCharHandle notifications, ms, a multiple of SENSOR_SAMPLE_PERIOD. Every sample goes to the stream. */
+#ifndef SENSOR_ACC_UPDATE_PERIOD
+#define SENSOR_ACC_UPDATE_PERIOD 50
+#endif
+
+extern uint8_t bnrg_expansion_board;
+
+/// Resets and sets up the controller through the current transport. hwVersion / fwVersion : what getBlueNRGVersion reported.
+void Sensor_App_Init (uint8_t *hwVersion, uint16_t *fwVersion);
+
+/// One round of the main loop.
+void Sensor_App_Process (void);
+
+void User_Process (AxesRaw_t *p_axes);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SENSOR_APP_H
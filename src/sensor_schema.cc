@@ -0,0 +1,126 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#include "sensor_schema.h"
+#include "GattSchema.h"
+
+using Char = Characteristic<Sensor_Service_t>;
+using Serv = Service<Sensor_Service_t>;
+
+/*****************************************************************************/
+/* UUIDs                                                                     */
+/*****************************************************************************/
+
+#if NEW_SERVICES
+constexpr Uuid128 ACC_SERVICE_UUID = uuid128 (0x01, 0x36, 0x6e, 0x80, 0xcf, 0x3a, 0x11, 0xe1, 0x9a, 0xb4, 0x00, 0x02, 0xa5, 0xd5, 0xc5, 0x1b);
+constexpr Uuid128 FREE_FALL_UUID = uuid128 (0x02, 0x36, 0x6e, 0x80, 0xcf, 0x3a, 0x11, 0xe1, 0x9a, 0xb4, 0x00, 0x02, 0xa5, 0xd5, 0xc5, 0x1b);
+constexpr Uuid128 ACC_UUID = uuid128 (0x03, 0x36, 0x6e, 0x80, 0xcf, 0x3a, 0x11, 0xe1, 0x9a, 0xb4, 0x00, 0x02, 0xa5, 0xd5, 0xc5, 0x1b);
+
+constexpr Uuid128 ENV_SENS_SERVICE_UUID = uuid128 (0x04, 0x36, 0x6e, 0x80, 0xcf, 0x3a, 0x11, 0xe1, 0x9a, 0xb4, 0x00, 0x02, 0xa5, 0xd5, 0xc5, 0x1b);
+constexpr Uuid128 TEMP_CHAR_UUID = uuid128 (0x05, 0x36, 0x6e, 0x80, 0xcf, 0x3a, 0x11, 0xe1, 0x9a, 0xb4, 0x00, 0x02, 0xa5, 0xd5, 0xc5, 0x1b);
+constexpr Uuid128 PRESS_CHAR_UUID = uuid128 (0x06, 0x36, 0x6e, 0x80, 0xcf, 0x3a, 0x11, 0xe1, 0x9a, 0xb4, 0x00, 0x02, 0xa5, 0xd5, 0xc5, 0x1b);
+constexpr Uuid128 HUMIDITY_CHAR_UUID = uuid128 (0x07, 0x36, 0x6e, 0x80, 0xcf, 0x3a, 0x11, 0xe1, 0x9a, 0xb4, 0x00, 0x02, 0xa5, 0xd5, 0xc5, 0x1b);
+
+// Time service: straight uuid = 0x08366e80cf3a11e19ab40002a5d5c51b
+constexpr Uuid128 TIME_SERVICE_UUID = uuid128 (0x08, 0x36, 0x6e, 0x80, 0xcf, 0x3a, 0x11, 0xe1, 0x9a, 0xb4, 0x00, 0x02, 0xa5, 0xd5, 0xc5, 0x1b);
+constexpr Uuid128 TIME_UUID = uuid128 (0x09, 0x36, 0x6e, 0x80, 0xcf, 0x3a, 0x11, 0xe1, 0x9a, 0xb4, 0x00, 0x02, 0xa5, 0xd5, 0xc5, 0x1b);
+constexpr Uuid128 MINUTE_UUID = uuid128 (0x0a, 0x36, 0x6e, 0x80, 0xcf, 0x3a, 0x11, 0xe1, 0x9a, 0xb4, 0x00, 0x02, 0xa5, 0xd5, 0xc5, 0x1b);
+
+constexpr Uuid128 LED_SERVICE_UUID = uuid128 (0x0b, 0x36, 0x6e, 0x80, 0xcf, 0x3a, 0x11, 0xe1, 0x9a, 0xb4, 0x00, 0x02, 0xa5, 0xd5, 0xc5, 0x1b);
+constexpr Uuid128 LED_UUID = uuid128 (0x0c, 0x36, 0x6e, 0x80, 0xcf, 0x3a, 0x11, 0xe1, 0x9a, 0xb4, 0x00, 0x02, 0xa5, 0xd5, 0xc5, 0x1b);
+#else
+constexpr Uuid128 ACC_SERVICE_UUID = uuid128 (0x02, 0x36, 0x6e, 0x80, 0xcf, 0x3a, 0x11, 0xe1, 0x9a, 0xb4, 0x00, 0x02, 0xa5, 0xd5, 0xc5, 0x1b);
+constexpr Uuid128 FREE_FALL_UUID = uuid128 (0xe2, 0x3e, 0x78, 0xa0, 0xcf, 0x4a, 0x11, 0xe1, 0x8f, 0xfc, 0x00, 0x02, 0xa5, 0xd5, 0xc5, 0x1b);
+constexpr Uuid128 ACC_UUID = uuid128 (0x34, 0x0a, 0x1b, 0x80, 0xcf, 0x4b, 0x11, 0xe1, 0xac, 0x36, 0x00, 0x02, 0xa5, 0xd5, 0xc5, 0x1b);
+
+constexpr Uuid128 ENV_SENS_SERVICE_UUID = uuid128 (0x42, 0x82, 0x1a, 0x40, 0xe4, 0x77, 0x11, 0xe2, 0x82, 0xd0, 0x00, 0x02, 0xa5, 0xd5, 0xc5, 0x1b);
+constexpr Uuid128 TEMP_CHAR_UUID = uuid128 (0xa3, 0x2e, 0x55, 0x20, 0xe4, 0x77, 0x11, 0xe2, 0xa9, 0xe3, 0x00, 0x02, 0xa5, 0xd5, 0xc5, 0x1b);
+constexpr Uuid128 PRESS_CHAR_UUID = uuid128 (0xcd, 0x20, 0xc4, 0x80, 0xe4, 0x8b, 0x11, 0xe2, 0x84, 0x0b, 0x00, 0x02, 0xa5, 0xd5, 0xc5, 0x1b);
+constexpr Uuid128 HUMIDITY_CHAR_UUID = uuid128 (0x01, 0xc5, 0x0b, 0x60, 0xe4, 0x8c, 0x11, 0xe2, 0xa0, 0x73, 0x00, 0x02, 0xa5, 0xd5, 0xc5, 0x1b);
+#endif
+
+constexpr Uuid128 ACC_STREAM_UUID = uuid128 (0x0d, 0x36, 0x6e, 0x80, 0xcf, 0x3a, 0x11, 0xe1, 0x9a, 0xb4, 0x00, 0x02, 0xa5, 0xd5, 0xc5, 0x1b);
+
+/*****************************************************************************/
+/* Presentation formats                                                      */
+/*****************************************************************************/
+
+constexpr PresentationFormat TEMP_FORMAT = presentationFormat (FORMAT_SINT16, -1, UNIT_TEMP_CELSIUS);
+constexpr PresentationFormat PRESS_FORMAT = presentationFormat (FORMAT_SINT24, -5, UNIT_PRESSURE_BAR);
+constexpr PresentationFormat HUMIDITY_FORMAT = presentationFormat (FORMAT_UINT16, -1, UNIT_UNITLESS);
+
+/*****************************************************************************/
+/* Services                                                                  */
+/*****************************************************************************/
+
+constexpr Char accChars[] = {
+        { FREE_FALL_UUID, 1, CHAR_PROP_NOTIFY, ATTR_PERMISSION_NONE, GATT_DONT_NOTIFY_EVENTS, 0, &Sensor_Service_t::freeFallCharHandle, nullptr, nullptr },
+        { ACC_UUID, 6, CHAR_PROP_NOTIFY | CHAR_PROP_READ, ATTR_PERMISSION_NONE, SENSOR_READ_EVENTS, 0, &Sensor_Service_t::accCharHandle, nullptr,
+          &accCharHandlers },
+        /* Variable length : as many samples as the connection's notifications carry. */
+        { ACC_STREAM_UUID, SAMPLE_STREAM_MAX_PAYLOAD, CHAR_PROP_NOTIFY, ATTR_PERMISSION_NONE, GATT_DONT_NOTIFY_EVENTS, 1, &Sensor_Service_t::accStreamCharHandle,
+          nullptr, &accStreamCharHandlers },
+};
+
+constexpr Serv accService = gattService (ACC_SERVICE_UUID, &Sensor_Service_t::accServHandle, accChars);
+static_assert (accService.records <= GATT_SCHEMA_MAX_RECORDS, "too many attributes in the acc service");
+static_assert (accService.unique, "duplicate characteristic UUID in the acc service");
+
+constexpr Char envChars[] = {
+        { TEMP_CHAR_UUID, 2, CHAR_PROP_READ, ATTR_PERMISSION_NONE, SENSOR_READ_EVENTS, 0, &Sensor_Service_t::tempCharHandle, &TEMP_FORMAT, &tempCharHandlers },
+        { PRESS_CHAR_UUID, 3, CHAR_PROP_READ, ATTR_PERMISSION_NONE, SENSOR_READ_EVENTS, 0, &Sensor_Service_t::pressCharHandle, &PRESS_FORMAT, &pressCharHandlers },
+        { HUMIDITY_CHAR_UUID, 2, CHAR_PROP_READ, ATTR_PERMISSION_NONE, SENSOR_READ_EVENTS, 0, &Sensor_Service_t::humidityCharHandle, &HUMIDITY_FORMAT,
+          &humidityCharHandlers },
+};
+
+constexpr Serv envService = gattService (ENV_SENS_SERVICE_UUID, &Sensor_Service_t::envSensServHandle, envChars);
+static_assert (envService.records <= GATT_SCHEMA_MAX_RECORDS, "too many attributes in the environmental service");
+static_assert (envService.unique, "duplicate characteristic UUID in the environmental service");
+
+#if NEW_SERVICES
+constexpr Char timeChars[] = {
+        { TIME_UUID, 4, CHAR_PROP_READ, ATTR_PERMISSION_NONE, GATT_DONT_NOTIFY_EVENTS, 0, &Sensor_Service_t::secondsCharHandle, nullptr, nullptr },
+        { MINUTE_UUID, 4, CHAR_PROP_NOTIFY | CHAR_PROP_READ, ATTR_PERMISSION_NONE, GATT_DONT_NOTIFY_EVENTS, 1, &Sensor_Service_t::minuteCharHandle, nullptr,
+          nullptr },
+};
+
+constexpr Serv timeService = gattService (TIME_SERVICE_UUID, &Sensor_Service_t::timeServHandle, timeChars);
+static_assert (timeService.records <= GATT_SCHEMA_MAX_RECORDS, "too many attributes in the time service");
+static_assert (timeService.unique, "duplicate characteristic UUID in the time service");
+
+constexpr Char ledChars[] = {
+        { LED_UUID, 4, CHAR_PROP_WRITE | CHAR_PROP_WRITE_WITHOUT_RESP, ATTR_PERMISSION_NONE, GATT_NOTIFY_ATTRIBUTE_WRITE, 1, &Sensor_Service_t::ledButtonCharHandle,
+          nullptr, &ledCharHandlers },
+};
+
+constexpr Serv ledService = gattService (LED_SERVICE_UUID, &Sensor_Service_t::ledServHandle, ledChars);
+static_assert (ledService.records <= GATT_SCHEMA_MAX_RECORDS, "too many attributes in the LED service");
+#endif
+
+/* In Sensor_Schema_Service_t order. */
+static const Serv *const services[] = {
+        &accService,
+        &envService,
+#if NEW_SERVICES
+        &timeService,
+        &ledService,
+#endif
+};
+
+static_assert (sizeof (services) / sizeof (services[0]) == SENSOR_SCHEMA_COUNT, "services and Sensor_Schema_Service_t differ");
+
+/*****************************************************************************/
+
+tBleStatus Sensor_Schema_Add (Sensor_Schema_Service_t service)
+{
+        if (service >= SENSOR_SCHEMA_COUNT) {
+                return BLE_STATUS_INVALID_PARAMS;
+        }
+
+        return registerService (*services[service], sensorService, &sensorService->handles);
+}
@@ -0,0 +1,50 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#ifndef SENSOR_SCHEMA_H
+#define SENSOR_SCHEMA_H
+
+#include "sensor_service.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * GATT services of the sensor application, described at compile time in
+ * sensor_schema.cc (see GattSchema.h).
+ */
+
+typedef enum {
+        SENSOR_SCHEMA_ACC,
+        SENSOR_SCHEMA_ENVIRONMENTAL,
+#if NEW_SERVICES
+        SENSOR_SCHEMA_TIME,
+        SENSOR_SCHEMA_LED,
+#endif
+        SENSOR_SCHEMA_COUNT
+} Sensor_Schema_Service_t;
+
+/// Adds service to the controller, the handles go to the selected Sensor_Service_t.
+tBleStatus Sensor_Schema_Add (Sensor_Schema_Service_t service);
+
+/* Event handlers of the characteristics, defined in sensor_service.c. */
+extern const Gatt_Char_Handlers_t accCharHandlers;
+extern const Gatt_Char_Handlers_t accStreamCharHandlers;
+extern const Gatt_Char_Handlers_t tempCharHandlers;
+extern const Gatt_Char_Handlers_t pressCharHandlers;
+extern const Gatt_Char_Handlers_t humidityCharHandlers;
+#if NEW_SERVICES
+extern const Gatt_Char_Handlers_t ledCharHandlers;
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SENSOR_SCHEMA_H
@@ -35,6 +35,14 @@
   ******************************************************************************
   */
 #include "sensor_service.h"
+#include "hci_dispatch.h"
+#include "hci_packet_pool.h"
+#include "aci_async.h"
+#include "hci_event_mask.h"
+#include "hci_capture.h"
+#include "aci_account.h"
+#include "sensor_schema.h"
+#include "cycle_counter.h"
 
 /** @addtogroup X-CUBE-BLE1_Applications
  *  @{
@@ -52,95 +60,29 @@
  * @{
  */
 /* Private variables ---------------------------------------------------------*/
-volatile int connected = FALSE;
-volatile uint8_t set_connectable = 1;
-volatile uint16_t connection_handle = 0;
-volatile uint8_t notification_enabled = FALSE;
-volatile AxesRaw_t axes_data = { 0, 0, 0 };
-uint16_t sampleServHandle, TXCharHandle, RXCharHandle;
-uint16_t accServHandle, freeFallCharHandle, accCharHandle;
-uint16_t envSensServHandle, tempCharHandle, pressCharHandle, humidityCharHandle;
+static Sensor_Service_t sensorService0 = SENSOR_SERVICE_INITIALIZER;
+Sensor_Service_t *sensorService = &sensorService0;
 
-#if NEW_SERVICES
-uint16_t timeServHandle, secondsCharHandle, minuteCharHandle;
-uint16_t ledServHandle, ledButtonCharHandle;
-uint8_t ledState = 0;
-int previousMinuteValue = -1;
 extern uint8_t bnrg_expansion_board;
-#endif
 /**
  * @}
  */
 
+
 /** @defgroup SENSOR_SERVICE_Private_Macros
  * @{
  */
 /* Private macros ------------------------------------------------------------*/
-#define COPY_UUID_128(uuid_struct, uuid_15, uuid_14, uuid_13, uuid_12, uuid_11, uuid_10, uuid_9, uuid_8, uuid_7, uuid_6, uuid_5, uuid_4, uuid_3, uuid_2,       \
-                      uuid_1, uuid_0)                                                                                                                          \
-        do {                                                                                                                                                   \
-                uuid_struct[0] = uuid_0;                                                                                                                       \
-                uuid_struct[1] = uuid_1;                                                                                                                       \
-                uuid_struct[2] = uuid_2;                                                                                                                       \
-                uuid_struct[3] = uuid_3;                                                                                                                       \
-                uuid_struct[4] = uuid_4;                                                                                                                       \
-                uuid_struct[5] = uuid_5;                                                                                                                       \
-                uuid_struct[6] = uuid_6;                                                                                                                       \
-                uuid_struct[7] = uuid_7;                                                                                                                       \
-                uuid_struct[8] = uuid_8;                                                                                                                       \
-                uuid_struct[9] = uuid_9;                                                                                                                       \
-                uuid_struct[10] = uuid_10;                                                                                                                     \
-                uuid_struct[11] = uuid_11;                                                                                                                     \
-                uuid_struct[12] = uuid_12;                                                                                                                     \
-                uuid_struct[13] = uuid_13;                                                                                                                     \
-                uuid_struct[14] = uuid_14;                                                                                                                     \
-                uuid_struct[15] = uuid_15;                                                                                                                     \
-        } while (0)
+/* Longest time an accelerometer sample waits for a stream notification, ms. */
+#define ACC_STREAM_LATENCY 100
+/* SAMPLE_STREAM_DELTA about doubles the samples per notification, clients must decode it (sample_codec.h). */
+#define ACC_STREAM_ENCODING SAMPLE_STREAM_RAW
 
-#if NEW_SERVICES
-#define COPY_ACC_SERVICE_UUID(uuid_struct)                                                                                                                     \
-        COPY_UUID_128 (uuid_struct, 0x01, 0x36, 0x6e, 0x80, 0xcf, 0x3a, 0x11, 0xe1, 0x9a, 0xb4, 0x00, 0x02, 0xa5, 0xd5, 0xc5, 0x1b)
-#define COPY_FREE_FALL_UUID(uuid_struct)                                                                                                                       \
-        COPY_UUID_128 (uuid_struct, 0x02, 0x36, 0x6e, 0x80, 0xcf, 0x3a, 0x11, 0xe1, 0x9a, 0xb4, 0x00, 0x02, 0xa5, 0xd5, 0xc5, 0x1b)
-#define COPY_ACC_UUID(uuid_struct) COPY_UUID_128 (uuid_struct, 0x03, 0x36, 0x6e, 0x80, 0xcf, 0x3a, 0x11, 0xe1, 0x9a, 0xb4, 0x00, 0x02, 0xa5, 0xd5, 0xc5, 0x1b)
-
-#define COPY_ENV_SENS_SERVICE_UUID(uuid_struct)                                                                                                                \
-        COPY_UUID_128 (uuid_struct, 0x04, 0x36, 0x6e, 0x80, 0xcf, 0x3a, 0x11, 0xe1, 0x9a, 0xb4, 0x00, 0x02, 0xa5, 0xd5, 0xc5, 0x1b)
-#define COPY_TEMP_CHAR_UUID(uuid_struct)                                                                                                                       \
-        COPY_UUID_128 (uuid_struct, 0x05, 0x36, 0x6e, 0x80, 0xcf, 0x3a, 0x11, 0xe1, 0x9a, 0xb4, 0x00, 0x02, 0xa5, 0xd5, 0xc5, 0x1b)
-#define COPY_PRESS_CHAR_UUID(uuid_struct)                                                                                                                      \
-        COPY_UUID_128 (uuid_struct, 0x06, 0x36, 0x6e, 0x80, 0xcf, 0x3a, 0x11, 0xe1, 0x9a, 0xb4, 0x00, 0x02, 0xa5, 0xd5, 0xc5, 0x1b)
-#define COPY_HUMIDITY_CHAR_UUID(uuid_struct)                                                                                                                   \
-        COPY_UUID_128 (uuid_struct, 0x07, 0x36, 0x6e, 0x80, 0xcf, 0x3a, 0x11, 0xe1, 0x9a, 0xb4, 0x00, 0x02, 0xa5, 0xd5, 0xc5, 0x1b)
-
-// Time service: uuid = 0x08, 0x36, 0x6e, 0x80, 0xcf, 0x3a, 0x11, 0xe1, 0x9a, 0xb4, 0x00, 0x02, 0xa5, 0xd5, 0xc5, 0x1b
-//      straight uuid = 0x08366e80cf3a11e19ab40002a5d5c51b
-#define COPY_TIME_SERVICE_UUID(uuid_struct)                                                                                                                    \
-        COPY_UUID_128 (uuid_struct, 0x08, 0x36, 0x6e, 0x80, 0xcf, 0x3a, 0x11, 0xe1, 0x9a, 0xb4, 0x00, 0x02, 0xa5, 0xd5, 0xc5, 0x1b)
-#define COPY_TIME_UUID(uuid_struct) COPY_UUID_128 (uuid_struct, 0x09, 0x36, 0x6e, 0x80, 0xcf, 0x3a, 0x11, 0xe1, 0x9a, 0xb4, 0x00, 0x02, 0xa5, 0xd5, 0xc5, 0x1b)
-#define COPY_MINUTE_UUID(uuid_struct)                                                                                                                          \
-        COPY_UUID_128 (uuid_struct, 0x0a, 0x36, 0x6e, 0x80, 0xcf, 0x3a, 0x11, 0xe1, 0x9a, 0xb4, 0x00, 0x02, 0xa5, 0xd5, 0xc5, 0x1b)
-
-// LED service
-#define COPY_LED_SERVICE_UUID(uuid_struct)                                                                                                                     \
-        COPY_UUID_128 (uuid_struct, 0x0b, 0x36, 0x6e, 0x80, 0xcf, 0x3a, 0x11, 0xe1, 0x9a, 0xb4, 0x00, 0x02, 0xa5, 0xd5, 0xc5, 0x1b)
-#define COPY_LED_UUID(uuid_struct) COPY_UUID_128 (uuid_struct, 0x0c, 0x36, 0x6e, 0x80, 0xcf, 0x3a, 0x11, 0xe1, 0x9a, 0xb4, 0x00, 0x02, 0xa5, 0xd5, 0xc5, 0x1b)
-#else
-#define COPY_ACC_SERVICE_UUID(uuid_struct)                                                                                                                     \
-        COPY_UUID_128 (uuid_struct, 0x02, 0x36, 0x6e, 0x80, 0xcf, 0x3a, 0x11, 0xe1, 0x9a, 0xb4, 0x00, 0x02, 0xa5, 0xd5, 0xc5, 0x1b)
-#define COPY_FREE_FALL_UUID(uuid_struct)                                                                                                                       \
-        COPY_UUID_128 (uuid_struct, 0xe2, 0x3e, 0x78, 0xa0, 0xcf, 0x4a, 0x11, 0xe1, 0x8f, 0xfc, 0x00, 0x02, 0xa5, 0xd5, 0xc5, 0x1b)
-#define COPY_ACC_UUID(uuid_struct) COPY_UUID_128 (uuid_struct, 0x34, 0x0a, 0x1b, 0x80, 0xcf, 0x4b, 0x11, 0xe1, 0xac, 0x36, 0x00, 0x02, 0xa5, 0xd5, 0xc5, 0x1b)
-
-#define COPY_ENV_SENS_SERVICE_UUID(uuid_struct)                                                                                                                \
-        COPY_UUID_128 (uuid_struct, 0x42, 0x82, 0x1a, 0x40, 0xe4, 0x77, 0x11, 0xe2, 0x82, 0xd0, 0x00, 0x02, 0xa5, 0xd5, 0xc5, 0x1b)
-#define COPY_TEMP_CHAR_UUID(uuid_struct)                                                                                                                       \
-        COPY_UUID_128 (uuid_struct, 0xa3, 0x2e, 0x55, 0x20, 0xe4, 0x77, 0x11, 0xe2, 0xa9, 0xe3, 0x00, 0x02, 0xa5, 0xd5, 0xc5, 0x1b)
-#define COPY_PRESS_CHAR_UUID(uuid_struct)                                                                                                                      \
-        COPY_UUID_128 (uuid_struct, 0xcd, 0x20, 0xc4, 0x80, 0xe4, 0x8b, 0x11, 0xe2, 0x84, 0x0b, 0x00, 0x02, 0xa5, 0xd5, 0xc5, 0x1b)
-#define COPY_HUMIDITY_CHAR_UUID(uuid_struct)                                                                                                                   \
-        COPY_UUID_128 (uuid_struct, 0x01, 0xc5, 0x0b, 0x60, 0xe4, 0x8c, 0x11, 0xe2, 0xa0, 0x73, 0x00, 0x02, 0xa5, 0xd5, 0xc5, 0x1b)
-#endif
+/* Changes too small to be worth a characteristic update (char_cache.h), in the characteristics' units. */
+#define ACC_DEADBAND 0      /* mg */
+#define TEMP_DEADBAND 1     /* 0.1 degree */
+#define PRESS_DEADBAND 10   /* Pa */
+#define HUMIDITY_DEADBAND 5 /* 0.1 %RH */
 
 /* Store Value into a buffer in Little Endian Format */
 #define STORE_LE_16(buf, val) (((buf)[0] = (uint8_t) (val)), ((buf)[1] = (uint8_t) (val >> 8)))
@@ -151,45 +93,76 @@ extern uint8_t bnrg_expansion_board;
 /** @defgroup SENSOR_SERVICE_Exported_Functions
  * @{
  */
+static void update_done (void *context, uint8_t status, const uint8_t *ret, uint8_t retLen);
+static void allow_read (void *context);
+
 /**
- * @brief  Add an accelerometer service using a vendor specific profile.
- *
- * @param  None
- * @retval tBleStatus Status
+ * @brief  Sends one packet of the accelerometer stream (sample_stream.h).
+ * @param  context : the Sensor_Service_t the stream belongs to.
+ * @retval 0 if the update was queued.
  */
-tBleStatus Add_Acc_Service (void)
+static int acc_stream_send (void *context, const uint8_t *packet, uint8_t len)
 {
-        tBleStatus ret;
+        Sensor_Service_t *s = context;
+        return Notify_Queue_Push (&s->notifyQueue, s->accServHandle, s->accStreamCharHandle, packet, len, update_done, NULL);
+}
 
-        uint8_t uuid[16];
+/**
+ * @brief  Updates a characteristic value. When the controller has no TX
+ *         buffer left for the notification, or updates queued before still
+ *         wait for one, or async commands are in flight (no blocking call
+ *         then, aci_async.h), the value goes to the notification queue and is
+ *         sent once the controller has room (notify_queue.h), instead of
+ *         being dropped.
+ * @param  Char_Cache_t* cache : cache of the characteristic, invalidated if the update fails. May be NULL.
+ * @retval Status : BLE_STATUS_SUCCESS once the value is written or queued.
+ */
+static tBleStatus update_char (uint16_t servHandle, uint16_t charHandle, const void *value, uint8_t len, Char_Cache_t *cache)
+{
+        Notify_Queue_t *q = &sensorService->notifyQueue;
+        tBleStatus ret = BLE_STATUS_INSUFFICIENT_RESOURCES;
 
-        COPY_ACC_SERVICE_UUID (uuid);
-        ret = aci_gatt_add_serv (UUID_TYPE_128, uuid, PRIMARY_SERVICE, 7, &accServHandle);
+        /* Sent right away, the value would overtake the queued ones. */
+        if (!Notify_Queue_Busy (q)) {
+                ret = ACI_BLOCKING (aci_gatt_update_char_value (servHandle, charHandle, 0, len, (uint8_t *)value));
 
-        if (ret != BLE_STATUS_SUCCESS) {
-                goto fail;
+                if (ret == BLE_STATUS_INSUFFICIENT_RESOURCES) {
+                        Notify_Queue_Pause (q);
+                }
         }
 
-        COPY_FREE_FALL_UUID (uuid);
-        ret = aci_gatt_add_char (accServHandle, UUID_TYPE_128, uuid, 1, CHAR_PROP_NOTIFY, ATTR_PERMISSION_NONE, 0, 16, 0, &freeFallCharHandle);
+        if ((ret == BLE_STATUS_INSUFFICIENT_RESOURCES || ret == BLE_STATUS_BUSY)
+            && Notify_Queue_Push (q, servHandle, charHandle, value, len, update_done, cache) == 0) {
+                ret = BLE_STATUS_SUCCESS;
+        }
 
-        if (ret != BLE_STATUS_SUCCESS) {
-                goto fail;
+        if (ret != BLE_STATUS_SUCCESS && cache) {
+                Char_Cache_Invalidate (cache);
         }
 
-        COPY_ACC_UUID (uuid);
-        ret = aci_gatt_add_char (accServHandle, UUID_TYPE_128, uuid, 6, CHAR_PROP_NOTIFY | CHAR_PROP_READ, ATTR_PERMISSION_NONE,
-                                 GATT_NOTIFY_READ_REQ_AND_WAIT_FOR_APPL_RESP, 16, 0, &accCharHandle);
+        return ret;
+}
 
-        if (ret != BLE_STATUS_SUCCESS) {
-                goto fail;
+/**
+ * @brief  Add an accelerometer service using a vendor specific profile.
+ *
+ * @param  None
+ * @retval tBleStatus Status
+ */
+tBleStatus Add_Acc_Service (void)
+{
+        /* Every characteristic update of the instance goes through it, the ones of the other services too. */
+        Notify_Queue_Init (&sensorService->notifyQueue);
+
+        if (Sensor_Schema_Add (SENSOR_SCHEMA_ACC) != BLE_STATUS_SUCCESS) {
+                printf ("Error while adding ACC service.\n");
+                return BLE_STATUS_ERROR;
         }
 
+        Sample_Stream_Init (&sensorService->accStream, acc_stream_send, sensorService, ACC_STREAM_LATENCY);
+        Sample_Stream_Set_Encoding (&sensorService->accStream, ACC_STREAM_ENCODING);
+        Char_Cache_Init (&sensorService->accCache, ACC_DEADBAND);
         return BLE_STATUS_SUCCESS;
-
-fail:
-        printf ("Error while adding ACC service.\n");
-        return BLE_STATUS_ERROR;
 }
 
 /**
@@ -204,7 +177,7 @@ tBleStatus Free_Fall_Notify (void)
         tBleStatus ret;
 
         val = 0x01;
-        ret = aci_gatt_update_char_value (accServHandle, freeFallCharHandle, 0, 1, &val);
+        ret = update_char (sensorService->accServHandle, sensorService->freeFallCharHandle, &val, 1, NULL);
 
         if (ret != BLE_STATUS_SUCCESS) {
                 PRINTF ("Error while updating ACC characteristic.\n");
@@ -223,12 +196,19 @@ tBleStatus Acc_Update (AxesRaw_t *data)
 {
         tBleStatus ret;
         uint8_t buff[6];
+        int32_t axes[3] = { data->AXIS_X, data->AXIS_Y, data->AXIS_Z };
+
+        if (!Char_Cache_Update (&sensorService->accCache, axes, 3)) {
+                return BLE_STATUS_SUCCESS;
+        }
 
         STORE_LE_16 (buff, data->AXIS_X);
         STORE_LE_16 (buff + 2, data->AXIS_Y);
         STORE_LE_16 (buff + 4, data->AXIS_Z);
 
-        ret = aci_gatt_update_char_value (accServHandle, accCharHandle, 0, 6, buff);
+        Aci_Account_Begin (ACI_OP_ACC_UPDATE);
+        ret = update_char (sensorService->accServHandle, sensorService->accCharHandle, buff, 6, &sensorService->accCache);
+        Aci_Account_End ();
 
         if (ret != BLE_STATUS_SUCCESS) {
                 PRINTF ("Error while updating ACC characteristic.\n");
@@ -238,6 +218,71 @@ tBleStatus Acc_Update (AxesRaw_t *data)
         return BLE_STATUS_SUCCESS;
 }
 
+/**
+ * @brief  Completion of the updates which went through the notification queue.
+ * @param  context : the Char_Cache_t of the characteristic, or NULL.
+ */
+static void update_done (void *context, uint8_t status, const uint8_t *ret, uint8_t retLen)
+{
+        (void)ret;
+        (void)retLen;
+
+        if (status != BLE_STATUS_SUCCESS) {
+                if (context) {
+                        Char_Cache_Invalidate (context);
+                }
+
+                PRINTF ("Error while updating a characteristic (%d).\n", status);
+        }
+}
+
+/**
+ * @brief  Same as Acc_Update, but does not wait for the controller : the
+ *         update goes to the notification queue (notify_queue.h).
+ * @param  Structure containing acceleration value in mg
+ * @retval Status
+ */
+tBleStatus Acc_Update_Async (AxesRaw_t *data)
+{
+        int32_t axes[3] = { data->AXIS_X, data->AXIS_Y, data->AXIS_Z };
+
+        if (!Char_Cache_Update (&sensorService->accCache, axes, 3)) {
+                return BLE_STATUS_SUCCESS;
+        }
+
+        uint8_t buff[6];
+        STORE_LE_16 (buff, data->AXIS_X);
+        STORE_LE_16 (buff + 2, data->AXIS_Y);
+        STORE_LE_16 (buff + 4, data->AXIS_Z);
+
+        if (Notify_Queue_Push (&sensorService->notifyQueue, sensorService->accServHandle, sensorService->accCharHandle, buff, 6, update_done,
+                               &sensorService->accCache)) {
+                Char_Cache_Invalidate (&sensorService->accCache);
+                PRINTF ("Error while updating ACC characteristic.\n");
+                return BLE_STATUS_INSUFFICIENT_RESOURCES;
+        }
+
+        return BLE_STATUS_SUCCESS;
+}
+
+/**
+ * @brief  Queues an acceleration sample for the stream characteristic. Samples
+ *         are sent several per notification, see sample_stream.h, once the
+ *         client has enabled them (acc_stream_cccd).
+ * @param  Structure containing acceleration value in mg
+ * @retval None
+ */
+void Acc_Stream_Push (AxesRaw_t *data)
+{
+        if (!sensorService->subscribers) {
+                return;
+        }
+
+        Sample_Stream_Push (&sensorService->accStream, data->AXIS_X, data->AXIS_Y, data->AXIS_Z);
+}
+
+static void refresh_characteristics (void *arg);
+
 /**
  * @brief  Add the Environmental Sensor service.
  *
@@ -246,79 +291,18 @@ tBleStatus Acc_Update (AxesRaw_t *data)
  */
 tBleStatus Add_Environmental_Sensor_Service (void)
 {
-        tBleStatus ret;
-        uint8_t uuid[16];
-        uint16_t uuid16;
-        charactFormat charFormat;
-        uint16_t descHandle;
-
-        COPY_ENV_SENS_SERVICE_UUID (uuid);
-        ret = aci_gatt_add_serv (UUID_TYPE_128, uuid, PRIMARY_SERVICE, 10, &envSensServHandle);
-        if (ret != BLE_STATUS_SUCCESS) goto fail;
-
-        /* Temperature Characteristic */
-        COPY_TEMP_CHAR_UUID (uuid);
-        ret = aci_gatt_add_char (envSensServHandle, UUID_TYPE_128, uuid, 2, CHAR_PROP_READ, ATTR_PERMISSION_NONE, GATT_NOTIFY_READ_REQ_AND_WAIT_FOR_APPL_RESP,
-                                 16, 0, &tempCharHandle);
-        if (ret != BLE_STATUS_SUCCESS) goto fail;
-
-        charFormat.format = FORMAT_SINT16;
-        charFormat.exp = -1;
-        charFormat.unit = UNIT_TEMP_CELSIUS;
-        charFormat.name_space = 0;
-        charFormat.desc = 0;
-
-        uuid16 = CHAR_FORMAT_DESC_UUID;
-
-        ret = aci_gatt_add_char_desc (envSensServHandle, tempCharHandle, UUID_TYPE_16, (uint8_t *)&uuid16, 7, 7, (void *)&charFormat, ATTR_PERMISSION_NONE,
-                                      ATTR_ACCESS_READ_ONLY, 0, 16, FALSE, &descHandle);
-        if (ret != BLE_STATUS_SUCCESS) goto fail;
-
-        /* Pressure Characteristic */
-        if (1) { // FIXME
-                COPY_PRESS_CHAR_UUID (uuid);
-                ret = aci_gatt_add_char (envSensServHandle, UUID_TYPE_128, uuid, 3, CHAR_PROP_READ, ATTR_PERMISSION_NONE,
-                                         GATT_NOTIFY_READ_REQ_AND_WAIT_FOR_APPL_RESP, 16, 0, &pressCharHandle);
-                if (ret != BLE_STATUS_SUCCESS) goto fail;
-
-                charFormat.format = FORMAT_SINT24;
-                charFormat.exp = -5;
-                charFormat.unit = UNIT_PRESSURE_BAR;
-                charFormat.name_space = 0;
-                charFormat.desc = 0;
-
-                uuid16 = CHAR_FORMAT_DESC_UUID;
-
-                ret = aci_gatt_add_char_desc (envSensServHandle, pressCharHandle, UUID_TYPE_16, (uint8_t *)&uuid16, 7, 7, (void *)&charFormat,
-                                              ATTR_PERMISSION_NONE, ATTR_ACCESS_READ_ONLY, 0, 16, FALSE, &descHandle);
-                if (ret != BLE_STATUS_SUCCESS) goto fail;
-        }
-        /* Humidity Characteristic */
-        if (1) { // FIXME
-                COPY_HUMIDITY_CHAR_UUID (uuid);
-                ret = aci_gatt_add_char (envSensServHandle, UUID_TYPE_128, uuid, 2, CHAR_PROP_READ, ATTR_PERMISSION_NONE,
-                                         GATT_NOTIFY_READ_REQ_AND_WAIT_FOR_APPL_RESP, 16, 0, &humidityCharHandle);
-                if (ret != BLE_STATUS_SUCCESS) goto fail;
-
-                charFormat.format = FORMAT_UINT16;
-                charFormat.exp = -1;
-                charFormat.unit = UNIT_UNITLESS;
-                charFormat.name_space = 0;
-                charFormat.desc = 0;
-
-                uuid16 = CHAR_FORMAT_DESC_UUID;
-
-                ret = aci_gatt_add_char_desc (envSensServHandle, humidityCharHandle, UUID_TYPE_16, (uint8_t *)&uuid16, 7, 7, (void *)&charFormat,
-                                              ATTR_PERMISSION_NONE, ATTR_ACCESS_READ_ONLY, 0, 16, FALSE, &descHandle);
-                if (ret != BLE_STATUS_SUCCESS) goto fail;
+        if (Sensor_Schema_Add (SENSOR_SCHEMA_ENVIRONMENTAL) != BLE_STATUS_SUCCESS) {
+                PRINTF ("Error while adding ENV_SENS service.\n");
+                return BLE_STATUS_ERROR;
         }
+
         PRINTF ("Service ENV_SENS added. Handle 0x%04X, TEMP Charac handle: 0x%04X, PRESS Charac handle: 0x%04X, HUMID Charac handle: 0x%04X\n",
-                envSensServHandle, tempCharHandle, pressCharHandle, humidityCharHandle);
+                sensorService->envSensServHandle, sensorService->tempCharHandle, sensorService->pressCharHandle, sensorService->humidityCharHandle);
+        Timer_Wheel_Init_Timer (&sensorService->refreshTimer, refresh_characteristics, sensorService);
+        Char_Cache_Init (&sensorService->tempCache, TEMP_DEADBAND);
+        Char_Cache_Init (&sensorService->pressCache, PRESS_DEADBAND);
+        Char_Cache_Init (&sensorService->humidityCache, HUMIDITY_DEADBAND);
         return BLE_STATUS_SUCCESS;
-
-fail:
-        PRINTF ("Error while adding ENV_SENS service.\n");
-        return BLE_STATUS_ERROR;
 }
 
 /**
@@ -330,7 +314,11 @@ tBleStatus Temp_Update (int16_t temp)
 {
         tBleStatus ret;
 
-        ret = aci_gatt_update_char_value (envSensServHandle, tempCharHandle, 0, 2, (uint8_t *)&temp);
+        if (!Char_Cache_Update_1 (&sensorService->tempCache, temp)) {
+                return BLE_STATUS_SUCCESS;
+        }
+
+        ret = update_char (sensorService->envSensServHandle, sensorService->tempCharHandle, &temp, 2, &sensorService->tempCache);
 
         if (ret != BLE_STATUS_SUCCESS) {
                 PRINTF ("Error while updating TEMP characteristic.\n");
@@ -348,7 +336,11 @@ tBleStatus Press_Update (int32_t press)
 {
         tBleStatus ret;
 
-        ret = aci_gatt_update_char_value (envSensServHandle, pressCharHandle, 0, 3, (uint8_t *)&press);
+        if (!Char_Cache_Update_1 (&sensorService->pressCache, press)) {
+                return BLE_STATUS_SUCCESS;
+        }
+
+        ret = update_char (sensorService->envSensServHandle, sensorService->pressCharHandle, &press, 3, &sensorService->pressCache);
 
         if (ret != BLE_STATUS_SUCCESS) {
                 PRINTF ("Error while updating TEMP characteristic.\n");
@@ -366,7 +358,11 @@ tBleStatus Humidity_Update (uint16_t humidity)
 {
         tBleStatus ret;
 
-        ret = aci_gatt_update_char_value (envSensServHandle, humidityCharHandle, 0, 2, (uint8_t *)&humidity);
+        if (!Char_Cache_Update_1 (&sensorService->humidityCache, humidity)) {
+                return BLE_STATUS_SUCCESS;
+        }
+
+        ret = update_char (sensorService->envSensServHandle, sensorService->humidityCharHandle, &humidity, 2, &sensorService->humidityCache);
 
         if (ret != BLE_STATUS_SUCCESS) {
                 PRINTF ("Error while updating TEMP characteristic.\n");
@@ -375,6 +371,89 @@ tBleStatus Humidity_Update (uint16_t humidity)
         return BLE_STATUS_SUCCESS;
 }
 
+/**
+ * @brief  Sensor emulation.
+ */
+static int16_t sample_temperature (void) { return 270 + ((uint64_t)rand () * 15) / RAND_MAX; }
+static int32_t sample_pressure (void) { return 100000 + ((uint64_t)rand () * 1000) / RAND_MAX; }
+static uint16_t sample_humidity (void) { return 450 + ((uint64_t)rand () * 100) / RAND_MAX; }
+
+/**
+ * @brief  Queues an update of a characteristic value without waiting for the
+ *         controller, unless the value in the controller is still good. A
+ *         value which does not fit waits for the next round.
+ * @param  Sensor_Service_t* s : instance the characteristic belongs to.
+ * @param  Char_Cache_t* cache : cache of the characteristic, already updated with value.
+ * @retval None
+ */
+static void refresh_char (Sensor_Service_t *s, uint16_t servHandle, uint16_t charHandle, const void *value, uint8_t len, Char_Cache_t *cache)
+{
+        if (Notify_Queue_Push (&s->notifyQueue, servHandle, charHandle, value, len, update_done, cache)) {
+                Char_Cache_Invalidate (cache);
+                ++s->readStats.refreshSkipped;
+        }
+}
+
+/**
+ * @brief  LOCAL_READS : writes the current value of every readable
+ *         characteristic to the controller, which answers the reads with it.
+ *         Runs every SENSOR_REFRESH_PERIOD ms while connected.
+ * @param  Sensor_Service_t* arg : instance to refresh.
+ * @retval None
+ */
+static void refresh_characteristics (void *arg)
+{
+        Sensor_Service_t *s = arg;
+        uint8_t acc[6];
+        int32_t axes[3] = { s->axes_data.AXIS_X, s->axes_data.AXIS_Y, s->axes_data.AXIS_Z };
+        int16_t temp = sample_temperature ();
+        int32_t press = sample_pressure ();
+        uint16_t humidity = sample_humidity ();
+
+        STORE_LE_16 (acc, s->axes_data.AXIS_X);
+        STORE_LE_16 (acc + 2, s->axes_data.AXIS_Y);
+        STORE_LE_16 (acc + 4, s->axes_data.AXIS_Z);
+
+        Aci_Account_Begin (ACI_OP_REFRESH);
+
+        if (Char_Cache_Update (&s->accCache, axes, 3)) {
+                refresh_char (s, s->accServHandle, s->accCharHandle, acc, 6, &s->accCache);
+        }
+
+        if (Char_Cache_Update_1 (&s->tempCache, temp)) {
+                refresh_char (s, s->envSensServHandle, s->tempCharHandle, &temp, 2, &s->tempCache);
+        }
+
+        if (Char_Cache_Update_1 (&s->pressCache, press)) {
+                refresh_char (s, s->envSensServHandle, s->pressCharHandle, &press, 3, &s->pressCache);
+        }
+
+        if (Char_Cache_Update_1 (&s->humidityCache, humidity)) {
+                refresh_char (s, s->envSensServHandle, s->humidityCharHandle, &humidity, 2, &s->humidityCache);
+        }
+
+        Aci_Account_End ();
+
+        ++s->readStats.refreshes;
+}
+
+/**
+ * @brief  Prints what serving the reads has cost so far. With LOCAL_READS the
+ *         application takes no part in reads, requests stays at 0.
+ * @param  None
+ * @retval None
+ */
+void Sensor_Service_Read_Report (void)
+{
+        const Sensor_Read_Stats_t *r = &sensorService->readStats;
+        uint32_t cyclesPerUs = Cycle_Counter_Per_Us ();
+        uint32_t mean = (r->requests) ? (r->cycles / r->requests) : (0);
+
+        printf ("reads %lu, mean %lu us, max %lu us, refreshes %lu, skipped %lu, allow retries %lu\n", (unsigned long)r->requests,
+                (unsigned long)(mean / cyclesPerUs), (unsigned long)(r->cyclesMax / cyclesPerUs), (unsigned long)r->refreshes,
+                (unsigned long)r->refreshSkipped, (unsigned long)r->allowRetries);
+}
+
 /**
  * @brief  Puts the device in connectable mode.
  *         If you want to specify a UUID list in the advertising data, those data can
@@ -395,32 +474,230 @@ tBleStatus Humidity_Update (uint16_t humidity)
  *  ret = aci_gap_update_adv_data(5, manuf_data);
  *
  */
-void setConnectable (void)
+static void make_connectable (void *context)
 {
         tBleStatus ret;
 
         const char local_name[] = { AD_TYPE_COMPLETE_LOCAL_NAME, 'Z', 'l', 'a', 'S', 'u', 'k', 'a' };
+        (void)context;
+
+        Aci_Account_Begin (ACI_OP_SET_CONNECTABLE);
 
         /* disable scan response */
-        hci_le_set_scan_resp_data (0, NULL);
+        ACI_BLOCKING (hci_le_set_scan_resp_data (0, NULL));
         PRINTF ("General Discoverable Mode.\n");
 
-        ret = aci_gap_set_discoverable (ADV_IND, 0, 0, PUBLIC_ADDR, NO_WHITE_LIST_USE, sizeof (local_name), local_name, 0, NULL, 0, 0);
+        ret = ACI_BLOCKING (aci_gap_set_discoverable (ADV_IND, 0, 0, PUBLIC_ADDR, NO_WHITE_LIST_USE, sizeof (local_name), local_name, 0, NULL, 0, 0));
+        Aci_Account_End ();
+        sensorService->advertising = (ret == BLE_STATUS_SUCCESS);
+
         if (ret != BLE_STATUS_SUCCESS) {
                 PRINTF ("Error while setting discoverable mode (%d)\n", ret);
         }
 }
 
+void setConnectable (void)
+{
+        /* Blocking calls : once the async commands in flight are done. Asked again on the next round if that cannot be arranged. */
+        if (Aci_Async_Defer (make_connectable, NULL)) {
+                sensorService->set_connectable = TRUE;
+        }
+}
+
+/**
+ * @brief  Connection of handle.
+ * @retval Sensor_Connection_t* : NULL if handle is not one of ours.
+ */
+static Sensor_Connection_t *find_connection (uint16_t handle)
+{
+        for (int i = 0; i < SENSOR_MAX_CONNECTIONS; ++i) {
+                Sensor_Connection_t *c = &sensorService->connections[i];
+
+                if (c->used && c->handle == handle) {
+                        return c;
+                }
+        }
+
+        return NULL;
+}
+
+/**
+ * @brief  Centrals the controller can serve at once.
+ */
+static int max_connections (void) { return (bnrg_expansion_board == IDB05A1) ? (SENSOR_MAX_CONNECTIONS) : (1); }
+
+/**
+ * @brief  Recounts the clients of the accelerometer stream and sizes its
+ *         notifications after the smallest ATT_MTU among them. The controller
+ *         sends every update to each subscribed client, over its own link,
+ *         so all of them get the same packets and those must fit every link.
+ * @param  None
+ * @retval None
+ */
+static void update_subscribers (void)
+{
+        uint16_t mtu = 0xffff;
+        uint8_t n = 0;
+
+        for (int i = 0; i < SENSOR_MAX_CONNECTIONS; ++i) {
+                const Sensor_Connection_t *c = &sensorService->connections[i];
+
+                if (!c->used || !c->notification_enabled) {
+                        continue;
+                }
+
+                ++n;
+
+                if (c->attMtu < mtu) {
+                        mtu = c->attMtu;
+                }
+        }
+
+        sensorService->subscribers = n;
+
+        /* Samples are only packed and sent while a client listens. */
+        if (!n) {
+                Sample_Stream_Reset (&sensorService->accStream);
+                return;
+        }
+
+        Sample_Stream_Set_Payload (&sensorService->accStream, mtu - 3);
+}
+
+/**
+ * @brief  Sets the ATT_MTU of a connection and sizes the notifications of
+ *         the variable length characteristics after it.
+ * @param  mtu : negotiated ATT_MTU.
+ * @retval None
+ */
+static void set_att_mtu (Sensor_Connection_t *c, uint16_t mtu)
+{
+        c->attMtu = mtu;
+        update_subscribers ();
+}
+
+/**
+ * @brief  Command Status of aci_gatt_exchange_configuration, sent by request_att_mtu.
+ */
+static void exchange_mtu_started (void *context, uint8_t status, const uint8_t *ret, uint8_t retLen)
+{
+        (void)context;
+        (void)ret;
+        (void)retLen;
+
+        if (status != BLE_STATUS_SUCCESS) {
+                PRINTF ("Error while starting the MTU exchange (%d)\n", status);
+        }
+}
+
+/**
+ * @brief  Starts the exchange MTU procedure on a connection, once. The
+ *         command is async (it runs from event handlers), the result comes
+ *         with EVT_BLUE_ATT_EXCHANGE_MTU_RESP.
+ *         Only the BlueNRG-MS firmware (IDB05A1) supports ATT_MTU > 23.
+ * @param  Sensor_Connection_t* c : NULL if the connection is not one of ours.
+ * @retval None
+ */
+static void request_att_mtu (Sensor_Connection_t *c)
+{
+        if (bnrg_expansion_board != IDB05A1 || !c || c->mtuRequested) {
+                return;
+        }
+
+        /* aci_gatt_exchange_configuration parameters : connection handle. */
+        uint8_t params[2];
+        STORE_LE_16 (params, c->handle);
+
+        if (Aci_Async_Send (OGF_VENDOR_CMD, OCF_GATT_EXCHANGE_CONFIG, params, sizeof (params), exchange_mtu_started, NULL)) {
+                PRINTF ("Error while starting the MTU exchange\n");
+                return;
+        }
+
+        c->mtuRequested = TRUE;
+}
+
+/**
+ * @brief  Aci_Async_Defer callbacks of GAP_ConnectionComplete_CB. Neither
+ *         failure is fatal : the server goes on with its other clients.
+ * @param  context : the connection handle (turn_away) or its Sensor_Connection_t (list_attributes).
+ * @retval None
+ */
+static void turn_away (void *context)
+{
+        uint16_t handle = (uintptr_t)context;
+        tBleStatus ret = ACI_BLOCKING (aci_gap_terminate (handle, HCI_OE_USER_ENDED_CONNECTION));
+
+        /* The central keeps a link the server does not serve, until it gives up on it. */
+        if (ret != BLE_STATUS_SUCCESS) {
+                printf ("Error while turning away connection 0x%04X (%d)\n", handle, ret);
+        }
+}
+
+static void list_attributes (void *context)
+{
+        Sensor_Connection_t *c = context;
+
+        /* Only lists the client's attributes (on_find_information_resp), nothing waits for it. */
+        if (!c->used) {
+                return;
+        }
+
+        tBleStatus ret = ACI_BLOCKING (aci_att_find_information_req (c->handle, 0x01, 0x01));
+
+        if (ret != BLE_STATUS_SUCCESS) {
+                printf ("Error while listing the attributes of connection 0x%04X (%d)\n", c->handle, ret);
+                /* No procedure complete event to wait for. */
+                request_att_mtu (c);
+        }
+}
+
 /**
  * @brief  This function is called when there is a LE Connection Complete event.
+ *         The device goes on advertising for the next central as long as
+ *         there is room for it.
  * @param  uint8_t Address of peer device
  * @param  uint16_t Connection handle
  * @retval None
  */
 void GAP_ConnectionComplete_CB (uint8_t addr[6], uint16_t handle)
 {
-        connected = TRUE;
-        connection_handle = handle;
+        Sensor_Connection_t *c = NULL;
+
+        /* The controller stops advertising when a central connects. */
+        sensorService->advertising = FALSE;
+
+        for (int i = 0; i < max_connections () && !c; ++i) {
+                if (!sensorService->connections[i].used) {
+                        c = &sensorService->connections[i];
+                }
+        }
+
+        if (!c) {
+                printf ("No room for connection 0x%04X\n", handle);
+
+                if (Aci_Async_Defer (turn_away, (void *)(uintptr_t)handle)) {
+                        printf ("Error while turning away connection 0x%04X\n", handle);
+                }
+
+                return;
+        }
+
+        c->used = TRUE;
+        c->handle = handle;
+        c->notification_enabled = FALSE;
+        c->mtuRequested = FALSE;
+        c->attMtu = ATT_DEFAULT_MTU;
+        Timer_Wheel_Init_Timer (&c->allowRetry, allow_read, c);
+
+#if LOCAL_READS
+        /* First round right away : reads must not see the values of the previous connection. */
+        if (!sensorService->connected) {
+                Timer_Wheel_Start (&sensorService->refreshTimer, 0, SENSOR_REFRESH_PERIOD);
+        }
+#endif
+
+        ++sensorService->connected;
+        sensorService->set_connectable = (sensorService->connected < max_connections ());
 
         printf ("Connected to device:");
         for (int i = 5; i > 0; i--) {
@@ -428,194 +705,382 @@ void GAP_ConnectionComplete_CB (uint8_t addr[6], uint16_t handle)
         }
         printf ("%02X\n", addr[0]);
 
-        tBleStatus stat = aci_att_find_information_req (connection_handle, 0x01, 0x01);
-
-        if (stat != BLE_STATUS_SUCCESS) {
-                printf ("stat != BLE_STATUS_SUCCESS (%d)\n", stat);
-                while (1)
-                        ;
+        /* Called from HCI_Process, maybe with a stream of updates in flight. */
+        if (Aci_Async_Defer (list_attributes, c)) {
+                printf ("Error while listing the attributes of connection 0x%04X\n", handle);
         }
 }
 
 /**
  * @brief  This function is called when the peer device gets disconnected.
- * @param  None
+ * @param  uint16_t Connection handle
  * @retval None
  */
-void GAP_DisconnectionComplete_CB (void)
+void GAP_DisconnectionComplete_CB (uint16_t handle)
 {
-        connected = FALSE;
+        Sensor_Connection_t *c = find_connection (handle);
+
+        /* One turned away by GAP_ConnectionComplete_CB. */
+        if (!c) {
+                return;
+        }
+
+        c->used = FALSE;
+        Timer_Wheel_Stop (&c->allowRetry);
+        --sensorService->connected;
         PRINTF ("Disconnected\n");
-        /* Make the device connectable again. */
-        set_connectable = TRUE;
-        notification_enabled = FALSE;
+        update_subscribers ();
+
+        /* Make the device connectable again, unless it still is. */
+        sensorService->set_connectable = !sensorService->advertising;
+
+        if (sensorService->connected) {
+                return;
+        }
+
+        Notify_Queue_Reset (&sensorService->notifyQueue);
+        Timer_Wheel_Stop (&sensorService->refreshTimer);
+        Sensor_Service_Read_Report ();
 }
 
 /**
- * @brief  Read request callback.
- * @param  uint16_t Handle of the attribute
- * @retval None
+ * @brief  Characteristic event handlers, found by attribute handle in
+ *         sensorService->handles (gatt_handle_table.h). The read handlers
+ *         update the value the controller then sends (Read_Request_CB).
  */
-void Read_Request_CB (uint16_t handle)
+static void read_acc (uint16_t connHandle, uint16_t charHandle)
+{
+        (void)connHandle;
+        (void)charHandle;
+        Acc_Update ((AxesRaw_t *)&sensorService->axes_data);
+}
+
+static void read_temperature (uint16_t connHandle, uint16_t charHandle)
+{
+        (void)connHandle;
+        (void)charHandle;
+        Acc_Update ((AxesRaw_t *)&sensorService->axes_data); // FIXME: to overcome issue on Android App
+        // If the user button is not pressed within
+        // a short time after the connection,
+        // a pop-up reports a "No valid characteristics found" error.
+        Temp_Update (sample_temperature ());
+}
+
+static void read_pressure (uint16_t connHandle, uint16_t charHandle)
+{
+        (void)connHandle;
+        (void)charHandle;
+        Press_Update (sample_pressure ());
+}
+
+static void read_humidity (uint16_t connHandle, uint16_t charHandle)
+{
+        (void)connHandle;
+        (void)charHandle;
+        Humidity_Update (sample_humidity ());
+}
+
+static void acc_stream_cccd (uint16_t connHandle, uint16_t charHandle, uint16_t config)
 {
-        if (handle == accCharHandle + 1) {
-                Acc_Update ((AxesRaw_t *)&axes_data);
+        Sensor_Connection_t *c = find_connection (connHandle);
+        (void)charHandle;
+
+        if (!c) {
+                return;
         }
-        else if (handle == tempCharHandle + 1) {
-                int16_t data;
-                data = 270 + ((uint64_t)rand () * 15) / RAND_MAX; // sensor emulation
-                Acc_Update ((AxesRaw_t *)&axes_data);             // FIXME: to overcome issue on Android App
-                // If the user button is not pressed within
-                // a short time after the connection,
-                // a pop-up reports a "No valid characteristics found" error.
-                Temp_Update (data);
+
+        c->notification_enabled = (config & GATT_CCCD_NOTIFY) != 0;
+        update_subscribers ();
+}
+
+#if NEW_SERVICES
+/* If GATT client has modified 'LED button characteristic' value, toggle LED2 */
+static void write_led (uint16_t connHandle, uint16_t charHandle, const uint8_t *data, uint8_t len)
+{
+        (void)connHandle;
+        (void)charHandle;
+        (void)data;
+        (void)len;
+        BSP_LED_Toggle (LED2);
+}
+#endif
+
+const Gatt_Char_Handlers_t accCharHandlers = { .read = read_acc, .tag = ACI_OP_READ_ACC };
+const Gatt_Char_Handlers_t accStreamCharHandlers = { .cccd = acc_stream_cccd };
+const Gatt_Char_Handlers_t tempCharHandlers = { .read = read_temperature, .tag = ACI_OP_READ_TEMPERATURE };
+const Gatt_Char_Handlers_t pressCharHandlers = { .read = read_pressure, .tag = ACI_OP_READ_PRESSURE };
+const Gatt_Char_Handlers_t humidityCharHandlers = { .read = read_humidity, .tag = ACI_OP_READ_HUMIDITY };
+#if NEW_SERVICES
+const Gatt_Char_Handlers_t ledCharHandlers = { .write = write_led };
+#endif
+
+/**
+ * @brief  Completion of aci_gatt_allow_read : the controller answers the
+ *         client now. Accounts the time the read waited on the application.
+ * @param  Sensor_Connection_t* context : connection of the read.
+ */
+static void read_allowed (void *context, uint8_t status, const uint8_t *ret, uint8_t retLen)
+{
+        Sensor_Connection_t *c = context;
+        (void)ret;
+        (void)retLen;
+
+        if (status != BLE_STATUS_SUCCESS) {
+                PRINTF ("Error while allowing a read (%d)\n", status);
         }
-        else if (handle == pressCharHandle + 1) {
-                int32_t data;
-                struct timer t;
-                Timer_Set (&t, CLOCK_SECOND / 10);
-                data = 100000 + ((uint64_t)rand () * 1000) / RAND_MAX;
-                Press_Update (data);
+
+        /* Time the client's read waits on the application, on top of the controller's own. */
+        uint32_t cycles = Cycle_Counter_Now () - c->readStart;
+        Sensor_Read_Stats_t *r = &sensorService->readStats;
+        ++r->requests;
+        r->cycles += cycles;
+
+        if (cycles > r->cyclesMax) {
+                r->cyclesMax = cycles;
         }
-        else if (handle == humidityCharHandle + 1) {
-                uint16_t data;
+}
 
-                data = 450 + ((uint64_t)rand () * 100) / RAND_MAX;
+/**
+ * @brief  Notify_Queue_When_Sent callback of Read_Request_CB : the value the
+ *         read asked for is in the controller, let it answer. Also the
+ *         allowRetry timer's callback.
+ * @param  Sensor_Connection_t* context : connection of the read.
+ */
+static void allow_read (void *context)
+{
+        Sensor_Connection_t *c = context;
+        /* aci_gatt_allow_read parameters : connection handle. */
+        uint8_t params[2];
+        STORE_LE_16 (params, c->handle);
+
+        /* Async, this may run from an event handler (the completion of the update). The client waits until it goes through. */
+        if (Aci_Async_Send (OGF_VENDOR_CMD, OCF_GATT_ALLOW_READ, params, sizeof (params), read_allowed, c)) {
+                ++sensorService->readStats.allowRetries;
+                Timer_Wheel_Start (&c->allowRetry, SENSOR_ALLOW_READ_RETRY, 0);
+        }
+}
 
-                Humidity_Update (data);
+/**
+ * @brief  Read request callback. The read handler updates the value, which
+ *         may have to wait in the notification queue behind earlier updates
+ *         (update_char). The read is allowed only once it has gone to the
+ *         controller, so the client never gets a stale value. The client
+ *         makes one request at a time.
+ * @param  uint16_t Connection the request comes from
+ * @param  uint16_t Handle of the attribute
+ * @retval None
+ */
+void Read_Request_CB (uint16_t conn_handle, uint16_t handle)
+{
+        Sensor_Connection_t *c = find_connection (conn_handle);
+
+        if (!c) {
+                return;
         }
 
+        c->readStart = Cycle_Counter_Now ();
+        const Gatt_Handle_Entry_t *entry = Gatt_Handle_Table_Find (&sensorService->handles, handle);
+        uint8_t tag = (entry) ? (entry->handlers->tag) : (GATT_CHAR_TAG_NONE);
+        Aci_Account_Begin ((tag != GATT_CHAR_TAG_NONE) ? (tag) : (ACI_OP_READ_REQUEST));
+
+        Gatt_Handle_Table_Read (&sensorService->handles, conn_handle, handle);
+
         // EXIT:
-        if (connection_handle != 0) aci_gatt_allow_read (connection_handle);
+        if (Notify_Queue_When_Sent (&sensorService->notifyQueue, allow_read, c)) {
+                PRINTF ("Error while waiting for a read's update\n");
+        }
+
+        Aci_Account_End ();
 }
 
 /**
- * @brief  Callback processing the ACI events.
- * @note   Inside this function each event must be identified and correctly
- *         parsed.
- * @param  void* Pointer to the ACI packet
+ * @brief  This function is called when an attribute gets modified (value or
+ *         CCCD written by the client).
+ * @param  Connection of the client
+ * @param  Handle of the attribute
+ * @param  Size of the modified attribute data
+ * @param  Pointer to the modified attribute data
  * @retval None
  */
-void HCI_Event_CB (void *pckt)
+void Attribute_Modified_CB (uint16_t conn_handle, uint16_t handle, uint8_t data_length, uint8_t *att_data)
 {
-        hci_uart_pckt *hci_pckt = pckt;
-        /* obtain event packet */
-        hci_event_pckt *event_pckt = (hci_event_pckt *)hci_pckt->data;
+        Gatt_Handle_Table_Modified (&sensorService->handles, conn_handle, handle, att_data, data_length);
+}
 
-        if (hci_pckt->type != HCI_EVENT_PKT) return;
+/**
+ * @brief  HCI event handlers, see sensorEvents below. Each one gets the event
+ *         payload (after the event / subevent / vendor code).
+ */
+static void on_disconnection_complete (void *data)
+{
+        evt_disconn_complete *evt = data;
+        GAP_DisconnectionComplete_CB (evt->handle);
+}
 
-        switch (event_pckt->evt) {
+static void on_connection_complete (void *data)
+{
+        evt_le_connection_complete *cc = data;
+        Aci_Account_Begin (ACI_OP_CONNECTION_SETUP);
+        GAP_ConnectionComplete_CB (cc->peer_bdaddr, cc->handle);
+        Aci_Account_End ();
+}
 
-        case EVT_DISCONN_COMPLETE: {
-                GAP_DisconnectionComplete_CB ();
-        } break;
+/* this callback is invoked when a GATT attribute is modified
+extract callback data and pass to suitable handler function */
+static void on_attribute_modified_IDB05A1 (void *data)
+{
+        evt_gatt_attr_modified_IDB05A1 *evt = data;
+        Attribute_Modified_CB (evt->conn_handle, evt->attr_handle, evt->data_length, evt->att_data);
+}
 
-        case EVT_LE_META_EVENT: {
-                evt_le_meta_event *evt = (void *)event_pckt->data;
+static void on_attribute_modified_IDB04A1 (void *data)
+{
+        evt_gatt_attr_modified_IDB04A1 *evt = data;
+        Attribute_Modified_CB (evt->conn_handle, evt->attr_handle, evt->data_length, evt->att_data);
+}
 
-                switch (evt->subevent) {
-                case EVT_LE_CONN_COMPLETE: {
-                        evt_le_connection_complete *cc = (void *)evt->data;
-                        GAP_ConnectionComplete_CB (cc->peer_bdaddr, cc->handle);
-                } break;
-                }
-        } break;
+static void on_read_permit_req (void *data)
+{
+        evt_gatt_read_permit_req *pr = data;
+        Read_Request_CB (pr->conn_handle, pr->attr_handle);
+}
 
-        case EVT_VENDOR: {
-                evt_blue_aci *blue_evt = (void *)event_pckt->data;
-                switch (blue_evt->ecode) {
+/* One ATT request at a time : the MTU exchange waits for the find information procedure. */
+static void on_gatt_procedure_complete (void *data)
+{
+        evt_gatt_procedure_complete *evt = data;
+        request_att_mtu (find_connection (evt->conn_handle));
+}
 
-#if NEW_SERVICES
-                case EVT_BLUE_GATT_ATTRIBUTE_MODIFIED: {
-                        /* this callback is invoked when a GATT attribute is modified
-                        extract callback data and pass to suitable handler function */
-                        if (bnrg_expansion_board == IDB05A1) {
-                                evt_gatt_attr_modified_IDB05A1 *evt = (evt_gatt_attr_modified_IDB05A1 *)blue_evt->data;
-                                Attribute_Modified_CB (evt->attr_handle, evt->data_length, evt->att_data);
-                        }
-                        else {
-                                evt_gatt_attr_modified_IDB04A1 *evt = (evt_gatt_attr_modified_IDB04A1 *)blue_evt->data;
-                                Attribute_Modified_CB (evt->attr_handle, evt->data_length, evt->att_data);
-                        }
-                } break;
-#endif
+static void on_exchange_mtu_resp (void *data)
+{
+        evt_att_exchange_mtu_resp *evt = data;
+        Sensor_Connection_t *c = find_connection (evt->conn_handle);
+        /* server_rx_mtu is what the peer can receive, ATT_MTU is the smaller of both sides' RX MTU. */
+        uint16_t mtu = (evt->server_rx_mtu < ATT_LOCAL_MTU) ? (evt->server_rx_mtu) : (ATT_LOCAL_MTU);
+        PRINTF ("ATT_MTU %d (peer RX MTU %d)\n", mtu, evt->server_rx_mtu);
+
+        if (c) {
+                set_att_mtu (c, mtu);
+        }
+}
 
-                case EVT_BLUE_GATT_READ_PERMIT_REQ: {
-                        evt_gatt_read_permit_req *pr = (void *)blue_evt->data;
-                        Read_Request_CB (pr->attr_handle);
-                } break;
-
-                case EVT_BLUE_ATT_FIND_INFORMATION_RESP: {
-                        evt_att_find_information_resp *evt = (void *)blue_evt->data;
-
-                        uint8_t *p = evt->handle_uuid_pair;
-                        for (int i = 0; i < evt->event_data_length; ++i) {
-                                if (evt->format == 1) {
-                                        printf ("handle [%x], UUID [%x]\n", *(uint16_t *)(p + i * 4), *(uint16_t *)(p + 2 + i * 4));
-                                }
-                                else {
-                                        printf ("handle [%x], UUID [??]\n", *(uint16_t *)(p + i * 18));
-                                }
-                        }
-
-                        break;
+/* The controller has TX buffers again, after refusing an update for the lack of them. */
+static void on_tx_pool_available (void *data)
+{
+        (void)data;
+        Notify_Queue_Resume (&sensorService->notifyQueue);
+}
+
+static void on_find_information_resp (void *data)
+{
+        evt_att_find_information_resp *evt = data;
+
+        uint8_t *p = evt->handle_uuid_pair;
+        for (int i = 0; i < evt->event_data_length; ++i) {
+                if (evt->format == 1) {
+                        printf ("handle [%x], UUID [%x]\n", *(uint16_t *)(p + i * 4), *(uint16_t *)(p + 2 + i * 4));
                 }
+                else {
+                        printf ("handle [%x], UUID [??]\n", *(uint16_t *)(p + i * 18));
                 }
-        } break;
         }
 }
 
-#if NEW_SERVICES
+/*
+ * Event table. The only board dependent entry is the attribute modified event
+ * whose layout differs between IDB04A1 and IDB05A1 : IDB04A1 is assumed until
+ * Sensor_Service_Init_Events knows better. The controller's event masks are
+ * derived from this table (Sensor_Service_Program_Event_Mask).
+ */
+#define SENSOR_BOARD_EVENTS [HCI_VENDOR_EVENT_SLOT (EVT_BLUE_GATT_ATTRIBUTE_MODIFIED)] = on_attribute_modified_IDB04A1,
+
+static HCI_Dispatch_Table_t sensorEvents = {
+        [HCI_EVENT_SLOT (EVT_DISCONN_COMPLETE)] = on_disconnection_complete,
+        [HCI_EVENT_SLOT (EVT_CMD_COMPLETE)] = Aci_Async_On_Cmd_Complete,
+        [HCI_EVENT_SLOT (EVT_CMD_STATUS)] = Aci_Async_On_Cmd_Status,
+        [HCI_LE_META_SLOT (EVT_LE_CONN_COMPLETE)] = on_connection_complete,
+        [HCI_VENDOR_EVENT_SLOT (EVT_BLUE_GATT_READ_PERMIT_REQ)] = on_read_permit_req,
+        [HCI_VENDOR_EVENT_SLOT (EVT_BLUE_ATT_FIND_INFORMATION_RESP)] = on_find_information_resp,
+        [HCI_VENDOR_EVENT_SLOT (EVT_BLUE_GATT_PROCEDURE_COMPLETE)] = on_gatt_procedure_complete,
+        [HCI_VENDOR_EVENT_SLOT (EVT_BLUE_ATT_EXCHANGE_MTU_RESP)] = on_exchange_mtu_resp,
+        [HCI_VENDOR_EVENT_SLOT (EVT_BLUE_GATT_TX_POOL_AVAILABLE)] = on_tx_pool_available,
+        SENSOR_BOARD_EVENTS
+};
+
 /**
- * @brief  Add a time service using a vendor specific profile
+ * @brief  Adapts the event table to bnrg_expansion_board. Call once the
+ *         board has been detected.
  * @param  None
- * @retval Status
+ * @retval None
  */
-tBleStatus Add_Time_Service (void)
+void Sensor_Service_Init_Events (void)
 {
-        tBleStatus ret;
-        uint8_t uuid[16];
-
-        /* copy "Timer service UUID" defined above to 'uuid' local variable */
-        COPY_TIME_SERVICE_UUID (uuid);
+        if (bnrg_expansion_board == IDB05A1) {
+                sensorEvents[HCI_VENDOR_EVENT_SLOT (EVT_BLUE_GATT_ATTRIBUTE_MODIFIED)] = on_attribute_modified_IDB05A1;
+        }
+}
 
-        /*
-         * now add "Time service" to GATT server, service handle is returned
-         * via 'timeServHandle' parameter of aci_gatt_add_serv() API.
-         * Please refer to 'BlueNRG Application Command Interface.pdf' for detailed
-         * API description
-        */
-        ret = aci_gatt_add_serv (UUID_TYPE_128, uuid, PRIMARY_SERVICE, 7, &timeServHandle);
-        if (ret != BLE_STATUS_SUCCESS) goto fail;
+/**
+ * @brief  Enables in the controller only the events sensorEvents handles. Call
+ *         after the GAP / GATT initialization.
+ * @param  None
+ * @retval Status
+ */
+tBleStatus Sensor_Service_Program_Event_Mask (void)
+{
+        HCI_Event_Mask_Init (bnrg_expansion_board == IDB05A1);
+        return HCI_Event_Mask_Apply (sensorEvents);
+}
 
-        /*
-         * now add "Seconds characteristic" to Time service, characteristic handle
-         * is returned via 'secondsCharHandle' parameter of aci_gatt_add_char() API.
-         * This characteristic is read only, as specified by CHAR_PROP_READ parameter.
-         * Please refer to 'BlueNRG Application Command Interface.pdf' for detailed
-         * API description
-        */
-        COPY_TIME_UUID (uuid);
-        ret = aci_gatt_add_char (timeServHandle, UUID_TYPE_128, uuid, 4, CHAR_PROP_READ, ATTR_PERMISSION_NONE, 0, 16, 0, &secondsCharHandle);
+/**
+ * @brief  Installs handler for slot (see hci_dispatch.h) and updates the
+ *         controller's event masks accordingly.
+ * @param  slot : HCI_EVENT_SLOT / HCI_LE_META_SLOT / HCI_VENDOR_EVENT_SLOT value.
+ * @param  handler : NULL to stop handling the event.
+ * @retval Status
+ */
+tBleStatus Sensor_Service_Set_Event_Handler (unsigned int slot, HCI_Event_Handler_t handler)
+{
+        return HCI_Event_Mask_Set_Handler (sensorEvents, slot, handler);
+}
 
-        if (ret != BLE_STATUS_SUCCESS) goto fail;
+/**
+ * @brief  Callback processing the ACI events.
+ * @note   Events are looked up in sensorEvents, see hci_dispatch.h. Handlers
+ *         may keep the packet with HCI_Packet_Hold (hci_packet_pool.h).
+ * @param  void* Pointer to the ACI packet
+ * @retval None
+ */
+void HCI_Event_CB (void *pckt)
+{
+#ifdef HCI_CAPTURE
+        HCI_Replay_Event_Begin ();
+#endif
+        HCI_Packet_Begin (pckt);
+        HCI_Dispatch (sensorEvents, pckt);
+        HCI_Packet_End ();
+#ifdef HCI_CAPTURE
+        HCI_Replay_Event_End (pckt);
+#endif
+}
 
-        COPY_MINUTE_UUID (uuid);
-        /*
-         * Add "Minutes characteristic" to "Time service".
-         * This characteristic is readable as well as notifiable only, as specified
-         * by CHAR_PROP_NOTIFY|CHAR_PROP_READ parameter below.
-         */
-        ret = aci_gatt_add_char (timeServHandle, UUID_TYPE_128, uuid, 4, CHAR_PROP_NOTIFY | CHAR_PROP_READ, ATTR_PERMISSION_NONE, 0, 16, 1, &minuteCharHandle);
-        if (ret != BLE_STATUS_SUCCESS) goto fail;
+#if NEW_SERVICES
+/**
+ * @brief  Add a time service using a vendor specific profile
+ * @param  None
+ * @retval Status
+ */
+tBleStatus Add_Time_Service (void)
+{
+        /* Seconds characteristic : read only, minutes characteristic : readable and notifiable, see sensor_schema.cc. */
+        if (Sensor_Schema_Add (SENSOR_SCHEMA_TIME) != BLE_STATUS_SUCCESS) {
+                PRINTF ("Error while adding Time service.\n");
+                return BLE_STATUS_ERROR;
+        }
 
-        PRINTF ("Service TIME added. Handle 0x%04X, TIME Charac handle: 0x%04X\n", timeServHandle, secondsCharHandle);
+        PRINTF ("Service TIME added. Handle 0x%04X, TIME Charac handle: 0x%04X\n", sensorService->timeServHandle, sensorService->secondsCharHandle);
         return BLE_STATUS_SUCCESS;
-
-/* return BLE_STATUS_ERROR if we reach this tag */
-fail:
-        PRINTF ("Error while adding Time service.\n");
-        return BLE_STATUS_ERROR;
 }
 
 /**
@@ -640,7 +1105,7 @@ tBleStatus Seconds_Update (void)
          * Please refer to 'BlueNRG Application Command Interface.pdf' for detailed
          * API description
          */
-        ret = aci_gatt_update_char_value (timeServHandle, secondsCharHandle, 0, 4, time);
+        ret = update_char (sensorService->timeServHandle, sensorService->secondsCharHandle, time, 4, NULL);
 
         if (ret != BLE_STATUS_SUCCESS) {
                 PRINTF ("Error while updating TIME characteristic.\n");
@@ -666,9 +1131,9 @@ tBleStatus Minutes_Notify (void)
         /* update "Minutes characteristic" value iff it has changed w.r.t. previous
          * "minute" value.
          */
-        if ((minuteValue = val / (60 * 1000)) != previousMinuteValue) {
+        if ((minuteValue = val / (60 * 1000)) != sensorService->previousMinuteValue) {
                 /* memorize this "minute" value for future usage */
-                previousMinuteValue = minuteValue;
+                sensorService->previousMinuteValue = minuteValue;
 
                 /* create a time[] array to pass as last argument of aci_gatt_update_char_value() API*/
                 const uint8_t time[4] = { (minuteValue >> 24) & 0xFF, (minuteValue >> 16) & 0xFF, (minuteValue >> 8) & 0xFF, (minuteValue)&0xFF };
@@ -678,7 +1143,7 @@ tBleStatus Minutes_Notify (void)
                  * Please refer to 'BlueNRG Application Command Interface.pdf' for detailed
                  * API description
                  */
-                ret = aci_gatt_update_char_value (timeServHandle, minuteCharHandle, 0, 4, time);
+                ret = update_char (sensorService->timeServHandle, sensorService->minuteCharHandle, time, 4, NULL);
                 if (ret != BLE_STATUS_SUCCESS) {
                         PRINTF ("Error while updating TIME characteristic.\n");
                         return BLE_STATUS_ERROR;
@@ -706,56 +1171,17 @@ void Update_Time_Characteristics (void)
  */
 tBleStatus Add_LED_Service (void)
 {
-        tBleStatus ret;
-        uint8_t uuid[16];
-
-        /* copy "LED service UUID" defined above to 'uuid' local variable */
-        COPY_LED_SERVICE_UUID (uuid);
-        /*
-         * now add "LED service" to GATT server, service handle is returned
-         * via 'ledServHandle' parameter of aci_gatt_add_serv() API.
-         * Please refer to 'BlueNRG Application Command Interface.pdf' for detailed
-         * API description
-        */
-        ret = aci_gatt_add_serv (UUID_TYPE_128, uuid, PRIMARY_SERVICE, 7, &ledServHandle);
-        if (ret != BLE_STATUS_SUCCESS) goto fail;
-
-        /* copy "LED button characteristic UUID" defined above to 'uuid' local variable */
-        COPY_LED_UUID (uuid);
-        /*
-         * now add "LED button characteristic" to LED service, characteristic handle
-         * is returned via 'ledButtonCharHandle' parameter of aci_gatt_add_char() API.
-         * This characteristic is writable, as specified by 'CHAR_PROP_WRITE' parameter.
-         * Please refer to 'BlueNRG Application Command Interface.pdf' for detailed
-         * API description
-        */
-        ret = aci_gatt_add_char (ledServHandle, UUID_TYPE_128, uuid, 4, CHAR_PROP_WRITE | CHAR_PROP_WRITE_WITHOUT_RESP, ATTR_PERMISSION_NONE,
-                                 GATT_NOTIFY_ATTRIBUTE_WRITE, 16, 1, &ledButtonCharHandle);
-        if (ret != BLE_STATUS_SUCCESS) goto fail;
+        /* LED button characteristic : writable, see sensor_schema.cc. */
+        if (Sensor_Schema_Add (SENSOR_SCHEMA_LED) != BLE_STATUS_SUCCESS) {
+                PRINTF ("Error while adding LED service.\n");
+                return BLE_STATUS_ERROR;
+        }
 
-        PRINTF ("Service LED BUTTON added. Handle 0x%04X, LED button Charac handle: 0x%04X\n", ledServHandle, ledButtonCharHandle);
+        PRINTF ("Service LED BUTTON added. Handle 0x%04X, LED button Charac handle: 0x%04X\n", sensorService->ledServHandle,
+                sensorService->ledButtonCharHandle);
         return BLE_STATUS_SUCCESS;
-
-fail:
-        PRINTF ("Error while adding LED service.\n");
-        return BLE_STATUS_ERROR;
 }
 
-/**
- * @brief  This function is called attribute value corresponding to
- *         ledButtonCharHandle characteristic gets modified.
- * @param  Handle of the attribute
- * @param  Size of the modified attribute data
- * @param  Pointer to the modified attribute data
- * @retval None
- */
-void Attribute_Modified_CB (uint16_t handle, uint8_t data_length, uint8_t *att_data)
-{
-        /* If GATT client has modified 'LED button characteristic' value, toggle LED2 */
-        if (handle == ledButtonCharHandle + 1) {
-                BSP_LED_Toggle (LED2);
-        }
-}
 #endif /* NEW_SERVICES */
        /**
         * @}
@@ -59,6 +59,11 @@
 #include "hal.h"
 #include "sm.h"
 #include "debug.h"
+#include "hci_dispatch.h"
+#include "sample_stream.h"
+#include "char_cache.h"
+#include "gatt_handle_table.h"
+#include "notify_queue.h"
 
 #include <stdlib.h>
 
@@ -90,6 +95,34 @@
  *           - LED characteristic (Readable and Writable)
  */
 #define NEW_SERVICES 0
+
+/**
+ * @brief Readable characteristics are refreshed in the controller every
+ *        SENSOR_REFRESH_PERIOD ms while connected, and reads are answered by
+ *        the controller alone (GATT_DONT_NOTIFY_EVENTS). Set to 0 to have
+ *        every read go through Read_Request_CB and aci_gatt_allow_read.
+ */
+#ifndef LOCAL_READS
+#define LOCAL_READS 1
+#endif
+#define SENSOR_REFRESH_PERIOD 100
+/* aci_gatt_allow_read is sent again after this many ms when no async slot is free. */
+#define SENSOR_ALLOW_READ_RETRY 1
+
+/**
+ * @brief Centrals served at once. The device keeps advertising while fewer
+ *        are connected. The BlueNRG firmware (IDB04A1) takes one only.
+ */
+#ifndef SENSOR_MAX_CONNECTIONS
+#define SENSOR_MAX_CONNECTIONS 2
+#endif
+
+/* Whether the controller asks Read_Request_CB for the value of the readable characteristics. */
+#if LOCAL_READS
+#define SENSOR_READ_EVENTS GATT_DONT_NOTIFY_EVENTS
+#else
+#define SENSOR_READ_EVENTS GATT_NOTIFY_READ_REQ_AND_WAIT_FOR_APPL_RESP
+#endif
 /**
  * @}
  */
@@ -107,6 +140,81 @@ typedef struct {
   i32_t AXIS_Y;
   i32_t AXIS_Z;
 } AxesRaw_t;
+
+/**
+ * @brief Cost of serving characteristic reads.
+ */
+typedef struct {
+  uint32_t requests;       /* reads answered by the application (Read_Request_CB) */
+  uint32_t cycles;         /* total CPU cycles from Read_Request_CB to the completion of aci_gatt_allow_read */
+  uint32_t cyclesMax;
+  uint32_t refreshes;      /* background refresh rounds (LOCAL_READS) */
+  uint32_t refreshSkipped; /* values not refreshed, no room for the command */
+  uint32_t allowRetries;   /* aci_gatt_allow_read sent again later, no room for the command */
+} Sensor_Read_Stats_t;
+
+/**
+ * @brief State of one connected central.
+ */
+typedef struct {
+  uint8_t used;
+  uint16_t handle;
+  uint8_t notification_enabled; /* accStreamCharHandle CCCD of this client */
+  uint16_t attMtu;
+  uint8_t mtuRequested;         /* the exchange MTU procedure was started */
+  uint32_t readStart;           /* when its last read permit request came, CPU cycles */
+  Timer_Wheel_Timer_t allowRetry; /* aci_gatt_allow_read found no async slot */
+} Sensor_Connection_t;
+
+/**
+ * @brief State of the sensor application : connections, sensor data and the
+ *        GATT handles returned by the controller.
+ */
+typedef struct {
+  volatile int connected;          /* connections open */
+  volatile uint8_t set_connectable;
+  volatile uint8_t advertising;
+  uint8_t subscribers;             /* connections with the stream notifications enabled */
+  Sensor_Connection_t connections[SENSOR_MAX_CONNECTIONS];
+  volatile AxesRaw_t axes_data;
+  Timer_Wheel_Timer_t sampleTimer; /* accelerometer emulation, see sensor_app.c */
+  uint8_t accUpdateSkip;           /* samples before the next accCharHandle update */
+  uint16_t sampleServHandle, TXCharHandle, RXCharHandle;
+  uint16_t accServHandle, freeFallCharHandle, accCharHandle, accStreamCharHandle;
+  uint16_t envSensServHandle, tempCharHandle, pressCharHandle, humidityCharHandle;
+  Sample_Stream_t accStream; /* accelerometer samples, packed into accStreamCharHandle notifications */
+  Notify_Queue_t notifyQueue; /* characteristic updates waiting for controller TX buffers */
+  Timer_Wheel_Timer_t refreshTimer; /* LOCAL_READS background refresh */
+  Char_Cache_t accCache, tempCache, pressCache, humidityCache; /* values in the controller */
+  Sensor_Read_Stats_t readStats;
+  Gatt_Handle_Table_t handles; /* attribute handle to characteristic handlers */
+#if NEW_SERVICES
+  uint16_t timeServHandle, secondsCharHandle, minuteCharHandle;
+  uint16_t ledServHandle, ledButtonCharHandle;
+  uint8_t ledState;
+  int previousMinuteValue;
+#endif
+} Sensor_Service_t;
+
+/* ATT_MTU until both sides agree on a larger one, a notification carries ATT_MTU - 3 bytes. */
+#define ATT_DEFAULT_MTU 23
+
+/* RX MTU the BlueNRG-MS firmware offers in the exchange MTU procedure (its largest ATT_MTU). */
+#ifndef ATT_LOCAL_MTU
+#define ATT_LOCAL_MTU 158
+#endif
+
+#if NEW_SERVICES
+#define SENSOR_SERVICE_INITIALIZER { .set_connectable = 1, .previousMinuteValue = -1 }
+#else
+#define SENSOR_SERVICE_INITIALIZER { .set_connectable = 1 }
+#endif
+
+/**
+ * @brief The application state. A single instance, as the HCI library keeps
+ *        its own in globals : host fleets (tools/sim_fleet.c) fork per board.
+ */
+extern Sensor_Service_t *sensorService;
 /**
  * @}
  */
@@ -116,12 +224,21 @@ typedef struct {
  */
 tBleStatus Add_Acc_Service(void);
 tBleStatus Acc_Update(AxesRaw_t *data);
+tBleStatus Acc_Update_Async(AxesRaw_t *data);
+void       Acc_Stream_Push(AxesRaw_t *data);
 tBleStatus Add_Environmental_Sensor_Service(void);
 void       setConnectable(void);
 void       enableNotification(void);
 void       GAP_ConnectionComplete_CB(uint8_t addr[6], uint16_t handle);
-void       GAP_DisconnectionComplete_CB(void);
+void       GAP_DisconnectionComplete_CB(uint16_t handle);
+void       Sensor_Service_Init_Events(void);
+tBleStatus Sensor_Service_Program_Event_Mask(void);
+tBleStatus Sensor_Service_Set_Event_Handler(unsigned int slot, HCI_Event_Handler_t handler);
 void       HCI_Event_CB(void *pckt);
+void       Read_Request_CB(uint16_t conn_handle, uint16_t handle);
+void       Attribute_Modified_CB(uint16_t conn_handle, uint16_t handle, uint8_t data_length,
+                                 uint8_t *att_data);
+void       Sensor_Service_Read_Report(void);
 
 #if NEW_SERVICES
   tBleStatus Add_Time_Service(void);
@@ -130,8 +247,6 @@ void       HCI_Event_CB(void *pckt);
   void       Update_Time_Characteristics(void);
 
   tBleStatus Add_LED_Service(void);
-  void       Attribute_Modified_CB(uint16_t handle, uint8_t data_length,
-                                   uint8_t *att_data);
 #endif
 /**
  * @}
@@ -0,0 +1,784 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#ifdef HOST_BUILD
+#include "sim_controller.h"
+#include "hci_transport.h"
+#include "hci_bottom_half.h"
+#include "virtual_clock.h"
+#include "hci.h"
+#include "hci_const.h"
+#include "bluenrg_aci_const.h"
+#include "bluenrg_gatt_server.h"
+#include "ble_status.h"
+#include "gatt_handle_table.h"
+#include <stdio.h>
+#include <string.h>
+
+#define H4_EVENT_HEADER_SIZE 3   /* packet type, event code, parameter length */
+#define H4_COMMAND_HEADER_SIZE 4 /* packet type, opcode, parameter length */
+#define SIM_PACKET_SIZE (H4_EVENT_HEADER_SIZE + 255)
+
+/* What getBlueNRGVersion makes of it : hardware 0x31 (IDB05A1), firmware 7.2a. */
+#define SIM_HCI_REVISION 0x3107
+#define SIM_LMP_SUBVERSION 0x002a
+
+/* HCI error codes. */
+#define UNKNOWN_CONNECTION_ID 0x02
+#define CONNECTION_TERMINATED_BY_LOCAL_HOST 0x16
+
+#define VENDOR(ocf) cmd_opcode_pack (OGF_VENDOR_CMD, ocf)
+#define STORE_LE_16(buf, val) (((buf)[0] = (uint8_t) (val)), ((buf)[1] = (uint8_t) ((val) >> 8)))
+
+typedef struct {
+        uint8_t used;
+        tClockTime due; /* raised (readable by the host) from then on */
+        uint16_t len;
+        uint8_t data[SIM_PACKET_SIZE];
+} Sim_Packet_t;
+
+typedef struct {
+        uint16_t handle;     /* declaration, the value is at handle + 1, the CCCD at handle + 2 */
+        uint8_t cccd;        /* notifiable or indicatable */
+        uint8_t readPermit;  /* reads wait for the host's aci_gatt_allow_read */
+        uint8_t subscribers; /* bit per connections[] entry */
+} Sim_Char_t;
+
+typedef struct {
+        uint8_t used;
+        uint16_t handle;
+        uint8_t readPending; /* a read waits for aci_gatt_allow_read */
+        tClockTime readStart;
+} Sim_Connection_t;
+
+Sim_Controller_Stats_t simControllerStats;
+
+static Sim_Packet_t packets[SIM_QUEUE_SIZE];
+static uint8_t order[SIM_QUEUE_SIZE]; /* packets[] indices, by due time */
+static uint8_t queued;
+
+static uintptr_t epoch; /* a reset outdates the callbacks scheduled before it */
+static uint16_t nextHandle;
+static Sim_Char_t chars[SIM_MAX_CHARS];
+static uint8_t charsCount;
+static Sim_Connection_t connections[SIM_MAX_CONNECTIONS];
+static uint8_t connectionsCount;
+static uint8_t advertising;
+static uint8_t connectionEvents; /* connection_event is scheduled */
+static uint8_t txUsed;
+static uint8_t txWaiting; /* an update was refused, EVT_BLUE_GATT_TX_POOL_AVAILABLE is due */
+static uint8_t txSent[SIM_MAX_CONNECTIONS]; /* notifications sent since the last Number Of Completed Packets */
+static uint8_t loseAnswers; /* Command Complete / Status events still to lose */
+static Sim_Controller_Update_Hook_t updateHook;
+
+/* Event masks the host programmed, all events are enabled after a reset. */
+static uint64_t hciMask;
+static uint64_t leMask;
+static uint32_t gattMask;
+static uint16_t gapMask;
+
+/*****************************************************************************/
+
+static uint16_t get_le_16 (const uint8_t *p) { return p[0] | (p[1] << 8); }
+
+static uint64_t get_le_64 (const uint8_t *p)
+{
+        uint64_t v = 0;
+
+        for (int i = 7; i >= 0; --i) {
+                v = v << 8 | p[i];
+        }
+
+        return v;
+}
+
+static void *current_epoch (void) { return (void *)epoch; }
+
+static int outdated (void *arg) { return (uintptr_t)arg != epoch; }
+
+/*****************************************************************************/
+
+/// VClock_Schedule callback : the EXTI of the controller's IRQ line.
+static void raise_irq (void *arg)
+{
+        if (!outdated (arg)) {
+                HCI_Bottom_Half_Schedule ();
+        }
+}
+
+/*****************************************************************************/
+
+/**
+ * Whether the masks let the event through. Command Complete / Status, Number Of
+ * Completed Packets (its Set_Event_Mask bit is reserved) and the vendor events
+ * outside the masks always go.
+ */
+static int enabled (uint8_t code, const uint8_t *params)
+{
+        if (code == EVT_CMD_COMPLETE || code == EVT_CMD_STATUS || code == EVT_NUM_COMP_PKTS) {
+                return 1;
+        }
+
+        if (code == EVT_VENDOR) {
+                uint16_t ecode = get_le_16 (params);
+
+                if (ecode >= EVT_BLUE_GATT_ATTRIBUTE_MODIFIED && ecode < EVT_BLUE_GATT_ATTRIBUTE_MODIFIED + 32) {
+                        return (gattMask >> (ecode - EVT_BLUE_GATT_ATTRIBUTE_MODIFIED)) & 1;
+                }
+
+                if (ecode >= EVT_BLUE_GAP_LIMITED_DISCOVERABLE && ecode < EVT_BLUE_GAP_LIMITED_DISCOVERABLE + 16) {
+                        return (gapMask >> (ecode - EVT_BLUE_GAP_LIMITED_DISCOVERABLE)) & 1;
+                }
+
+                return 1;
+        }
+
+        if (code == 0 || code > 64 || !((hciMask >> (code - 1)) & 1)) {
+                return 0;
+        }
+
+        return code != EVT_LE_META_EVENT || (params[0] && params[0] <= 64 && ((leMask >> (params[0] - 1)) & 1));
+}
+
+/*****************************************************************************/
+
+/// Queues an event for the host, raised delay ms from now.
+static void emit (tClockTime delay, uint8_t code, const uint8_t *params, uint8_t len)
+{
+        if (!enabled (code, params)) {
+                ++simControllerStats.suppressed;
+                return;
+        }
+
+        if (queued >= SIM_QUEUE_SIZE) {
+                ++simControllerStats.dropped;
+                return;
+        }
+
+        uint8_t slot = 0;
+
+        while (packets[slot].used) {
+                ++slot;
+        }
+
+        Sim_Packet_t *p = &packets[slot];
+        p->used = 1;
+        p->due = VClock_Now () + delay;
+        p->len = H4_EVENT_HEADER_SIZE + len;
+        p->data[0] = HCI_EVENT_PKT;
+        p->data[1] = code;
+        p->data[2] = len;
+        memcpy (p->data + H4_EVENT_HEADER_SIZE, params, len);
+
+        /* FIFO between events due at the same time. */
+        uint8_t i = queued;
+
+        while (i > 0 && (int32_t)(packets[order[i - 1]].due - p->due) > 0) {
+                order[i] = order[i - 1];
+                --i;
+        }
+
+        order[i] = slot;
+        ++queued;
+        VClock_Schedule (delay, raise_irq, current_epoch ());
+}
+
+/*****************************************************************************/
+
+static void emit_vendor (tClockTime delay, uint16_t ecode, const uint8_t *params, uint8_t len)
+{
+        uint8_t p[2 + 32];
+        STORE_LE_16 (p, ecode);
+        memcpy (p + 2, params, len);
+        emit (delay, EVT_VENDOR, p, 2 + len);
+}
+
+/*****************************************************************************/
+
+/// Whether the answer to a command gets lost (Sim_Controller_Lose_Answers).
+static int lost (void)
+{
+        if (!loseAnswers) {
+                return 0;
+        }
+
+        --loseAnswers;
+        ++simControllerStats.lost;
+        return 1;
+}
+
+/*****************************************************************************/
+
+static void command_complete (uint16_t opcode, const uint8_t *ret, uint8_t len)
+{
+        if (lost ()) {
+                return;
+        }
+
+        /* 1 command credit. */
+        uint8_t p[EVT_CMD_COMPLETE_SIZE + 16] = { 1, (uint8_t)opcode, (uint8_t)(opcode >> 8) };
+        memcpy (p + EVT_CMD_COMPLETE_SIZE, ret, len);
+        emit (SIM_COMMAND_LATENCY, EVT_CMD_COMPLETE, p, EVT_CMD_COMPLETE_SIZE + len);
+}
+
+/*****************************************************************************/
+
+static void command_status (uint16_t opcode, uint8_t status)
+{
+        if (lost ()) {
+                return;
+        }
+
+        uint8_t p[] = { status, 1, (uint8_t)opcode, (uint8_t)(opcode >> 8) };
+        emit (SIM_COMMAND_LATENCY, EVT_CMD_STATUS, p, sizeof (p));
+}
+
+/*****************************************************************************/
+
+static int find_connection (uint16_t handle)
+{
+        for (int i = 0; i < SIM_MAX_CONNECTIONS; ++i) {
+                if (connections[i].used && connections[i].handle == handle) {
+                        return i;
+                }
+        }
+
+        return -1;
+}
+
+/*****************************************************************************/
+
+static Sim_Char_t *find_char (uint16_t handle)
+{
+        for (int i = 0; i < charsCount; ++i) {
+                if (chars[i].handle == handle) {
+                        return &chars[i];
+                }
+        }
+
+        return NULL;
+}
+
+/*****************************************************************************/
+
+/// Returns the declaration handle of a new characteristic, 0 if there is no room.
+static uint16_t add_char (uint8_t properties, uint8_t eventMask)
+{
+        if (charsCount >= SIM_MAX_CHARS) {
+                return 0;
+        }
+
+        Sim_Char_t *c = &chars[charsCount++];
+        c->handle = nextHandle;
+        c->cccd = (properties & (CHAR_PROP_NOTIFY | CHAR_PROP_INDICATE)) != 0;
+        c->readPermit = (eventMask & GATT_NOTIFY_READ_REQ_AND_WAIT_FOR_APPL_RESP) != 0;
+        c->subscribers = 0;
+        nextHandle += (c->cccd) ? (3) : (2);
+        return c->handle;
+}
+
+/*****************************************************************************/
+
+/// aci_gatt_update_char_value : a notification to every subscriber, if there are TX buffers for all of them.
+static uint8_t update_char_value (const uint8_t *p)
+{
+        const Sim_Char_t *c = find_char (get_le_16 (p + 2));
+        uint8_t len = p[5];
+        uint8_t n = (c) ? (__builtin_popcount (c->subscribers)) : (0);
+
+        if (txUsed + n > SIM_TX_BUFFERS) {
+                ++simControllerStats.refused;
+                txWaiting = 1;
+                return BLE_STATUS_INSUFFICIENT_RESOURCES;
+        }
+
+        txUsed += n;
+
+        for (int i = 0; c && i < SIM_MAX_CONNECTIONS; ++i) {
+                txSent[i] += (c->subscribers >> i) & 1;
+        }
+
+        simControllerStats.notifications += n;
+        simControllerStats.notificationBytes += n * len;
+
+        if (updateHook) {
+                updateHook (get_le_16 (p + 2), p + 6, len);
+        }
+
+        return BLE_STATUS_SUCCESS;
+}
+
+/*****************************************************************************/
+
+/// aci_gatt_allow_read : the read waiting on connection handle is answered.
+static void allow_read (uint16_t handle)
+{
+        int i = find_connection (handle);
+
+        if (i < 0 || !connections[i].readPending) {
+                return;
+        }
+
+        uint32_t wait = VClock_Now () - connections[i].readStart;
+        connections[i].readPending = 0;
+        simControllerStats.readWaitSum += wait;
+
+        if (wait > simControllerStats.readWaitMax) {
+                simControllerStats.readWaitMax = wait;
+        }
+}
+
+/*****************************************************************************/
+
+/// Every SIM_CONN_INTERVAL ms while connected : sends the notifications waiting in the TX buffers.
+static void connection_event (void *arg)
+{
+        if (outdated (arg)) {
+                return;
+        }
+
+        if (!connectionsCount) {
+                connectionEvents = 0;
+                return;
+        }
+
+        uint8_t sent = SIM_TX_PER_INTERVAL * connectionsCount;
+        txUsed = (txUsed > sent) ? (txUsed - sent) : (0);
+
+        /* As any HCI controller, reports the packets which went out (the sensor firmware has no use for it, but cannot mask it). */
+        for (int i = 0; i < SIM_MAX_CONNECTIONS; ++i) {
+                if (connections[i].used && txSent[i]) {
+                        uint8_t p[5] = { 1 };
+                        STORE_LE_16 (p + 1, connections[i].handle);
+                        STORE_LE_16 (p + 3, txSent[i]);
+                        txSent[i] = 0;
+                        emit (0, EVT_NUM_COMP_PKTS, p, sizeof (p));
+                }
+        }
+
+        if (txWaiting) {
+                uint8_t p[4];
+                uint16_t first = 0;
+
+                for (int i = 0; i < SIM_MAX_CONNECTIONS; ++i) {
+                        if (connections[i].used) {
+                                first = connections[i].handle;
+                                break;
+                        }
+                }
+
+                txWaiting = 0;
+                STORE_LE_16 (p, first);
+                STORE_LE_16 (p + 2, SIM_TX_BUFFERS - txUsed);
+                emit_vendor (0, EVT_BLUE_GATT_TX_POOL_AVAILABLE, p, sizeof (p));
+        }
+
+        VClock_Schedule (SIM_CONN_INTERVAL, connection_event, arg);
+}
+
+/*****************************************************************************/
+
+/// LE Connection Update Complete for handle, delay ms from now. The parameters stay what they were.
+static void connection_update (uint16_t handle, tClockTime delay)
+{
+        /* subevent, status, handle, interval, latency, supervision timeout */
+        uint8_t p[10] = { EVT_LE_CONN_UPDATE_COMPLETE, BLE_STATUS_SUCCESS };
+        STORE_LE_16 (p + 2, handle);
+        STORE_LE_16 (p + 4, SIM_CONN_INTERVAL * 4 / 5);
+        STORE_LE_16 (p + 6, 0);
+        STORE_LE_16 (p + 8, 400);
+        emit (delay, EVT_LE_META_EVENT, p, sizeof (p));
+}
+
+/*****************************************************************************/
+
+static void disconnect (int i, uint8_t reason)
+{
+        uint8_t p[4] = { BLE_STATUS_SUCCESS };
+        STORE_LE_16 (p + 1, connections[i].handle);
+        p[3] = reason;
+
+        connections[i].used = 0;
+        connections[i].readPending = 0;
+        txSent[i] = 0;
+        --connectionsCount;
+
+        for (int j = 0; j < charsCount; ++j) {
+                chars[j].subscribers &= ~(1 << i);
+        }
+
+        /* What was waiting for the link is dropped with it. */
+        if (!connectionsCount) {
+                txUsed = 0;
+                txWaiting = 0;
+        }
+
+        emit (0, EVT_DISCONN_COMPLETE, p, sizeof (p));
+}
+
+/*****************************************************************************/
+
+/// aci_gap_terminate, aci_gatt_exchange_configuration, aci_att_find_information_req : Command Status, then the procedure's events.
+static void procedure (uint16_t opcode, const uint8_t *params)
+{
+        uint16_t handle = get_le_16 (params);
+        int i = find_connection (handle);
+
+        if (i < 0) {
+                command_status (opcode, UNKNOWN_CONNECTION_ID);
+                return;
+        }
+
+        command_status (opcode, BLE_STATUS_SUCCESS);
+
+        if (opcode == VENDOR (OCF_GAP_TERMINATE)) {
+                disconnect (i, CONNECTION_TERMINATED_BY_LOCAL_HOST);
+                return;
+        }
+
+        if (opcode == VENDOR (OCF_GATT_EXCHANGE_CONFIG)) {
+                uint8_t mtu[5];
+                STORE_LE_16 (mtu, handle);
+                mtu[2] = 2;
+                STORE_LE_16 (mtu + 3, SIM_PEER_MTU);
+                emit_vendor (SIM_CONN_INTERVAL, EVT_BLUE_ATT_EXCHANGE_MTU_RESP, mtu, sizeof (mtu));
+        }
+
+        uint8_t complete[4];
+        STORE_LE_16 (complete, handle);
+        complete[2] = 1;
+        complete[3] = BLE_STATUS_SUCCESS;
+        emit_vendor (SIM_CONN_INTERVAL, EVT_BLUE_GATT_PROCEDURE_COMPLETE, complete, sizeof (complete));
+}
+
+/*****************************************************************************/
+
+static void command (uint16_t opcode, const uint8_t *p)
+{
+        uint8_t ret[9] = { BLE_STATUS_SUCCESS };
+        uint8_t retLen = 1;
+        uint16_t handle;
+        const uint8_t *uuid;
+
+        ++simControllerStats.commands;
+
+        switch (opcode) {
+        case cmd_opcode_pack (OGF_INFO_PARAM, OCF_READ_LOCAL_VERSION):
+                /* status, HCI version, HCI revision, LMP version, manufacturer, LMP subversion */
+                ret[1] = 6;
+                STORE_LE_16 (ret + 2, SIM_HCI_REVISION);
+                ret[4] = 6;
+                STORE_LE_16 (ret + 5, 0x0030);
+                STORE_LE_16 (ret + 7, SIM_LMP_SUBVERSION);
+                retLen = 9;
+                break;
+
+        case VENDOR (OCF_GAP_INIT):
+                /* GAP service, device name and appearance characteristics. */
+                STORE_LE_16 (ret + 1, nextHandle++);
+                STORE_LE_16 (ret + 3, add_char (0, 0));
+                STORE_LE_16 (ret + 5, add_char (0, 0));
+                retLen = 7;
+                break;
+
+        case VENDOR (OCF_GATT_ADD_SERV):
+                STORE_LE_16 (ret + 1, nextHandle++);
+                retLen = 3;
+                break;
+
+        case VENDOR (OCF_GATT_ADD_CHAR):
+                /* service handle, UUID type, UUID, value length, properties, security permissions, event mask ... */
+                uuid = p + 3 + ((p[2] == UUID_TYPE_16) ? (2) : (16));
+                handle = add_char (uuid[1], uuid[3]);
+                ret[0] = (handle) ? (BLE_STATUS_SUCCESS) : (BLE_STATUS_INSUFFICIENT_RESOURCES);
+                STORE_LE_16 (ret + 1, handle);
+                retLen = 3;
+                break;
+
+        case VENDOR (OCF_GATT_ADD_CHAR_DESC):
+                STORE_LE_16 (ret + 1, nextHandle++);
+                retLen = 3;
+                break;
+
+        case VENDOR (OCF_GATT_UPD_CHAR_VAL):
+                ret[0] = update_char_value (p);
+                break;
+
+        case VENDOR (OCF_GATT_ALLOW_READ):
+                allow_read (get_le_16 (p));
+                break;
+
+        case cmd_opcode_pack (OGF_HOST_CTL, OCF_SET_EVENT_MASK):
+                hciMask = get_le_64 (p);
+                break;
+
+        case cmd_opcode_pack (OGF_LE_CTL, OCF_LE_SET_EVENT_MASK):
+                leMask = get_le_64 (p);
+                break;
+
+        case VENDOR (OCF_GATT_SET_EVT_MASK):
+                gattMask = get_le_16 (p) | (uint32_t)get_le_16 (p + 2) << 16;
+                break;
+
+        case VENDOR (OCF_GAP_SET_EVT_MASK):
+                gapMask = get_le_16 (p);
+                break;
+
+        case VENDOR (OCF_GAP_SET_DISCOVERABLE):
+                advertising = 1;
+                break;
+
+        case VENDOR (OCF_GAP_TERMINATE):
+        case VENDOR (OCF_GATT_EXCHANGE_CONFIG):
+        case VENDOR (OCF_ATT_FIND_INFO_REQ):
+                procedure (opcode, p);
+                return;
+
+        default:
+                break;
+        }
+
+        command_complete (opcode, ret, retLen);
+}
+
+/*****************************************************************************/
+
+static void sim_reset (void)
+{
+        ++epoch;
+        memset (packets, 0, sizeof (packets));
+        queued = 0;
+        memset (connections, 0, sizeof (connections));
+        connectionsCount = 0;
+        charsCount = 0;
+        nextHandle = 1;
+        advertising = 0;
+        connectionEvents = 0;
+        txUsed = 0;
+        txWaiting = 0;
+        memset (txSent, 0, sizeof (txSent));
+        hciMask = leMask = ~0ULL;
+        gattMask = 0xFFFFFFFF;
+        gapMask = 0xFFFF;
+}
+
+/*****************************************************************************/
+
+static void sim_write (const void *data1, const void *data2, int32_t n_bytes1, int32_t n_bytes2)
+{
+        uint8_t cmd[H4_COMMAND_HEADER_SIZE + 255];
+
+        if (n_bytes1 + n_bytes2 < H4_COMMAND_HEADER_SIZE || n_bytes1 + n_bytes2 > (int32_t)sizeof (cmd)) {
+                return;
+        }
+
+        memcpy (cmd, data1, n_bytes1);
+        memcpy (cmd + n_bytes1, data2, n_bytes2);
+
+        if (cmd[0] == HCI_COMMAND_PKT) {
+                command (get_le_16 (cmd + 1), cmd + H4_COMMAND_HEADER_SIZE);
+        }
+}
+
+/*****************************************************************************/
+
+static uint8_t sim_data_present (void) { return queued && (int32_t)(packets[order[0]].due - VClock_Now ()) <= 0; }
+
+/*****************************************************************************/
+
+static int32_t sim_read (uint8_t *buffer, uint8_t buff_size)
+{
+        if (!sim_data_present ()) {
+                return 0;
+        }
+
+        Sim_Packet_t *p = &packets[order[0]];
+        uint32_t latency = VClock_Now () - p->due;
+        uint16_t len = p->len;
+
+        --queued;
+        memmove (order, order + 1, queued);
+
+        /* avoid to read more data that size of the buffer */
+        if (len > buff_size) {
+                len = buff_size;
+        }
+
+        memcpy (buffer, p->data, len);
+        p->used = 0;
+
+        ++simControllerStats.events;
+        simControllerStats.latencySum += latency;
+
+        if (latency > simControllerStats.latencyMax) {
+                simControllerStats.latencyMax = latency;
+        }
+
+        return len;
+}
+
+/*****************************************************************************/
+
+static void sim_enable_irq (void) { HCI_Bottom_Half_Unmask (); }
+
+static void sim_disable_irq (void) { HCI_Bottom_Half_Mask (); }
+
+/*****************************************************************************/
+
+const HCI_Transport_t hciTransportSim = { "sim", sim_reset, sim_reset, sim_write, sim_read, sim_data_present, sim_enable_irq, sim_disable_irq };
+
+/*****************************************************************************/
+/* The centrals.                                                             */
+/*****************************************************************************/
+
+uint8_t Sim_Controller_Advertising (void) { return advertising; }
+
+/*****************************************************************************/
+
+int Sim_Controller_Connect (uint16_t handle)
+{
+        int i = 0;
+
+        while (i < SIM_MAX_CONNECTIONS && connections[i].used) {
+                ++i;
+        }
+
+        if (!advertising || i == SIM_MAX_CONNECTIONS || find_connection (handle) >= 0) {
+                return -1;
+        }
+
+        /* The controller stops advertising when a central connects. */
+        advertising = 0;
+        connections[i].used = 1;
+        connections[i].handle = handle;
+        ++connectionsCount;
+
+        /* subevent, status, handle, role (slave), peer address type and address, interval, latency, supervision timeout, clock accuracy */
+        uint8_t p[19] = { EVT_LE_CONN_COMPLETE, BLE_STATUS_SUCCESS };
+        STORE_LE_16 (p + 2, handle);
+        p[4] = 0x01;
+        p[5] = 0x00;
+        memcpy (p + 6, (uint8_t[]){ (uint8_t)handle, 0x00, 0x00, 0xE1, 0x80, 0x02 }, 6);
+        STORE_LE_16 (p + 12, SIM_CONN_INTERVAL * 4 / 5);
+        STORE_LE_16 (p + 14, 0);
+        STORE_LE_16 (p + 16, 400);
+        p[18] = 0;
+        emit (0, EVT_LE_META_EVENT, p, sizeof (p));
+
+        /* The central settles the connection parameters soon after. */
+        connection_update (handle, SIM_CONN_UPDATE_DELAY);
+
+        if (!connectionEvents) {
+                connectionEvents = 1;
+                VClock_Schedule (SIM_CONN_INTERVAL, connection_event, current_epoch ());
+        }
+
+        return 0;
+}
+
+/*****************************************************************************/
+
+void Sim_Controller_Disconnect (uint16_t handle, uint8_t reason)
+{
+        int i = find_connection (handle);
+
+        if (i >= 0) {
+                disconnect (i, reason);
+        }
+}
+
+/*****************************************************************************/
+
+void Sim_Controller_Write (uint16_t connHandle, uint16_t attrHandle, const uint8_t *data, uint8_t len)
+{
+        int i = find_connection (connHandle);
+
+        if (i < 0 || len > 24) {
+                return;
+        }
+
+        for (int j = 0; j < charsCount; ++j) {
+                Sim_Char_t *c = &chars[j];
+
+                if (c->cccd && attrHandle == c->handle + 2 && len > 0) {
+                        c->subscribers = (data[0] & (GATT_CCCD_NOTIFY | GATT_CCCD_INDICATE)) ? (c->subscribers | (1 << i))
+                                                                                             : (c->subscribers & ~(1 << i));
+                }
+        }
+
+        /* IDB05A1 layout : connection, attribute, length, offset, data. */
+        uint8_t p[7 + 24];
+        STORE_LE_16 (p, connHandle);
+        STORE_LE_16 (p + 2, attrHandle);
+        p[4] = len;
+        STORE_LE_16 (p + 5, 0);
+        memcpy (p + 7, data, len);
+        emit_vendor (0, EVT_BLUE_GATT_ATTRIBUTE_MODIFIED, p, 7 + len);
+}
+
+/*****************************************************************************/
+
+void Sim_Controller_Update_Connection (uint16_t handle)
+{
+        if (find_connection (handle) >= 0) {
+                connection_update (handle, SIM_CONN_INTERVAL);
+        }
+}
+
+/*****************************************************************************/
+
+int Sim_Controller_Read (uint16_t connHandle, uint16_t attrHandle)
+{
+        int i = find_connection (connHandle);
+
+        /* The client makes one request at a time. */
+        if (i < 0 || connections[i].readPending) {
+                return -1;
+        }
+
+        const Sim_Char_t *c = find_char (attrHandle - 1);
+        ++simControllerStats.reads;
+
+        if (!c || !c->readPermit) {
+                /* Answered with the value the controller has. */
+                return 0;
+        }
+
+        /* connection, attribute, offset length, offset */
+        uint8_t p[7];
+        STORE_LE_16 (p, connHandle);
+        STORE_LE_16 (p + 2, attrHandle);
+        p[4] = 2;
+        STORE_LE_16 (p + 5, 0);
+        connections[i].readPending = 1;
+        connections[i].readStart = VClock_Now ();
+        emit_vendor (0, EVT_BLUE_GATT_READ_PERMIT_REQ, p, sizeof (p));
+        return 0;
+}
+
+/*****************************************************************************/
+
+void Sim_Controller_Lose_Answers (uint8_t n) { loseAnswers = n; }
+
+/*****************************************************************************/
+
+void Sim_Controller_On_Update (Sim_Controller_Update_Hook_t hook) { updateHook = hook; }
+
+/*****************************************************************************/
+
+void Sim_Controller_Report (void)
+{
+        const Sim_Controller_Stats_t *s = &simControllerStats;
+
+        printf ("sim controller: %u commands, %u events (%u dropped, %u masked), %u notifications (%u B), %u refused, event latency mean %.2f ms, max %u "
+                "ms, %u reads (waited %u ms, max %u ms)\n",
+                s->commands, s->events, s->dropped, s->suppressed, s->notifications, s->notificationBytes, s->refused,
+                (s->events) ? ((double)s->latencySum / s->events) : (0.0), s->latencyMax, s->reads, s->readWaitSum, s->readWaitMax);
+}
+
+#endif /* HOST_BUILD */
@@ -0,0 +1,112 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#ifndef SIM_CONTROLLER_H
+#define SIM_CONTROLLER_H
+
+#ifdef HOST_BUILD
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/*
+ * BlueNRG-MS (IDB05A1) stand-in for host builds, behind hciTransportSim
+ * (hci_transport.h). It runs on the virtual clock (virtual_clock.h) : every
+ * answer and event is a VClock_Schedule callback, which raises the "IRQ"
+ * through the HCI bottom half as the EXTI does on target. So whole sessions
+ * (init, connections, hours of streaming) take simulated time only, and
+ * replay identically.
+ *
+ * Commands are answered after SIM_COMMAND_LATENCY ms. GATT commands get
+ * attribute handles, updates of a characteristic some central has subscribed
+ * to are notifications : each takes one of SIM_TX_BUFFERS buffers, given back
+ * SIM_TX_PER_INTERVAL at a time every connection event. An update finding no
+ * buffer is refused (BLE_STATUS_INSUFFICIENT_RESOURCES) and the controller
+ * sends EVT_BLUE_GATT_TX_POOL_AVAILABLE once it has room again. Reads of a
+ * characteristic added with GATT_NOTIFY_READ_REQ_AND_WAIT_FOR_APPL_RESP raise
+ * EVT_BLUE_GATT_READ_PERMIT_REQ and wait for aci_gatt_allow_read, the others
+ * are answered right away.
+ *
+ * The controller honours the event masks the host programs (hci_event_mask.h)
+ * : it sends an LE Connection Update Complete soon after each connection and
+ * whenever the central updates the connection, which the sensor firmware does
+ * not handle, so it masks them. Like any controller it also sends a Number Of
+ * Completed Packets event after each connection event which carried
+ * notifications, which cannot be masked.
+ *
+ * The centrals are played by the caller (Sim_Controller_Connect ...), usually
+ * from VClock_Schedule callbacks of its own. Single threaded, as the virtual
+ * clock.
+ */
+
+#define SIM_COMMAND_LATENCY 1 /* ms */
+#define SIM_CONN_INTERVAL 8   /* ms between connection events */
+#define SIM_TX_BUFFERS 8
+#define SIM_TX_PER_INTERVAL 4 /* notifications sent per connection event */
+#define SIM_PEER_MTU 247      /* RX MTU the centrals offer */
+#define SIM_MAX_CONNECTIONS 4
+#define SIM_MAX_CHARS 32
+#define SIM_QUEUE_SIZE 32 /* events waiting for the host */
+#define SIM_CONN_UPDATE_DELAY 1000 /* ms from a connection to its parameters update */
+
+typedef struct {
+        uint32_t commands;
+        uint32_t events;            /// Events the host has read.
+        uint32_t dropped;           /// Events lost, SIM_QUEUE_SIZE were waiting for the host already.
+        uint32_t suppressed;        /// Events not sent, masked by the host.
+        uint32_t notifications;     /// Notifications sent to the centrals.
+        uint32_t notificationBytes; /// Their payload.
+        uint32_t refused;           /// Updates refused for the lack of a TX buffer.
+        uint32_t latencySum;        /// Simulated ms from an event being raised to the host reading it.
+        uint32_t latencyMax;
+        uint32_t reads;       /// Reads the centrals made.
+        uint32_t readWaitSum; /// Simulated ms reads waited for aci_gatt_allow_read.
+        uint32_t readWaitMax;
+        uint32_t lost; /// Command Complete / Status events lost on purpose (Sim_Controller_Lose_Answers).
+} Sim_Controller_Stats_t;
+
+extern Sim_Controller_Stats_t simControllerStats;
+
+/// Whether a central may connect (the host made the device discoverable).
+uint8_t Sim_Controller_Advertising (void);
+
+/// A central connects with the given handle. Returns 0, or -1 when not advertising or out of connections.
+int Sim_Controller_Connect (uint16_t handle);
+
+/// The central of handle disconnects.
+void Sim_Controller_Disconnect (uint16_t handle, uint8_t reason);
+
+/// The central writes an attribute. Writing 1 to the CCCD of a characteristic subscribes it to the notifications.
+void Sim_Controller_Write (uint16_t connHandle, uint16_t attrHandle, const uint8_t *data, uint8_t len);
+
+/// The central updates the connection parameters (to the same ones) : LE Connection Update Complete one connection interval later.
+void Sim_Controller_Update_Connection (uint16_t handle);
+
+/// The central reads the value attrHandle. Returns 0, or -1 when not connected or still waiting for its previous read.
+int Sim_Controller_Read (uint16_t connHandle, uint16_t attrHandle);
+
+/// The controller executes the next n commands but their Command Complete / Status never reach the host.
+void Sim_Controller_Lose_Answers (uint8_t n);
+
+typedef void (*Sim_Controller_Update_Hook_t) (uint16_t charHandle, const uint8_t *value, uint8_t len);
+
+/// hook (NULL : none) gets every characteristic update the controller accepts.
+void Sim_Controller_On_Update (Sim_Controller_Update_Hook_t hook);
+
+/// Prints simControllerStats.
+void Sim_Controller_Report (void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HOST_BUILD */
+#endif // SIM_CONTROLLER_H
@@ -1,6 +1,6 @@
 /**
   ******************************************************************************
-  * @file    stm32_bluenrg_ble.c
+  * @file    stm32_bluenrg_ble.cc
   * @author  CL
   * @version V1.0.0
   * @date    04-July-2014
@@ -37,9 +37,16 @@
 
 /* Includes ------------------------------------------------------------------*/
 #include "stm32_bluenrg_ble.h"
+extern "C" {
 #include "gp_timer.h"
+}
 #include "debug.h"
 #include "stm32f4xx_nucleo_bluenrg.h"
+#include "irq_priorities.h"
+#include "BlueNrgPins.h"
+#include "hci_bottom_half.h"
+#include "hci_transport.h"
+#include "cycle_counter.h"
 
 extern volatile uint32_t ms_counter;
 
@@ -63,6 +70,52 @@ extern volatile uint32_t ms_counter;
 #define MAX_BUFFER_SIZE 255
 #define TIMEOUT_DURATION 15
 
+/**
+ * @}
+ */
+
+/** @defgroup STM32_BLUENRG_BLE_Private_Types
+ * @{
+ */
+
+/**
+ * The BlueNRG controller : its SPI bus, EXTI line and a compile-time set of
+ * CS, IRQ and reset pins. There is one instance (bnrg0) since the HCI library
+ * keeps a single global state, and every call to it is resolved statically.
+ */
+template <typename Cs, typename Irq, typename Reset> struct BlueNrgSpi {
+        BlueNrgSpi (SPI_HandleTypeDef *spi, SPI_TypeDef *instance, IRQn_Type exti) : spi (spi), instance (instance), exti (exti) {}
+
+        void init ();
+        void writeSerial (const void *data1, const void *data2, int32_t n_bytes1, int32_t n_bytes2);
+        int32_t readAll (uint8_t *buffer, uint8_t buff_size);
+        int32_t write (uint8_t *data1, uint8_t *data2, uint8_t n_bytes1, uint8_t n_bytes2);
+        uint8_t dataPresent () { return Irq::read (); }
+        void reset ();
+        void hwBootloader ();
+
+        /// Masks the EXTI and the HCI bottom half (where the SPI reads happen), see hci_bottom_half.h.
+        void enableIrq ()
+        {
+                HAL_NVIC_EnableIRQ (exti);
+                HCI_Bottom_Half_Unmask ();
+        }
+
+        void disableIrq ()
+        {
+                HAL_NVIC_DisableIRQ (exti);
+                HCI_Bottom_Half_Mask ();
+        }
+
+        SPI_HandleTypeDef *spi;
+        SPI_TypeDef *instance;
+        IRQn_Type exti;
+
+private:
+        static void setIrqAsOutput ();
+        static void setIrqAsInput ();
+};
+
 /**
  * @}
  */
@@ -73,6 +126,14 @@ extern volatile uint32_t ms_counter;
 
 SPI_HandleTypeDef SpiHandle;
 
+/* Radio used by the HCI library. */
+static BlueNrgSpi<BnrgCs, BnrgIrq, BnrgReset> bnrg0 (&SpiHandle, BNRG_SPI_INSTANCE, BNRG_SPI_EXTI_IRQn);
+
+#ifdef BNRG_SPI_STATS
+BNRG_SPI_Stats_t bnrgSpiStats;
+static uint32_t sessionStart;
+#endif
+
 /**
  * @}
  */
@@ -83,13 +144,22 @@ SPI_HandleTypeDef SpiHandle;
 
 /* Private function prototypes -----------------------------------------------*/
 static void us150Delay (void);
-void set_irq_as_output (void);
-void set_irq_as_input (void);
+static inline uint32_t spi_session_begin (void);
+static inline void spi_session_end (uint32_t basepri);
+static void gpio_init (GPIO_TypeDef *port, uint32_t pin, uint32_t mode, uint32_t pull, uint32_t speed, uint32_t alternate);
+static void spi_write (const void *data1, const void *data2, int32_t n_bytes1, int32_t n_bytes2);
+static int32_t spi_read (uint8_t *buffer, uint8_t buff_size);
+static uint8_t spi_data_present (void);
+static void spi_enable_irq (void);
+static void spi_disable_irq (void);
 
 /**
  * @}
  */
 
+/* HCI transport backed by bnrg0, see hci_transport.h */
+const HCI_Transport_t hciTransportSpi = { "spi", BNRG_SPI_Init, BlueNRG_RST, spi_write, spi_read, spi_data_present, spi_enable_irq, spi_disable_irq };
+
 /** @defgroup STM32_BLUENRG_BLE_Exported_Functions
  * @{
  */
@@ -108,13 +178,12 @@ void print_csv_time (void)
 
 /**
  * @brief  This function is used for low level initialization of the SPI
- *         communication with the BlueNRG Expansion Board.
+ *         communication with the BlueNRG Expansion Board(s).
  * @param  hspi: SPI handle.
  * @retval None
  */
 void HAL_SPI_MspInit (SPI_HandleTypeDef *hspi)
 {
-        GPIO_InitTypeDef GPIO_InitStruct;
         if (hspi->Instance == BNRG_SPI_INSTANCE) {
                 /* Enable peripherals clock */
 
@@ -130,61 +199,37 @@ void HAL_SPI_MspInit (SPI_HandleTypeDef *hspi)
                 BNRG_SPI_CLK_ENABLE ();
 
                 /* Reset */
-                GPIO_InitStruct.Pin = BNRG_SPI_RESET_PIN;
-                GPIO_InitStruct.Mode = BNRG_SPI_RESET_MODE;
-                GPIO_InitStruct.Pull = BNRG_SPI_RESET_PULL;
-                GPIO_InitStruct.Speed = BNRG_SPI_RESET_SPEED;
-                GPIO_InitStruct.Alternate = BNRG_SPI_RESET_ALTERNATE;
-                HAL_GPIO_Init (BNRG_SPI_RESET_PORT, &GPIO_InitStruct);
-                HAL_GPIO_WritePin (BNRG_SPI_RESET_PORT, BNRG_SPI_RESET_PIN, GPIO_PIN_RESET); /*Added to avoid spurious interrupt from the BlueNRG */
+                gpio_init (BNRG_SPI_RESET_PORT, BNRG_SPI_RESET_PIN, BNRG_SPI_RESET_MODE, BNRG_SPI_RESET_PULL, BNRG_SPI_RESET_SPEED,
+                           BNRG_SPI_RESET_ALTERNATE);
+                BnrgReset::reset (); /*Added to avoid spurious interrupt from the BlueNRG */
 
                 /* SCLK */
-                GPIO_InitStruct.Pin = BNRG_SPI_SCLK_PIN;
-                GPIO_InitStruct.Mode = BNRG_SPI_SCLK_MODE;
-                GPIO_InitStruct.Pull = BNRG_SPI_SCLK_PULL;
-                GPIO_InitStruct.Speed = BNRG_SPI_SCLK_SPEED;
-                GPIO_InitStruct.Alternate = BNRG_SPI_SCLK_ALTERNATE;
-                HAL_GPIO_Init (BNRG_SPI_SCLK_PORT, &GPIO_InitStruct);
+                gpio_init (BNRG_SPI_SCLK_PORT, BNRG_SPI_SCLK_PIN, BNRG_SPI_SCLK_MODE, BNRG_SPI_SCLK_PULL, BNRG_SPI_SCLK_SPEED, BNRG_SPI_SCLK_ALTERNATE);
 
                 /* MISO */
-                GPIO_InitStruct.Pin = BNRG_SPI_MISO_PIN;
-                GPIO_InitStruct.Mode = BNRG_SPI_MISO_MODE;
-                GPIO_InitStruct.Pull = BNRG_SPI_MISO_PULL;
-                GPIO_InitStruct.Speed = BNRG_SPI_MISO_SPEED;
-                GPIO_InitStruct.Alternate = BNRG_SPI_MISO_ALTERNATE;
-                HAL_GPIO_Init (BNRG_SPI_MISO_PORT, &GPIO_InitStruct);
+                gpio_init (BNRG_SPI_MISO_PORT, BNRG_SPI_MISO_PIN, BNRG_SPI_MISO_MODE, BNRG_SPI_MISO_PULL, BNRG_SPI_MISO_SPEED, BNRG_SPI_MISO_ALTERNATE);
 
                 /* MOSI */
-                GPIO_InitStruct.Pin = BNRG_SPI_MOSI_PIN;
-                GPIO_InitStruct.Mode = BNRG_SPI_MOSI_MODE;
-                GPIO_InitStruct.Pull = BNRG_SPI_MOSI_PULL;
-                GPIO_InitStruct.Speed = BNRG_SPI_MOSI_SPEED;
-                GPIO_InitStruct.Alternate = BNRG_SPI_MOSI_ALTERNATE;
-                HAL_GPIO_Init (BNRG_SPI_MOSI_PORT, &GPIO_InitStruct);
+                gpio_init (BNRG_SPI_MOSI_PORT, BNRG_SPI_MOSI_PIN, BNRG_SPI_MOSI_MODE, BNRG_SPI_MOSI_PULL, BNRG_SPI_MOSI_SPEED, BNRG_SPI_MOSI_ALTERNATE);
 
                 /* NSS/CSN/CS */
-                GPIO_InitStruct.Pin = BNRG_SPI_CS_PIN;
-                GPIO_InitStruct.Mode = BNRG_SPI_CS_MODE;
-                GPIO_InitStruct.Pull = BNRG_SPI_CS_PULL;
-                GPIO_InitStruct.Speed = BNRG_SPI_CS_SPEED;
-                GPIO_InitStruct.Alternate = BNRG_SPI_CS_ALTERNATE;
-                HAL_GPIO_Init (BNRG_SPI_CS_PORT, &GPIO_InitStruct);
-                HAL_GPIO_WritePin (BNRG_SPI_CS_PORT, BNRG_SPI_CS_PIN, GPIO_PIN_SET);
+                gpio_init (BNRG_SPI_CS_PORT, BNRG_SPI_CS_PIN, BNRG_SPI_CS_MODE, BNRG_SPI_CS_PULL, BNRG_SPI_CS_SPEED, BNRG_SPI_CS_ALTERNATE);
+                BnrgCs::set ();
 
                 /* IRQ -- INPUT */
-                GPIO_InitStruct.Pin = BNRG_SPI_IRQ_PIN;
-                GPIO_InitStruct.Mode = BNRG_SPI_IRQ_MODE;
-                GPIO_InitStruct.Pull = BNRG_SPI_IRQ_PULL;
-                GPIO_InitStruct.Speed = BNRG_SPI_IRQ_SPEED;
-                GPIO_InitStruct.Alternate = BNRG_SPI_IRQ_ALTERNATE;
-                HAL_GPIO_Init (BNRG_SPI_IRQ_PORT, &GPIO_InitStruct);
+                gpio_init (BNRG_SPI_IRQ_PORT, BNRG_SPI_IRQ_PIN, BNRG_SPI_IRQ_MODE, BNRG_SPI_IRQ_PULL, BNRG_SPI_IRQ_SPEED, BNRG_SPI_IRQ_ALTERNATE);
 
                 /* Configure the NVIC for SPI */
-                HAL_NVIC_SetPriority (BNRG_SPI_EXTI_IRQn, 3, 0);
+                HAL_NVIC_SetPriority (BNRG_SPI_EXTI_IRQn, IRQ_PRIORITY_BNRG_EXTI, 0);
                 HAL_NVIC_EnableIRQ (BNRG_SPI_EXTI_IRQn);
         }
 }
 
+static void spi_write (const void *data1, const void *data2, int32_t n_bytes1, int32_t n_bytes2)
+{
+        bnrg0.writeSerial (data1, data2, n_bytes1, n_bytes2);
+}
+
 /**
  * @brief  Writes data to a serial interface.
  * @param  data1   :  1st buffer
@@ -193,7 +238,8 @@ void HAL_SPI_MspInit (SPI_HandleTypeDef *hspi)
  * @param  n_bytes2: number of bytes in 2nd buffer
  * @retval None
  */
-void Hal_Write_Serial (const void *data1, const void *data2, int32_t n_bytes1, int32_t n_bytes2)
+template <typename Cs, typename Irq, typename Reset>
+void BlueNrgSpi<Cs, Irq, Reset>::writeSerial (const void *data1, const void *data2, int32_t n_bytes1, int32_t n_bytes2)
 {
 #ifdef OPTIMIZED_SPI /* used by the server (L0 and F4, not L4) for the throughput test */
         struct timer t;
@@ -202,10 +248,10 @@ void Hal_Write_Serial (const void *data1, const void *data2, int32_t n_bytes1, i
 
         Timer_Set (&t, CLOCK_SECOND / 10);
 
-        Disable_SPI_IRQ ();
+        disableIrq ();
 
         while (1) {
-                ret = BlueNRG_SPI_Write (&SpiHandle, (uint8_t *)data1, (uint8_t *)data2 + data2_offset, n_bytes1, n_bytes2);
+                ret = write ((uint8_t *)data1, (uint8_t *)data2 + data2_offset, n_bytes1, n_bytes2);
 
                 if (ret >= 0) {
                         n_bytes1 = 0;
@@ -219,7 +265,7 @@ void Hal_Write_Serial (const void *data1, const void *data2, int32_t n_bytes1, i
                 }
         }
 
-        Enable_SPI_IRQ ();
+        enableIrq ();
 
 #else /* not OPTIMIZED_SPI */
         struct timer t;
@@ -238,7 +284,7 @@ void Hal_Write_Serial (const void *data1, const void *data2, int32_t n_bytes1, i
 #endif
 
         while (1) {
-                if (BlueNRG_SPI_Write (&SpiHandle, (uint8_t *)data1, (uint8_t *)data2, n_bytes1, n_bytes2) == 0) break;
+                if (write ((uint8_t *)data1, (uint8_t *)data2, n_bytes1, n_bytes2) == 0) break;
                 if (Timer_Expired (&t)) {
                         break;
                 }
@@ -252,28 +298,33 @@ void Hal_Write_Serial (const void *data1, const void *data2, int32_t n_bytes1, i
  * @param  None
  * @retval None
  */
-void BNRG_SPI_Init (void)
+void BNRG_SPI_Init (void) { bnrg0.init (); }
+
+/**
+ * @brief  Initializes the SPI bus of one radio. See BNRG_SPI_Init.
+ */
+template <typename Cs, typename Irq, typename Reset> void BlueNrgSpi<Cs, Irq, Reset>::init ()
 {
-        SpiHandle.Instance = BNRG_SPI_INSTANCE;
-        SpiHandle.Init.Mode = BNRG_SPI_MODE;
-        SpiHandle.Init.Direction = BNRG_SPI_DIRECTION;
-        SpiHandle.Init.DataSize = BNRG_SPI_DATASIZE;
-        SpiHandle.Init.CLKPolarity = BNRG_SPI_CLKPOLARITY;
-        SpiHandle.Init.CLKPhase = BNRG_SPI_CLKPHASE;
-        SpiHandle.Init.NSS = BNRG_SPI_NSS;
-        SpiHandle.Init.FirstBit = BNRG_SPI_FIRSTBIT;
-        SpiHandle.Init.TIMode = BNRG_SPI_TIMODE;
-        SpiHandle.Init.CRCPolynomial = BNRG_SPI_CRCPOLYNOMIAL;
-        SpiHandle.Init.BaudRatePrescaler = BNRG_SPI_BAUDRATEPRESCALER;
-        SpiHandle.Init.CRCCalculation = BNRG_SPI_CRCCALCULATION;
-
-        HAL_SPI_Init (&SpiHandle);
+        spi->Instance = instance;
+        spi->Init.Mode = BNRG_SPI_MODE;
+        spi->Init.Direction = BNRG_SPI_DIRECTION;
+        spi->Init.DataSize = BNRG_SPI_DATASIZE;
+        spi->Init.CLKPolarity = BNRG_SPI_CLKPOLARITY;
+        spi->Init.CLKPhase = BNRG_SPI_CLKPHASE;
+        spi->Init.NSS = BNRG_SPI_NSS;
+        spi->Init.FirstBit = BNRG_SPI_FIRSTBIT;
+        spi->Init.TIMode = BNRG_SPI_TIMODE;
+        spi->Init.CRCPolynomial = BNRG_SPI_CRCPOLYNOMIAL;
+        spi->Init.BaudRatePrescaler = BNRG_SPI_BAUDRATEPRESCALER;
+        spi->Init.CRCCalculation = BNRG_SPI_CRCCALCULATION;
+
+        HAL_SPI_Init (spi);
 
 #ifdef OPTIMIZED_SPI /* used by the server (L0 and F4, not L4) for the throughput test */
                      /* Added HAP to enable SPI since Optimized SPI Transmit, Receive and Transmit/Receive APIs are
                         used for BlueNRG, BlueNRG-MS SPI communication in order to get the best performance in terms of
                         BLE throughput */
-        __HAL_SPI_ENABLE (&SpiHandle);
+        __HAL_SPI_ENABLE (spi);
 #endif
 }
 
@@ -282,11 +333,13 @@ void BNRG_SPI_Init (void)
  * @param  None
  * @retval None
  */
-void BlueNRG_RST (void)
+void BlueNRG_RST (void) { bnrg0.reset (); }
+
+template <typename Cs, typename Irq, typename Reset> void BlueNrgSpi<Cs, Irq, Reset>::reset ()
 {
-        HAL_GPIO_WritePin (BNRG_SPI_RESET_PORT, BNRG_SPI_RESET_PIN, GPIO_PIN_RESET);
+        Reset::reset ();
         HAL_Delay (5);
-        HAL_GPIO_WritePin (BNRG_SPI_RESET_PORT, BNRG_SPI_RESET_PIN, GPIO_PIN_SET);
+        Reset::set ();
         HAL_Delay (5);
 }
 
@@ -296,34 +349,31 @@ void BlueNRG_RST (void)
  * @retval 1 if data are present, 0 otherwise
  */
 // FIXME: find a better way to handle this return value (bool type? TRUE and FALSE)
-uint8_t BlueNRG_DataPresent (void)
-{
-        if (HAL_GPIO_ReadPin (BNRG_SPI_EXTI_PORT, BNRG_SPI_EXTI_PIN) == GPIO_PIN_SET)
-                return 1;
-        else
-                return 0;
-} /* end BlueNRG_DataPresent() */
+static uint8_t spi_data_present (void) { return bnrg0.dataPresent (); } /* end spi_data_present() */
 
 /**
  * @brief  Activate internal bootloader using pin.
  * @param  None
  * @retval None
  */
-void BlueNRG_HW_Bootloader (void)
+void BlueNRG_HW_Bootloader (void) { bnrg0.hwBootloader (); }
+
+template <typename Cs, typename Irq, typename Reset> void BlueNrgSpi<Cs, Irq, Reset>::hwBootloader ()
 {
-        set_irq_as_output ();
-        BlueNRG_RST ();
-        set_irq_as_input ();
+        setIrqAsOutput ();
+        reset ();
+        setIrqAsInput ();
 }
 
 /**
  * @brief  Reads from BlueNRG SPI buffer and store data into local buffer.
- * @param  hspi     : SPI handle
  * @param  buffer   : Buffer where data from SPI are stored
  * @param  buff_size: Buffer size
  * @retval int32_t  : Number of read bytes
  */
-int32_t BlueNRG_SPI_Read_All (SPI_HandleTypeDef *hspi, uint8_t *buffer, uint8_t buff_size)
+static int32_t spi_read (uint8_t *buffer, uint8_t buff_size) { return bnrg0.readAll (buffer, buff_size); }
+
+template <typename Cs, typename Irq, typename Reset> int32_t BlueNrgSpi<Cs, Irq, Reset>::readAll (uint8_t *buffer, uint8_t buff_size)
 {
 #ifdef OPTIMIZED_SPI /* used by the server (L0 and F4, not L4) for the throughput test */
         uint16_t byte_count;
@@ -332,12 +382,12 @@ int32_t BlueNRG_SPI_Read_All (SPI_HandleTypeDef *hspi, uint8_t *buffer, uint8_t
         const uint8_t header_master[5] = { 0x0b, 0x00, 0x00, 0x00, 0x00 };
         uint8_t header_slave[5];
 
-        __disable_irq ();
+        uint32_t basepri = spi_session_begin ();
 
-        HAL_GPIO_WritePin (BNRG_SPI_CS_PORT, BNRG_SPI_CS_PIN, GPIO_PIN_RESET);
+        Cs::reset ();
 
         /* Read the header */
-        HAL_SPI_TransmitReceive_Opt (hspi, header_master, header_slave, HEADER_SIZE);
+        HAL_SPI_TransmitReceive_Opt (spi, header_master, header_slave, HEADER_SIZE);
 
         if (header_slave[0] == 0x02) {
                 // device is ready
@@ -349,16 +399,16 @@ int32_t BlueNRG_SPI_Read_All (SPI_HandleTypeDef *hspi, uint8_t *buffer, uint8_t
                         // avoid to read more data that size of the buffer
                         if (byte_count > buff_size) byte_count = buff_size;
 
-                        HAL_SPI_Receive_Opt (hspi, buffer, byte_count);
+                        HAL_SPI_Receive_Opt (spi, buffer, byte_count);
 
                         len = byte_count;
                 }
         }
 
         // Release CS line.
-        HAL_GPIO_WritePin (BNRG_SPI_CS_PORT, BNRG_SPI_CS_PIN, GPIO_PIN_SET);
+        Cs::set ();
 
-        __enable_irq ();
+        spi_session_end (basepri);
 
 #ifdef PRINT_CSV_FORMAT
         if (len > 0) {
@@ -382,10 +432,10 @@ int32_t BlueNRG_SPI_Read_All (SPI_HandleTypeDef *hspi, uint8_t *buffer, uint8_t
         uint8_t header_slave[HEADER_SIZE];
 
         /* CS reset */
-        HAL_GPIO_WritePin (BNRG_SPI_CS_PORT, BNRG_SPI_CS_PIN, GPIO_PIN_RESET);
+        Cs::reset ();
 
         /* Read the header */
-        HAL_SPI_TransmitReceive (hspi, header_master, header_slave, HEADER_SIZE, TIMEOUT_DURATION);
+        HAL_SPI_TransmitReceive (spi, header_master, header_slave, HEADER_SIZE, TIMEOUT_DURATION);
 
         if (header_slave[0] == 0x02) {
                 /* device is ready */
@@ -399,13 +449,13 @@ int32_t BlueNRG_SPI_Read_All (SPI_HandleTypeDef *hspi, uint8_t *buffer, uint8_t
                         }
 
                         for (len = 0; len < byte_count; len++) {
-                                HAL_SPI_TransmitReceive (hspi, &char_ff, (uint8_t *)&read_char, 1, TIMEOUT_DURATION);
+                                HAL_SPI_TransmitReceive (spi, &char_ff, (uint8_t *)&read_char, 1, TIMEOUT_DURATION);
                                 buffer[len] = read_char;
                         }
                 }
         }
         /* Release CS line */
-        HAL_GPIO_WritePin (BNRG_SPI_CS_PORT, BNRG_SPI_CS_PIN, GPIO_PIN_SET);
+        Cs::set ();
 
         // Add a small delay to give time to the BlueNRG to set the IRQ pin low
         // to avoid a useless SPI read at the end of the transaction
@@ -435,6 +485,13 @@ int32_t BlueNRG_SPI_Read_All (SPI_HandleTypeDef *hspi, uint8_t *buffer, uint8_t
  * @retval Number of read bytes
  */
 int32_t BlueNRG_SPI_Write (SPI_HandleTypeDef *hspi, uint8_t *data1, uint8_t *data2, uint8_t Nb_bytes1, uint8_t Nb_bytes2)
+{
+        (void)hspi;
+        return bnrg0.write (data1, data2, Nb_bytes1, Nb_bytes2);
+}
+
+template <typename Cs, typename Irq, typename Reset>
+int32_t BlueNrgSpi<Cs, Irq, Reset>::write (uint8_t *data1, uint8_t *data2, uint8_t Nb_bytes1, uint8_t Nb_bytes2)
 {
 #ifdef OPTIMIZED_SPI /* used by the server (L0 and F4, not L4) for the throughput test */
         int16_t result = 0;
@@ -444,9 +501,9 @@ int32_t BlueNRG_SPI_Write (SPI_HandleTypeDef *hspi, uint8_t *data1, uint8_t *dat
         const uint8_t header_master[5] = { 0x0a, 0x00, 0x00, 0x00, 0x00 };
         uint8_t header_slave[5] = { 0x00 };
 
-        HAL_GPIO_WritePin (BNRG_SPI_CS_PORT, BNRG_SPI_CS_PIN, GPIO_PIN_RESET);
+        Cs::reset ();
 
-        HAL_SPI_TransmitReceive_Opt (hspi, header_master, header_slave, HEADER_SIZE);
+        HAL_SPI_TransmitReceive_Opt (spi, header_master, header_slave, HEADER_SIZE);
 
         if (header_slave[0] != 0x02) {
                 result = -1;
@@ -460,7 +517,7 @@ int32_t BlueNRG_SPI_Write (SPI_HandleTypeDef *hspi, uint8_t *data1, uint8_t *dat
                 goto failed; // BlueNRG .
         }
 
-        HAL_SPI_Transmit_Opt (hspi, data1, Nb_bytes1);
+        HAL_SPI_Transmit_Opt (spi, data1, Nb_bytes1);
 
         rx_bytes -= Nb_bytes1;
 
@@ -471,14 +528,14 @@ int32_t BlueNRG_SPI_Write (SPI_HandleTypeDef *hspi, uint8_t *data1, uint8_t *dat
                 tx_bytes = Nb_bytes2;
         }
 
-        HAL_SPI_Transmit_Opt (hspi, data2, tx_bytes);
+        HAL_SPI_Transmit_Opt (spi, data2, tx_bytes);
 
         result = tx_bytes;
 
 failed:
 
         // Release CS line
-        HAL_GPIO_WritePin (BNRG_SPI_CS_PORT, BNRG_SPI_CS_PIN, GPIO_PIN_SET);
+        Cs::set ();
 
         return result;
 
@@ -495,7 +552,7 @@ failed:
 
         unsigned char read_char_buf[MAX_BUFFER_SIZE];
 
-        Disable_SPI_IRQ ();
+        disableIrq ();
 
         /*
          If the SPI_FIX is enabled the IRQ is set in Output mode, then it is pulled
@@ -504,20 +561,20 @@ failed:
          After these transmit/receive operations the IRQ is reset in input mode.
        */
         if (spi_fix_enabled) {
-                set_irq_as_output ();
+                setIrqAsOutput ();
 
                 /* Assert CS line after at least 112us */
                 us150Delay ();
         }
 
         /* CS reset */
-        HAL_GPIO_WritePin (BNRG_SPI_CS_PORT, BNRG_SPI_CS_PIN, GPIO_PIN_RESET);
+        Cs::reset ();
 
         /* Exchange header */
-        HAL_SPI_TransmitReceive (hspi, header_master, header_slave, HEADER_SIZE, TIMEOUT_DURATION);
+        HAL_SPI_TransmitReceive (spi, header_master, header_slave, HEADER_SIZE, TIMEOUT_DURATION);
 
         if (spi_fix_enabled) {
-                set_irq_as_input ();
+                setIrqAsInput ();
         }
 
         if (header_slave[0] == 0x02) {
@@ -526,10 +583,10 @@ failed:
 
                         /*  Buffer is big enough */
                         if (Nb_bytes1 > 0) {
-                                HAL_SPI_TransmitReceive (hspi, data1, read_char_buf, Nb_bytes1, TIMEOUT_DURATION);
+                                HAL_SPI_TransmitReceive (spi, data1, read_char_buf, Nb_bytes1, TIMEOUT_DURATION);
                         }
                         if (Nb_bytes2 > 0) {
-                                HAL_SPI_TransmitReceive (hspi, data2, read_char_buf, Nb_bytes2, TIMEOUT_DURATION);
+                                HAL_SPI_TransmitReceive (spi, data2, read_char_buf, Nb_bytes2, TIMEOUT_DURATION);
                         }
                 }
                 else {
@@ -543,9 +600,9 @@ failed:
         }
 
         /* Release CS line */
-        HAL_GPIO_WritePin (BNRG_SPI_CS_PORT, BNRG_SPI_CS_PIN, GPIO_PIN_SET);
+        Cs::set ();
 
-        Enable_SPI_IRQ ();
+        enableIrq ();
 
         return result;
 
@@ -553,42 +610,39 @@ failed:
 }
 
 /**
- * @brief  Set in Output mode the IRQ.
+ * @brief  Set in Output mode the IRQ (driven high). Only ODR and MODER are
+ *         touched, the EXTI configuration and the pull-down stay as set up in
+ *         HAL_SPI_MspInit.
  * @param  None
  * @retval None
  */
-void set_irq_as_output (void)
+template <typename Cs, typename Irq, typename Reset> void BlueNrgSpi<Cs, Irq, Reset>::setIrqAsOutput ()
 {
-        GPIO_InitTypeDef GPIO_InitStructure;
-
         /* Pull IRQ high */
-        GPIO_InitStructure.Pin = BNRG_SPI_IRQ_PIN;
-        GPIO_InitStructure.Mode = GPIO_MODE_OUTPUT_PP;
-        GPIO_InitStructure.Speed = BNRG_SPI_IRQ_SPEED;
-        GPIO_InitStructure.Pull = GPIO_NOPULL;
-        HAL_GPIO_Init (BNRG_SPI_IRQ_PORT, &GPIO_InitStructure);
-        HAL_GPIO_WritePin (BNRG_SPI_IRQ_PORT, BNRG_SPI_IRQ_PIN, GPIO_PIN_SET);
+        Irq::set ();
+        Irq::setMode (GpioMode::OUT);
 }
 
 /**
- * @brief  Set the IRQ in input mode.
+ * @brief  Set the IRQ back in input mode.
  * @param  None
  * @retval None
  */
-void set_irq_as_input (void)
+template <typename Cs, typename Irq, typename Reset> void BlueNrgSpi<Cs, Irq, Reset>::setIrqAsInput () { Irq::setMode (GpioMode::IN); }
+
+/**
+ * @brief  GPIO setup helper for HAL_SPI_MspInit.
+ * @retval None
+ */
+static void gpio_init (GPIO_TypeDef *port, uint32_t pin, uint32_t mode, uint32_t pull, uint32_t speed, uint32_t alternate)
 {
-        GPIO_InitTypeDef GPIO_InitStructure;
-
-        /* IRQ input */
-        GPIO_InitStructure.Pin = BNRG_SPI_IRQ_PIN;
-        GPIO_InitStructure.Mode = BNRG_SPI_IRQ_MODE;
-        GPIO_InitStructure.Pull = GPIO_PULLDOWN;
-        GPIO_InitStructure.Speed = BNRG_SPI_IRQ_SPEED;
-        GPIO_InitStructure.Alternate = BNRG_SPI_IRQ_ALTERNATE;
-        HAL_GPIO_Init (BNRG_SPI_IRQ_PORT, &GPIO_InitStructure);
-
-        GPIO_InitStructure.Pull = BNRG_SPI_IRQ_PULL;
-        HAL_GPIO_Init (BNRG_SPI_IRQ_PORT, &GPIO_InitStructure);
+        GPIO_InitTypeDef GPIO_InitStruct;
+        GPIO_InitStruct.Pin = pin;
+        GPIO_InitStruct.Mode = mode;
+        GPIO_InitStruct.Pull = pull;
+        GPIO_InitStruct.Speed = speed;
+        GPIO_InitStruct.Alternate = alternate;
+        HAL_GPIO_Init (port, &GPIO_InitStruct);
 }
 
 /**
@@ -612,19 +666,55 @@ static void us150Delay (void)
 #endif
 }
 
+/**
+ * @brief  Starts an SPI session. Only the BlueNRG EXTI and IRQs less urgent than
+ *         it are held off (BASEPRI), so USB and SysTick are serviced during the
+ *         transfer. See irq_priorities.h.
+ * @param  None
+ * @retval Previous BASEPRI value, to be passed to spi_session_end.
+ */
+static inline uint32_t spi_session_begin (void)
+{
+        uint32_t basepri = __get_BASEPRI ();
+        __set_BASEPRI_MAX (IRQ_PRIORITY_TO_BASEPRI (IRQ_PRIORITY_BNRG_EXTI));
+#ifdef BNRG_SPI_STATS
+        sessionStart = Cycle_Counter_Now ();
+#endif
+        return basepri;
+}
+
+/**
+ * @brief  Ends an SPI session started with spi_session_begin.
+ * @param  basepri: value returned by spi_session_begin.
+ * @retval None
+ */
+static inline void spi_session_end (uint32_t basepri)
+{
+#ifdef BNRG_SPI_STATS
+        uint32_t cycles = Cycle_Counter_Now () - sessionStart;
+
+        if (cycles > bnrgSpiStats.maskedCyclesMax) {
+                bnrgSpiStats.maskedCyclesMax = cycles;
+        }
+
+        ++bnrgSpiStats.sessions;
+#endif
+        __set_BASEPRI (basepri);
+}
+
 /**
  * @brief  Enable SPI IRQ.
  * @param  None
  * @retval None
  */
-void Enable_SPI_IRQ (void) { HAL_NVIC_EnableIRQ (BNRG_SPI_EXTI_IRQn); }
+static void spi_enable_irq (void) { bnrg0.enableIrq (); }
 
 /**
  * @brief  Disable SPI IRQ.
  * @param  None
  * @retval None
  */
-void Disable_SPI_IRQ (void) { HAL_NVIC_DisableIRQ (BNRG_SPI_EXTI_IRQn); }
+static void spi_disable_irq (void) { bnrg0.disableIrq (); }
 
 /**
  * @brief  Clear Pending SPI IRQ.
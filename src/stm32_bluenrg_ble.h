@@ -47,6 +47,8 @@ extern "C" {
 #include "stm32f4xx_nucleo_bluenrg.h"
 #define SYSCLK_FREQ 84000000
 
+extern SPI_HandleTypeDef SpiHandle;
+
 void BNRG_SPI_Init (void);
 void BlueNRG_RST (void);
 uint8_t BlueNRG_DataPresent (void);
@@ -55,6 +57,20 @@ int32_t BlueNRG_SPI_Read_All (SPI_HandleTypeDef *hspi, uint8_t *buffer, uint8_t
 int32_t BlueNRG_SPI_Write (SPI_HandleTypeDef *hspi, uint8_t *data1, uint8_t *data2, uint8_t Nb_bytes1, uint8_t Nb_bytes2);
 void Hal_Write_Serial (const void *data1, const void *data2, int32_t n_bytes1, int32_t n_bytes2);
 
+#ifdef BNRG_SPI_STATS
+/**
+ * SPI session statistics. maskedCyclesMax is the longest time (in CPU cycles) an
+ * SPI session kept BASEPRI raised, i.e. the worst case latency it adds to any IRQ
+ * at or below IRQ_PRIORITY_BNRG_EXTI. IRQs above it (USB, SysTick) are not delayed.
+ */
+typedef struct {
+        uint32_t sessions;
+        uint32_t maskedCyclesMax;
+} BNRG_SPI_Stats_t;
+
+extern BNRG_SPI_Stats_t bnrgSpiStats;
+#endif
+
 #ifdef OPTIMIZED_SPI
 /* Optimized functions for throughput test */
 /* Used by the server (L0 and F4, not L4) */
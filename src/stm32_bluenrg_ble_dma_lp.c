@@ -38,6 +38,7 @@
 /* Includes ------------------------------------------------------------------*/
 #include "stm32_bluenrg_ble_dma_lp.h"
 #include "hci_const.h"
+#include "timer_wheel.h"
 
 /** @addtogroup BSP
  *  @{
@@ -392,13 +393,13 @@ void BlueNRG_RST(void)
   
   TIMER_Start(ubnRFResetTimerID, BLUENRG_HOLD_TIME_IN_RESET);
   ubnRFresetTimerLock = 1;
-  while(ubnRFresetTimerLock == 1);
+  while(ubnRFresetTimerLock == 1) Timer_Wheel_Process(); /* the callback runs in the main loop */
   
   HAL_GPIO_WritePin(BNRG_SPI_RESET_PORT, BNRG_SPI_RESET_PIN, GPIO_PIN_SET);
     
   TIMER_Start(ubnRFResetTimerID, BLUENRG_HOLD_TIME_AFTER_RESET);
   ubnRFresetTimerLock = 1;
-  while(ubnRFresetTimerLock == 1);
+  while(ubnRFresetTimerLock == 1) Timer_Wheel_Process(); /* the callback runs in the main loop */
   TIMER_Delete(ubnRFResetTimerID);
   
   return;
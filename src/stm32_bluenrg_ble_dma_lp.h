@@ -72,7 +72,7 @@
 #endif /* USE_STM32L4XX_NUCLEO */
   
 #include "stm32xx_lpm.h"  
-#include "stm32xx_timerserver.h"
+#include "timer_server.h"
 
 /** @addtogroup BSP
  *  @{
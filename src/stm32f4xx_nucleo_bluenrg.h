@@ -31,6 +31,7 @@ extern "C" {
 #define BNRG_SPI_RESET_SPEED GPIO_SPEED_LOW
 #define BNRG_SPI_RESET_ALTERNATE 0
 #define BNRG_SPI_RESET_PORT GPIOI
+#define BNRG_SPI_RESET_PORT_BASE GPIOI_BASE
 #define BNRG_SPI_RESET_CLK_ENABLE() __GPIOI_CLK_ENABLE ()
 
 // SCLK
@@ -67,6 +68,7 @@ extern "C" {
 #define BNRG_SPI_CS_SPEED GPIO_SPEED_HIGH
 #define BNRG_SPI_CS_ALTERNATE 0
 #define BNRG_SPI_CS_PORT GPIOF
+#define BNRG_SPI_CS_PORT_BASE GPIOF_BASE
 #define BNRG_SPI_CS_CLK_ENABLE() __GPIOF_CLK_ENABLE ()
 
 // IRQ
@@ -76,6 +78,7 @@ extern "C" {
 #define BNRG_SPI_IRQ_SPEED GPIO_SPEED_HIGH
 #define BNRG_SPI_IRQ_ALTERNATE 0
 #define BNRG_SPI_IRQ_PORT GPIOA
+#define BNRG_SPI_IRQ_PORT_BASE GPIOA_BASE
 #define BNRG_SPI_IRQ_CLK_ENABLE() __GPIOA_CLK_ENABLE ()
 
 // EXTI External Interrupt for SPI
@@ -87,6 +90,29 @@ extern "C" {
 #define BNRG_SPI_EXTI_PORT BNRG_SPI_IRQ_PORT
 #define RTC_WAKEUP_IRQHandler RTC_WKUP_IRQHandler
 
+#ifdef HCI_TRANSPORT_UART
+// BlueNRG module with UART (H4) interface. Reset line is the one defined above.
+#define BNRG_UART_INSTANCE USART6
+#define BNRG_UART_CLK_ENABLE() __USART6_CLK_ENABLE ()
+#define BNRG_UART_BAUDRATE 115200
+#define BNRG_UART_ALTERNATE GPIO_AF8_USART6
+#define BNRG_UART_TX_PIN GPIO_PIN_6
+#define BNRG_UART_RX_PIN GPIO_PIN_7
+#define BNRG_UART_PORT GPIOC
+#define BNRG_UART_PORT_CLK_ENABLE() __GPIOC_CLK_ENABLE ()
+#define BNRG_UART_IRQn USART6_IRQn
+#define BNRG_UART_IRQHandler USART6_IRQHandler
+#endif
+
+// USER button (B1 on the STM32F746G-DISCO, high when pressed, pulled down on the board)
+#define PUSH_BUTTON_PIN GPIO_PIN_11
+#define PUSH_BUTTON_MODE GPIO_MODE_INPUT
+#define PUSH_BUTTON_PULL GPIO_NOPULL
+#define PUSH_BUTTON_SPEED GPIO_SPEED_LOW
+#define PUSH_BUTTON_PORT GPIOI
+#define PUSH_BUTTON_PORT_BASE GPIOI_BASE
+#define PUSH_BUTTON_CLK_ENABLE() __GPIOI_CLK_ENABLE ()
+
 // EXTI External Interrupt for user button
 //#define PUSH_BUTTON_EXTI_IRQHandler EXTI15_10_IRQHandler
 
@@ -147,7 +147,8 @@ extern "C" {
   * @brief This is the HAL system configuration section
   */
 #define VDD_VALUE ((uint32_t)3300)         /*!< Value of VDD in mv */
-#define TICK_INT_PRIORITY ((uint32_t)0x0F) /*!< tick interrupt priority */
+#include "irq_priorities.h"
+#define TICK_INT_PRIORITY ((uint32_t)IRQ_PRIORITY_SYSTICK) /*!< tick interrupt priority */
 #define USE_RTOS 0
 #define PREFETCH_ENABLE 1
 #define ART_ACCLERATOR_ENABLE 1 /* To enable instruction cache and prefetch */
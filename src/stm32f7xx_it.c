@@ -2,6 +2,8 @@
 #include "ble_status.h"
 #include "hci.h"
 #include "stm32_bluenrg_ble.h"
+#include "hci_transport.h"
+#include "hci_bottom_half.h"
 
 
 /******************************************************************************/
@@ -82,7 +84,7 @@ void DebugMon_Handler (void) {}
  * @param  None
  * @retval None
  */
-void PendSV_Handler (void) {}
+void PendSV_Handler (void) { HCI_Bottom_Half_Run (); }
 
 /**
  * @brief  This function handles SysTick Handler.
@@ -103,7 +105,19 @@ void SysTick_Handler (void) { HAL_IncTick (); }
 // void EXTI4_IRQHandler (void) {}
 
 // EXTI0_IRQHandler
-void BNRG_SPI_EXTI_IRQHandler (void) { HCI_Isr (); }
+void BNRG_SPI_EXTI_IRQHandler (void)
+{
+        /*
+         * HCI_Isr clears the line too (Clear_SPI_EXTI_Flag), but only in the bottom half.
+         * Left pending, the EXTI would re-enter until then and PendSV, below it, never runs.
+         */
+        __HAL_GPIO_EXTI_CLEAR_IT (BNRG_SPI_EXTI_PIN);
+        HCI_Bottom_Half_Schedule ();
+}
+
+#ifdef HCI_TRANSPORT_UART
+void BNRG_UART_IRQHandler (void) { HCI_Transport_Uart_Isr (); }
+#endif
 
 /**
   * @brief  EXTI4_15_IRQHandler This function handles External lines 4 to 15 interrupt request.
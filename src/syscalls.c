@@ -11,6 +11,7 @@
 #include <stm32f7xx.h>
 #include <stm32f7xx_hal.h>
 #include "usb/debug_usb.h"
+#include "hci_btsnoop.h"
 
 #undef errno
 extern int errno;
@@ -235,6 +236,14 @@ int _wait (int *status)
  */
 int _write (int file, char *ptr, int len)
 {
+#ifdef HCI_BTSNOOP
+        /* The USB channel carries the btsnoop records only, text would corrupt the stream. */
+        if (HCI_Btsnoop_Active ()) {
+                hciBtsnoopStats.silenced += len;
+                return len;
+        }
+#endif
+
         debugLog (0, MICRO_STRING, ptr, len + 1);
         return len;
 }
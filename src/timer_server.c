@@ -0,0 +1,107 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#include "timer_server.h"
+#include "timer_wheel.h"
+#include <stddef.h>
+
+typedef struct {
+        Timer_Wheel_Timer_t timer;
+        pf_TIMER_TimerCallBack_t callback; /// NULL when free.
+        eTimerMode_t mode;
+} Timer_Server_Timer_t;
+
+static Timer_Server_Timer_t timers[TIMER_SERVER_MAX_TIMERS];
+
+/*****************************************************************************/
+
+static void on_timer (void *arg)
+{
+        Timer_Server_Timer_t *t = arg;
+        t->callback ();
+}
+
+/*****************************************************************************/
+
+static Timer_Server_Timer_t *find (uint8_t ubTimerID)
+{
+        if (ubTimerID >= TIMER_SERVER_MAX_TIMERS || !timers[ubTimerID].callback) {
+                return NULL;
+        }
+
+        return &timers[ubTimerID];
+}
+
+/*****************************************************************************/
+
+void TIMER_Init (void)
+{
+        for (int i = 0; i < TIMER_SERVER_MAX_TIMERS; ++i) {
+                TIMER_Delete (i);
+        }
+}
+
+/*****************************************************************************/
+
+void TIMER_Create (eTimerModuleID_t eTimerModuleID, uint8_t *pTimerId, eTimerMode_t eTimerMode, pf_TIMER_TimerCallBack_t pTimerCallBack)
+{
+        (void)eTimerModuleID;
+        *pTimerId = TIMER_SERVER_NO_TIMER;
+
+        for (int i = 0; i < TIMER_SERVER_MAX_TIMERS; ++i) {
+                Timer_Server_Timer_t *t = &timers[i];
+
+                if (t->callback) {
+                        continue;
+                }
+
+                Timer_Wheel_Init_Timer (&t->timer, on_timer, t);
+                t->callback = pTimerCallBack;
+                t->mode = eTimerMode;
+                *pTimerId = i;
+                return;
+        }
+}
+
+/*****************************************************************************/
+
+void TIMER_Start (uint8_t ubTimerID, uint32_t timeoutTicks)
+{
+        Timer_Server_Timer_t *t = find (ubTimerID);
+
+        if (!t) {
+                return;
+        }
+
+        /* Never shorter than asked for. */
+        uint32_t ms = (uint32_t)(((uint64_t)timeoutTicks * TIMER_SERVER_TICK_US + 999) / 1000);
+        Timer_Wheel_Start (&t->timer, ms, (t->mode == eTimerMode_Repeated) ? ((ms) ? (ms) : (1)) : (0));
+}
+
+/*****************************************************************************/
+
+void TIMER_Stop (uint8_t ubTimerID)
+{
+        Timer_Server_Timer_t *t = find (ubTimerID);
+
+        if (t) {
+                Timer_Wheel_Stop (&t->timer);
+        }
+}
+
+/*****************************************************************************/
+
+void TIMER_Delete (uint8_t ubTimerID)
+{
+        Timer_Server_Timer_t *t = find (ubTimerID);
+
+        if (t) {
+                Timer_Wheel_Stop (&t->timer);
+                t->callback = NULL;
+        }
+}
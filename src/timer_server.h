@@ -0,0 +1,57 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#ifndef TIMER_SERVER_H
+#define TIMER_SERVER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/*
+ * The ST timer server API (TIMER_*, stm32xx_timerserver.h) on the timer
+ * wheel (timer_wheel.h), in place of the RTC wakeup based timer server. For
+ * the ST drivers written against it (stm32_bluenrg_ble_dma_lp.c).
+ *
+ * Differences with the ST timer server :
+ * - Callbacks run from Timer_Wheel_Process, i.e. in the main loop, never in
+ *   an interrupt. Whoever waits for one must process the wheel meanwhile.
+ * - Like the wheel, none of the functions may be called from interrupts.
+ * - Timeouts are still given in timer server ticks (TIMER_SERVER_TICK_US),
+ *   rounded up to the wheel's millisecond.
+ * - TIMER_Init takes no RTC and there is no RTC wakeup handler.
+ */
+
+#define TIMER_SERVER_MAX_TIMERS 8
+#define TIMER_SERVER_TICK_US 54 /* RTC wakeup timer on the LSI / 2, as the drivers' timeouts assume */
+#define TIMER_SERVER_NO_TIMER 0xFF
+
+typedef void (*pf_TIMER_TimerCallBack_t) (void);
+
+typedef enum { eTimerMode_SingleShot, eTimerMode_Repeated } eTimerMode_t;
+
+/// Who the callback runs for. The ST server ran eTimerModuleID_Interrupt ones in the interrupt, here all run in the main loop.
+typedef enum { eTimerModuleID_BlueNRG_Profile_App, eTimerModuleID_Interrupt } eTimerModuleID_t;
+
+void TIMER_Init (void);
+
+/// Allocates a timer, *pTimerId is TIMER_SERVER_NO_TIMER if there is none left.
+void TIMER_Create (eTimerModuleID_t eTimerModuleID, uint8_t *pTimerId, eTimerMode_t eTimerMode, pf_TIMER_TimerCallBack_t pTimerCallBack);
+/// (Re)starts the timer : first call after timeoutTicks, then every timeoutTicks if repeated.
+void TIMER_Start (uint8_t ubTimerID, uint32_t timeoutTicks);
+void TIMER_Stop (uint8_t ubTimerID);
+/// Stops and frees the timer.
+void TIMER_Delete (uint8_t ubTimerID);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TIMER_SERVER_H
@@ -0,0 +1,190 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#include "timer_wheel.h"
+#include "clock.h"
+#include <stddef.h>
+
+#define SLOT_MASK (TIMER_WHEEL_SLOTS - 1)
+#define MAX_DELTA ((1UL << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS)) - 1)
+
+Timer_Wheel_Stats_t timerWheelStats;
+
+static Timer_Wheel_Timer_t *wheel[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+static uint32_t nextTick; /* Next tick to process, every timer expires at or after it. */
+static uint8_t processing; /* Callbacks running, wheel[0][nextTick & SLOT_MASK] is being walked. */
+
+/*****************************************************************************/
+
+static void timer_link (Timer_Wheel_Timer_t **head, Timer_Wheel_Timer_t *timer)
+{
+        timer->next = *head;
+        timer->pprev = head;
+
+        if (*head) {
+                (*head)->pprev = &timer->next;
+        }
+
+        *head = timer;
+}
+
+/*****************************************************************************/
+
+static void timer_unlink (Timer_Wheel_Timer_t *timer)
+{
+        *timer->pprev = timer->next;
+
+        if (timer->next) {
+                timer->next->pprev = timer->pprev;
+        }
+
+        timer->pprev = NULL;
+}
+
+/*****************************************************************************/
+
+/// Slot for timer->expires, seen from nextTick.
+static void add (Timer_Wheel_Timer_t *timer)
+{
+        uint32_t expires = timer->expires;
+        uint32_t delta = expires - nextTick;
+        int level = 0;
+
+        if ((int32_t)delta < 0) {
+                /* Already due : next tick. */
+                expires = nextTick;
+                delta = 0;
+        }
+        else if (delta > MAX_DELTA) {
+                /* Out of range : as far as possible, it comes back here on the cascade. */
+                expires = nextTick + MAX_DELTA;
+                delta = MAX_DELTA;
+        }
+
+        while (delta >= TIMER_WHEEL_SLOTS) {
+                delta >>= TIMER_WHEEL_BITS;
+                ++level;
+        }
+
+        timer_link (&wheel[level][(expires >> (level * TIMER_WHEEL_BITS)) & SLOT_MASK], timer);
+}
+
+/*****************************************************************************/
+
+/// Redistributes one slot of level over the finer levels. Returns the slot index.
+static uint32_t cascade (int level)
+{
+        uint32_t index = (nextTick >> (level * TIMER_WHEEL_BITS)) & SLOT_MASK;
+        Timer_Wheel_Timer_t *timer = wheel[level][index];
+
+        wheel[level][index] = NULL;
+
+        while (timer) {
+                Timer_Wheel_Timer_t *next = timer->next;
+                add (timer);
+                ++timerWheelStats.cascaded;
+                timer = next;
+        }
+
+        return index;
+}
+
+/*****************************************************************************/
+
+void Timer_Wheel_Init_Timer (Timer_Wheel_Timer_t *timer, Timer_Wheel_Callback_t callback, void *arg)
+{
+        timer->next = NULL;
+        timer->pprev = NULL;
+        timer->callback = callback;
+        timer->arg = arg;
+        timer->period = 0;
+}
+
+/*****************************************************************************/
+
+void Timer_Wheel_Start (Timer_Wheel_Timer_t *timer, uint32_t delay, uint32_t period)
+{
+        tClockTime now = Clock_Time ();
+
+        Timer_Wheel_Stop (timer);
+
+        if (timerWheelStats.active == 0) {
+                /* Nothing to process in between. */
+                nextTick = now;
+        }
+
+        timer->expires = now + delay;
+        timer->period = period;
+
+        /* Not in the slot being walked, or a timer restarting itself with no delay would never let go. */
+        if (processing && (int32_t)(timer->expires - nextTick) <= 0) {
+                timer->expires = nextTick + 1;
+        }
+
+        add (timer);
+
+        if (++timerWheelStats.active > timerWheelStats.activeMax) {
+                timerWheelStats.activeMax = timerWheelStats.active;
+        }
+}
+
+/*****************************************************************************/
+
+void Timer_Wheel_Stop (Timer_Wheel_Timer_t *timer)
+{
+        if (!timer->pprev) {
+                return;
+        }
+
+        timer_unlink (timer);
+        --timerWheelStats.active;
+}
+
+/*****************************************************************************/
+
+void Timer_Wheel_Process (void)
+{
+        tClockTime now = Clock_Time ();
+
+        while (timerWheelStats.active && Timer_Wheel_Due (nextTick, now)) {
+                uint32_t index = nextTick & SLOT_MASK;
+
+                for (int level = 1; level < TIMER_WHEEL_LEVELS && index == 0; ++level) {
+                        index = cascade (level);
+                }
+
+                Timer_Wheel_Timer_t **head = &wheel[0][nextTick & SLOT_MASK];
+                processing = 1;
+
+                while (*head) {
+                        Timer_Wheel_Timer_t *timer = *head;
+
+                        timer_unlink (timer);
+
+                        if (timer->period) {
+                                timer->expires += timer->period;
+
+                                /* Periods missed while the main loop was busy are skipped. */
+                                if ((int32_t)(timer->expires - nextTick) <= 0) {
+                                        timer->expires = nextTick + 1;
+                                }
+
+                                add (timer);
+                        }
+                        else {
+                                --timerWheelStats.active;
+                        }
+
+                        ++timerWheelStats.fired;
+                        timer->callback (timer->arg);
+                }
+
+                processing = 0;
+                ++nextTick;
+        }
+}
@@ -0,0 +1,83 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/*
+ * Callback timers for the main loop, on a hierarchical timing wheel.
+ *
+ * Time is Clock_Time, i.e. the SysTick driven millisecond tick gp_timer uses
+ * too (the virtual clock on host builds), so both agree. Timer_Wheel_Process,
+ * called from the main loop, advances the wheel to the current time and runs
+ * the callbacks which are due, in the main loop context : they may use the
+ * ACI. Starting and stopping a timer is O(1), whatever the number of timers,
+ * and the main loop pays per elapsed tick, not per timer.
+ *
+ * TIMER_WHEEL_LEVELS levels of TIMER_WHEEL_SLOTS slots each. Level 0 has one
+ * slot per millisecond, every further level TIMER_WHEEL_SLOTS times coarser.
+ * Timers further away than the wheel spans (~4.6 hours) go round again.
+ * Timers move to finer levels (cascade) as their expiry gets closer.
+ *
+ * Timers are owned by the caller (usually static or in a per-connection
+ * structure). None of the functions may be called from interrupts.
+ *
+ * The library's polled timers (gp_timer.h, see gp_timer.c) and the ST timer
+ * server API (TIMER_*, see timer_server.h) are built on this too.
+ */
+
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS 4
+
+typedef void (*Timer_Wheel_Callback_t) (void *arg);
+
+typedef struct Timer_Wheel_Timer {
+        struct Timer_Wheel_Timer *next;
+        struct Timer_Wheel_Timer **pprev; /// NULL when not running.
+        uint32_t expires;
+        uint32_t period; /// 0 for one shot timers.
+        Timer_Wheel_Callback_t callback;
+        void *arg;
+} Timer_Wheel_Timer_t;
+
+typedef struct {
+        uint16_t active;
+        uint16_t activeMax;
+        uint32_t fired;
+        uint32_t cascaded; /// Timers moved to a finer level.
+} Timer_Wheel_Stats_t;
+
+extern Timer_Wheel_Stats_t timerWheelStats;
+
+void Timer_Wheel_Init_Timer (Timer_Wheel_Timer_t *timer, Timer_Wheel_Callback_t callback, void *arg);
+
+/// (Re)starts timer : first call after delay ms, then every period ms unless period is 0. From a callback, not before the next tick.
+void Timer_Wheel_Start (Timer_Wheel_Timer_t *timer, uint32_t delay, uint32_t period);
+/// Stops timer, no-op if it is not running. A callback may stop its own timer.
+void Timer_Wheel_Stop (Timer_Wheel_Timer_t *timer);
+
+static inline uint8_t Timer_Wheel_Running (const Timer_Wheel_Timer_t *timer) { return timer->pprev != 0; }
+
+/// Whether the deadline expires (Clock_Time) has come at now, across the 32-bit wrap. Polled timers (gp_timer.c) use it too.
+static inline uint8_t Timer_Wheel_Due (uint32_t expires, uint32_t now) { return (int32_t)(now - expires) >= 0; }
+
+/// Main loop : runs the callbacks of every timer due by now.
+void Timer_Wheel_Process (void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TIMER_WHEEL_H
@@ -0,0 +1,68 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+#ifndef VIRTUAL_CLOCK_H
+#define VIRTUAL_CLOCK_H
+
+#ifdef HOST_BUILD
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "clock.h"
+
+/**
+ * Discrete-event clock for host builds (implemented in clock.c). Time only
+ * moves when somebody waits : HAL_Delay / Clock_Wait advance it instantly, and
+ * a busy loop polling Clock_Time / HAL_GetTick (Timer_Expired, the write
+ * timeout) is detected and skipped forward to the next scheduled event. Runs are
+ * therefore as fast as the CPU allows, and repeatable.
+ *
+ * Must be driven from one thread (the main loop). Callbacks run in that thread.
+ *
+ * Against a real peer (hciTransportSocket) skipping ahead would expire the
+ * library's command timeouts before any answer could come : VClock_Real_Time
+ * makes the clock follow the wall clock instead. Clock_Time may then be read
+ * from any thread, and nothing may be scheduled.
+ */
+
+typedef void (*VClock_Callback_t) (void *arg);
+
+typedef struct {
+        uint32_t events;    /// Scheduled callbacks which have run.
+        uint32_t idleSkips; /// Times a polling loop was fast-forwarded.
+        uint32_t overflows; /// VClock_Schedule calls rejected because the queue was full.
+} VClock_Stats_t;
+
+extern VClock_Stats_t vclockStats;
+
+/// Current simulated time. Unlike Clock_Time, never taken for a polling loop : for the simulation itself.
+tClockTime VClock_Now (void);
+
+/// Moves simulated time forward by ms, running every event due on the way. Callbacks may call it too.
+void VClock_Advance (tClockTime ms);
+
+/// Runs callback (arg) delay ms from now. Returns 0, or -1 if the queue is full.
+int VClock_Schedule (tClockTime delay, VClock_Callback_t callback, void *arg);
+
+/// Follows the wall clock from now on : waits sleep, polling loops are not skipped.
+void VClock_Real_Time (void);
+
+/**
+ * Prints simulated and wall time since Clock_Init, and the throughput / mean
+ * simulated time per operation for `operations` operations carrying `bytes` bytes.
+ */
+void VClock_Report (const char *label, uint32_t operations, uint32_t bytes);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HOST_BUILD */
+#endif // VIRTUAL_CLOCK_H
@@ -0,0 +1,167 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+/*
+ * Host test of what the high level operations cost on the link to the
+ * controller (src/aci_account.h). Runs the firmware's initialization and a
+ * session over the simulated controller (src/sim_controller.h) : a central
+ * connects, subscribes to the accelerometer stream and reads every readable
+ * characteristic (through Read_Request_CB, the firmware is built with
+ * LOCAL_READS 0). Fails if any operation costs more than the budget below in
+ * any of its calls.
+ *
+ * An operation made cheaper : lower its budget to what the report shows. More
+ * expensive on purpose : raise it, in the same commit.
+ *
+ * Built by host/CMakeLists.txt (with ACI_ACCOUNTING), run by ctest.
+ */
+
+#include "sensor_app.h"
+#include "sim_controller.h"
+#include "virtual_clock.h"
+#include "hci_transport.h"
+#include "aci_account.h"
+#include <stdio.h>
+#include <string.h>
+
+#define CENTRAL 0x0801
+#define SUBSCRIBE 200 /* ms from the connection to the CCCD write */
+#define READ_PERIOD 100
+#define READS 40 /* 10 of every readable characteristic */
+#define SESSION 10000
+
+/*
+ * Most a single call may cost : commands, tx bytes, events, rx bytes, transport
+ * transfers, round trips. Read_Request_CB for the temperature updates the
+ * accelerometer characteristic as well (see read_temperature). The operations
+ * not called in this session (Read_Request_CB as a whole, Refresh) are not
+ * checked.
+ */
+static const Aci_Account_Cost_t budget[ACI_OP_COUNT] = {
+        [ACI_OP_ACC_UPDATE] = { 1, 16, 1, 7, 2, 1 },
+        [ACI_OP_READ_ACC] = { 2, 22, 1, 7, 3, 1 },
+        [ACI_OP_READ_TEMPERATURE] = { 3, 34, 2, 14, 5, 2 },
+        [ACI_OP_READ_PRESSURE] = { 2, 19, 1, 7, 3, 1 },
+        [ACI_OP_READ_HUMIDITY] = { 2, 18, 1, 7, 3, 1 },
+        [ACI_OP_ADD_ACC_SERVICE] = { 4, 110, 4, 36, 8, 4 },
+        [ACI_OP_ADD_ENVIRONMENTAL_SERVICE] = { 7, 185, 7, 63, 14, 7 },
+        [ACI_OP_SET_CONNECTABLE] = { 2, 61, 2, 14, 4, 2 },
+        [ACI_OP_CONNECTION_SETUP] = { 1, 10, 1, 7, 2, 1 },
+};
+
+static uint16_t readHandles[4];
+static int reads;
+
+/*****************************************************************************/
+
+/// The central reads the value of every readable characteristic in turn.
+static void read_next (void *arg)
+{
+        (void)arg;
+
+        if (reads == READS) {
+                return;
+        }
+
+        Sim_Controller_Read (CENTRAL, readHandles[reads % 4] + 1);
+        ++reads;
+        VClock_Schedule (READ_PERIOD, read_next, NULL);
+}
+
+/*****************************************************************************/
+
+static void subscribe (void *arg)
+{
+        (void)arg;
+        const uint8_t notify[] = { 0x01, 0x00 };
+        Sim_Controller_Write (CENTRAL, sensorService->accStreamCharHandle + 2, notify, sizeof (notify));
+        VClock_Schedule (READ_PERIOD, read_next, NULL);
+}
+
+/*****************************************************************************/
+
+static void connect (void *arg)
+{
+        (void)arg;
+
+        if (Sim_Controller_Connect (CENTRAL) < 0) {
+                VClock_Schedule (10, connect, NULL);
+                return;
+        }
+
+        VClock_Schedule (SUBSCRIBE, subscribe, NULL);
+}
+
+/*****************************************************************************/
+
+static void disconnect (void *arg)
+{
+        (void)arg;
+        Sim_Controller_Disconnect (CENTRAL, 0x13);
+}
+
+/*****************************************************************************/
+
+int main (void)
+{
+        uint8_t hwVersion;
+        uint16_t fwVersion;
+        int failures = 0;
+
+        Clock_Init ();
+        HCI_Transport_Set (&hciTransportSim);
+        Aci_Account_Reset ();
+        Sensor_App_Init (&hwVersion, &fwVersion);
+
+        readHandles[0] = sensorService->accCharHandle;
+        readHandles[1] = sensorService->tempCharHandle;
+        readHandles[2] = sensorService->pressCharHandle;
+        readHandles[3] = sensorService->humidityCharHandle;
+
+        VClock_Schedule (0, connect, NULL);
+        VClock_Schedule (SESSION, disconnect, NULL);
+        tClockTime start = VClock_Now ();
+
+        while (VClock_Now () - start < SESSION + 1000) {
+                Sensor_App_Process ();
+        }
+
+        printf ("\n");
+        Aci_Account_Report ();
+
+        if (simControllerStats.reads != READS || aciAccountStats[ACI_OP_READ_TEMPERATURE].calls != READS / 4) {
+                printf ("FAIL %u reads, %lu through Read_Request_CB for the temperature\n", simControllerStats.reads,
+                        (unsigned long)aciAccountStats[ACI_OP_READ_TEMPERATURE].calls);
+                ++failures;
+        }
+
+        if (Aci_Account_Check (budget)) {
+                printf ("FAIL over budget\n");
+                ++failures;
+        }
+
+        /* The check itself : one command less than what was measured, and every operation called is over. */
+        Aci_Account_Cost_t tight[ACI_OP_COUNT];
+        int called = 0;
+
+        for (int i = 0; i < ACI_OP_COUNT; ++i) {
+                tight[i] = aciAccountStats[i].max;
+                tight[i].commands -= (tight[i].commands > 0);
+                called += (aciAccountStats[i].calls && aciAccountStats[i].max.commands);
+        }
+
+        printf ("\nWith one command less :\n");
+
+        if (Aci_Account_Check (tight) != called) {
+                printf ("FAIL the check let operations more expensive than their budget through\n");
+                ++failures;
+        }
+
+        printf ("aci_account_test : %s\n", (failures) ? ("FAILED") : ("OK"));
+        return failures != 0;
+}
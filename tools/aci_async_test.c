@@ -0,0 +1,147 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+/*
+ * Host test of the non blocking ACI commands (src/aci_async.h) when the
+ * controller's answer goes wrong, over the simulated controller
+ * (src/sim_controller.h) after the firmware's initialization :
+ *
+ * - a command whose Command Complete is lost fails with BLE_STATUS_TIMEOUT
+ *   after ACI_ASYNC_TIMEOUT, not before, and blocking calls and further
+ *   commands go through again afterwards,
+ * - a Command Complete too short to hold its header is ignored, it neither
+ *   completes the command in flight nor reads past the event.
+ *
+ * Built and run by host/CMakeLists.txt (ctest).
+ */
+
+#include "sensor_app.h"
+#include "sim_controller.h"
+#include "virtual_clock.h"
+#include "hci_transport.h"
+#include "aci_async.h"
+#include "hci.h"
+#include <stdio.h>
+
+static int failures;
+
+#define CHECK(cond)                                                                                                                                  \
+        do {                                                                                                                                         \
+                if (!(cond)) {                                                                                                                       \
+                        printf ("FAIL %s:%d : %s\n", __FILE__, __LINE__, #cond);                                                                     \
+                        ++failures;                                                                                                                  \
+                }                                                                                                                                    \
+        } while (0)
+
+static int calls;
+static uint8_t lastStatus;
+static tClockTime lastTime;
+
+/*****************************************************************************/
+
+static void done (void *context, uint8_t status, const uint8_t *ret, uint8_t retLen)
+{
+        (void)context;
+        (void)ret;
+        (void)retLen;
+        ++calls;
+        lastStatus = status;
+        lastTime = VClock_Now ();
+}
+
+/*****************************************************************************/
+
+static void run (tClockTime duration)
+{
+        tClockTime start = VClock_Now ();
+
+        while (VClock_Now () - start < duration) {
+                Sensor_App_Process ();
+        }
+}
+
+/*****************************************************************************/
+
+/// Read Local Version Information, which the simulated controller answers with Command Complete.
+static int send (void)
+{
+        uint8_t none = 0;
+        return Aci_Async_Send (OGF_INFO_PARAM, OCF_READ_LOCAL_VERSION, &none, 0, done, NULL);
+}
+
+/*****************************************************************************/
+
+static void testLostAnswer (void)
+{
+        calls = 0;
+        Sim_Controller_Lose_Answers (1);
+        tClockTime start = VClock_Now ();
+        CHECK (send () == 0);
+
+        run (ACI_ASYNC_TIMEOUT - 10);
+        CHECK (calls == 0);
+        CHECK (!Aci_Async_Idle ());
+        CHECK (ACI_BLOCKING (BLE_STATUS_SUCCESS) == BLE_STATUS_BUSY);
+
+        run (20);
+        CHECK (calls == 1 && lastStatus == BLE_STATUS_TIMEOUT);
+        CHECK (lastTime - start >= ACI_ASYNC_TIMEOUT && lastTime - start <= ACI_ASYNC_TIMEOUT + 1);
+        CHECK (aciAsyncStats.timedOut == 1 && aciAsyncStats.credits > 0);
+        CHECK (Aci_Async_Idle () && !Aci_Async_Pending ());
+        CHECK (ACI_BLOCKING (BLE_STATUS_SUCCESS) == BLE_STATUS_SUCCESS);
+
+        /* The next one is answered. */
+        CHECK (send () == 0);
+        run (10);
+        CHECK (calls == 2 && lastStatus == BLE_STATUS_SUCCESS);
+        CHECK (Aci_Async_Idle ());
+}
+
+/*****************************************************************************/
+
+static void testShortComplete (void)
+{
+        uint16_t opcode = cmd_opcode_pack (OGF_INFO_PARAM, OCF_READ_LOCAL_VERSION);
+
+        /* Event code, plen 2 : credits and half of the opcode, though the opcode is there in full. */
+        uint8_t event[] = { EVT_CMD_COMPLETE, 2, 1, (uint8_t)opcode, (uint8_t)(opcode >> 8), BLE_STATUS_SUCCESS };
+
+        calls = 0;
+        Sim_Controller_Lose_Answers (1);
+        CHECK (send () == 0);
+
+        Aci_Async_On_Cmd_Complete (event + HCI_EVENT_HDR_SIZE);
+        CHECK (calls == 0 && aciAsyncStats.malformed == 1);
+        CHECK (!Aci_Async_Idle ());
+
+        /* Then the timeout cleans up. */
+        run (ACI_ASYNC_TIMEOUT + 10);
+        CHECK (calls == 1 && lastStatus == BLE_STATUS_TIMEOUT);
+        CHECK (Aci_Async_Idle ());
+}
+
+/*****************************************************************************/
+
+int main (void)
+{
+        uint8_t hwVersion;
+        uint16_t fwVersion;
+
+        Clock_Init ();
+        HCI_Transport_Set (&hciTransportSim);
+        Sensor_App_Init (&hwVersion, &fwVersion);
+        run (100);
+        CHECK (Aci_Async_Idle () && !aciAsyncStats.timedOut);
+
+        testLostAnswer ();
+        testShortComplete ();
+
+        CHECK (simControllerStats.lost == 2);
+        printf ("aci_async_test : %s\n", (failures) ? ("FAILED") : ("OK"));
+        return failures != 0;
+}
@@ -0,0 +1,94 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+/*
+ * Host test of the reads answered by the application (LOCAL_READS 0) when
+ * aci_gatt_allow_read finds every async slot taken, over the simulated
+ * controller (src/sim_controller.h). The slots are held by a command whose
+ * Command Complete is lost, until ACI_ASYNC_TIMEOUT. The read must wait, not
+ * be forgotten : it is allowed once the slots are free, and the client may
+ * read again.
+ *
+ * Built and run by host/CMakeLists.txt (ctest).
+ */
+
+#include "sensor_app.h"
+#include "sim_controller.h"
+#include "virtual_clock.h"
+#include "hci_transport.h"
+#include "aci_async.h"
+#include "notify_queue.h"
+#include "hci.h"
+#include <stdio.h>
+
+#define CENTRAL 0x0801
+
+static int failures;
+
+#define CHECK(cond)                                                                                                                                  \
+        do {                                                                                                                                         \
+                if (!(cond)) {                                                                                                                       \
+                        printf ("FAIL %s:%d : %s\n", __FILE__, __LINE__, #cond);                                                                     \
+                        ++failures;                                                                                                                  \
+                }                                                                                                                                    \
+        } while (0)
+
+/*****************************************************************************/
+
+static void run (tClockTime duration)
+{
+        tClockTime start = VClock_Now ();
+
+        while (VClock_Now () - start < duration) {
+                Sensor_App_Process ();
+        }
+}
+
+/*****************************************************************************/
+
+int main (void)
+{
+        uint8_t hwVersion;
+        uint16_t fwVersion;
+        uint8_t none = 0;
+        const Sensor_Read_Stats_t *r = &sensorService->readStats;
+
+        Clock_Init ();
+        HCI_Transport_Set (&hciTransportSim);
+        Sensor_App_Init (&hwVersion, &fwVersion);
+        run (100);
+        CHECK (Sim_Controller_Connect (CENTRAL) == 0);
+        run (300);
+
+        /* Nothing for the read to wait for : the accelerometer stands still, and the controller has its value. */
+        Timer_Wheel_Stop (&sensorService->sampleTimer);
+        Acc_Update_Async ((AxesRaw_t *)&sensorService->axes_data);
+        run (100);
+        CHECK (Notify_Queue_Count (&sensorService->notifyQueue) == 0);
+
+        /* Every slot taken until the lost answer times out. */
+        Sim_Controller_Lose_Answers (1);
+
+        while (Aci_Async_Send (OGF_INFO_PARAM, OCF_READ_LOCAL_VERSION, &none, 0, NULL, NULL) == 0) {
+        }
+
+        CHECK (Sim_Controller_Read (CENTRAL, sensorService->accCharHandle + 1) == 0);
+        run (ACI_ASYNC_TIMEOUT / 2);
+        CHECK (r->requests == 0 && r->allowRetries > 0);
+        CHECK (Sim_Controller_Read (CENTRAL, sensorService->accCharHandle + 1) < 0);
+
+        run (ACI_ASYNC_TIMEOUT);
+        CHECK (r->requests == 1 && aciAsyncStats.timedOut == 1);
+        CHECK (Sim_Controller_Read (CENTRAL, sensorService->accCharHandle + 1) == 0);
+        run (100);
+        CHECK (r->requests == 2 && simControllerStats.reads == 2);
+
+        printf ("read allowed after %lu retries\n", (unsigned long)r->allowRetries);
+        printf ("allow_read_test : %s\n", (failures) ? ("FAILED") : ("OK"));
+        return failures != 0;
+}
@@ -0,0 +1,84 @@
+#!/usr/bin/env python3
+#
+# Author : lukasz.iwaszkiewicz@gmail.com
+# License : see COPYING file for details.
+#
+# Writes the btsnoop stream the firmware sends over USB when built with
+# HCI_BTSNOOP (see src/hci_btsnoop.h) to a file Wireshark opens. Reads the
+# raw USB stream from a device node, a file or stdin, skips whatever precedes
+# the btsnoop file header (debug messages) and copies the rest.
+#
+# Usage : btsnoop.py OUTPUT.btsnoop [INPUT]
+
+import struct
+import sys
+
+MAGIC = b"btsnoop\0"
+HEADER_SIZE = 16
+RECORD_HEADER_SIZE = 24
+
+
+def main():
+    if len(sys.argv) < 2:
+        sys.exit("usage: btsnoop.py OUTPUT.btsnoop [INPUT]")
+
+    src = open(sys.argv[2], "rb", buffering=0) if len(sys.argv) > 2 else sys.stdin.buffer
+    pending = b""
+
+    # Find the file header.
+    while True:
+        chunk = src.read(512)
+
+        if not chunk:
+            sys.exit("no btsnoop header in the stream")
+
+        pending += chunk
+        pos = pending.find(MAGIC)
+
+        if pos >= 0:
+            pending = pending[pos:]
+            break
+
+        pending = pending[-(len(MAGIC) - 1):]
+
+    records = 0
+    drops = 0
+
+    with open(sys.argv[1], "wb") as out:
+        out.write(pending)
+        out.flush()
+        pending = pending[HEADER_SIZE:]
+
+        try:
+            while True:
+                chunk = src.read(512)
+
+                if not chunk:
+                    break
+
+                out.write(chunk)
+                out.flush()
+                pending += chunk
+
+                # Walk the complete records only to report progress.
+                while len(pending) >= RECORD_HEADER_SIZE:
+                    _, included, _, cumulative_drops = struct.unpack(">IIII", pending[:16])
+
+                    if len(pending) < RECORD_HEADER_SIZE + included:
+                        break
+
+                    records += 1
+
+                    if cumulative_drops != drops:
+                        drops = cumulative_drops
+                        print("%d records dropped by the firmware so far" % drops, file=sys.stderr)
+
+                    pending = pending[RECORD_HEADER_SIZE + included:]
+        except KeyboardInterrupt:
+            pass
+
+    print("%d records written" % records, file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
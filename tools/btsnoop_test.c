@@ -0,0 +1,257 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+/*
+ * Host test of the btsnoop stream (src/hci_btsnoop.h) and the held packets it
+ * shares with dispatch (src/hci_packet_pool.h), over the simulated controller
+ * (src/sim_controller.h). A central connects, streams the accelerometer and
+ * updates the connection parameters, a handler of Connection Update Complete
+ * keeps the last KEPT of its events (HCI_Packet_Hold). The stream is drained the
+ * way main.cc moves it to USB, a bounded number of bytes per loop, stalling
+ * STALL ms after each update :
+ *
+ * - it parses back into as many well formed H4 records as were recorded,
+ * - received packets are recorded from pool blocks, the handler's holds of
+ *   events not handed over yet take references on those, no second copy,
+ * - left undrained, the ring drops records and the stream stays well formed,
+ * - every block is back in the pool in the end.
+ *
+ * Built and run by host/CMakeLists.txt (ctest).
+ */
+
+#include "sensor_app.h"
+#include "sim_controller.h"
+#include "virtual_clock.h"
+#include "hci_transport.h"
+#include "hci_btsnoop.h"
+#include "hci_packet_pool.h"
+#include "hci.h"
+#include <stdio.h>
+#include <string.h>
+
+#define CENTRAL 0x0801
+#define UPDATES 20
+#define KEPT 4
+#define STALL 5 /* ms */
+#define USB_CHUNK 256 /* bytes moved per main loop iteration */
+#define STREAM_SIZE (1024 * 1024)
+
+static int failures;
+
+#define CHECK(cond)                                                                                                                                  \
+        do {                                                                                                                                         \
+                if (!(cond)) {                                                                                                                       \
+                        printf ("FAIL %s:%d : %s\n", __FILE__, __LINE__, #cond);                                                                     \
+                        ++failures;                                                                                                                  \
+                }                                                                                                                                    \
+        } while (0)
+
+static uint8_t stream[STREAM_SIZE];
+static uint32_t streamLen;
+static HCI_Packet_t *kept[KEPT];
+static uint32_t handled, shared;
+
+/*****************************************************************************/
+
+/// What main.cc's btsnoopFlush does, with USB_CHUNK bytes free in the USB buffer.
+static void drain (void)
+{
+        const uint8_t *data;
+        uint32_t n, room = USB_CHUNK;
+
+        while (room > 0 && (n = HCI_Btsnoop_Peek (&data)) > 0) {
+                if (n > room) {
+                        n = room;
+                }
+
+                if (streamLen + n <= STREAM_SIZE) {
+                        memcpy (stream + streamLen, data, n);
+                        streamLen += n;
+                }
+
+                HCI_Btsnoop_Consume (n);
+                room -= n;
+        }
+}
+
+/*****************************************************************************/
+
+static void run (tClockTime duration, uint8_t draining)
+{
+        tClockTime start = VClock_Now ();
+
+        while (VClock_Now () - start < duration) {
+                Sensor_App_Process ();
+
+                if (draining) {
+                        drain ();
+                }
+        }
+}
+
+/*****************************************************************************/
+
+/// Stops recording and moves what is left, the stream ends on a whole record.
+static void finish (void)
+{
+        const uint8_t *data;
+        HCI_Btsnoop_Stop ();
+
+        while (HCI_Btsnoop_Peek (&data)) {
+                drain ();
+        }
+}
+
+/*****************************************************************************/
+
+/// Keeps the event past dispatch. btsnoop has copied it on the read path already.
+static void on_conn_update (void *data)
+{
+        (void)data;
+        uint32_t copies = hciPacketPoolStats.copies;
+        HCI_Packet_t *packet = HCI_Packet_Hold ();
+
+        if (!packet) {
+                return;
+        }
+
+        shared += (hciPacketPoolStats.copies == copies);
+
+        if (kept[handled % KEPT]) {
+                HCI_Packet_Release (kept[handled % KEPT]);
+        }
+
+        kept[handled++ % KEPT] = packet;
+}
+
+/*****************************************************************************/
+
+static void set_handler (HCI_Event_Handler_t handler)
+{
+        while (Sensor_Service_Set_Event_Handler (HCI_LE_META_SLOT (EVT_LE_CONN_UPDATE_COMPLETE), handler) == BLE_STATUS_BUSY) {
+                Sensor_App_Process ();
+        }
+}
+
+/*****************************************************************************/
+
+static uint32_t be32 (const uint8_t *p) { return (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3]; }
+
+/*****************************************************************************/
+
+/// Counts the records in the stream, returns -1 at the first malformed one.
+static int parse (uint32_t *received, uint32_t *drops)
+{
+        static const uint8_t fileHeader[16] = { 'b', 't', 's', 'n', 'o', 'o', 'p', 0, 0, 0, 0, 1, 0, 0, 0x03, 0xEA };
+        uint32_t pos = sizeof (fileHeader);
+        int records = 0;
+
+        if (streamLen < pos || memcmp (stream, fileHeader, pos)) {
+                return -1;
+        }
+
+        *received = *drops = 0;
+
+        while (pos < streamLen) {
+                if (streamLen - pos < 24) {
+                        return -1;
+                }
+
+                const uint8_t *r = stream + pos;
+                uint32_t len = be32 (r);
+                uint32_t flags = be32 (r + 8);
+                const uint8_t *h4 = r + 24;
+
+                if (len != be32 (r + 4) || len < 3 || streamLen - pos - 24 < len || be32 (r + 12) < *drops) {
+                        return -1;
+                }
+
+                /* Events from the controller, commands to it, whole. */
+                if (flags == 0x03 && (h4[0] != HCI_EVENT_PKT || len != 3U + h4[2])) {
+                        return -1;
+                }
+
+                if (flags == 0x02 && (h4[0] != HCI_COMMAND_PKT || len != 4U + h4[3])) {
+                        return -1;
+                }
+
+                *received += (flags & 0x01);
+                *drops = be32 (r + 12);
+                pos += 24 + len;
+                ++records;
+        }
+
+        return records;
+}
+
+/*****************************************************************************/
+
+int main (void)
+{
+        uint8_t hwVersion;
+        uint16_t fwVersion;
+        const uint8_t notify[] = { 0x01, 0x00 };
+        uint32_t received, drops;
+
+        Clock_Init ();
+        HCI_Transport_Set (&hciTransportSim);
+        Sensor_App_Init (&hwVersion, &fwVersion);
+        HCI_Btsnoop_Start ();
+        set_handler (on_conn_update);
+        run (100, 1);
+
+        CHECK (Sim_Controller_Connect (CENTRAL) == 0);
+        run (100, 1);
+        Sim_Controller_Write (CENTRAL, sensorService->accStreamCharHandle + 2, notify, sizeof (notify));
+
+        /* USB stalls a little : the events are dispatched before btsnoop has handed them over. */
+        for (int i = 0; i < UPDATES; ++i) {
+                Sim_Controller_Update_Connection (CENTRAL);
+                run (STALL, 0);
+                run (100 - STALL, 1);
+        }
+
+        /* The handler's events are still held : the stream has released its references. */
+        finish ();
+        CHECK (handled > UPDATES && shared >= UPDATES);
+        CHECK (hciPacketPoolStats.inUse == KEPT);
+
+        for (int i = 0; i < KEPT; ++i) {
+                CHECK (kept[i] != NULL);
+
+                if (kept[i]) {
+                        CHECK (kept[i]->data[0] == HCI_EVENT_PKT && kept[i]->data[1] == EVT_LE_META_EVENT && kept[i]->data[3] == EVT_LE_CONN_UPDATE_COMPLETE);
+                        CHECK (kept[i]->len == 3U + kept[i]->data[2]);
+                        HCI_Packet_Release (kept[i]);
+                }
+        }
+
+        CHECK (hciPacketPoolStats.inUse == 0);
+        CHECK (parse (&received, &drops) == (int)hciBtsnoopStats.records);
+        CHECK (streamLen == hciBtsnoopStats.bytes && !hciBtsnoopStats.dropped);
+        CHECK (received > 0 && hciBtsnoopStats.held == received);
+        CHECK (hciPacketPoolStats.holds == hciPacketPoolStats.copies + shared && !hciPacketPoolStats.exhausted);
+
+        /* Nobody moves the ring : records are dropped, past HCI_BTSNOOP_HELD received ones are copied into the ring. */
+        streamLen = 0;
+        HCI_Btsnoop_Start ();
+        run (2000, 0);
+        CHECK (hciBtsnoopStats.dropped > 0);
+        CHECK (hciPacketPoolStats.inUse == HCI_BTSNOOP_HELD);
+        run (500, 1);
+        finish ();
+
+        CHECK (parse (&received, &drops) == (int)hciBtsnoopStats.records);
+        CHECK (drops > 0 && hciBtsnoopStats.held < received);
+        CHECK (hciPacketPoolStats.inUse == 0);
+
+        printf ("%u records (%u received, %u held), %u dropped, %u pool copies, %u holds (%u shared by the handler)\n", hciBtsnoopStats.records, received,
+                hciBtsnoopStats.held, hciBtsnoopStats.dropped, hciPacketPoolStats.copies, hciPacketPoolStats.holds, shared);
+        printf ("btsnoop_test : %s\n", (failures) ? ("FAILED") : ("OK"));
+        return failures != 0;
+}
@@ -0,0 +1,120 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+/*
+ * Host test of the compile-time pin types (src/Gpio.h, src/BlueNrgPins.h) on
+ * MockGpioPort. The host aliases must name the pins the board header wires,
+ * and every pin operation must touch its own bit (or MODER field) only, with
+ * one register write, as GpioPort does on target.
+ *
+ * Built and run by host/CMakeLists.txt (ctest).
+ */
+
+#include "BlueNrgPins.h"
+#include "stm32f4xx_nucleo_bluenrg.h"
+#include <cstdio>
+
+static_assert (BnrgCs::mask == BNRG_SPI_CS_PIN, "host CS pin differs from the board wiring");
+static_assert (BnrgIrq::mask == BNRG_SPI_IRQ_PIN, "host IRQ pin differs from the board wiring");
+static_assert (BnrgReset::mask == BNRG_SPI_RESET_PIN, "host reset pin differs from the board wiring");
+
+static int failures;
+
+#define CHECK(cond)                                                                                                                                  \
+        do {                                                                                                                                         \
+                if (!(cond)) {                                                                                                                       \
+                        printf ("FAIL %s:%d : %s\n", __FILE__, __LINE__, #cond);                                                                     \
+                        ++failures;                                                                                                                  \
+                }                                                                                                                                    \
+        } while (0)
+
+template <int id> static void clear ()
+{
+        MockGpioPort<id>::odr = MockGpioPort<id>::idr = MockGpioPort<id>::moder = MockGpioPort<id>::writes = 0;
+}
+
+/*****************************************************************************/
+
+/// Output latch : own bit only, one write per operation.
+static void testOutput ()
+{
+        clear<0> ();
+        MockGpioPort<0>::odr = 0xa5a5 & ~BnrgCs::mask;
+
+        BnrgCs::set ();
+        CHECK (MockGpioPort<0>::odr == (0xa5a5 | BnrgCs::mask));
+        BnrgCs::reset ();
+        CHECK (MockGpioPort<0>::odr == (0xa5a5 & ~BnrgCs::mask));
+        BnrgCs::write (true);
+        CHECK (MockGpioPort<0>::odr & BnrgCs::mask);
+        BnrgCs::write (false);
+        CHECK (!(MockGpioPort<0>::odr & BnrgCs::mask));
+        CHECK (MockGpioPort<0>::writes == 4);
+}
+
+/*****************************************************************************/
+
+/// Input : follows idr, costs no write.
+static void testInput ()
+{
+        clear<1> ();
+        CHECK (!BnrgIrq::read ());
+        MockGpioPort<1>::idr = BnrgIrq::mask;
+        CHECK (BnrgIrq::read ());
+        MockGpioPort<1>::idr = ~BnrgIrq::mask;
+        CHECK (!BnrgIrq::read ());
+        CHECK (MockGpioPort<1>::writes == 0);
+}
+
+/*****************************************************************************/
+
+/// MODER : the pin's 2 bit field only (the IRQ line turned output for the bootloader and back).
+static void testMode ()
+{
+        clear<1> ();
+        unsigned shift = 2 * __builtin_ctz (BnrgIrq::mask);
+        MockGpioPort<1>::moder = 0xffffffff;
+
+        BnrgIrq::setMode (GpioMode::IN);
+        CHECK (MockGpioPort<1>::moder == ~(0x03U << shift));
+        BnrgIrq::setMode (GpioMode::OUT);
+        CHECK (MockGpioPort<1>::moder == (~(0x03U << shift) | (uint32_t (GpioMode::OUT) << shift)));
+        BnrgIrq::setMode (GpioMode::AF);
+        CHECK (((MockGpioPort<1>::moder >> shift) & 0x03) == uint32_t (GpioMode::AF));
+        CHECK (MockGpioPort<1>::writes == 3);
+}
+
+/*****************************************************************************/
+
+/// The reset sequence of BlueNrgSpi::reset : pulses the reset line, leaves CS and IRQ alone.
+static void testPortsIndependent ()
+{
+        clear<0> ();
+        clear<1> ();
+        clear<2> ();
+
+        BnrgReset::reset ();
+        CHECK (!(MockGpioPort<2>::odr & BnrgReset::mask));
+        BnrgReset::set ();
+        CHECK (MockGpioPort<2>::odr == BnrgReset::mask);
+        CHECK (MockGpioPort<2>::writes == 2);
+        CHECK (MockGpioPort<0>::writes == 0 && MockGpioPort<1>::writes == 0);
+}
+
+/*****************************************************************************/
+
+int main ()
+{
+        testOutput ();
+        testInput ();
+        testMode ();
+        testPortsIndependent ();
+
+        printf ("gpio_mock_test : %s\n", (failures) ? ("FAILED") : ("OK"));
+        return failures != 0;
+}
@@ -0,0 +1,240 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+/*
+ * Host benchmark of the table driven HCI event dispatch (src/hci_dispatch.h)
+ * against the nested switches HCI_Event_CB used before it (event, LE
+ * subevent, vendor ecode, and the IDB04A1 / IDB05A1 test at run time). Both
+ * dispatch the same random mix of the events a streaming session brings, and
+ * must call the same handlers the same number of times. Prints the time per
+ * event of each.
+ *
+ * Built by host/CMakeLists.txt, ctest runs a short round.
+ * hci_dispatch_bench [EVENTS]   (default 10000000)
+ */
+
+#include "hci_dispatch.h"
+#include "hci.h"
+#include "hci_const.h"
+#include "bluenrg_aci_const.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CYCLES() __rdtsc ()
+#else
+#define CYCLES() 0
+#endif
+
+#define PACKET_SIZE 16
+#define SEQUENCE 65536 /* random packet order, too long for the branch predictors to learn */
+
+enum { DISCONNECT, CMD_COMPLETE, CMD_STATUS, CONNECT, READ_PERMIT, ATTR_MODIFIED_04, ATTR_MODIFIED_05, PROCEDURE_COMPLETE, TX_POOL, HANDLERS };
+
+static uint32_t calls[2][HANDLERS];
+static volatile uint8_t sink;
+static int current; /* 0 : switch, 1 : table */
+static volatile uint8_t board = 1; /* IDB05A1, read at run time as HCI_Event_CB did */
+
+typedef struct {
+        uint8_t bytes[PACKET_SIZE];
+        unsigned int weight;
+} Packet_t;
+
+/*
+ * A streaming session seen by the host : mostly Command Complete for the
+ * characteristic updates and TX pool available, some reads and writes, and
+ * events nobody handles (which the controller would not send with the masks
+ * programmed, see hci_event_mask_bench).
+ */
+static Packet_t packets[] = {
+        { { HCI_EVENT_PKT, EVT_CMD_COMPLETE, 4, 0x01, 0x06, 0xFD, 0x00 }, 40 },
+        { { HCI_EVENT_PKT, EVT_VENDOR, 2, EVT_BLUE_GATT_TX_POOL_AVAILABLE & 0xFF, EVT_BLUE_GATT_TX_POOL_AVAILABLE >> 8 }, 20 },
+        { { HCI_EVENT_PKT, EVT_CMD_STATUS, 4, 0x00, 0x01, 0x93, 0xFC }, 5 },
+        { { HCI_EVENT_PKT, EVT_VENDOR, 4, EVT_BLUE_GATT_READ_PERMIT_REQ & 0xFF, EVT_BLUE_GATT_READ_PERMIT_REQ >> 8, 0x01, 0x08 }, 10 },
+        { { HCI_EVENT_PKT, EVT_VENDOR, 8, EVT_BLUE_GATT_ATTRIBUTE_MODIFIED & 0xFF, EVT_BLUE_GATT_ATTRIBUTE_MODIFIED >> 8, 0x01, 0x08 }, 10 },
+        { { HCI_EVENT_PKT, EVT_VENDOR, 5, EVT_BLUE_GATT_PROCEDURE_COMPLETE & 0xFF, EVT_BLUE_GATT_PROCEDURE_COMPLETE >> 8, 0x01, 0x08 }, 5 },
+        { { HCI_EVENT_PKT, EVT_LE_META_EVENT, 19, EVT_LE_CONN_COMPLETE, 0x00, 0x01, 0x08 }, 1 },
+        { { HCI_EVENT_PKT, EVT_DISCONN_COMPLETE, 4, 0x00, 0x01, 0x08, 0x13 }, 1 },
+        { { HCI_EVENT_PKT, EVT_LE_META_EVENT, 10, EVT_LE_CONN_UPDATE_COMPLETE, 0x00, 0x01, 0x08 }, 4 },
+        { { HCI_EVENT_PKT, EVT_ENCRYPT_CHANGE, 4, 0x00, 0x01, 0x08, 0x01 }, 2 },
+        { { HCI_EVENT_PKT, EVT_VENDOR, 3, EVT_BLUE_GAP_PAIRING_CMPLT & 0xFF, EVT_BLUE_GAP_PAIRING_CMPLT >> 8, 0x00 }, 2 },
+};
+
+#define PACKETS (sizeof (packets) / sizeof (packets[0]))
+
+static uint8_t sequence[SEQUENCE];
+
+/*****************************************************************************/
+
+/*
+ * What a handler costs at least : look at the payload. Real handlers are not
+ * inlined into the switch either, they are too big or live in other files.
+ */
+#define HANDLER __attribute__ ((noinline))
+
+static inline void handled (int handler, const void *data)
+{
+        ++calls[current][handler];
+        sink += *(const uint8_t *)data;
+}
+
+static HANDLER void on_disconnect (void *data) { handled (DISCONNECT, data); }
+static HANDLER void on_cmd_complete (void *data) { handled (CMD_COMPLETE, data); }
+static HANDLER void on_cmd_status (void *data) { handled (CMD_STATUS, data); }
+static HANDLER void on_connect (void *data) { handled (CONNECT, data); }
+static HANDLER void on_read_permit (void *data) { handled (READ_PERMIT, data); }
+static HANDLER void on_attr_modified_IDB04A1 (void *data) { handled (ATTR_MODIFIED_04, data); }
+static HANDLER void on_attr_modified_IDB05A1 (void *data) { handled (ATTR_MODIFIED_05, data); }
+static HANDLER void on_procedure_complete (void *data) { handled (PROCEDURE_COMPLETE, data); }
+static HANDLER void on_tx_pool (void *data) { handled (TX_POOL, data); }
+
+/*****************************************************************************/
+
+/// HCI_Event_CB before the dispatch table, with the events handled since.
+static void dispatch_switch (void *pckt)
+{
+        hci_uart_pckt *hci_pckt = pckt;
+        hci_event_pckt *event_pckt = (hci_event_pckt *)hci_pckt->data;
+
+        if (hci_pckt->type != HCI_EVENT_PKT) return;
+
+        switch (event_pckt->evt) {
+
+        case EVT_DISCONN_COMPLETE:
+                on_disconnect (event_pckt->data);
+                break;
+
+        case EVT_CMD_COMPLETE:
+                on_cmd_complete (event_pckt->data);
+                break;
+
+        case EVT_CMD_STATUS:
+                on_cmd_status (event_pckt->data);
+                break;
+
+        case EVT_LE_META_EVENT: {
+                evt_le_meta_event *evt = (void *)event_pckt->data;
+
+                switch (evt->subevent) {
+                case EVT_LE_CONN_COMPLETE:
+                        on_connect (evt->data);
+                        break;
+                }
+        } break;
+
+        case EVT_VENDOR: {
+                evt_blue_aci *blue_evt = (void *)event_pckt->data;
+
+                switch (blue_evt->ecode) {
+                case EVT_BLUE_GATT_ATTRIBUTE_MODIFIED:
+                        if (board == 1) {
+                                on_attr_modified_IDB05A1 (blue_evt->data);
+                        }
+                        else {
+                                on_attr_modified_IDB04A1 (blue_evt->data);
+                        }
+                        break;
+
+                case EVT_BLUE_GATT_READ_PERMIT_REQ:
+                        on_read_permit (blue_evt->data);
+                        break;
+
+                case EVT_BLUE_GATT_PROCEDURE_COMPLETE:
+                        on_procedure_complete (blue_evt->data);
+                        break;
+
+                case EVT_BLUE_GATT_TX_POOL_AVAILABLE:
+                        on_tx_pool (blue_evt->data);
+                        break;
+                }
+        } break;
+        }
+}
+
+/*****************************************************************************/
+
+static HCI_Dispatch_Table_t table = {
+        [HCI_EVENT_SLOT (EVT_DISCONN_COMPLETE)] = on_disconnect,
+        [HCI_EVENT_SLOT (EVT_CMD_COMPLETE)] = on_cmd_complete,
+        [HCI_EVENT_SLOT (EVT_CMD_STATUS)] = on_cmd_status,
+        [HCI_LE_META_SLOT (EVT_LE_CONN_COMPLETE)] = on_connect,
+        [HCI_VENDOR_EVENT_SLOT (EVT_BLUE_GATT_READ_PERMIT_REQ)] = on_read_permit,
+        [HCI_VENDOR_EVENT_SLOT (EVT_BLUE_GATT_PROCEDURE_COMPLETE)] = on_procedure_complete,
+        [HCI_VENDOR_EVENT_SLOT (EVT_BLUE_GATT_TX_POOL_AVAILABLE)] = on_tx_pool,
+        /* Chosen once at init, see Sensor_Service_Init_Events. */
+        [HCI_VENDOR_EVENT_SLOT (EVT_BLUE_GATT_ATTRIBUTE_MODIFIED)] = on_attr_modified_IDB05A1,
+};
+
+static void dispatch_table (void *pckt) { HCI_Dispatch (table, pckt); }
+
+/*****************************************************************************/
+
+static double run (void (*volatile dispatch) (void *), uint32_t events, uint64_t *cycles)
+{
+        struct timespec t0, t1;
+        uint64_t c0;
+
+        clock_gettime (CLOCK_MONOTONIC, &t0);
+        c0 = CYCLES ();
+
+        for (uint32_t i = 0; i < events; ++i) {
+                dispatch (packets[sequence[i % SEQUENCE]].bytes);
+        }
+
+        *cycles = CYCLES () - c0;
+        clock_gettime (CLOCK_MONOTONIC, &t1);
+        return ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / events;
+}
+
+/*****************************************************************************/
+
+int main (int argc, char **argv)
+{
+        uint32_t events = (argc > 1) ? (strtoul (argv[1], NULL, 0)) : (10000000);
+        unsigned int weights = 0;
+        uint32_t seed = 1;
+        uint64_t cycles[2];
+        double ns[2];
+
+        if (events == 0) {
+                fprintf (stderr, "Usage : hci_dispatch_bench [EVENTS]\n");
+                return 2;
+        }
+
+        for (unsigned int p = 0; p < PACKETS; ++p) {
+                weights += packets[p].weight;
+        }
+
+        for (int i = 0; i < SEQUENCE; ++i) {
+                seed = seed * 1103515245 + 12345;
+                unsigned int w = (seed >> 16) % weights;
+                unsigned int p = 0;
+
+                while (w >= packets[p].weight) {
+                        w -= packets[p++].weight;
+                }
+
+                sequence[i] = p;
+        }
+
+        current = 0;
+        ns[0] = run (dispatch_switch, events, &cycles[0]);
+        current = 1;
+        hciDispatchStats.handled = hciDispatchStats.unhandled = 0;
+        ns[1] = run (dispatch_table, events, &cycles[1]);
+
+        int ok = (memcmp (calls[0], calls[1], sizeof (calls[0])) == 0);
+        printf ("%u events, %u handled, %u unhandled\n", events, hciDispatchStats.handled, hciDispatchStats.unhandled);
+        printf ("switch : %6.2f ns/event %6.1f cycles/event\n", ns[0], (double)cycles[0] / events);
+        printf ("table  : %6.2f ns/event %6.1f cycles/event\n", ns[1], (double)cycles[1] / events);
+        printf ("hci_dispatch_bench : %s\n", (ok) ? ("OK") : ("FAILED, the two dispatch different handlers"));
+        return !ok;
+}
@@ -0,0 +1,174 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+/*
+ * Host benchmark of the controller event masks (src/hci_event_mask.h) : the
+ * firmware streams to a central over the simulated controller
+ * (src/sim_controller.h), which honours the masks, for three rounds of
+ * MINUTES simulated minutes each. The central updates the connection every
+ * UPDATE_PERIOD ms, as some centrals keep doing, and the controller reports
+ * each with an LE Connection Update Complete, which the firmware does not
+ * handle :
+ *
+ * 1. the masks programmed at init, from the firmware's handlers,
+ * 2. a handler for LE Connection Update Complete installed at run time
+ *    (Sensor_Service_Set_Event_Handler), so the masks let it through,
+ * 3. that handler removed again.
+ *
+ * Prints the events delivered to the host and suppressed by the controller in
+ * each round. Fails if the masks do not follow the handlers. Number Of
+ * Completed Packets, which the firmware does not handle either, cannot be
+ * masked and comes in every round.
+ *
+ * Built by host/CMakeLists.txt, ctest runs a short round.
+ * hci_event_mask_bench [MINUTES]   (default 10)
+ */
+
+#include "sensor_app.h"
+#include "sim_controller.h"
+#include "virtual_clock.h"
+#include "hci_transport.h"
+#include "hci_const.h"
+#include "ble_status.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define SUBSCRIBE 200 /* ms from the connection to the CCCD write */
+#define UPDATE_PERIOD 100 /* ms between two connection updates of the central */
+#define CENTRAL 0x0801
+
+static uint32_t updateEvents;
+static int failures;
+
+/*****************************************************************************/
+
+static void on_connection_update (void *data)
+{
+        (void)data;
+        ++updateEvents;
+}
+
+/*****************************************************************************/
+
+static void update_connection (void *arg)
+{
+        (void)arg;
+        Sim_Controller_Update_Connection (CENTRAL);
+        VClock_Schedule (UPDATE_PERIOD, update_connection, NULL);
+}
+
+/*****************************************************************************/
+
+static void subscribe (void *arg)
+{
+        (void)arg;
+        const uint8_t notify[] = { 0x01, 0x00 };
+        Sim_Controller_Write (CENTRAL, sensorService->accStreamCharHandle + 2, notify, sizeof (notify));
+}
+
+/*****************************************************************************/
+
+static void connect (void *arg)
+{
+        (void)arg;
+
+        if (Sim_Controller_Connect (CENTRAL) < 0) {
+                VClock_Schedule (10, connect, NULL);
+                return;
+        }
+
+        VClock_Schedule (SUBSCRIBE, subscribe, NULL);
+        VClock_Schedule (UPDATE_PERIOD, update_connection, NULL);
+}
+
+/*****************************************************************************/
+
+/// Blocking commands are sent from the main loop only : waits for the async ones in flight.
+static void set_handler (HCI_Event_Handler_t handler)
+{
+        tBleStatus ret;
+
+        while ((ret = Sensor_Service_Set_Event_Handler (HCI_LE_META_SLOT (EVT_LE_CONN_UPDATE_COMPLETE), handler)) == BLE_STATUS_BUSY) {
+                Sensor_App_Process ();
+        }
+
+        if (ret != BLE_STATUS_SUCCESS) {
+                printf ("FAIL Sensor_Service_Set_Event_Handler : 0x%02x\n", ret);
+                ++failures;
+        }
+}
+
+/*****************************************************************************/
+
+/// Runs the main loop for duration ms, prints and returns what the host got and what it was spared.
+static void run_round (const char *label, tClockTime duration, uint32_t *delivered, uint32_t *suppressed)
+{
+        uint32_t events = simControllerStats.events;
+        uint32_t masked = simControllerStats.suppressed;
+        uint32_t handled = updateEvents;
+        tClockTime start = VClock_Now ();
+
+        while (VClock_Now () - start < duration) {
+                Sensor_App_Process ();
+        }
+
+        *delivered = simControllerStats.events - events;
+        *suppressed = simControllerStats.suppressed - masked;
+        printf ("%-28s %10u %8.1f/s %10u %8.1f/s %10u\n", label, *delivered, *delivered * 1000.0 / duration, *suppressed,
+                *suppressed * 1000.0 / duration, updateEvents - handled);
+}
+
+/*****************************************************************************/
+
+int main (int argc, char **argv)
+{
+        uint32_t minutes = (argc > 1) ? (atoi (argv[1])) : (10);
+        tClockTime duration = minutes * 60 * 1000;
+        uint32_t delivered[3], suppressed[3];
+        uint8_t hwVersion;
+        uint16_t fwVersion;
+
+        if (minutes < 1) {
+                fprintf (stderr, "Usage : hci_event_mask_bench [MINUTES]\n");
+                return 2;
+        }
+
+        Clock_Init ();
+        HCI_Transport_Set (&hciTransportSim);
+        Sensor_App_Init (&hwVersion, &fwVersion);
+        VClock_Schedule (0, connect, NULL);
+
+        printf ("%-28s %10s %10s %10s %10s %10s\n", "round", "delivered", "", "suppressed", "", "handled");
+        run_round ("masks from the handlers", duration, &delivered[0], &suppressed[0]);
+
+        set_handler (on_connection_update);
+        run_round ("connection updates handled", duration, &delivered[1], &suppressed[1]);
+
+        set_handler (NULL);
+        uint32_t handled = updateEvents;
+        run_round ("handler removed", duration, &delivered[2], &suppressed[2]);
+
+        if (!suppressed[0] || !suppressed[2]) {
+                printf ("FAIL the controller sent every event\n");
+                ++failures;
+        }
+
+        if (!updateEvents || updateEvents != handled) {
+                printf ("FAIL the handler got %u events, %u after it was removed\n", handled, updateEvents - handled);
+                ++failures;
+        }
+
+        if (suppressed[1] >= suppressed[0] || delivered[1] <= delivered[0]) {
+                printf ("FAIL the masks did not follow the installed handler\n");
+                ++failures;
+        }
+
+        Sim_Controller_Report ();
+        printf ("hci_event_mask_bench : %s\n", (failures) ? ("FAILED") : ("OK"));
+        return failures != 0;
+}
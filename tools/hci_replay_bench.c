@@ -0,0 +1,201 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+/*
+ * Host harness of the HCI capture and replay (src/hci_capture.h). Captures
+ * the events of a streaming session over the simulated controller
+ * (src/sim_controller.h) the way the board does after its initialization,
+ * then replays the capture through HCI_Event_CB :
+ *
+ * 1. as fast as the main loop takes it, printing the cost of each event kind
+ *    (nanoseconds on the host, cycles on the board),
+ * 2. at the recorded pace, which must take the recorded (simulated) time,
+ * 3. cut in the middle of its last record, and with the last record's length
+ *    corrupted : the replay must end with the last complete record.
+ *
+ * Every replay must deliver every complete record, to HCI_Event_CB unless a
+ * blocking call of the firmware took it as its answer. Or replays CAPTURE, a file
+ * holding a capture read out of the board (hciCaptureBuffer, hciCaptureStats.bytes
+ * long), at full speed.
+ *
+ * Built by host/CMakeLists.txt (with HCI_CAPTURE), run by ctest.
+ * hci_replay_bench [CAPTURE]
+ */
+
+#include "sensor_app.h"
+#include "sim_controller.h"
+#include "virtual_clock.h"
+#include "hci_transport.h"
+#include "hci_capture.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SUBSCRIBE 200 /* ms from the connection to the CCCD write */
+#define CENTRAL 0x0801
+#define SESSION 60000 /* ms, at most : until the capture buffer is full */
+
+static uint8_t capture[HCI_CAPTURE_SIZE];
+static int failures;
+
+/*****************************************************************************/
+
+static void subscribe (void *arg)
+{
+        (void)arg;
+        const uint8_t notify[] = { 0x01, 0x00 };
+        Sim_Controller_Write (CENTRAL, sensorService->accStreamCharHandle + 2, notify, sizeof (notify));
+}
+
+/*****************************************************************************/
+
+static void connect (void *arg)
+{
+        (void)arg;
+
+        if (Sim_Controller_Connect (CENTRAL) < 0) {
+                VClock_Schedule (10, connect, NULL);
+                return;
+        }
+
+        VClock_Schedule (SUBSCRIBE, subscribe, NULL);
+}
+
+/*****************************************************************************/
+
+/// Returns the number of complete records in the len bytes at data, and their recorded duration in ms.
+static uint32_t count_records (const uint8_t *data, uint32_t len, uint32_t *duration)
+{
+        uint32_t records = 0;
+        uint32_t i = 0;
+
+        *duration = 0;
+
+        while (len - i >= HCI_CAPTURE_RECORD_HEADER_SIZE && len - i - HCI_CAPTURE_RECORD_HEADER_SIZE >= data[i + 2]) {
+                *duration += data[i] | (data[i + 1] << 8);
+                i += HCI_CAPTURE_RECORD_HEADER_SIZE + data[i + 2];
+                ++records;
+        }
+
+        return records;
+}
+
+/*****************************************************************************/
+
+/// Replays and runs the main loop until the report is out. Returns the simulated time taken.
+static tClockTime replay (const char *label, const uint8_t *data, uint32_t len, uint8_t paced, uint32_t expected)
+{
+        tClockTime start = VClock_Now ();
+
+        printf ("%s, %u records :\n", label, expected);
+        HCI_Replay_Start (data, len, paced);
+
+        while (HCI_Transport_Get () == &hciTransportReplay) {
+                Sensor_App_Process ();
+        }
+
+        /* The last events are dispatched, and the report printed. */
+        Sensor_App_Process ();
+
+        /* Blocking calls the replayed events trigger take their answers without dispatching them. */
+        if (hciReplayStats.records != expected || hciReplayStats.events > expected || hciReplayStats.events + hciReplayStats.commands < expected) {
+                printf ("FAIL %s : %u records replayed, %u events\n", label, hciReplayStats.records, hciReplayStats.events);
+                ++failures;
+        }
+
+        return VClock_Now () - start;
+}
+
+/*****************************************************************************/
+
+int main (int argc, char **argv)
+{
+        uint8_t hwVersion;
+        uint16_t fwVersion;
+        uint32_t len, duration, records;
+
+        Clock_Init ();
+        HCI_Transport_Set (&hciTransportSim);
+        Sensor_App_Init (&hwVersion, &fwVersion);
+
+        if (argc > 1) {
+                FILE *f = fopen (argv[1], "rb");
+
+                if (!f) {
+                        perror (argv[1]);
+                        return 2;
+                }
+
+                len = fread (capture, 1, sizeof (capture), f);
+                fclose (f);
+                replay ("capture", capture, len, 0, count_records (capture, len, &duration));
+                printf ("hci_replay_bench : %s\n", (failures) ? ("FAILED") : ("OK"));
+                return failures != 0;
+        }
+
+        /* Capture, as main does after the initialization. */
+        HCI_Capture_Start ();
+        VClock_Schedule (0, connect, NULL);
+        tClockTime start = VClock_Now ();
+
+        while (!hciCaptureStats.dropped && VClock_Now () - start < SESSION) {
+                Sensor_App_Process ();
+        }
+
+        HCI_Capture_Stop ();
+
+        /* The central unsubscribes : no live traffic (Number Of Completed Packets cannot be masked) in the replays. */
+        const uint8_t off[] = { 0x00, 0x00 };
+        Sim_Controller_Write (CENTRAL, sensorService->accStreamCharHandle + 2, off, sizeof (off));
+        start = VClock_Now ();
+
+        while (VClock_Now () - start < SUBSCRIBE) {
+                Sensor_App_Process ();
+        }
+
+        len = hciCaptureStats.bytes;
+        memcpy (capture, hciCaptureBuffer, len);
+        records = count_records (capture, len, &duration);
+        printf ("captured %u records, %u B, %u ms\n", hciCaptureStats.records, len, duration);
+
+        if (records != hciCaptureStats.records || records < 100) {
+                printf ("FAIL capture : %u records of %u\n", records, hciCaptureStats.records);
+                ++failures;
+        }
+
+        replay ("full speed", capture, len, 0, records);
+
+        tClockTime took = replay ("paced", capture, len, 1, records);
+
+        if (took < duration || took > duration + 10) {
+                printf ("FAIL paced : took %u ms\n", took);
+                ++failures;
+        }
+
+        /* A truncated capture, its end on the heap so that reading past it shows with sanitizers / valgrind. */
+        uint8_t *cut = malloc (len - 2);
+        memcpy (cut, capture, len - 2);
+        replay ("truncated", cut, len - 2, 0, records - 1);
+        free (cut);
+
+        /* The last record claims more than there is. */
+        uint32_t last = 0;
+
+        for (uint32_t i = 0; i < records - 1; ++i) {
+                last += HCI_CAPTURE_RECORD_HEADER_SIZE + capture[last + 2];
+        }
+
+        uint8_t *corrupt = malloc (len);
+        memcpy (corrupt, capture, len);
+        corrupt[last + 2] = 0xFF;
+        replay ("corrupt", corrupt, len, 0, records - 1);
+        free (corrupt);
+
+        printf ("hci_replay_bench : %s\n", (failures) ? ("FAILED") : ("OK"));
+        return failures != 0;
+}
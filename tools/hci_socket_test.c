@@ -0,0 +1,148 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+/*
+ * Host test of the socket transport (src/hci_transport_socket.c). A thread
+ * plays the controller on the other end of the socket : it answers a blocking
+ * ACI call with its Command Complete, then sends an event nobody asked for,
+ * split over two writes. The call must succeed, and the event must reach
+ * HCI_Event_CB through the reader thread (HCI_Isr) and HCI_Process.
+ *
+ * Built and run by host/CMakeLists.txt (ctest).
+ */
+
+#include "hci_transport.h"
+#include "hci.h"
+#include "clock.h"
+#include "bluenrg_hal_aci.h"
+#include "bluenrg_aci_const.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define EVENT_TIMEOUT 1000 /* ms */
+
+static int listener = -1;
+static volatile uint16_t opcodeSeen;
+static volatile uint8_t eventSeen;
+
+/*****************************************************************************/
+
+void HCI_Event_CB (void *pckt)
+{
+        const uint8_t *p = pckt;
+
+        if (p[0] == HCI_EVENT_PKT && p[1] == EVT_DISCONN_COMPLETE) {
+                eventSeen = 1;
+        }
+}
+
+/*****************************************************************************/
+
+static int read_exact (int fd, uint8_t *buffer, size_t len)
+{
+        while (len > 0) {
+                ssize_t r = read (fd, buffer, len);
+
+                if (r <= 0) {
+                        return -1;
+                }
+
+                buffer += r;
+                len -= r;
+        }
+
+        return 0;
+}
+
+/*****************************************************************************/
+
+static void *controller (void *arg)
+{
+        (void)arg;
+        int fd = accept (listener, NULL, NULL);
+        uint8_t cmd[4 + 255];
+
+        if (fd < 0 || read_exact (fd, cmd, 4) < 0 || read_exact (fd, cmd + 4, cmd[3]) < 0 || cmd[0] != HCI_COMMAND_PKT) {
+                return NULL;
+        }
+
+        opcodeSeen = cmd[1] | (cmd[2] << 8);
+
+        /* Command Complete : 1 credit, the opcode, status. */
+        uint8_t complete[] = { HCI_EVENT_PKT, EVT_CMD_COMPLETE, 4, 1, cmd[1], cmd[2], BLE_STATUS_SUCCESS };
+        write (fd, complete, sizeof (complete));
+
+        /* Disconnection Complete of handle 1, header and parameters apart. */
+        uint8_t disconnection[] = { HCI_EVENT_PKT, EVT_DISCONN_COMPLETE, 4, 0, 0x01, 0x00, HCI_OE_USER_ENDED_CONNECTION };
+        write (fd, disconnection, 3);
+        usleep (10000);
+        write (fd, disconnection + 3, sizeof (disconnection) - 3);
+
+        /* Stay connected until the test is done. */
+        read_exact (fd, cmd, 1);
+        close (fd);
+        return NULL;
+}
+
+/*****************************************************************************/
+
+int main (void)
+{
+        struct sockaddr_un addr;
+        memset (&addr, 0, sizeof (addr));
+        addr.sun_family = AF_UNIX;
+        snprintf (addr.sun_path, sizeof (addr.sun_path), "/tmp/hci_socket_test.%d.sock", (int)getpid ());
+        unlink (addr.sun_path);
+
+        listener = socket (AF_UNIX, SOCK_STREAM, 0);
+
+        if (listener < 0 || bind (listener, (struct sockaddr *)&addr, sizeof (addr)) < 0 || listen (listener, 1) < 0) {
+                perror ("hci_socket_test");
+                return 1;
+        }
+
+        setenv ("BNRG_SOCKET", addr.sun_path, 1);
+
+        Clock_Init ();
+        HCI_Transport_Set (&hciTransportSocket);
+        HCI_Transport_Init ();
+        HCI_Init ();
+
+        pthread_t thread;
+        pthread_create (&thread, NULL, controller, NULL);
+
+        int failures = 0;
+        tBleStatus ret = aci_hal_set_tx_power_level (1, 4);
+        uint16_t expected = cmd_opcode_pack (OGF_VENDOR_CMD, OCF_HAL_SET_TX_POWER_LEVEL);
+
+        if (ret != BLE_STATUS_SUCCESS || opcodeSeen != expected) {
+                printf ("FAIL command : status 0x%02x, opcode 0x%04x (expected 0x%04x)\n", ret, opcodeSeen, expected);
+                ++failures;
+        }
+
+        tClockTime start = Clock_Time ();
+
+        while (!eventSeen && Clock_Time () - start < EVENT_TIMEOUT) {
+                HCI_Process ();
+                usleep (1000);
+        }
+
+        if (!eventSeen) {
+                printf ("FAIL event : disconnection complete not delivered\n");
+                ++failures;
+        }
+
+        printf ("hci_socket_test : %s\n", (failures) ? ("FAILED") : ("OK"));
+        unlink (addr.sun_path);
+        return failures != 0;
+}
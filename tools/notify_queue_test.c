@@ -0,0 +1,164 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+/*
+ * Host test of the characteristic update queue (src/notify_queue.h) over the
+ * simulated controller (src/sim_controller.h), with a central subscribed to
+ * the accelerometer characteristic and the firmware's own updates stopped :
+ *
+ * - an update pushed while the queue is idle is built in the command slot
+ *   straight away, not copied into the queue,
+ * - pushed faster than the controller's TX buffers drain, updates are refused,
+ *   those built in the slot too, and every one reaches the controller once,
+ *   in order and with its own value.
+ *
+ * Built and run by host/CMakeLists.txt (ctest).
+ */
+
+#include "sensor_app.h"
+#include "sim_controller.h"
+#include "virtual_clock.h"
+#include "hci_transport.h"
+#include "notify_queue.h"
+#include "hci.h"
+#include <stdio.h>
+
+#define CENTRAL 0x0801
+#define UPDATES 300
+
+static int failures;
+
+#define CHECK(cond)                                                                                                                                  \
+        do {                                                                                                                                         \
+                if (!(cond)) {                                                                                                                       \
+                        printf ("FAIL %s:%d : %s\n", __FILE__, __LINE__, #cond);                                                                     \
+                        ++failures;                                                                                                                  \
+                }                                                                                                                                    \
+        } while (0)
+
+static uint16_t pushed, received, outOfOrder, done;
+
+/*****************************************************************************/
+
+static void run (tClockTime duration)
+{
+        tClockTime start = VClock_Now ();
+
+        while (VClock_Now () - start < duration) {
+                Sensor_App_Process ();
+        }
+}
+
+/*****************************************************************************/
+
+/// What the controller took : the values must come as they were pushed.
+static void on_update (uint16_t charHandle, const uint8_t *value, uint8_t len)
+{
+        if (charHandle != sensorService->accCharHandle) {
+                return;
+        }
+
+        if (len != 6 || (uint16_t)(value[0] | (value[1] << 8)) != received || value[5] != (uint8_t)~received) {
+                ++outOfOrder;
+        }
+
+        ++received;
+}
+
+/*****************************************************************************/
+
+static void on_done (void *context, uint8_t status, const uint8_t *ret, uint8_t retLen)
+{
+        (void)context;
+        (void)ret;
+        (void)retLen;
+        done += (status == BLE_STATUS_SUCCESS);
+}
+
+/*****************************************************************************/
+
+static int push (void)
+{
+        uint8_t value[6] = { (uint8_t)pushed, (uint8_t)(pushed >> 8), 0, 0, 0, (uint8_t)~pushed };
+        Sensor_Service_t *s = sensorService;
+
+        if (Notify_Queue_Push (&s->notifyQueue, s->accServHandle, s->accCharHandle, value, sizeof (value), on_done, NULL)) {
+                return -1;
+        }
+
+        ++pushed;
+        return 0;
+}
+
+/*****************************************************************************/
+
+int main (void)
+{
+        uint8_t hwVersion;
+        uint16_t fwVersion;
+        const uint8_t notify[] = { 0x01, 0x00 };
+        Notify_Queue_Stats_t *stats = &sensorService->notifyQueue.stats;
+
+        Clock_Init ();
+        HCI_Transport_Set (&hciTransportSim);
+        Sensor_App_Init (&hwVersion, &fwVersion);
+        run (100);
+
+        CHECK (Sim_Controller_Connect (CENTRAL) == 0);
+        run (100);
+        Sim_Controller_Write (CENTRAL, sensorService->accCharHandle + 2, notify, sizeof (notify));
+        run (100);
+
+        /* The queue's updates only from now on. */
+        Timer_Wheel_Stop (&sensorService->sampleTimer);
+        Timer_Wheel_Stop (&sensorService->refreshTimer);
+        run (100);
+        Sim_Controller_On_Update (on_update);
+        Notify_Queue_Stats_t before = *stats;
+
+        /* One at a time : never copied. */
+        for (int i = 0; i < 10; ++i) {
+                CHECK (push () == 0);
+                run (20);
+        }
+
+        CHECK (stats->direct - before.direct == 10 && stats->queued - before.queued == 10);
+        CHECK (received == 10 && done == 10);
+
+        /* One at a time, as soon as the previous one is taken : the controller refuses some built in the slot. */
+        while (pushed < UPDATES / 2) {
+                if (!Notify_Queue_Count (&sensorService->notifyQueue)) {
+                        CHECK (push () == 0);
+                }
+
+                Sensor_App_Process ();
+        }
+
+        CHECK (stats->refused > before.refused);
+        CHECK (stats->direct - before.direct > 10);
+        CHECK (!outOfOrder);
+
+        /* As fast as the queue takes them. */
+        while (pushed < UPDATES) {
+                while (pushed < UPDATES && push () == 0) {
+                }
+
+                run (1);
+        }
+
+        run (1000);
+        CHECK (received == UPDATES && done == UPDATES && !outOfOrder);
+        CHECK (stats->refused > before.refused && stats->failed == before.failed);
+        CHECK (stats->direct - before.direct < UPDATES);
+        CHECK (Notify_Queue_Count (&sensorService->notifyQueue) == 0);
+
+        printf ("%u updates, %lu built in the slot, %lu refused\n", pushed, (unsigned long)(stats->direct - before.direct),
+                (unsigned long)(stats->refused - before.refused));
+        printf ("notify_queue_test : %s\n", (failures) ? ("FAILED") : ("OK"));
+        return failures != 0;
+}
@@ -0,0 +1,171 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+/*
+ * Host benchmark of the characteristic reads, in the mode the firmware is
+ * built with (LOCAL_READS, sensor_service.h). A central streams the
+ * accelerometer and reads the readable characteristics in turn, one every
+ * READ_PERIOD ms, for MINUTES simulated minutes over the simulated controller
+ * (src/sim_controller.h). Prints what the reads cost :
+ *
+ * - how long the central waited for the application (aci_gatt_allow_read),
+ *   in simulated ms, on top of the controller's own answer,
+ * - the host CPU time Read_Request_CB and its update took (readStats),
+ * - the commands and events per second the session took, the refresh of
+ *   LOCAL_READS included, and the stream's notifications per second.
+ *
+ * host/CMakeLists.txt builds it twice : read_latency_bench (LOCAL_READS 1, the
+ * default) and read_latency_bench_app_reads (LOCAL_READS 0). Run both to
+ * compare, ctest runs a short round of each. Fails if a read was not served
+ * the way the mode says.
+ *
+ * read_latency_bench [MINUTES]   (default 10)
+ */
+
+#include "sensor_app.h"
+#include "sim_controller.h"
+#include "virtual_clock.h"
+#include "hci_transport.h"
+#include "cycle_counter.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define CENTRAL 0x0801
+#define SUBSCRIBE 200 /* ms from the connection to the CCCD write */
+#define READ_PERIOD 25
+#define DRAIN 1000 /* ms after the last read, for it to be answered */
+
+static uint16_t readHandles[4];
+static uint32_t issued, busy;
+static uint8_t reading;
+
+/*****************************************************************************/
+
+/// The central reads the value of every readable characteristic in turn.
+static void read_next (void *arg)
+{
+        (void)arg;
+
+        if (!reading) {
+                return;
+        }
+
+        /* The previous read still waits for the application. */
+        if (Sim_Controller_Read (CENTRAL, readHandles[issued % 4] + 1) < 0) {
+                ++busy;
+        }
+        else {
+                ++issued;
+        }
+
+        VClock_Schedule (READ_PERIOD, read_next, NULL);
+}
+
+/*****************************************************************************/
+
+static void subscribe (void *arg)
+{
+        (void)arg;
+        const uint8_t notify[] = { 0x01, 0x00 };
+        Sim_Controller_Write (CENTRAL, sensorService->accStreamCharHandle + 2, notify, sizeof (notify));
+        reading = 1;
+        VClock_Schedule (READ_PERIOD, read_next, NULL);
+}
+
+/*****************************************************************************/
+
+static void connect (void *arg)
+{
+        (void)arg;
+
+        if (Sim_Controller_Connect (CENTRAL) < 0) {
+                VClock_Schedule (10, connect, NULL);
+                return;
+        }
+
+        VClock_Schedule (SUBSCRIBE, subscribe, NULL);
+}
+
+/*****************************************************************************/
+
+static void run (tClockTime duration)
+{
+        tClockTime start = VClock_Now ();
+
+        while (VClock_Now () - start < duration) {
+                Sensor_App_Process ();
+        }
+}
+
+/*****************************************************************************/
+
+int main (int argc, char **argv)
+{
+        uint32_t minutes = (argc > 1) ? (atoi (argv[1])) : (10);
+        tClockTime duration = minutes * 60 * 1000;
+        uint8_t hwVersion;
+        uint16_t fwVersion;
+        int failures = 0;
+
+        if (minutes < 1) {
+                fprintf (stderr, "Usage : read_latency_bench [MINUTES]\n");
+                return 2;
+        }
+
+        Clock_Init ();
+        HCI_Transport_Set (&hciTransportSim);
+        Sensor_App_Init (&hwVersion, &fwVersion);
+
+        readHandles[0] = sensorService->accCharHandle;
+        readHandles[1] = sensorService->tempCharHandle;
+        readHandles[2] = sensorService->pressCharHandle;
+        readHandles[3] = sensorService->humidityCharHandle;
+
+        /* Counted from the connection on. */
+        uint32_t commands = simControllerStats.commands;
+        uint32_t events = simControllerStats.events;
+        VClock_Schedule (0, connect, NULL);
+        run (duration);
+        reading = 0;
+        run (DRAIN);
+
+        const Sim_Controller_Stats_t *s = &simControllerStats;
+        const Sensor_Read_Stats_t *r = &sensorService->readStats;
+        double seconds = (duration + DRAIN) / 1000.0;
+        uint32_t cyclesPerUs = Cycle_Counter_Per_Us ();
+
+        printf ("\nLOCAL_READS %d, a read every %d ms for %u min\n", LOCAL_READS, READ_PERIOD, minutes);
+        printf ("reads %u, %u skipped (the previous one still waiting)\n", s->reads, busy);
+        printf ("wait for the application : mean %.2f ms, max %u ms\n", (s->reads) ? ((double)s->readWaitSum / s->reads) : (0.0), s->readWaitMax);
+        printf ("Read_Request_CB : %lu reads, mean %.2f us, max %.2f us (host)\n", (unsigned long)r->requests,
+                (r->requests) ? ((double)r->cycles / r->requests / cyclesPerUs) : (0.0), (double)r->cyclesMax / cyclesPerUs);
+        printf ("refresh rounds %lu, values skipped %lu\n", (unsigned long)r->refreshes, (unsigned long)r->refreshSkipped);
+        printf ("commands %.1f/s, events %.1f/s, notifications %.1f/s\n", (s->commands - commands) / seconds, (s->events - events) / seconds,
+                s->notifications / seconds);
+
+        if (s->reads != issued || !issued) {
+                printf ("FAIL %u reads made, the controller saw %u\n", issued, s->reads);
+                ++failures;
+        }
+
+#if LOCAL_READS
+        /* The controller answers alone, from values refreshed every SENSOR_REFRESH_PERIOD ms. */
+        if (r->requests || s->readWaitSum || r->refreshes < duration / SENSOR_REFRESH_PERIOD - 1) {
+                printf ("FAIL the application took part in the reads, or did not refresh the values\n");
+                ++failures;
+        }
+#else
+        if (r->requests != s->reads || r->refreshes) {
+                printf ("FAIL %lu reads through Read_Request_CB\n", (unsigned long)r->requests);
+                ++failures;
+        }
+#endif
+
+        printf ("read_latency_bench : %s\n", (failures) ? ("FAILED") : ("OK"));
+        return failures != 0;
+}
@@ -0,0 +1,217 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+/*
+ * Host benchmark of the sample stream encoding (src/sample_codec.h). Packs
+ * synthetic accelerometer traces the way Sample_Stream does, raw and delta
+ * encoded, checks every packet of both formats through the reference decoder
+ * (which tells them apart by the header alone), and prints the samples per
+ * packet, the compression ratio and the encoding time per sample.
+ *
+ * cc -O2 -Isrc tools/sample_codec_bench.c src/sample_codec.c -lm -o sample_codec_bench
+ * ./sample_codec_bench [PAYLOAD]   (ATT_MTU - 3, default 20)
+ */
+
+#include "sample_codec.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CYCLES() __rdtsc ()
+#else
+#define CYCLES() 0
+#endif
+
+#define SAMPLES 100000
+#define KEYFRAME_INTERVAL 16
+#define MAX_PAYLOAD 251 /* ATT_MTU 254 */
+
+static int16_t trace[SAMPLES][3];
+static uint32_t seed = 1;
+
+/*****************************************************************************/
+
+static int noise (int amplitude)
+{
+        seed = seed * 1103515245 + 12345;
+        return (int)((seed >> 16) % (2 * amplitude + 1)) - amplitude;
+}
+
+/*****************************************************************************/
+
+/// Board lying still : gravity on z, sensor noise.
+static void still (void)
+{
+        for (int i = 0; i < SAMPLES; ++i) {
+                trace[i][0] = noise (4);
+                trace[i][1] = noise (4);
+                trace[i][2] = 1000 + noise (4);
+        }
+}
+
+/*****************************************************************************/
+
+/// Hand held, slow swinging.
+static void motion (void)
+{
+        for (int i = 0; i < SAMPLES; ++i) {
+                trace[i][0] = 400 * sin (i / 40.0) + noise (12);
+                trace[i][1] = 250 * cos (i / 55.0) + noise (12);
+                trace[i][2] = 1000 - 150 * sin (i / 70.0) + noise (12);
+        }
+}
+
+/*****************************************************************************/
+
+/// What the accelerometer emulation (sensor_app.c) does : +100 mg per sample on every axis.
+static void ramp (void)
+{
+        for (int i = 0; i < SAMPLES; ++i) {
+                trace[i][0] = trace[i][1] = trace[i][2] = (int16_t)(i * 100);
+        }
+}
+
+/*****************************************************************************/
+
+static double seconds (const struct timespec *a, const struct timespec *b) { return (b->tv_sec - a->tv_sec) + (b->tv_nsec - a->tv_nsec) / 1e9; }
+
+/*****************************************************************************/
+
+static int run (const char *name, void (*generate) (void), unsigned int payload)
+{
+        static uint8_t stream[SAMPLES * (SAMPLE_CODEC_HEADER_SIZE + SAMPLE_CODEC_MAX_SAMPLE_SIZE)];
+        static uint16_t lengths[SAMPLES];
+        static int16_t decoded[MAX_PAYLOAD][3];
+        Sample_Codec_t codec;
+        Sample_Decoder_t decoder;
+        uint8_t sample[SAMPLE_CODEC_MAX_SAMPLE_SIZE];
+        uint32_t packets = 0;
+        uint8_t *p = stream;
+        struct timespec t0, t1;
+        int i = 0;
+
+        generate ();
+        Sample_Codec_Reset (&codec);
+
+        clock_gettime (CLOCK_MONOTONIC, &t0);
+        uint64_t c0 = CYCLES ();
+
+        while (i < SAMPLES) {
+                uint8_t key = (packets % KEYFRAME_INTERVAL) == 0;
+
+                if (key) {
+                        Sample_Codec_Reset (&codec);
+                }
+
+                unsigned int len = Sample_Codec_Header (p, packets, i, SAMPLE_CODEC_FORMAT_DELTA | ((key) ? (SAMPLE_CODEC_KEYFRAME) : (0)));
+
+                while (i < SAMPLES) {
+                        Sample_Codec_t next = codec;
+                        uint8_t size = Sample_Codec_Encode (&next, trace[i], sample);
+
+                        if (len + size > payload) {
+                                break;
+                        }
+
+                        memcpy (p + len, sample, size);
+                        len += size;
+                        codec = next;
+                        ++i;
+                }
+
+                lengths[packets++] = len;
+                p += len;
+        }
+
+        uint64_t cycles = CYCLES () - c0;
+        clock_gettime (CLOCK_MONOTONIC, &t1);
+        uint64_t bytes = p - stream;
+
+        /* Everything must come back out of the reference decoder. */
+        Sample_Decoder_Init (&decoder);
+        p = stream;
+        i = 0;
+
+        for (uint32_t k = 0; k < packets; ++k) {
+                uint16_t timestamp;
+                int n = Sample_Decoder_Packet (&decoder, p, lengths[k], decoded, MAX_PAYLOAD, &timestamp);
+
+                if (n < 0 || timestamp != (uint16_t)i || memcmp (decoded, trace[i], n * sizeof (trace[0]))) {
+                        printf ("%s : packet %lu does not decode\n", name, (unsigned long)k);
+                        return 1;
+                }
+
+                i += n;
+                p += lengths[k];
+        }
+
+        if (i != SAMPLES) {
+                printf ("%s : %d samples decoded out of %d\n", name, i, SAMPLES);
+                return 1;
+        }
+
+        /* The same trace raw, through the same decoder : the header tells the format. */
+        unsigned int rawPerPacket = (payload - SAMPLE_CODEC_HEADER_SIZE) / SAMPLE_CODEC_RAW_SAMPLE_SIZE;
+        uint32_t rawPackets = 0;
+        uint64_t rawBytes = 0;
+
+        for (i = 0; i < SAMPLES; ++rawPackets) {
+                uint8_t raw[MAX_PAYLOAD];
+                uint16_t timestamp;
+                unsigned int len = Sample_Codec_Header (raw, packets + rawPackets, i, SAMPLE_CODEC_FORMAT_RAW | SAMPLE_CODEC_KEYFRAME);
+                int first = i;
+
+                for (; i < SAMPLES && i - first < (int)rawPerPacket; ++i) {
+                        len += Sample_Codec_Encode_Raw (trace[i], raw + len);
+                }
+
+                int n = Sample_Decoder_Packet (&decoder, raw, len, decoded, MAX_PAYLOAD, &timestamp);
+
+                if (n != i - first || timestamp != (uint16_t)first || memcmp (decoded, trace[first], n * sizeof (trace[0]))) {
+                        printf ("%s : raw packet %lu does not decode\n", name, (unsigned long)rawPackets);
+                        return 1;
+                }
+
+                rawBytes += len;
+        }
+
+        /* A format this decoder does not know is refused, not taken for another. */
+        uint8_t unknown[SAMPLE_CODEC_HEADER_SIZE + SAMPLE_CODEC_RAW_SAMPLE_SIZE];
+        uint16_t timestamp;
+        Sample_Codec_Header (unknown, 0, 0, SAMPLE_CODEC_FORMAT_MASK | SAMPLE_CODEC_KEYFRAME);
+        Sample_Codec_Encode_Raw (trace[0], unknown + SAMPLE_CODEC_HEADER_SIZE);
+
+        if (Sample_Decoder_Packet (&decoder, unknown, sizeof (unknown), decoded, MAX_PAYLOAD, &timestamp) >= 0) {
+                printf ("%s : a packet of unknown format decodes\n", name);
+                return 1;
+        }
+
+        printf ("%-8s %9u %9.1f %9.2f %8.2f %8.1f %9.1f\n", name, rawPerPacket, (double)SAMPLES / packets, (double)rawBytes / bytes,
+                (double)rawPackets / packets, seconds (&t0, &t1) * 1e9 / SAMPLES, (double)cycles / SAMPLES);
+        return 0;
+}
+
+/*****************************************************************************/
+
+int main (int argc, char **argv)
+{
+        unsigned int payload = (argc > 1) ? (atoi (argv[1])) : (20);
+
+        if (payload < SAMPLE_CODEC_HEADER_SIZE + SAMPLE_CODEC_MAX_SAMPLE_SIZE || payload > MAX_PAYLOAD) {
+                fprintf (stderr, "payload must be %d..%d\n", SAMPLE_CODEC_HEADER_SIZE + SAMPLE_CODEC_MAX_SAMPLE_SIZE, MAX_PAYLOAD);
+                return 2;
+        }
+
+        printf ("payload %u bytes, %d samples, keyframe every %d packets\n", payload, SAMPLES, KEYFRAME_INTERVAL);
+        printf ("%-8s %9s %9s %9s %8s %8s %9s\n", "trace", "raw/pkt", "delta/pkt", "ratio", "pkts", "ns/smp", "cyc/smp");
+
+        return run ("still", still, payload) | run ("motion", motion, payload) | run ("ramp", ramp, payload);
+}
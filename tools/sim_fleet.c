@@ -0,0 +1,194 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+/*
+ * Fleet of virtual boards for load testing the central side : BOARDS copies
+ * of the firmware (src/sensor_app.h) over the simulated controller
+ * (src/sim_controller.h), run in parallel for MINUTES of simulated time. A
+ * central connects to each board and subscribes to its accelerometer
+ * stream. Prints the event rates of each board and of the fleet, in
+ * simulated and in wall clock time.
+ *
+ * Every board is a process of its own : the HCI library keeps its state
+ * (packet pool, queues, the command being waited for) in globals, so two
+ * boards cannot share an address space. The boards are started together
+ * with fork and send their counters back through a pipe.
+ *
+ * sim_fleet [BOARDS [MINUTES]]   (default 16 boards, 10 minutes)
+ */
+
+#include "sensor_app.h"
+#include "sim_controller.h"
+#include "virtual_clock.h"
+#include "hci_transport.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define MAX_BOARDS 256
+#define SUBSCRIBE 200 /* ms from the connection to the CCCD write */
+
+typedef struct {
+        int ok;
+        uint32_t events;
+        uint32_t commands;
+        uint32_t notifications;
+        uint32_t notificationBytes;
+        uint32_t dropped;
+        double wall; /* s */
+} Board_Result_t;
+
+static uint16_t handle;
+
+/*****************************************************************************/
+
+static double wall_time (void)
+{
+        struct timespec t;
+        clock_gettime (CLOCK_MONOTONIC, &t);
+        return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/*****************************************************************************/
+
+static void subscribe (void *arg)
+{
+        (void)arg;
+        const uint8_t notify[] = { 0x01, 0x00 };
+        Sim_Controller_Write (handle, sensorService->accStreamCharHandle + 2, notify, sizeof (notify));
+}
+
+/*****************************************************************************/
+
+/// The central, retrying every 10 ms until the board advertises.
+static void connect (void *arg)
+{
+        (void)arg;
+
+        if (Sim_Controller_Connect (handle) < 0) {
+                VClock_Schedule (10, connect, NULL);
+                return;
+        }
+
+        VClock_Schedule (SUBSCRIBE, subscribe, NULL);
+}
+
+/*****************************************************************************/
+
+/// One board, in the child process.
+static Board_Result_t run_board (int index, tClockTime duration)
+{
+        Board_Result_t result = { 0 };
+        uint8_t hwVersion;
+        uint16_t fwVersion;
+        double start = wall_time ();
+
+        Clock_Init ();
+        HCI_Transport_Set (&hciTransportSim);
+        Sensor_App_Init (&hwVersion, &fwVersion);
+
+        /* The centrals do not all come at once. */
+        handle = 0x0801 + index;
+        VClock_Schedule (index * 7, connect, NULL);
+        tClockTime begin = VClock_Now ();
+
+        while (VClock_Now () - begin < duration) {
+                Sensor_App_Process ();
+        }
+
+        result.ok = (bnrg_expansion_board == IDB05A1 && simControllerStats.notifications > 0);
+        result.events = simControllerStats.events;
+        result.commands = simControllerStats.commands;
+        result.notifications = simControllerStats.notifications;
+        result.notificationBytes = simControllerStats.notificationBytes;
+        result.dropped = simControllerStats.dropped;
+        result.wall = wall_time () - start;
+        return result;
+}
+
+/*****************************************************************************/
+
+int main (int argc, char **argv)
+{
+        int boards = (argc > 1) ? (atoi (argv[1])) : (16);
+        uint32_t minutes = (argc > 2) ? (atoi (argv[2])) : (10);
+        tClockTime duration = minutes * 60 * 1000;
+        double seconds = duration / 1000.0;
+        static pid_t pids[MAX_BOARDS];
+        static int pipes[MAX_BOARDS];
+        int failures = 0;
+
+        if (boards < 1 || boards > MAX_BOARDS || minutes < 1) {
+                fprintf (stderr, "Usage : sim_fleet [BOARDS (1..%d) [MINUTES]]\n", MAX_BOARDS);
+                return 2;
+        }
+
+        fflush (stdout);
+        double start = wall_time ();
+
+        for (int i = 0; i < boards; ++i) {
+                int fd[2];
+
+                if (pipe (fd) < 0 || (pids[i] = fork ()) < 0) {
+                        perror ("sim_fleet");
+                        return 2;
+                }
+
+                if (pids[i] == 0) {
+                        close (fd[0]);
+                        /* The firmware's own log, board after board, would be of no use. */
+                        freopen ("/dev/null", "w", stdout);
+                        Board_Result_t result = run_board (i, duration);
+                        _exit (write (fd[1], &result, sizeof (result)) != sizeof (result));
+                }
+
+                close (fd[1]);
+                pipes[i] = fd[0];
+        }
+
+        Board_Result_t total = { 0 };
+        printf ("board     events   events/s  wall events/s  notifications  dropped\n");
+
+        for (int i = 0; i < boards; ++i) {
+                Board_Result_t r;
+                int status;
+
+                if (read (pipes[i], &r, sizeof (r)) != sizeof (r)) {
+                        memset (&r, 0, sizeof (r));
+                }
+
+                close (pipes[i]);
+                waitpid (pids[i], &status, 0);
+
+                if (!r.ok || r.dropped || !WIFEXITED (status) || WEXITSTATUS (status)) {
+                        printf ("FAIL board %d\n", i);
+                        ++failures;
+                }
+
+                printf ("%5d %10u %10.1f %14.0f %14u %8u\n", i, r.events, r.events / seconds, (r.wall > 0) ? (r.events / r.wall) : (0),
+                        r.notifications, r.dropped);
+
+                total.events += r.events;
+                total.commands += r.commands;
+                total.notifications += r.notifications;
+                total.notificationBytes += r.notificationBytes;
+                total.dropped += r.dropped;
+        }
+
+        double wall = wall_time () - start;
+        printf ("fleet : %d boards, %.0f s simulated in %.2f s wall, %u events (%.1f/s simulated, %.0f/s wall), %u commands, %u notifications "
+                "(%.1f B/s simulated), %u dropped\n",
+                boards, seconds, wall, total.events, total.events / seconds, total.events / wall, total.commands, total.notifications,
+                total.notificationBytes / seconds, total.dropped);
+
+        printf ("sim_fleet : %s\n", (failures) ? ("FAILED") : ("OK"));
+        return failures != 0;
+}
@@ -0,0 +1,127 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+/*
+ * Host soak test of the firmware over the simulated controller
+ * (src/sim_controller.h) on the virtual clock. Runs the board's init and main
+ * loop (src/sensor_app.h) for an hour of simulated time while a central
+ * connects, subscribes to the accelerometer stream, and disconnects again
+ * every SESSION ms. Every session must be served and streamed, nothing may
+ * be lost on the way, and it must all take seconds. Prints the simulated
+ * notification throughput and the event latency.
+ *
+ * Built and run by host/CMakeLists.txt (ctest).
+ * sim_soak_test [MINUTES]   (simulated, default 60)
+ */
+
+#include "sensor_app.h"
+#include "sim_controller.h"
+#include "virtual_clock.h"
+#include "hci_transport.h"
+#include "aci_async.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define SESSION 60000  /* ms connected */
+#define SUBSCRIBE 200  /* ms from the connection to the CCCD write */
+#define RECONNECT 500  /* ms from the disconnection to the next attempt */
+#define REMOTE_USER_TERMINATED 0x13
+
+static uint32_t sessions;
+static uint32_t streamed; /* sessions which got notifications */
+static uint32_t notificationsBefore;
+static uint16_t handle = 0x0801;
+
+static void connect (void *arg);
+
+/*****************************************************************************/
+
+static void disconnect (void *arg)
+{
+        (void)arg;
+
+        if (simControllerStats.notifications > notificationsBefore) {
+                ++streamed;
+        }
+
+        Sim_Controller_Disconnect (handle, REMOTE_USER_TERMINATED);
+        ++handle;
+        VClock_Schedule (RECONNECT, connect, NULL);
+}
+
+/*****************************************************************************/
+
+static void subscribe (void *arg)
+{
+        (void)arg;
+        const uint8_t notify[] = { 0x01, 0x00 };
+        Sim_Controller_Write (handle, sensorService->accStreamCharHandle + 2, notify, sizeof (notify));
+}
+
+/*****************************************************************************/
+
+/// The central, retrying every 10 ms until the device advertises.
+static void connect (void *arg)
+{
+        (void)arg;
+
+        if (Sim_Controller_Connect (handle) < 0) {
+                VClock_Schedule (10, connect, NULL);
+                return;
+        }
+
+        ++sessions;
+        notificationsBefore = simControllerStats.notifications;
+        VClock_Schedule (SUBSCRIBE, subscribe, NULL);
+        VClock_Schedule (SESSION, disconnect, NULL);
+}
+
+/*****************************************************************************/
+
+int main (int argc, char **argv)
+{
+        uint32_t minutes = (argc > 1) ? (atoi (argv[1])) : (60);
+        tClockTime duration = minutes * 60 * 1000;
+        uint8_t hwVersion;
+        uint16_t fwVersion;
+        int failures = 0;
+
+        Clock_Init ();
+        HCI_Transport_Set (&hciTransportSim);
+        Sensor_App_Init (&hwVersion, &fwVersion);
+
+        if (bnrg_expansion_board != IDB05A1 || !sensorService->accStreamCharHandle) {
+                printf ("FAIL init : board %d, stream handle 0x%04x\n", bnrg_expansion_board, sensorService->accStreamCharHandle);
+                ++failures;
+        }
+
+        tClockTime start = VClock_Now ();
+        VClock_Schedule (0, connect, NULL);
+
+        while (VClock_Now () - start < duration) {
+                Sensor_App_Process ();
+        }
+
+        uint32_t expected = duration / (SESSION + RECONNECT);
+
+        if (sessions < expected || streamed + 1 < sessions) {
+                printf ("FAIL sessions : %u connected, %u streamed (expected %u)\n", sessions, streamed, expected);
+                ++failures;
+        }
+
+        if (simControllerStats.dropped || aciAsyncStats.rejected || vclockStats.overflows) {
+                printf ("FAIL lost : %u events, %u async commands, %u clock events\n", simControllerStats.dropped, aciAsyncStats.rejected,
+                        vclockStats.overflows);
+                ++failures;
+        }
+
+        VClock_Report ("sim_soak_test", simControllerStats.notifications, simControllerStats.notificationBytes);
+        Sim_Controller_Report ();
+        printf ("sim_soak_test : %s\n", (failures) ? ("FAILED") : ("OK"));
+        return failures != 0;
+}
@@ -0,0 +1,193 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+/*
+ * Host benchmark of the timer wheel (src/timer_wheel.h) against polling a
+ * deadline per timer on every main loop pass, the way gp_timer users do
+ * (Timer_Expired). For 16 to 4096 periodic timers (periods of 10 ms to 1 s,
+ * restarted now and then as timeouts are), runs TICKS ms of main loop, one
+ * pass per tick, and prints the time per pass of both. Both must make the
+ * same number of callbacks.
+ *
+ * The clock is this program's own, the wheel is linked alone :
+ * cc -O2 -Isrc -I$BLUE_NRG_ROOT/STM32_BlueNRG/SimpleBlueNRG_HCI/includes tools/timer_wheel_bench.c src/timer_wheel.c src/gp_timer.c -o timer_wheel_bench
+ * ./timer_wheel_bench [TICKS]   (default 1000000 ms)
+ */
+
+#include "timer_wheel.h"
+#include "gp_timer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CYCLES() __rdtsc ()
+#else
+#define CYCLES() 0
+#endif
+
+#define MAX_TIMERS 4096
+#define RESTART_EVERY 64 /* ticks between two restarts of a random timer */
+
+const uint32_t CLOCK_SECOND = 1000;
+static tClockTime now;
+static Timer_Wheel_Timer_t wheelTimers[MAX_TIMERS];
+static struct timer polledTimers[MAX_TIMERS];
+static uint32_t periods[MAX_TIMERS];
+static uint32_t seed;
+static volatile uint32_t calls;
+
+tClockTime Clock_Time (void) { return now; }
+
+/*****************************************************************************/
+
+static uint32_t random32 (void)
+{
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        return seed;
+}
+
+/*****************************************************************************/
+
+static void on_timer (void *arg)
+{
+        (void)arg;
+        ++calls;
+}
+
+/*****************************************************************************/
+
+static double elapsed_ns (const struct timespec *t0)
+{
+        struct timespec t1;
+        clock_gettime (CLOCK_MONOTONIC, &t1);
+        return (t1.tv_sec - t0->tv_sec) * 1e9 + (t1.tv_nsec - t0->tv_nsec);
+}
+
+/*****************************************************************************/
+
+/// Main loop passes with the wheel. Returns ns per pass.
+static double run_wheel (int timers, uint32_t ticks, uint32_t *callbacks, uint64_t *cycles)
+{
+        struct timespec t0;
+
+        seed = 1;
+        now = 0;
+        calls = 0;
+
+        for (int i = 0; i < timers; ++i) {
+                Timer_Wheel_Init_Timer (&wheelTimers[i], on_timer, NULL);
+                Timer_Wheel_Start (&wheelTimers[i], periods[i], periods[i]);
+        }
+
+        clock_gettime (CLOCK_MONOTONIC, &t0);
+        uint64_t c0 = CYCLES ();
+
+        for (uint32_t t = 0; t < ticks; ++t) {
+                ++now;
+
+                if (now % RESTART_EVERY == 0) {
+                        int i = random32 () % timers;
+                        Timer_Wheel_Start (&wheelTimers[i], periods[i], periods[i]);
+                }
+
+                Timer_Wheel_Process ();
+        }
+
+        *cycles = CYCLES () - c0;
+        double ns = elapsed_ns (&t0);
+
+        for (int i = 0; i < timers; ++i) {
+                Timer_Wheel_Stop (&wheelTimers[i]);
+        }
+
+        *callbacks = calls;
+        return ns / ticks;
+}
+
+/*****************************************************************************/
+
+/// Main loop passes polling every timer. Returns ns per pass.
+static double run_polled (int timers, uint32_t ticks, uint32_t *callbacks, uint64_t *cycles)
+{
+        struct timespec t0;
+
+        seed = 1;
+        now = 0;
+        calls = 0;
+
+        for (int i = 0; i < timers; ++i) {
+                Timer_Set (&polledTimers[i], periods[i]);
+        }
+
+        clock_gettime (CLOCK_MONOTONIC, &t0);
+        uint64_t c0 = CYCLES ();
+
+        for (uint32_t t = 0; t < ticks; ++t) {
+                ++now;
+
+                if (now % RESTART_EVERY == 0) {
+                        Timer_Restart (&polledTimers[random32 () % timers]);
+                }
+
+                for (int i = 0; i < timers; ++i) {
+                        if (Timer_Expired (&polledTimers[i])) {
+                                Timer_Reset (&polledTimers[i]);
+                                on_timer (NULL);
+                        }
+                }
+        }
+
+        *cycles = CYCLES () - c0;
+        double ns = elapsed_ns (&t0);
+        *callbacks = calls;
+        return ns / ticks;
+}
+
+/*****************************************************************************/
+
+int main (int argc, char **argv)
+{
+        uint32_t ticks = (argc > 1) ? (strtoul (argv[1], NULL, 0)) : (1000000);
+        int failures = 0;
+
+        if (ticks == 0) {
+                fprintf (stderr, "Usage : timer_wheel_bench [TICKS]\n");
+                return 2;
+        }
+
+        seed = 7;
+
+        for (int i = 0; i < MAX_TIMERS; ++i) {
+                periods[i] = 10 + random32 () % 991;
+        }
+
+        printf ("%6s %12s %12s %12s %12s %12s\n", "timers", "callbacks", "wheel ns", "cycles", "polled ns", "cycles");
+
+        for (int timers = 16; timers <= MAX_TIMERS; timers *= 4) {
+                uint32_t callbacks[2];
+                uint64_t cycles[2];
+                double ns[2];
+
+                ns[0] = run_wheel (timers, ticks, &callbacks[0], &cycles[0]);
+                ns[1] = run_polled (timers, ticks, &callbacks[1], &cycles[1]);
+                printf ("%6d %12u %12.1f %12.1f %12.1f %12.1f\n", timers, callbacks[0], ns[0], (double)cycles[0] / ticks, ns[1],
+                        (double)cycles[1] / ticks);
+
+                if (callbacks[0] != callbacks[1]) {
+                        printf ("FAIL %d timers : %u callbacks from the wheel, %u polled\n", timers, callbacks[0], callbacks[1]);
+                        ++failures;
+                }
+        }
+
+        printf ("%u cascaded, %u running at most\n", timerWheelStats.cascaded, timerWheelStats.activeMax);
+        printf ("timer_wheel_bench : %s\n", (failures) ? ("FAILED") : ("OK"));
+        return failures != 0;
+}
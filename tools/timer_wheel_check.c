@@ -0,0 +1,314 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+/*
+ * Randomized check of the timer wheel (src/timer_wheel.h) against exact
+ * expiry times, while the clock ticks through TICKS ms. Most of the TIMERS
+ * timers are started, restarted and stopped at random (from the callbacks
+ * too), one shot and periodic, mostly with short delays. The LONG_TIMERS
+ * others are left alone to expire, with delays up to twice what the wheel
+ * spans, and restart themselves when they do. The clock starts TICKS / 2 ms
+ * before it wraps round. Every callback must come on the very tick its timer
+ * expires (the next one for a timer started from a callback with no delay),
+ * no running timer may be missed, and some timers started beyond the wheel's
+ * span must have expired. Then a timer restarting itself with no delay must
+ * fire once per tick, not hang the wheel.
+ *
+ * Along the way : a gp_timer (src/gp_timer.c) set with every one shot timer
+ * must expire on the same tick, and the TIMER_* shim (src/timer_server.h)
+ * must call back at its rounded up periods.
+ *
+ * The clock is this program's own, the wheel is linked alone :
+ * cc -O2 -Isrc -I$BLUE_NRG_ROOT/STM32_BlueNRG/SimpleBlueNRG_HCI/includes tools/timer_wheel_check.c src/timer_wheel.c src/gp_timer.c src/timer_server.c -o timer_wheel_check
+ * ./timer_wheel_check [TICKS [SEED]]   (default 20000000 ms, seed 1)
+ */
+
+#include "timer_wheel.h"
+#include "timer_server.h"
+#include "gp_timer.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define TIMERS 500
+#define LONG_TIMERS 50 /* timers[0 .. LONG_TIMERS - 1] */
+#define SPAN (1UL << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS))
+#define SERVER_PERIOD_TICKS 93 /* 5022 us, 6 ms on the wheel */
+#define SERVER_PERIOD_MS 6
+
+typedef struct {
+        Timer_Wheel_Timer_t timer;
+        struct timer gp;
+        uint32_t due;
+        uint32_t period;
+        uint8_t running;
+        uint8_t far; /// Started beyond the wheel's span.
+} Check_Timer_t;
+
+const uint32_t CLOCK_SECOND = 1000;
+static tClockTime now;
+static Check_Timer_t timers[TIMERS];
+static uint32_t seed = 1;
+static uint32_t fired, farFired, failures, serverFired, rearmed;
+static uint8_t inCallback;
+
+tClockTime Clock_Time (void) { return now; }
+
+/*****************************************************************************/
+
+static uint32_t random32 (void)
+{
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        return seed;
+}
+
+/*****************************************************************************/
+
+static void fail (const char *what, const Check_Timer_t *t)
+{
+        if (++failures <= 10) {
+                printf ("FAIL at %u : %s, timer %d due %u period %u\n", now, what, (int)(t - timers), t->due, t->period);
+        }
+}
+
+/*****************************************************************************/
+
+/// Mostly short delays, as timeouts and retries are, some far beyond the wheel's span.
+static uint32_t random_delay (void)
+{
+        uint32_t r = random32 () % 100;
+
+        if (r < 70) {
+                return random32 () % TIMER_WHEEL_SLOTS;
+        }
+
+        if (r < 90) {
+                return random32 () % (TIMER_WHEEL_SLOTS * TIMER_WHEEL_SLOTS);
+        }
+
+        if (r < 99) {
+                return random32 () % 300000;
+        }
+
+        return random32 () % (2 * SPAN);
+}
+
+/*****************************************************************************/
+
+/// One of the timers changed at random.
+static Check_Timer_t *random_timer (void) { return &timers[LONG_TIMERS + random32 () % (TIMERS - LONG_TIMERS)]; }
+
+/*****************************************************************************/
+
+static void start (Check_Timer_t *t)
+{
+        uint8_t isLong = (t < timers + LONG_TIMERS);
+        uint32_t delay = (isLong) ? (random32 () % (2 * SPAN)) : (random_delay ());
+        uint32_t period = (isLong || random32 () % 4) ? (0) : (1 + random32 () % 500);
+
+        Timer_Wheel_Start (&t->timer, delay, period);
+
+        /* The wheel is on this tick's slot. */
+        if (inCallback && delay == 0) {
+                delay = 1;
+        }
+
+        t->due = now + delay;
+        t->period = period;
+        t->running = 1;
+        t->far = (delay >= SPAN);
+
+        if (!period) {
+                Timer_Set (&t->gp, delay);
+
+                if ((delay > 0 && Timer_Expired (&t->gp)) || Timer_Remaining (&t->gp) != delay) {
+                        fail ("gp_timer expired when set", t);
+                }
+        }
+}
+
+/*****************************************************************************/
+
+static void stop (Check_Timer_t *t)
+{
+        Timer_Wheel_Stop (&t->timer);
+        t->running = 0;
+}
+
+/*****************************************************************************/
+
+static void on_timer (void *arg)
+{
+        Check_Timer_t *t = arg;
+
+        inCallback = 1;
+        ++fired;
+        farFired += t->far;
+
+        if (!t->running || t->due != now) {
+                fail ((t->running) ? ("fired on the wrong tick") : ("fired while stopped"), t);
+        }
+
+        if (t->period) {
+                t->due += t->period;
+        }
+        else {
+                t->running = 0;
+
+                /* The gp_timer set with it expires on this tick, not before. */
+                --now;
+                int early = Timer_Expired (&t->gp);
+                ++now;
+
+                if (early || !Timer_Expired (&t->gp) || Timer_Remaining (&t->gp) != 0) {
+                        fail ("gp_timer and wheel disagree", t);
+                }
+        }
+
+        /* Callbacks change the wheel too, this timer's own slot included. */
+        uint32_t r = random32 () % 16;
+        Check_Timer_t *other = random_timer ();
+
+        if (t < timers + LONG_TIMERS) {
+                start (t);
+        }
+
+        if (r == 0) {
+                stop (other);
+        }
+        else if (r == 1) {
+                start (other);
+        }
+
+        inCallback = 0;
+}
+
+/*****************************************************************************/
+
+static void on_server_timer (void) { ++serverFired; }
+static void on_server_unused (void) {}
+
+/*****************************************************************************/
+
+static void on_rearm (void *arg)
+{
+        ++rearmed;
+        Timer_Wheel_Start (arg, 0, 0);
+}
+
+/*****************************************************************************/
+
+int main (int argc, char **argv)
+{
+        uint32_t ticks = (argc > 1) ? (strtoul (argv[1], NULL, 0)) : (20000000);
+        seed = (argc > 2) ? (strtoul (argv[2], NULL, 0)) : (1);
+
+        if (ticks == 0 || seed == 0) {
+                fprintf (stderr, "Usage : timer_wheel_check [TICKS [SEED]]\n");
+                return 2;
+        }
+
+        now = 0xFFFFFFFF - ticks / 2;
+        tClockTime begin = now;
+
+        for (int i = 0; i < TIMERS; ++i) {
+                Timer_Wheel_Init_Timer (&timers[i].timer, on_timer, &timers[i]);
+        }
+
+        for (int i = 0; i < LONG_TIMERS; ++i) {
+                start (&timers[i]);
+        }
+
+        /* The shim : one repeated timer, the rest of the pool taken, the next create refused. */
+        uint8_t serverId, unused;
+        TIMER_Init ();
+        TIMER_Create (eTimerModuleID_Interrupt, &serverId, eTimerMode_Repeated, on_server_timer);
+
+        for (int i = 1; i < TIMER_SERVER_MAX_TIMERS; ++i) {
+                TIMER_Create (eTimerModuleID_Interrupt, &unused, eTimerMode_SingleShot, on_server_unused);
+        }
+
+        TIMER_Create (eTimerModuleID_Interrupt, &unused, eTimerMode_SingleShot, on_server_unused);
+
+        if (unused != TIMER_SERVER_NO_TIMER) {
+                printf ("FAIL TIMER_Create past the pool\n");
+                ++failures;
+        }
+
+        TIMER_Start (serverId, SERVER_PERIOD_TICKS);
+
+        for (uint32_t i = 0; i < ticks; ++i) {
+                ++now;
+
+                for (uint32_t r = random32 () % 8; r < 2; ++r) {
+                        Check_Timer_t *t = random_timer ();
+
+                        if (random32 () % 3) {
+                                start (t);
+                        }
+                        else {
+                                stop (t);
+                        }
+                }
+
+                Timer_Wheel_Process ();
+        }
+
+        /* Nothing due may be left behind. */
+        uint32_t running = 1; /* the shim's */
+
+        for (int i = 0; i < TIMERS; ++i) {
+                Check_Timer_t *t = &timers[i];
+                running += t->running;
+
+                if (t->running != Timer_Wheel_Running (&t->timer) || (t->running && Timer_Wheel_Due (t->due, now))) {
+                        fail ("missed", t);
+                }
+        }
+
+        if (running != timerWheelStats.active) {
+                printf ("FAIL %u timers running, the wheel counts %u\n", running, timerWheelStats.active);
+                ++failures;
+        }
+
+        if (serverFired != (now - begin) / SERVER_PERIOD_MS) {
+                printf ("FAIL TIMER_* : %u callbacks in %u ms\n", serverFired, now - begin);
+                ++failures;
+        }
+
+        /* Long enough a run for timers started beyond the span to come back. */
+        if (ticks > SPAN + SPAN / 8 && !farFired) {
+                printf ("FAIL no timer started beyond the wheel's span has expired\n");
+                ++failures;
+        }
+
+        TIMER_Delete (serverId);
+
+        /* A timer restarting itself with no delay : once per tick. */
+        Timer_Wheel_Timer_t rearm;
+        Timer_Wheel_Init_Timer (&rearm, on_rearm, &rearm);
+        Timer_Wheel_Start (&rearm, 0, 0);
+
+        for (int i = 0; i < 100; ++i) {
+                ++now;
+                Timer_Wheel_Process ();
+        }
+
+        Timer_Wheel_Stop (&rearm);
+
+        if (rearmed != 100) {
+                printf ("FAIL a timer restarted with no delay from its callback fired %u times in 100 ticks\n", rearmed);
+                ++failures;
+        }
+
+        printf ("%u ticks from %u (wrapped at %u), %u callbacks (%u beyond the span), %u cascaded, %u running at most\n", ticks, begin,
+                0xFFFFFFFF - begin + 1, fired, farFired, timerWheelStats.cascaded, timerWheelStats.activeMax);
+        printf ("timer_wheel_check : %s\n", (failures) ? ("FAILED") : ("OK"));
+        return failures != 0;
+}
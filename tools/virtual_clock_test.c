@@ -0,0 +1,172 @@
+/****************************************************************************
+ *                                                                          *
+ *  Author : lukasz.iwaszkiewicz@gmail.com                                  *
+ *  ~~~~~~~~                                                                *
+ *  License : see COPYING file for details.                                 *
+ *  ~~~~~~~~~                                                               *
+ ****************************************************************************/
+
+/*
+ * Host test of the virtual clock (src/virtual_clock.h, src/clock.c) : events
+ * run in time order, waits and busy waits (HAL_Delay, gp_timer, polling
+ * HAL_GetTick) take simulated time only and end exactly when due, and a full
+ * queue is reported.
+ *
+ * Built and run by host/CMakeLists.txt (ctest).
+ */
+
+#include "virtual_clock.h"
+#include "gp_timer.h"
+#include <stm32f7xx_hal.h>
+#include <stdio.h>
+#include <time.h>
+
+#define HOUR (3600 * 1000) /* ms */
+
+static int failures;
+
+#define CHECK(cond)                                                                                                                                  \
+        do {                                                                                                                                         \
+                if (!(cond)) {                                                                                                                       \
+                        printf ("FAIL %s:%d : %s\n", __FILE__, __LINE__, #cond);                                                                     \
+                        ++failures;                                                                                                                  \
+                }                                                                                                                                    \
+        } while (0)
+
+static tClockTime seen[8];
+static int seenCount;
+
+/*****************************************************************************/
+
+static void record (void *arg)
+{
+        (void)arg;
+
+        if (seenCount < 8) {
+                seen[seenCount++] = VClock_Now ();
+        }
+}
+
+/*****************************************************************************/
+
+/// Time order, FIFO between events due at the same time, Advance stops at its target.
+static void testOrder (void)
+{
+        Clock_Init ();
+        seenCount = 0;
+
+        static int a, b;
+        VClock_Schedule (30, record, NULL);
+        VClock_Schedule (10, record, &a);
+        VClock_Schedule (10, record, &b);
+
+        VClock_Advance (20);
+        CHECK (seenCount == 2 && seen[0] == 10 && seen[1] == 10);
+        CHECK (Clock_Time () == 20);
+
+        VClock_Advance (20);
+        CHECK (seenCount == 3 && seen[2] == 30);
+        CHECK (VClock_Now () == 40);
+}
+
+/*****************************************************************************/
+
+/// A callback scheduling another one due before the target of the Advance running it.
+static void chain (void *arg)
+{
+        record (arg);
+        VClock_Schedule (5, record, NULL);
+}
+
+static void testNested (void)
+{
+        Clock_Init ();
+        seenCount = 0;
+
+        VClock_Schedule (10, chain, NULL);
+        VClock_Advance (100);
+        CHECK (seenCount == 2 && seen[0] == 10 && seen[1] == 15);
+        CHECK (VClock_Now () == 100);
+}
+
+/*****************************************************************************/
+
+/// HAL_Delay, a gp_timer and a HAL_GetTick busy wait : simulated time only, events run on the way.
+static void testWaits (void)
+{
+        Clock_Init ();
+        seenCount = 0;
+
+        HAL_Delay (1000);
+        CHECK (HAL_GetTick () == 1000);
+
+        VClock_Schedule (200, record, NULL);
+        struct timer t;
+        Timer_Set (&t, 500);
+
+        while (!Timer_Expired (&t)) {
+        }
+
+        CHECK (seenCount == 1 && seen[0] == 1200);
+        CHECK (Clock_Time () == 1500);
+
+        uint32_t start = HAL_GetTick ();
+
+        while (HAL_GetTick () - start < 100) {
+        }
+
+        CHECK (HAL_GetTick () == start + 100);
+}
+
+/*****************************************************************************/
+
+/// An hour of 1 ms waits takes simulated time, not an hour.
+static void testHour (void)
+{
+        struct timespec start, end;
+
+        Clock_Init ();
+        clock_gettime (CLOCK_MONOTONIC, &start);
+
+        for (int i = 0; i < HOUR; ++i) {
+                HAL_Delay (1);
+        }
+
+        clock_gettime (CLOCK_MONOTONIC, &end);
+        CHECK (Clock_Time () == HOUR);
+        CHECK (end.tv_sec - start.tv_sec < 10);
+}
+
+/*****************************************************************************/
+
+static void testOverflow (void)
+{
+        Clock_Init ();
+        vclockStats.overflows = 0;
+        int i = 0;
+
+        while (VClock_Schedule (1, record, NULL) == 0 && i < 1000) {
+                ++i;
+        }
+
+        CHECK (i < 1000 && vclockStats.overflows == 1);
+
+        /* The queue drains. */
+        seenCount = 0;
+        VClock_Advance (1);
+        CHECK (VClock_Schedule (1, record, NULL) == 0);
+}
+
+/*****************************************************************************/
+
+int main (void)
+{
+        testOrder ();
+        testNested ();
+        testWaits ();
+        testHour ();
+        testOverflow ();
+
+        printf ("virtual_clock_test : %s\n", (failures) ? ("FAILED") : ("OK"));
+        return failures != 0;
+}